@@ -0,0 +1,168 @@
+#include "DnsCache.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "lwip/netdb.h"
+#include <cstring>
+
+static const char* TAG = "DnsCache";
+
+DnsCache& DnsCache::instance()
+{
+    static DnsCache instance;
+    return instance;
+}
+
+DnsCache::DnsCache(uint32_t ttlMs)
+    : m_ttlUs(static_cast<int64_t>(ttlMs) * 1000)
+    , m_stats{}
+    , m_mutex(nullptr)
+{
+    for (Entry& entry : m_entries) {
+        entry.host[0] = '\0';
+        entry.address.s_addr = 0;
+        entry.expiresUs = 0;
+    }
+    m_mutex = xSemaphoreCreateMutex();
+    if (!m_mutex) {
+        ESP_LOGE(TAG, "Failed to create DNS cache mutex");
+    }
+}
+
+DnsCache::~DnsCache()
+{
+    if (m_mutex) {
+        vSemaphoreDelete(m_mutex);
+        m_mutex = nullptr;
+    }
+}
+
+bool DnsCache::lookup(const std::string& host, struct in_addr& outAddress)
+{
+    if (inet_aton(host.c_str(), &outAddress)) {
+        return true;
+    }
+    if (!m_mutex) {
+        return false;
+    }
+
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    int index = findLocked(host, esp_timer_get_time());
+    if (index >= 0) {
+        outAddress = m_entries[index].address;
+        m_stats.hits++;
+    }
+    xSemaphoreGive(m_mutex);
+    return index >= 0;
+}
+
+esp_err_t DnsCache::resolve(const std::string& host, struct in_addr& outAddress)
+{
+    if (lookup(host, outAddress)) {
+        return ESP_OK;
+    }
+
+    // The resolver blocks (lwIP retries on its own schedule); the lock is not held
+    int64_t start = esp_timer_get_time();
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo* result = nullptr;
+    int err = getaddrinfo(host.c_str(), nullptr, &hints, &result);
+    int64_t now = esp_timer_get_time();
+
+    bool found = (err == 0 && result != nullptr && result->ai_addr != nullptr);
+    if (found) {
+        outAddress = reinterpret_cast<struct sockaddr_in*>(result->ai_addr)->sin_addr;
+    }
+    if (result) {
+        freeaddrinfo(result);
+    }
+
+    if (m_mutex) {
+        xSemaphoreTake(m_mutex, portMAX_DELAY);
+        m_stats.misses++;
+        m_stats.lastResolveUs = static_cast<uint32_t>(now - start);
+        if (found) {
+            storeLocked(host, outAddress, now);
+        } else {
+            m_stats.failures++;
+        }
+        xSemaphoreGive(m_mutex);
+    }
+
+    if (!found) {
+        ESP_LOGW(TAG, "Could not resolve %s (%d)", host.c_str(), err);
+        return ESP_ERR_NOT_FOUND;
+    }
+    ESP_LOGI(TAG, "Resolved %s in %lu ms", host.c_str(), (unsigned long)((now - start) / 1000));
+    return ESP_OK;
+}
+
+void DnsCache::store(const std::string& host, const struct in_addr& address)
+{
+    if (m_mutex) {
+        xSemaphoreTake(m_mutex, portMAX_DELAY);
+        storeLocked(host, address, esp_timer_get_time());
+        xSemaphoreGive(m_mutex);
+    }
+}
+
+void DnsCache::invalidate(const std::string& host)
+{
+    if (!m_mutex) {
+        return;
+    }
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    int index = findLocked(host, esp_timer_get_time());
+    if (index >= 0) {
+        m_entries[index].expiresUs = 0;
+    }
+    xSemaphoreGive(m_mutex);
+}
+
+DnsCache::Stats DnsCache::getStats() const
+{
+    Stats stats{};
+    if (m_mutex) {
+        xSemaphoreTake(m_mutex, portMAX_DELAY);
+        stats = m_stats;
+        xSemaphoreGive(m_mutex);
+    }
+    return stats;
+}
+
+int DnsCache::findLocked(const std::string& host, int64_t nowUs) const
+{
+    for (int i = 0; i < MAX_ENTRIES; i++) {
+        const Entry& entry = m_entries[i];
+        if (entry.expiresUs > nowUs && host == entry.host) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void DnsCache::storeLocked(const std::string& host, const struct in_addr& address, int64_t nowUs)
+{
+    if (host.size() > MAX_HOST_LENGTH) {
+        return;  // Still resolved, just not worth caching
+    }
+
+    // Reuse the host's own entry, else the one that expires first
+    int slot = 0;
+    for (int i = 0; i < MAX_ENTRIES; i++) {
+        if (host == m_entries[i].host) {
+            slot = i;
+            break;
+        }
+        if (m_entries[i].expiresUs < m_entries[slot].expiresUs) {
+            slot = i;
+        }
+    }
+
+    Entry& entry = m_entries[slot];
+    memcpy(entry.host, host.c_str(), host.size() + 1);
+    entry.address = address;
+    entry.expiresUs = nowUs + m_ttlUs;
+}
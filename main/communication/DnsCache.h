@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include "esp_err.h"
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "lwip/sockets.h"
+
+/**
+ * @brief Small cache of resolved JMRI server addresses
+ *
+ * Both JMRI clients connect to the same host, and reconnects repeat the
+ * lookup every time. Resolved IPv4 addresses are kept for
+ * CONFIG_JMRI_DNS_CACHE_TTL_S so only the first connection pays for DNS.
+ * Numeric addresses are parsed in place and never cached or looked up.
+ * Names found by mDNS discovery are store()d here too, as lwIP's resolver
+ * does not answer ".local" names.
+ *
+ * lookup() never blocks and may be called from any task; resolve() blocks
+ * in the resolver on a miss and belongs on a connection task. A failed
+ * connection should invalidate() its entry in case the server moved.
+ */
+class DnsCache {
+public:
+    static constexpr int MAX_ENTRIES = 4;
+    static constexpr size_t MAX_HOST_LENGTH = 63;
+
+    struct Stats {
+        uint32_t hits;           // Served from the cache (or numeric)
+        uint32_t misses;         // Went to the resolver
+        uint32_t failures;       // Resolver found nothing
+        uint32_t lastResolveUs;  // Time of the most recent resolver call
+    };
+
+    /**
+     * @brief Application-wide cache shared by both JMRI clients
+     */
+    static DnsCache& instance();
+
+    /**
+     * @param ttlMs How long a resolved address stays valid
+     */
+    explicit DnsCache(uint32_t ttlMs = CONFIG_JMRI_DNS_CACHE_TTL_S * 1000);
+    ~DnsCache();
+
+    DnsCache(const DnsCache&) = delete;
+    DnsCache& operator=(const DnsCache&) = delete;
+
+    /**
+     * @brief Address of @p host if numeric or cached (never blocks)
+     * @return false if the resolver would be needed
+     */
+    bool lookup(const std::string& host, struct in_addr& outAddress);
+
+    /**
+     * @brief Address of @p host, asking the resolver on a miss
+     * @return ESP_OK, or ESP_ERR_NOT_FOUND if the name does not resolve
+     */
+    esp_err_t resolve(const std::string& host, struct in_addr& outAddress);
+
+    /**
+     * @brief Cache an address learned without the resolver (e.g. from mDNS)
+     */
+    void store(const std::string& host, const struct in_addr& address);
+
+    /**
+     * @brief Forget the cached address of @p host
+     */
+    void invalidate(const std::string& host);
+
+    Stats getStats() const;
+
+private:
+    struct Entry {
+        char host[MAX_HOST_LENGTH + 1];
+        struct in_addr address;
+        int64_t expiresUs;  // 0 = free
+    };
+
+    int findLocked(const std::string& host, int64_t nowUs) const;
+    void storeLocked(const std::string& host, const struct in_addr& address, int64_t nowUs);
+
+    Entry m_entries[MAX_ENTRIES];
+    int64_t m_ttlUs;
+    Stats m_stats;
+    mutable SemaphoreHandle_t m_mutex;
+};
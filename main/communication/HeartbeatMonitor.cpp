@@ -0,0 +1,48 @@
+#include "HeartbeatMonitor.h"
+
+HeartbeatMonitor::HeartbeatMonitor()
+    : m_intervalUs(0)
+    , m_lastHeartbeatUs(0)
+{
+}
+
+void HeartbeatMonitor::reset(int64_t nowUs)
+{
+    m_intervalUs = 0;
+    m_lastHeartbeatUs = nowUs;
+}
+
+void HeartbeatMonitor::setIntervalSeconds(int seconds)
+{
+    m_intervalUs = seconds > 0 ? static_cast<int64_t>(seconds) * 1000000 : 0;
+}
+
+HeartbeatMonitor::Action HeartbeatMonitor::poll(int64_t nowUs) const
+{
+    if (m_intervalUs <= 0) {
+        return Action::NONE;
+    }
+    return (nowUs - m_lastHeartbeatUs >= m_intervalUs / 2) ? Action::SEND_HEARTBEAT : Action::NONE;
+}
+
+int64_t HeartbeatMonitor::getNextDeadlineUs() const
+{
+    if (m_intervalUs <= 0) {
+        return -1;
+    }
+    return m_lastHeartbeatUs + m_intervalUs / 2;
+}
+
+HeartbeatMonitor::KeepAlive HeartbeatMonitor::getKeepAlive() const
+{
+    KeepAlive keepAlive{ 0, 0, 0 };
+    int seconds = getIntervalSeconds();
+    if (seconds <= 0) {
+        return keepAlive;
+    }
+    // Quiet for half an interval, then one probe a second for the rest of it
+    keepAlive.idleSeconds = seconds / 2 > 0 ? seconds / 2 : 1;
+    keepAlive.intervalSeconds = 1;
+    keepAlive.count = seconds - keepAlive.idleSeconds > 0 ? seconds - keepAlive.idleSeconds : 1;
+    return keepAlive;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+ * @brief Heartbeat scheduling and link liveness for the WiThrottle connection
+ *
+ * The server announces its heartbeat timeout with `*<seconds>` and E-stops
+ * our locos if it hears nothing from us for that long. This tracks when we
+ * last sent a heartbeat and tells the receive loop when the next `*` is due
+ * (every half interval). JMRI does not answer `*`, so a quiet server is not
+ * a dead one; liveness is left to TCP keepalive, with timings from
+ * getKeepAlive() so that a dead link is reported at most one interval after
+ * the last segment received. Any inbound line, or even an ACK, restarts that
+ * wait, so a server that is talking is never probed.
+ *
+ * Pure logic with caller-supplied timestamps; not thread-safe.
+ */
+class HeartbeatMonitor {
+public:
+    enum class Action {
+        NONE,            // Nothing due yet
+        SEND_HEARTBEAT   // Send `*`
+    };
+
+    // TCP keepalive timings (SO_KEEPALIVE with TCP_KEEPIDLE / TCP_KEEPINTVL / TCP_KEEPCNT)
+    struct KeepAlive {
+        int idleSeconds;      // Silence before the first probe
+        int intervalSeconds;  // Between unanswered probes
+        int count;            // Unanswered probes before the link is dropped
+    };
+
+    HeartbeatMonitor();
+
+    /**
+     * @brief Start monitoring a new connection (heartbeat disabled until negotiated)
+     */
+    void reset(int64_t nowUs);
+
+    /**
+     * @brief Apply the server's `*<seconds>` announcement (0 disables)
+     */
+    void setIntervalSeconds(int seconds);
+
+    /**
+     * @brief Record that a heartbeat was queued
+     */
+    void onHeartbeatSent(int64_t nowUs) { m_lastHeartbeatUs = nowUs; }
+
+    /**
+     * @brief Decide what is due at @p nowUs
+     */
+    Action poll(int64_t nowUs) const;
+
+    /**
+     * @brief Time the next heartbeat is due (-1 if disabled)
+     */
+    int64_t getNextDeadlineUs() const;
+
+    /**
+     * @brief Keepalive that drops a silent link within one interval (all 0 if disabled)
+     */
+    KeepAlive getKeepAlive() const;
+
+    bool isEnabled() const { return m_intervalUs > 0; }
+    int getIntervalSeconds() const { return static_cast<int>(m_intervalUs / 1000000); }
+
+private:
+    int64_t m_intervalUs;
+    int64_t m_lastHeartbeatUs;
+};
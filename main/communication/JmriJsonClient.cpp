@@ -1,5 +1,7 @@
 #include "JmriJsonClient.h"
+#include "DnsCache.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include <cstring>
@@ -15,46 +17,130 @@ namespace {
         return result;
     }
     
-    std::string extractJsonString(const std::string& json, const std::string& key) {
-        std::string searchKey = "\"" + key + "\":\"";
-        size_t pos = json.find(searchKey);
-        if (pos == std::string::npos) return "";
-        
-        pos += searchKey.length();
-        size_t endPos = json.find('"', pos);
-        if (endPos == std::string::npos) return "";
-        
-        return json.substr(pos, endPos - pos);
+    // Copy a token into a fixed field, truncating to fit
+    void copyField(char* field, size_t capacity, size_t& length, std::string_view text)
+    {
+        length = text.size() < capacity ? text.size() : capacity;
+        memcpy(field, text.data(), length);
     }
     
-    int extractJsonInt(const std::string& json, const std::string& key) {
-        std::string searchKey = "\"" + key + "\":";
-        size_t pos = json.find(searchKey);
-        if (pos == std::string::npos) return -1;
-        
-        pos += searchKey.length();
-        return atoi(json.c_str() + pos);
+    // JMRI JSON power states: 0=unknown, 2=ON, 4=OFF
+    JmriJsonClient::PowerState powerStateFromJson(int stateValue)
+    {
+        switch (stateValue) {
+            case 2:
+                return JmriJsonClient::PowerState::ON;
+            case 4:
+                return JmriJsonClient::PowerState::OFF;
+            default:
+                return JmriJsonClient::PowerState::UNKNOWN;
+        }
+    }
+    
+    // Append @p text to @p out with JSON string escaping; false if it does not fit
+    bool appendEscaped(char* out, size_t capacity, size_t& used, std::string_view text)
+    {
+        for (char c : text) {
+            if ((c == '"' || c == '\\') && used < capacity) {
+                out[used++] = '\\';
+            }
+            if (used >= capacity) {
+                return false;
+            }
+            out[used++] = c;
+        }
+        return true;
+    }
+    
+    bool appendText(char* out, size_t capacity, size_t& used, std::string_view text)
+    {
+        if (used + text.size() > capacity) {
+            return false;
+        }
+        memcpy(out + used, text.data(), text.size());
+        used += text.size();
+        return true;
     }
 }
 
 static const char* TAG = "JmriJsonClient";
 
+// WebSocket opcodes (RFC 6455 section 5.2)
+static constexpr uint8_t WS_OPCODE_CONTINUATION = 0x00;
+static constexpr uint8_t WS_OPCODE_TEXT = 0x01;
+
+// Longest the writer task waits for the WebSocket client to take a message
+static constexpr int TX_SEND_TIMEOUT_MS = 1000;
+// Sends slower than this are logged as a sign of a struggling server
+static constexpr uint32_t TX_SLOW_SEND_US = 100000;
+
 JmriJsonClient::JmriJsonClient()
     : m_state(ConnectionState::DISCONNECTED)
     , m_client(nullptr)
     , m_serverHost("")
     , m_serverPort(12080)
-    , m_heartbeatTask(nullptr)
+    , m_heartbeatJob(Scheduler::INVALID_JOB)
+    , m_connectStartUs(0)
+    , m_openedUs(0)
+    , m_connectTimings{}
+    , m_helloTimeoutJob(Scheduler::INVALID_JOB)
+    , m_txQueue(nullptr)
+    , m_transmitTask(nullptr)
+    , m_txExited(nullptr)
+    , m_txRunning(false)
+    , m_txQueued(0)
+    , m_txSent(0)
+    , m_txDropped(0)
+    , m_txFailed(0)
+    , m_txMaxEnqueueUs(0)
     , m_configuredPowerName("DCC++")  // Default to DCC++
+    , m_subscriptions(CONFIG_JMRI_JSON_MAX_SUBSCRIPTIONS, CONFIG_JMRI_JSON_NAME_POOL_SIZE)
+    , m_subscriptionsSent(0)
+    , m_sessionReady(false)
     , m_powerCallback(nullptr)
     , m_connectionCallback(nullptr)
+    , m_itemCallback(nullptr)
+    , m_elementListeners{}
+    , m_elementListenerCount(0)
+    , m_messageListeners(0)
+    , m_messageActive(false)
+    , m_messageSkipped(false)
+    , m_messageBytes(0)
+    , m_messageFragments(0)
+    , m_frameOffset(0)
+    , m_frameStats{}
+    , m_elementDepth(-1)
+    , m_dataDepth(-1)
+    , m_elementTypeLength(0)
+    , m_elementNameLength(0)
+    , m_elementUserNameLength(0)
+    , m_elementMethodLength(0)
+    , m_elementState(-1)
+    , m_elementCode(0)
+    , m_elementListener(nullptr)
 {
+    m_txQueue = xQueueCreate(CONFIG_JMRI_JSON_TX_QUEUE_LENGTH, sizeof(TxMessage));
+    if (!m_txQueue) {
+        ESP_LOGE(TAG, "Failed to create JSON TX queue");
+    }
+    m_txExited = xSemaphoreCreateBinary();
+    if (!m_txExited) {
+        ESP_LOGE(TAG, "Failed to create JSON TX exit semaphore");
+    }
 }
 
 JmriJsonClient::~JmriJsonClient()
 {
     stopHeartbeat();
     disconnect();
+    if (m_txQueue) {
+        vQueueDelete(m_txQueue);
+        m_txQueue = nullptr;
+    }
+    if (m_txExited) {
+        vSemaphoreDelete(m_txExited);
+        m_txExited = nullptr;
+    }
 }
 
 esp_err_t JmriJsonClient::initialize()
@@ -65,36 +151,47 @@ esp_err_t JmriJsonClient::initialize()
 
 esp_err_t JmriJsonClient::connect(const std::string& host, uint16_t port)
 {
-    // Clean up any existing client first
-    if (m_client) {
-        ESP_LOGW(TAG, "Client already exists, cleaning up before reconnecting");
-        disconnect();
-        vTaskDelay(pdMS_TO_TICKS(500)); // Give more time for full cleanup
-    }
-    
+    // Checked before any cleanup, so a second call cannot tear down an attempt in flight
     if (m_state == ConnectionState::CONNECTING) {
         ESP_LOGW(TAG, "Already connecting, please wait");
         return ESP_ERR_INVALID_STATE;
     }
     
+    // Clean up any existing client first; stop() returns once its task has exited
+    if (m_client) {
+        ESP_LOGW(TAG, "Client already exists, cleaning up before reconnecting");
+        disconnect();
+    }
+    
     m_serverHost = host;
     m_serverPort = port;
+    m_connectStartUs = esp_timer_get_time();
+    m_connectTimings = ConnectTimings{};
     
     ESP_LOGI(TAG, "Connecting to JMRI JSON WebSocket ws://%s:%d/json/", host.c_str(), port);
     setState(ConnectionState::CONNECTING);
     
+    // A cached address spares the WebSocket task a DNS lookup
+    std::string uriHost = host;
+    struct in_addr address;
+    char addressText[INET_ADDRSTRLEN];
+    if (DnsCache::instance().lookup(host, address) &&
+        inet_ntop(AF_INET, &address, addressText, sizeof(addressText)) != nullptr) {
+        uriHost = addressText;
+    }
+    
     // Build WebSocket URI - JMRI JSON WebSocket endpoint
-    std::string uri = "ws://" + host + ":" + std::to_string(port) + "/json/";
+    std::string uri = "ws://" + uriHost + ":" + std::to_string(port) + "/json/";
     
     // Configure WebSocket client
     esp_websocket_client_config_t ws_cfg = {};
     ws_cfg.uri = uri.c_str();
     ws_cfg.reconnect_timeout_ms = 10000;
-    ws_cfg.network_timeout_ms = 10000;
+    ws_cfg.network_timeout_ms = CONFIG_JMRI_CONNECT_TIMEOUT_MS;
     ws_cfg.ping_interval_sec = 10;
     ws_cfg.disable_auto_reconnect = false;
     ws_cfg.task_stack = 4096;
-    ws_cfg.buffer_size = 2048;
+    ws_cfg.buffer_size = CONFIG_JMRI_JSON_WS_BUFFER_SIZE;
     
     // Create WebSocket client
     m_client = esp_websocket_client_init(&ws_cfg);
@@ -107,10 +204,14 @@ esp_err_t JmriJsonClient::connect(const std::string& host, uint16_t port)
     // Register event handler
     esp_websocket_register_events(m_client, WEBSOCKET_EVENT_ANY, websocketEventHandler, this);
     
+    // Writer first, so messages queued on 'hello' go straight out
+    startTransmitTask();
+    
     // Start connection
     esp_err_t err = esp_websocket_client_start(m_client);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Failed to start WebSocket client: %s", esp_err_to_name(err));
+        stopTransmitTask();
         esp_websocket_client_destroy(m_client);
         m_client = nullptr;
         setState(ConnectionState::FAILED);
@@ -122,23 +223,25 @@ esp_err_t JmriJsonClient::connect(const std::string& host, uint16_t port)
 
 void JmriJsonClient::disconnect()
 {
-    // Stop heartbeat task first
+    // Stop the heartbeat first; neither it nor the writer may touch a destroyed client
+    stopHelloTimeout();
     stopHeartbeat();
     
     if (m_client) {
         ESP_LOGI(TAG, "Disconnecting from JMRI JSON server");
         
-        // Stop the client (this closes the socket)
+        // Stop the client (closes the socket and waits for its task to exit).
+        // A send in progress then fails at once, so the writer exits promptly.
         esp_err_t err = esp_websocket_client_stop(m_client);
         if (err != ESP_OK) {
             ESP_LOGW(TAG, "Error stopping WebSocket client: %s", esp_err_to_name(err));
         }
-        
-        // Small delay to allow socket to close
-        vTaskDelay(pdMS_TO_TICKS(100));
-        
+    }
+    stopTransmitTask();
+    
+    if (m_client) {
         // Destroy the client
-        err = esp_websocket_client_destroy(m_client);
+        esp_err_t err = esp_websocket_client_destroy(m_client);
         if (err != ESP_OK) {
             ESP_LOGW(TAG, "Error destroying WebSocket client: %s", esp_err_to_name(err));
         }
@@ -147,7 +250,9 @@ void JmriJsonClient::disconnect()
     }
     
     setState(ConnectionState::DISCONNECTED);
-    m_powerStates.clear();
+    m_sessionReady = false;
+    m_subscriptions.clearStates();
+    notifySessionListeners(false);
 }
 
 esp_err_t JmriJsonClient::setPower(bool on)
@@ -176,11 +281,25 @@ esp_err_t JmriJsonClient::setPower(bool on)
 
 JmriJsonClient::PowerState JmriJsonClient::getPower() const
 {
-    auto it = m_powerStates.find(m_configuredPowerName);
-    if (it != m_powerStates.end()) {
-        return it->second;
+    uint16_t id = m_subscriptions.find(ItemType::POWER, m_configuredPowerName);
+    return powerStateFromJson(m_subscriptions.getState(id));
+}
+
+esp_err_t JmriJsonClient::subscribe(ItemType type, std::string_view systemName, uint16_t* outId)
+{
+    if (type == ItemType::POWER || type == ItemType::COUNT || systemName.empty()) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    // The writer task sends the "get" for every id past m_subscriptionsSent
+    uint16_t id = m_subscriptions.intern(type, systemName);
+    if (id == JsonSubscriptionTable::INVALID_ID) {
+        return ESP_ERR_NO_MEM;
+    }
+    if (outId) {
+        *outId = id;
     }
-    return PowerState::UNKNOWN;
+    return ESP_OK;
 }
 
 esp_err_t JmriJsonClient::requestPowerList()
@@ -199,18 +318,44 @@ esp_err_t JmriJsonClient::requestPowerList()
     // {"type":"power","method":"list"}
     std::string message = "{\"type\":\"power\",\"method\":\"list\"}";
     
-    ESP_LOGD(TAG, "Sending power list request: %s", message.c_str());
+    ESP_LOGD(TAG, "Queueing power list request: %s", message.c_str());
     
-    esp_err_t err = esp_websocket_client_send_text(m_client, message.c_str(), message.length(), portMAX_DELAY);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to send power list request: %s (%d)", esp_err_to_name(err), err);
-        return err;
+    return queueMessage(message);
+}
+
+esp_err_t JmriJsonClient::addElementListener(const char* type, ElementListener* listener)
+{
+    if (!type || !listener) {
+        return ESP_ERR_INVALID_ARG;
     }
-    
-    ESP_LOGI(TAG, "Power list request sent successfully");
+    if (m_elementListenerCount >= MAX_ELEMENT_LISTENERS) {
+        ESP_LOGE(TAG, "No room for a '%s' listener", type);
+        return ESP_ERR_NO_MEM;
+    }
+    m_elementListeners[m_elementListenerCount++] = ElementListenerEntry{ type, listener };
     return ESP_OK;
 }
 
+void JmriJsonClient::removeElementListener(ElementListener* listener)
+{
+    size_t kept = 0;
+    for (size_t i = 0; i < m_elementListenerCount; i++) {
+        if (m_elementListeners[i].listener != listener) {
+            m_elementListeners[kept++] = m_elementListeners[i];
+        }
+    }
+    m_elementListenerCount = kept;
+    m_messageListeners = 0;
+}
+
+esp_err_t JmriJsonClient::sendMessage(std::string_view message)
+{
+    if (!isConnected()) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    return queueMessage(message);
+}
+
 void JmriJsonClient::sendHeartbeat()
 {
     if (isConnected()) {
@@ -219,11 +364,56 @@ void JmriJsonClient::sendHeartbeat()
     }
 }
 
+void JmriJsonClient::logFrameStats() const
+{
+    FrameStats stats = m_frameStats;
+    ESP_LOGI(TAG, "RX: %lu messages in %lu fragments (max %lu per message), largest %lu bytes, "
+             "%lu oversized, %lu discarded",
+             (unsigned long)stats.messages, (unsigned long)stats.fragments,
+             (unsigned long)stats.maxFragments, (unsigned long)stats.largestBytes,
+             (unsigned long)stats.oversized, (unsigned long)stats.discarded);
+}
+
+void JmriJsonClient::resetFrameStats()
+{
+    m_frameStats = FrameStats{};
+}
+
 #if CONFIG_THROTTLE_TESTS
-void JmriJsonClient::testProcessMessage(const std::string& message)
+void JmriJsonClient::testProcessMessage(std::string_view message)
 {
     processMessage(message);
 }
+
+void JmriJsonClient::testProcessFragment(uint8_t opCode, std::string_view data, size_t payloadOffset,
+                                         size_t payloadLength, bool fin)
+{
+    esp_websocket_event_data_t event = {};
+    event.data_ptr = data.data();
+    event.data_len = static_cast<int>(data.size());
+    event.op_code = opCode;
+    event.payload_offset = static_cast<int>(payloadOffset);
+    event.payload_len = static_cast<int>(payloadLength);
+    event.fin = fin;
+    processDataEvent(event);
+}
+
+void JmriJsonClient::testSetConnected(bool connected)
+{
+    m_state = connected ? ConnectionState::CONNECTED : ConnectionState::DISCONNECTED;
+    m_sessionReady = connected;
+    notifySessionListeners(connected);
+}
+
+bool JmriJsonClient::testTakeQueuedMessage(std::string& outMessage)
+{
+    TxMessage message;
+    if (!m_txQueue || xQueueReceive(m_txQueue, &message, 0) != pdTRUE) {
+        return false;
+    }
+    outMessage.assign(message.data, message.length);
+    return true;
+}
 #endif
 
 void JmriJsonClient::websocketEventHandler(void* handler_args, esp_event_base_t base, int32_t event_id, void* event_data)
@@ -234,8 +424,12 @@ void JmriJsonClient::websocketEventHandler(void* handler_args, esp_event_base_t
     switch (event_id) {
         case WEBSOCKET_EVENT_CONNECTED: {
             ESP_LOGI(TAG, "WebSocket connected");
+            client->m_messageActive = false;  // Nothing carries over from a previous connection
+            client->m_openedUs = esp_timer_get_time();
+            client->m_connectTimings.openUs = static_cast<uint32_t>(client->m_openedUs - client->m_connectStartUs);
             client->setState(ConnectionState::CONNECTED);
-            // Start heartbeat task to keep connection alive
+            client->startHelloTimeout();
+            // Start heartbeat to keep connection alive
             client->startHeartbeat();
             // Don't send immediately - wait for hello message first
             // The power list will be requested after we receive 'hello'
@@ -244,16 +438,15 @@ void JmriJsonClient::websocketEventHandler(void* handler_args, esp_event_base_t
             
         case WEBSOCKET_EVENT_DISCONNECTED:
             ESP_LOGW(TAG, "WebSocket disconnected");
+            client->m_sessionReady = false;
+            client->stopHelloTimeout();
             client->stopHeartbeat();
             client->setState(ConnectionState::DISCONNECTED);
+            client->notifySessionListeners(false);
             break;
             
         case WEBSOCKET_EVENT_DATA:
-            if (data->op_code == 0x01) {  // Text frame
-                std::string message(data->data_ptr, data->data_len);
-                ESP_LOGD(TAG, "Received: %s", message.c_str());
-                client->processMessage(message);
-            }
+            client->processDataEvent(*data);
             break;
             
         case WEBSOCKET_EVENT_ERROR:
@@ -266,72 +459,275 @@ void JmriJsonClient::websocketEventHandler(void* handler_args, esp_event_base_t
     }
 }
 
-void JmriJsonClient::processMessage(const std::string& message)
+void JmriJsonClient::processMessage(std::string_view message)
+{
+    esp_websocket_event_data_t event = {};
+    event.data_ptr = message.data();
+    event.data_len = static_cast<int>(message.size());
+    event.op_code = WS_OPCODE_TEXT;
+    event.payload_len = static_cast<int>(message.size());
+    event.fin = true;
+    processDataEvent(event);
+}
+
+void JmriJsonClient::processDataEvent(const esp_websocket_event_data_t& event)
 {
-    ESP_LOGD(TAG, "Received: %s", message.c_str());
+    // A frame larger than the client buffer arrives as several DATA events
+    // with increasing payload_offset; a fragmented message continues in
+    // further frames with opcode 0. Control frames may be interleaved.
+    if (event.op_code != WS_OPCODE_TEXT && event.op_code != WS_OPCODE_CONTINUATION) {
+        return;
+    }
+    
+    size_t offset = event.payload_offset > 0 ? static_cast<size_t>(event.payload_offset) : 0;
+    size_t length = event.data_len > 0 ? static_cast<size_t>(event.data_len) : 0;
     
-    // Extract type field
-    std::string type = extractJsonString(message, "type");
+    if (event.op_code == WS_OPCODE_TEXT && offset == 0) {
+        if (m_messageActive) {
+            ESP_LOGW(TAG, "Message interrupted after %u bytes", (unsigned)m_messageBytes);
+            m_frameStats.discarded++;
+        }
+        m_messageActive = true;
+        m_messageSkipped = false;
+        m_messageBytes = 0;
+        m_messageFragments = 0;
+        m_frameOffset = 0;
+        m_tokenizer.reset();
+        m_elementDepth = -1;
+        m_dataDepth = -1;
+        m_messageListeners = 0;
+    } else if (!m_messageActive) {
+        return;  // Tail of a message whose start we never saw
+    }
+    
+    if (!m_messageSkipped && offset != m_frameOffset) {
+        ESP_LOGW(TAG, "Fragment at offset %u, expected %u; discarding message",
+                 (unsigned)offset, (unsigned)m_frameOffset);
+        m_messageSkipped = true;
+        m_frameStats.discarded++;
+    }
+    
+    m_messageFragments++;
+    m_messageBytes += length;
+    m_frameOffset = offset + length;
+    
+    if (!m_messageSkipped && m_messageBytes > CONFIG_JMRI_JSON_MAX_MESSAGE_SIZE) {
+        ESP_LOGW(TAG, "Message exceeds %d bytes; skipping the rest", CONFIG_JMRI_JSON_MAX_MESSAGE_SIZE);
+        m_messageSkipped = true;
+        m_frameStats.oversized++;
+    }
+    
+    if (!m_messageSkipped) {
+        ESP_LOGV(TAG, "Received: %.*s", static_cast<int>(length), event.data_ptr);
+        if (m_tokenizer.feed(event.data_ptr, length, *this) == JsonTokenizer::Status::ERROR) {
+            ESP_LOGW(TAG, "Malformed JSON frame (after %lu tokens)", (unsigned long)m_tokenizer.getTokenCount());
+            m_messageSkipped = true;
+            m_frameStats.discarded++;
+        }
+    }
+    
+    if (m_frameOffset >= static_cast<size_t>(event.payload_len)) {
+        m_frameOffset = 0;
+        if (event.fin) {
+            finishMessage();
+        }
+    }
+}
+
+void JmriJsonClient::finishMessage()
+{
+    bool complete = !m_messageSkipped;
+    if (complete && m_tokenizer.finish(*this) != JsonTokenizer::Status::COMPLETE) {
+        ESP_LOGW(TAG, "Message ended inside a JSON document (%u bytes)", (unsigned)m_messageBytes);
+        m_frameStats.discarded++;
+        complete = false;
+    }
     
-    if (type == "power") {
-        // Extract data object (simplified - assumes data is present)
-        size_t dataPos = message.find("\"data\":");
-        if (dataPos != std::string::npos) {
-            std::string data = message.substr(dataPos + 7);  // Skip "data":
-            handlePowerMessage(type, data);
+    for (size_t i = 0; i < m_elementListenerCount; i++) {
+        if (m_messageListeners & (1u << i)) {
+            m_elementListeners[i].listener->onMessageEnd(complete);
         }
+    }
+    m_messageListeners = 0;
+    
+    m_frameStats.messages++;
+    m_frameStats.fragments += m_messageFragments;
+    if (m_messageFragments > m_frameStats.maxFragments) {
+        m_frameStats.maxFragments = m_messageFragments;
+    }
+    if (m_messageBytes > m_frameStats.largestBytes) {
+        m_frameStats.largestBytes = static_cast<uint32_t>(m_messageBytes);
+    }
+    m_messageActive = false;
+}
+
+void JmriJsonClient::onToken(const JsonTokenizer::Token& token)
+{
+    using TokenType = JsonTokenizer::TokenType;
+    
+    // Everything inside "data" goes to the listener that claimed the type
+    if (m_elementListener && m_dataDepth >= 0 && token.depth >= m_dataDepth) {
+        m_elementListener->onElementData(token, token.depth - m_dataDepth);
+    }
+    
+    // Messages are {"type":...,"data":{...}}, alone or as elements of a list array
+    switch (token.type) {
+        case TokenType::OBJECT_START:
+            if (m_dataDepth >= 0) {
+                break;  // Nested object inside data (e.g. roster function keys)
+            }
+            if (m_elementDepth >= 0 && token.depth >= m_elementDepth) {
+                // Inside the current element: only its "data" member matters
+                if (token.depth == m_elementDepth && token.is("data")) {
+                    m_dataDepth = token.depth + 1;
+                }
+            } else {
+                m_elementDepth = token.depth + 1;
+                m_elementTypeLength = 0;
+                m_elementNameLength = 0;
+                m_elementUserNameLength = 0;
+                m_elementMethodLength = 0;
+                m_elementState = -1;
+                m_elementCode = 0;
+                m_elementListener = nullptr;
+            }
+            break;
+            
+        case TokenType::OBJECT_END:
+            if (m_dataDepth >= 0 && token.depth + 1 == m_dataDepth) {
+                m_dataDepth = -1;
+            } else if (m_dataDepth < 0 && token.depth + 1 == m_elementDepth) {
+                handleElement();
+                m_elementDepth = -1;
+            }
+            break;
+            
+        case TokenType::STRING:
+            if (token.depth == m_elementDepth && m_dataDepth < 0 && token.is("type")) {
+                copyField(m_elementType, sizeof(m_elementType), m_elementTypeLength, token.text);
+                // JMRI always sends "type" before "data", so the listener sees all of it
+                for (size_t i = 0; i < m_elementListenerCount; i++) {
+                    if (token.text == m_elementListeners[i].type) {
+                        m_elementListener = m_elementListeners[i].listener;
+                        m_messageListeners |= 1u << i;
+                        break;
+                    }
+                }
+            } else if (token.depth == m_elementDepth && m_dataDepth < 0 && token.is("method")) {
+                copyField(m_elementMethod, sizeof(m_elementMethod), m_elementMethodLength, token.text);
+            } else if (token.depth == m_dataDepth && token.is("name")) {
+                copyField(m_elementName, sizeof(m_elementName), m_elementNameLength, token.text);
+            } else if (token.depth == m_dataDepth && token.is("userName")) {
+                copyField(m_elementUserName, sizeof(m_elementUserName), m_elementUserNameLength, token.text);
+            }
+            break;
+            
+        case TokenType::NUMBER:
+            if (token.depth == m_dataDepth) {
+                if (token.is("state")) {
+                    token.getInt(m_elementState);
+                } else if (token.is("code")) {
+                    token.getInt(m_elementCode);
+                }
+            }
+            break;
+            
+        default:
+            break;
+    }
+}
+
+void JmriJsonClient::handleElement()
+{
+    std::string_view type(m_elementType, m_elementTypeLength);
+    std::string_view name(m_elementName, m_elementNameLength);
+    ItemType itemType;
+    
+    if (m_elementListener) {
+        // Elements of a list response sit one level down, inside the array
+        m_elementListener->onElementEnd(m_elementDepth > 1,
+                                        std::string_view(m_elementMethod, m_elementMethodLength));
+    } else if (type == "power") {
+        handlePowerMessage(name, m_elementState);
+    } else if (JsonSubscriptionTable::parseType(type, itemType)) {
+        handleItemMessage(itemType, name, std::string_view(m_elementUserName, m_elementUserNameLength),
+                          m_elementState);
     } else if (type == "pong") {
         ESP_LOGD(TAG, "Heartbeat acknowledged");
     } else if (type == "hello") {
         ESP_LOGI(TAG, "Server hello received - connection ready");
-        // Small delay to ensure WebSocket is fully ready for bidirectional communication
-        vTaskDelay(pdMS_TO_TICKS(200));
-        // Subscribe to power state updates for our configured power manager
+        stopHelloTimeout();
+        m_connectTimings.helloUs = static_cast<uint32_t>(esp_timer_get_time() - m_openedUs);
+        // Subscribe to power state updates for our configured power manager.
+        // Queued, not sent: this runs on the WebSocket client's own task.
         std::string subscribeMsg = "{\"type\":\"power\",\"data\":{\"name\":\"" + 
                                    escapeJson(m_configuredPowerName) + "\"},\"method\":\"get\"}";
-        esp_websocket_client_send_text(m_client, subscribeMsg.c_str(), subscribeMsg.length(), pdMS_TO_TICKS(1000));
-        ESP_LOGI(TAG, "Subscribed to power updates for '%s'", m_configuredPowerName.c_str());
+        if (queueMessage(subscribeMsg) == ESP_OK) {
+            ESP_LOGI(TAG, "Subscribed to power updates for '%s'", m_configuredPowerName.c_str());
+        }
+        // The writer re-sends every item subscription once the queue is idle
+        m_subscriptionsSent = 0;
+        m_sessionReady = true;
+        notifySessionListeners(true);
+    } else if (type == "error") {
+        ESP_LOGW(TAG, "Server error %d", m_elementCode);
+    } else {
+        ESP_LOGD(TAG, "Ignoring '%.*s' message", static_cast<int>(type.size()), type.data());
     }
 }
 
-void JmriJsonClient::handlePowerMessage(const std::string& type, const std::string& data)
+void JmriJsonClient::notifySessionListeners(bool started)
+{
+    for (size_t i = 0; i < m_elementListenerCount; i++) {
+        if (started) {
+            m_elementListeners[i].listener->onSessionStart();
+        } else {
+            m_elementListeners[i].listener->onSessionEnd();
+        }
+    }
+}
+
+void JmriJsonClient::handlePowerMessage(std::string_view name, int stateValue)
 {
-    // Extract power manager name and state
-    std::string name = extractJsonString(data, "name");
-    int stateValue = extractJsonInt(data, "state");
-    
     if (name.empty()) {
         ESP_LOGW(TAG, "Power message missing name");
         return;
     }
     
-    // JMRI JSON power states: 0=unknown, 2=ON, 4=OFF
-    PowerState newState;
-    switch (stateValue) {
-        case 2:
-            newState = PowerState::ON;
-            break;
-        case 4:
-            newState = PowerState::OFF;
-            break;
-        default:
-            newState = PowerState::UNKNOWN;
-            break;
-    }
-    
-    ESP_LOGI(TAG, "Power '%s' state: %d", name.c_str(), (int)newState);
+    PowerState newState = powerStateFromJson(stateValue);
+    ESP_LOGI(TAG, "Power '%.*s' state: %d", static_cast<int>(name.size()), name.data(), (int)newState);
     
-    // Update cached state
-    bool stateChanged = false;
-    auto it = m_powerStates.find(name);
-    if (it == m_powerStates.end() || it->second != newState) {
-        m_powerStates[name] = newState;
-        stateChanged = true;
+    // Every district the server reports is interned, so a power list fills the table
+    uint16_t id = m_subscriptions.intern(ItemType::POWER, name);
+    if (id == JsonSubscriptionTable::INVALID_ID || !m_subscriptions.update(id, stateValue)) {
+        return;
     }
     
     // Only notify callback for the configured power manager
-    if (stateChanged && m_powerCallback && name == m_configuredPowerName) {
-        m_powerCallback(name, newState);
+    if (m_powerCallback && name == m_configuredPowerName) {
+        m_powerCallback(m_configuredPowerName, newState);
+    }
+    if (m_itemCallback) {
+        m_itemCallback(ItemType::POWER, id, stateValue);
+    }
+}
+
+void JmriJsonClient::handleItemMessage(ItemType type, std::string_view name, std::string_view userName, int stateValue)
+{
+    uint16_t id = m_subscriptions.find(type, name);
+    if (id == JsonSubscriptionTable::INVALID_ID) {
+        m_frameStats.unmatched++;
+        ESP_LOGD(TAG, "Update for unsubscribed %s '%.*s'", JsonSubscriptionTable::getTypeName(type),
+                 static_cast<int>(name.size()), name.data());
+        return;
+    }
+    
+    m_subscriptions.setUserName(id, userName);
+    if (stateValue < 0 || !m_subscriptions.update(id, stateValue)) {
+        return;
+    }
+    if (m_itemCallback) {
+        m_itemCallback(type, id, stateValue);
     }
 }
 
@@ -355,72 +751,232 @@ esp_err_t JmriJsonClient::sendJsonCommand(const std::string& type, const std::st
     
     // Build JSON message: {"type":"...", "data":{...}}
     std::string message = "{\"type\":\"" + type + "\",\"data\":" + data + "}";
+    return queueMessage(message);
+}
+
+esp_err_t JmriJsonClient::queueMessage(std::string_view message)
+{
+    if (!m_txQueue) {
+        return ESP_ERR_INVALID_STATE;
+    }
     
-    // Send with reasonable timeout
-    int sent = esp_websocket_client_send_text(m_client, message.c_str(), message.length(), pdMS_TO_TICKS(1000));
+    if (message.size() > MAX_TX_MESSAGE_LENGTH) {
+        m_txDropped.fetch_add(1, std::memory_order_relaxed);
+        ESP_LOGW(TAG, "Message too long (%u bytes), dropping", (unsigned)message.size());
+        return ESP_ERR_INVALID_SIZE;
+    }
     
-    // The ESP WebSocket client returns the number of bytes sent on success, or -1 on error
-    // However, it seems to return -1 even when the message is successfully queued/sent
-    // This appears to be a quirk or bug in the library
-    if (sent < 0) {
-        // Log as warning but don't treat as fatal error since commands seem to work
-        ESP_LOGW(TAG, "WebSocket send returned %d (message may still have been sent)", sent);
-    } else {
-        ESP_LOGD(TAG, "Sent %d bytes: %s", sent, message.c_str());
+    int64_t start = esp_timer_get_time();
+    TxMessage tx;
+    tx.length = static_cast<uint16_t>(message.size());
+    memcpy(tx.data, message.data(), message.size());
+    
+    // Never block the caller (LVGL or WebSocket event task); the writer owns the socket
+    BaseType_t accepted = xQueueSend(m_txQueue, &tx, 0);
+    
+    uint32_t elapsedUs = static_cast<uint32_t>(esp_timer_get_time() - start);
+    uint32_t maxUs = m_txMaxEnqueueUs.load(std::memory_order_relaxed);
+    while (elapsedUs > maxUs &&
+           !m_txMaxEnqueueUs.compare_exchange_weak(maxUs, elapsedUs, std::memory_order_relaxed)) {
     }
     
-    // Always return OK since the commands actually work despite the error return
+    if (accepted != pdTRUE) {
+        m_txDropped.fetch_add(1, std::memory_order_relaxed);
+        ESP_LOGW(TAG, "TX queue full, dropping: %.*s", static_cast<int>(message.size()), message.data());
+        return ESP_ERR_NO_MEM;
+    }
+    m_txQueued.fetch_add(1, std::memory_order_relaxed);
     return ESP_OK;
 }
 
-void JmriJsonClient::startHeartbeat()
+void JmriJsonClient::startTransmitTask()
 {
-    // Don't start if already running
-    if (m_heartbeatTask != nullptr) {
+    if (m_transmitTask != nullptr || !m_txQueue || !m_txExited) {
         return;
     }
     
-    // Create heartbeat task
-    BaseType_t result = xTaskCreate(
-        heartbeatTask,
-        "jmri_heartbeat",
-        2048,
-        this,
-        5,
-        &m_heartbeatTask
-    );
-    
-    if (result == pdPASS) {
-        ESP_LOGI(TAG, "Heartbeat task started");
-    } else {
-        ESP_LOGE(TAG, "Failed to create heartbeat task");
-        m_heartbeatTask = nullptr;
+    xQueueReset(m_txQueue);
+    // Drop a stale exit signal from a writer that outlived an earlier stop
+    xSemaphoreTake(m_txExited, 0);
+    m_txRunning = true;
+    TaskHandle_t task = nullptr;
+    if (xTaskCreate(transmitTask, "jmri_tx", 3072, this, 5, &task) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create JSON TX task");
+        m_txRunning = false;
+        return;
     }
+    m_transmitTask = task;
 }
 
-void JmriJsonClient::stopHeartbeat()
+void JmriJsonClient::stopTransmitTask()
 {
-    if (m_heartbeatTask != nullptr) {
-        ESP_LOGI(TAG, "Stopping heartbeat task");
-        vTaskDelete(m_heartbeatTask);
-        m_heartbeatTask = nullptr;
+    if (m_transmitTask == nullptr) {
+        return;
     }
+    
+    // The writer checks the flag between messages, so it exits within one send
+    // timeout. Waited for without a limit: the queue, the semaphore and the
+    // client may be freed once this returns. It deletes itself; its handle is
+    // never used after the signal.
+    m_txRunning = false;
+    xSemaphoreTake(m_txExited, portMAX_DELAY);
 }
 
-void JmriJsonClient::heartbeatTask(void* pvParameters)
+void JmriJsonClient::transmitTask(void* pvParameters)
 {
     JmriJsonClient* client = static_cast<JmriJsonClient*>(pvParameters);
+    TxMessage message;
+    
+    while (client->m_txRunning) {
+        // Queued messages go first; subscriptions are sent one at a time when
+        // the queue is idle, so a reconnect never floods the queue
+        bool subscribing = client->m_sessionReady &&
+                           client->m_subscriptionsSent < client->m_subscriptions.size();
+        if (xQueueReceive(client->m_txQueue, &message, subscribing ? 0 : pdMS_TO_TICKS(100)) != pdTRUE &&
+            !(subscribing && client->encodeNextSubscription(message))) {
+            continue;
+        }
+        
+        if (!client->m_client || !esp_websocket_client_is_connected(client->m_client)) {
+            client->m_txFailed.fetch_add(1, std::memory_order_relaxed);
+            ESP_LOGW(TAG, "Not connected, dropping: %.*s", static_cast<int>(message.length), message.data);
+            continue;
+        }
+        
+        int64_t start = esp_timer_get_time();
+        int sent = esp_websocket_client_send_text(client->m_client, message.data, message.length,
+                                                  pdMS_TO_TICKS(TX_SEND_TIMEOUT_MS));
+        uint32_t elapsedUs = static_cast<uint32_t>(esp_timer_get_time() - start);
+        client->m_txSendLatency.record(elapsedUs);
+        
+        // The client returns the number of bytes sent, or -1 on error or timeout
+        if (sent < 0) {
+            client->m_txFailed.fetch_add(1, std::memory_order_relaxed);
+            ESP_LOGW(TAG, "WebSocket send returned %d after %lu us: %.*s", sent, (unsigned long)elapsedUs,
+                     static_cast<int>(message.length), message.data);
+        } else {
+            client->m_txSent.fetch_add(1, std::memory_order_relaxed);
+            ESP_LOGD(TAG, "Sent %d bytes: %.*s", sent, static_cast<int>(message.length), message.data);
+            if (elapsedUs > TX_SLOW_SEND_US) {
+                ESP_LOGW(TAG, "Slow send: %lu ms", (unsigned long)(elapsedUs / 1000));
+            }
+        }
+    }
     
-    ESP_LOGI(TAG, "Heartbeat task running");
+    // Signal last: the client may be destroyed as soon as the stopper wakes
+    client->m_transmitTask = nullptr;
+    xSemaphoreGive(client->m_txExited);
+    vTaskDelete(nullptr);
+}
+
+bool JmriJsonClient::encodeNextSubscription(TxMessage& message)
+{
+    // Power districts are subscribed on 'hello' and learned from power lists
+    size_t id = m_subscriptionsSent;
+    while (id < m_subscriptions.size() && m_subscriptions.getType(id) == ItemType::POWER) {
+        id++;
+    }
+    if (id >= m_subscriptions.size()) {
+        m_subscriptionsSent = id;
+        return false;
+    }
+    m_subscriptionsSent = id + 1;
+    
+    // {"type":"sensor","data":{"name":"IS12"},"method":"get"}
+    size_t used = 0;
+    bool fits = appendText(message.data, sizeof(message.data), used, "{\"type\":\"") &&
+                appendText(message.data, sizeof(message.data), used,
+                           JsonSubscriptionTable::getTypeName(m_subscriptions.getType(id))) &&
+                appendText(message.data, sizeof(message.data), used, "\",\"data\":{\"name\":\"") &&
+                appendEscaped(message.data, sizeof(message.data), used, m_subscriptions.getSystemName(id)) &&
+                appendText(message.data, sizeof(message.data), used, "\"},\"method\":\"get\"}");
+    if (!fits) {
+        m_txDropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    message.length = static_cast<uint16_t>(used);
+    return true;
+}
+
+JmriJsonClient::TxStats JmriJsonClient::getTxStats() const
+{
+    TxStats stats;
+    stats.queued = m_txQueued.load(std::memory_order_relaxed);
+    stats.sent = m_txSent.load(std::memory_order_relaxed);
+    stats.dropped = m_txDropped.load(std::memory_order_relaxed);
+    stats.failed = m_txFailed.load(std::memory_order_relaxed);
+    stats.maxEnqueueUs = m_txMaxEnqueueUs.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void JmriJsonClient::logTxStats() const
+{
+    TxStats stats = getTxStats();
+    ESP_LOGI(TAG, "TX: %lu queued, %lu sent, %lu dropped, %lu failed, worst caller wait %lu us",
+             (unsigned long)stats.queued, (unsigned long)stats.sent, (unsigned long)stats.dropped,
+             (unsigned long)stats.failed, (unsigned long)stats.maxEnqueueUs);
+    m_txSendLatency.log(TAG, "Send");
+}
+
+void JmriJsonClient::startHeartbeat()
+{
+    // Don't start if already running
+    if (m_heartbeatJob != Scheduler::INVALID_JOB) {
+        return;
+    }
     
-    while (true) {
-        // Wait 30 seconds
-        vTaskDelay(pdMS_TO_TICKS(30000));
-        
-        // Send heartbeat if connected
-        if (client->isConnected()) {
+    Scheduler::JobId job = Scheduler::instance().schedulePeriodic(
+        HEARTBEAT_INTERVAL_MS, Scheduler::Priority::LOW,
+        [this]() {
             ESP_LOGD(TAG, "Sending heartbeat");
-            client->sendHeartbeat();
-        }
+            sendHeartbeat();
+        },
+        "jmri_heartbeat");
+    
+    if (job == Scheduler::INVALID_JOB) {
+        ESP_LOGE(TAG, "Failed to schedule heartbeat");
+        return;
+    }
+    
+    Scheduler::JobId expected = Scheduler::INVALID_JOB;
+    if (m_heartbeatJob.compare_exchange_strong(expected, job)) {
+        ESP_LOGI(TAG, "Heartbeat started");
+    } else {
+        Scheduler::instance().cancel(job);  // Lost a race with another start
+    }
+}
+
+void JmriJsonClient::startHelloTimeout()
+{
+    Scheduler::JobId job = Scheduler::instance().scheduleOnce(
+        CONFIG_JMRI_HANDSHAKE_TIMEOUT_MS, Scheduler::Priority::NORMAL,
+        [this]() { onHelloTimeout(); },
+        "json_hello");
+    Scheduler::instance().cancel(m_helloTimeoutJob.exchange(job));
+}
+
+void JmriJsonClient::stopHelloTimeout()
+{
+    Scheduler::instance().cancel(m_helloTimeoutJob.exchange(Scheduler::INVALID_JOB));
+}
+
+void JmriJsonClient::onHelloTimeout()
+{
+    if (m_sessionReady || m_state != ConnectionState::CONNECTED) {
+        return;
+    }
+    // Only mark the attempt failed: stopping the client here would wait for the
+    // WebSocket task, which may itself be waiting to cancel this job. The
+    // connection controller replaces the connection on its next check.
+    ESP_LOGW(TAG, "No hello from server within %d ms", CONFIG_JMRI_HANDSHAKE_TIMEOUT_MS);
+    setState(ConnectionState::FAILED);
+}
+
+void JmriJsonClient::stopHeartbeat()
+{
+    Scheduler::JobId job = m_heartbeatJob.exchange(Scheduler::INVALID_JOB);
+    if (job != Scheduler::INVALID_JOB) {
+        ESP_LOGI(TAG, "Stopping heartbeat");
+        Scheduler::instance().cancel(job);
     }
 }
@@ -1,11 +1,20 @@
 #pragma once
 
 #include <string>
-#include <map>
+#include <string_view>
+#include <atomic>
 #include <functional>
 #include "esp_err.h"
 #include "esp_websocket_client.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
 #include "sdkconfig.h"
+#include "JsonTokenizer.h"
+#include "JsonSubscriptionTable.h"
+#include "LatencyHistogram.h"
+#include "Scheduler.h"
 
 /**
  * @brief JMRI JSON Protocol Client
@@ -14,9 +23,24 @@
  * Uses WebSocket connection to JMRI JSON server.
  * Provides more detailed control than WiThrottle, especially for power districts.
  * 
+ * Incoming frames are tokenized incrementally as WebSocket fragments arrive
+ * (see JsonTokenizer); each {"type":...,"data":{...}} element, including
+ * every element of a list response, is dispatched when it closes. Frames
+ * are never reassembled, so memory use does not grow with frame size.
+ * 
+ * Sensors, turnouts, lights and blocks are tracked by subscribe(); their
+ * names are interned in a JsonSubscriptionTable and updates are applied by
+ * item id, with callbacks only on real state changes. Other types can be
+ * claimed by an ElementListener (JmriJsonThrottle takes "throttle" and
+ * "rosterEntry"), which receives the element's data as tokens.
+ * 
+ * Outgoing messages are copied into a queue drained by a writer task that
+ * owns esp_websocket_client_send_text(), so callers (including the LVGL
+ * task) and the WebSocket event task never wait on the network.
+ * 
  * Protocol documentation: https://www.jmri.org/help/en/html/web/JsonServlet.shtml
  */
-class JmriJsonClient {
+class JmriJsonClient : private JsonTokenizer::Handler {
 public:
     /**
      * @brief Power states for tracks/districts
@@ -50,6 +74,100 @@ public:
      */
     using ConnectionStateCallback = std::function<void(ConnectionState state)>;
     
+    using ItemType = JsonSubscriptionTable::ItemType;
+    
+    /**
+     * @brief Callback for subscribed item state changes
+     * @param type Item type
+     * @param id Item id returned by subscribe(); names via getSubscriptions()
+     * @param state JMRI state value (e.g. sensor 2=ACTIVE, 4=INACTIVE)
+     */
+    using ItemStateCallback = std::function<void(ItemType type, uint16_t id, int state)>;
+    
+    /**
+     * @brief Receives the elements of one JSON type (e.g. "throttle")
+     * 
+     * Elements whose type has a listener bypass the built-in handlers. Their
+     * "data" members are streamed to the listener token by token, so it can
+     * keep just the fields it needs. Everything runs on the WebSocket task.
+     */
+    class ElementListener {
+    public:
+        virtual ~ElementListener() = default;
+        
+        /**
+         * @brief One token inside the element's "data" object
+         * @param token Token (views valid only during the call)
+         * @param depth 0 for direct members of "data", 1 for their members, ...
+         */
+        virtual void onElementData(const JsonTokenizer::Token& token, int depth) = 0;
+        
+        /**
+         * @brief The element closed
+         * @param inList true if it was one element of a list response
+         * @param method The element's "method" (e.g. "delete"), empty if none
+         */
+        virtual void onElementEnd(bool inList, std::string_view method) = 0;
+        
+        /**
+         * @brief The WebSocket message that carried this type's elements ended
+         * @param complete false if part of it was skipped (gap, size cap, bad JSON)
+         */
+        virtual void onMessageEnd(bool complete) {}
+        
+        /**
+         * @brief The server said hello: a new session is ready for messages
+         */
+        virtual void onSessionStart() {}
+        
+        /**
+         * @brief The connection closed
+         */
+        virtual void onSessionEnd() {}
+    };
+    
+    /**
+     * @brief Most element listeners that can be registered
+     */
+    static constexpr size_t MAX_ELEMENT_LISTENERS = 4;
+    
+    /**
+     * @brief Outgoing message statistics
+     */
+    struct TxStats {
+        uint32_t queued;         // Accepted by the TX queue
+        uint32_t sent;           // Handed to the WebSocket client
+        uint32_t dropped;        // Rejected: queue full or message too long
+        uint32_t failed;         // Send failed or timed out in the writer
+        uint32_t maxEnqueueUs;   // Longest time a caller spent queueing
+    };
+    
+    /**
+     * @brief Longest outgoing message, in bytes
+     */
+    static constexpr size_t MAX_TX_MESSAGE_LENGTH = 192;
+    
+    /**
+     * @brief Received text message statistics
+     */
+    struct FrameStats {
+        uint32_t messages;       // Complete text messages
+        uint32_t fragments;      // DATA events across all messages
+        uint32_t maxFragments;   // Most DATA events in one message
+        uint32_t largestBytes;   // Largest message seen
+        uint32_t oversized;      // Messages skipped for exceeding the size cap
+        uint32_t discarded;      // Messages abandoned for a missing fragment or bad JSON
+        uint32_t unmatched;      // Item updates for names that are not subscribed
+    };
+    
+    /**
+     * @brief Time spent in each phase of the last connection attempt
+     */
+    struct ConnectTimings {
+        uint32_t openUs;   // connect() to WebSocket open (DNS, TCP and upgrade)
+        uint32_t helloUs;  // WebSocket open to the server's 'hello' (0 until it arrives)
+    };
+    
     JmriJsonClient();
     ~JmriJsonClient();
     
@@ -65,9 +183,15 @@ public:
     
     /**
      * @brief Connect to JMRI JSON server
+     *
+     * Returns at once; the WebSocket client opens the connection on its own
+     * task within CONFIG_JMRI_CONNECT_TIMEOUT_MS, and the server must then
+     * say 'hello' within CONFIG_JMRI_HANDSHAKE_TIMEOUT_MS. A host already
+     * in DnsCache is connected to by address.
      * @param host Server hostname or IP address
      * @param port Server port (default 12080 for JSON WebSocket)
-     * @return ESP_OK if connection initiated
+     * @return ESP_OK if connection initiated, ESP_ERR_INVALID_STATE while an
+     *         earlier attempt is still connecting (call disconnect() to abandon it)
      */
     esp_err_t connect(const std::string& host, uint16_t port = 12080);
     
@@ -127,6 +251,52 @@ public:
      */
     void setConnectionStateCallback(ConnectionStateCallback callback) { m_connectionCallback = callback; }
     
+    /**
+     * @brief Track an item's state
+     * 
+     * The name is interned and a JSON "get" (which JMRI treats as a
+     * subscription) is sent by the writer task, now if the session is up and
+     * again after every reconnect. Subscribing twice returns the same id.
+     * 
+     * @param type Item type (not POWER; see setConfiguredPowerName())
+     * @param systemName JMRI system name (e.g. "IS12", "LT3")
+     * @param outId Receives the item id (optional)
+     * @return ESP_OK, or ESP_ERR_NO_MEM if the table is full
+     */
+    esp_err_t subscribe(ItemType type, std::string_view systemName, uint16_t* outId = nullptr);
+    
+    /**
+     * @brief Set subscribed item state change callback
+     * Called on the WebSocket task, only when an item's state changes.
+     */
+    void setItemStateCallback(ItemStateCallback callback) { m_itemCallback = callback; }
+    
+    /**
+     * @brief Interned items: names and last reported states by id
+     */
+    const JsonSubscriptionTable& getSubscriptions() const { return m_subscriptions; }
+    
+    /**
+     * @brief Route elements of @p type to @p listener
+     * Register before connecting.
+     * @param type JSON type string (must outlive the client, e.g. a literal)
+     * @return ESP_OK, or ESP_ERR_NO_MEM if MAX_ELEMENT_LISTENERS are registered
+     */
+    esp_err_t addElementListener(const char* type, ElementListener* listener);
+    
+    /**
+     * @brief Stop routing any type to @p listener (call while disconnected)
+     */
+    void removeElementListener(ElementListener* listener);
+    
+    /**
+     * @brief Queue a complete JSON message for the writer task
+     * Never blocks; the message is copied (at most MAX_TX_MESSAGE_LENGTH bytes).
+     * @return ESP_OK, ESP_ERR_INVALID_STATE if not connected,
+     *         ESP_ERR_NO_MEM if the queue is full
+     */
+    esp_err_t sendMessage(std::string_view message);
+    
     /**
      * @brief Send heartbeat (keep-alive)
      * Should be called periodically when connected
@@ -134,46 +304,176 @@ public:
     void sendHeartbeat();
     
     /**
-     * @brief Start heartbeat task
+     * @brief Start the heartbeat job on the shared Scheduler
      * Automatically sends heartbeats every 30 seconds
      */
     void startHeartbeat();
     
     /**
-     * @brief Stop heartbeat task
+     * @brief Stop the heartbeat job
      */
     void stopHeartbeat();
+    
+    /**
+     * @brief Phase timings of the last connection attempt
+     */
+    ConnectTimings getConnectTimings() const { return m_connectTimings; }
+    
+    /**
+     * @brief Received message statistics
+     * Updated by the WebSocket task; values may lag by one message.
+     */
+    FrameStats getFrameStats() const { return m_frameStats; }
+    
+    /**
+     * @brief Log received message statistics
+     */
+    void logFrameStats() const;
+    
+    /**
+     * @brief Zero the received message statistics
+     */
+    void resetFrameStats();
+    
+    /**
+     * @brief Outgoing message statistics
+     * Counted by the writer task and by callers on any task.
+     */
+    TxStats getTxStats() const;
+    
+    /**
+     * @brief Time the writer task spent in each send (how slow the server is)
+     */
+    const LatencyHistogram& getTxSendLatency() const { return m_txSendLatency; }
+    
+    /**
+     * @brief Log outgoing message statistics and send latency
+     */
+    void logTxStats() const;
 
 #if CONFIG_THROTTLE_TESTS
     /**
      * @brief Test-only hook to process a raw JSON message
      */
-    void testProcessMessage(const std::string& message);
+    void testProcessMessage(std::string_view message);
+    
+    /**
+     * @brief Test-only hook to process one WebSocket DATA event
+     */
+    void testProcessFragment(uint8_t opCode, std::string_view data, size_t payloadOffset,
+                             size_t payloadLength, bool fin);
+    
+    /**
+     * @brief Test-only hook to mark the session up (or down) without a server
+     */
+    void testSetConnected(bool connected);
+    
+    /**
+     * @brief Test-only hook to take the oldest queued message
+     * @return false if the queue is empty
+     */
+    bool testTakeQueuedMessage(std::string& outMessage);
 #endif
 
 private:
-    void processMessage(const std::string& message);
-    void handlePowerMessage(const std::string& type, const std::string& data);
+    struct TxMessage {
+        uint16_t length;
+        char data[MAX_TX_MESSAGE_LENGTH];
+    };
+    
+    void processMessage(std::string_view message);
+    void processDataEvent(const esp_websocket_event_data_t& event);
+    void finishMessage();
+    void onToken(const JsonTokenizer::Token& token) override;
+    void handleElement();
+    void notifySessionListeners(bool started);
+    void handlePowerMessage(std::string_view name, int stateValue);
+    void handleItemMessage(ItemType type, std::string_view name, std::string_view userName, int stateValue);
+    bool encodeNextSubscription(TxMessage& message);
     void setState(ConnectionState newState);
     esp_err_t sendJsonCommand(const std::string& type, const std::string& data);
+    esp_err_t queueMessage(std::string_view message);
+    void startTransmitTask();
+    void stopTransmitTask();
+    void startHelloTimeout();
+    void stopHelloTimeout();
+    void onHelloTimeout();
     
     static void websocketEventHandler(void* handler_args, esp_event_base_t base, int32_t event_id, void* event_data);
-    static void heartbeatTask(void* pvParameters);
+    static void transmitTask(void* pvParameters);
     
     ConnectionState m_state;
     esp_websocket_client_handle_t m_client;
     std::string m_serverHost;
     uint16_t m_serverPort;
     
-    // Heartbeat task
-    TaskHandle_t m_heartbeatTask;
+    // Heartbeat job on the shared Scheduler (low priority, rides along with other wake-ups)
+    static constexpr uint32_t HEARTBEAT_INTERVAL_MS = 30000;
+    std::atomic<Scheduler::JobId> m_heartbeatJob;
+    
+    // Connection phase timing and the one-shot job that gives up on a silent server
+    int64_t m_connectStartUs;
+    int64_t m_openedUs;
+    ConnectTimings m_connectTimings;
+    std::atomic<Scheduler::JobId> m_helloTimeoutJob;
+    
+    // Messages waiting for the writer task; callers never block on send.
+    // The writer clears m_transmitTask and gives m_txExited as it exits, so
+    // nothing touches its handle once the task is gone.
+    QueueHandle_t m_txQueue;
+    std::atomic<TaskHandle_t> m_transmitTask;
+    SemaphoreHandle_t m_txExited;
+    std::atomic<bool> m_txRunning;
+    std::atomic<uint32_t> m_txQueued;
+    std::atomic<uint32_t> m_txSent;
+    std::atomic<uint32_t> m_txDropped;
+    std::atomic<uint32_t> m_txFailed;
+    std::atomic<uint32_t> m_txMaxEnqueueUs;
+    LatencyHistogram m_txSendLatency;
     
     // Configured power manager name to control and monitor
     std::string m_configuredPowerName;
     
-    // Power states for known districts
-    std::map<std::string, PowerState> m_powerStates;
+    // Power districts and subscribed items, with their last reported states
+    JsonSubscriptionTable m_subscriptions;
+    // Items whose "get" the writer has sent this session; reset on 'hello'
+    std::atomic<size_t> m_subscriptionsSent;
+    std::atomic<bool> m_sessionReady;
     
     PowerStateCallback m_powerCallback;
     ConnectionStateCallback m_connectionCallback;
+    ItemStateCallback m_itemCallback;
+    
+    struct ElementListenerEntry {
+        const char* type;
+        ElementListener* listener;
+    };
+    ElementListenerEntry m_elementListeners[MAX_ELEMENT_LISTENERS];
+    size_t m_elementListenerCount;
+    uint32_t m_messageListeners;  // Bit i: listener i saw an element in this message
+    
+    // Text message being received: a text frame plus any continuation
+    // frames, each of which may arrive in several DATA events
+    bool m_messageActive;      // Between the first DATA event and the final one
+    bool m_messageSkipped;     // Oversized or broken; drain without parsing
+    size_t m_messageBytes;
+    uint32_t m_messageFragments;
+    size_t m_frameOffset;      // Next expected payload_offset in the current frame
+    FrameStats m_frameStats;
+    
+    // Incoming frame tokenizer and the element currently being collected
+    JsonTokenizer m_tokenizer;
+    int m_elementDepth;      // Depth of the element's members (-1 if none)
+    int m_dataDepth;         // Depth of its "data" members (-1 outside "data")
+    char m_elementType[24];
+    size_t m_elementTypeLength;
+    char m_elementName[64];
+    size_t m_elementNameLength;
+    char m_elementUserName[64];
+    size_t m_elementUserNameLength;
+    char m_elementMethod[16];
+    size_t m_elementMethodLength;
+    int m_elementState;
+    int m_elementCode;
+    ElementListener* m_elementListener;  // Listener for the current element's type
 };
@@ -0,0 +1,625 @@
+#include "JmriJsonThrottle.h"
+#include "esp_log.h"
+#include <charconv>
+#include <cstring>
+
+static const char* TAG = "JmriJsonThrottle";
+
+namespace {
+    constexpr int MAX_FUNCTION = 28;
+    constexpr int MAX_SPEED = 126;
+
+    // Appends to a Message; once anything fails to fit, finish() reports it
+    struct MessageWriter {
+        JmriJsonThrottle::Message& message;
+        bool fits;
+
+        explicit MessageWriter(JmriJsonThrottle::Message& target) : message(target), fits(true)
+        {
+            message.length = 0;
+        }
+
+        void text(std::string_view value)
+        {
+            if (!fits || message.length + value.size() > sizeof(message.data)) {
+                fits = false;
+                return;
+            }
+            memcpy(message.data + message.length, value.data(), value.size());
+            message.length += static_cast<uint16_t>(value.size());
+        }
+
+        void number(int value)
+        {
+            char digits[12];
+            auto result = std::to_chars(digits, digits + sizeof(digits), value);
+            text(std::string_view(digits, result.ptr - digits));
+        }
+
+        bool finish()
+        {
+            if (!fits) {
+                message.length = 0;
+            }
+            return fits;
+        }
+    };
+
+    // {"type":"throttle","data":{"name":"T<id>"  (the caller adds members and closes)
+    bool beginThrottle(MessageWriter& writer, char throttleId)
+    {
+        if (ThrottleTransport::throttleIndex(throttleId) < 0 && throttleId != 'T') {
+            writer.fits = false;
+            return false;
+        }
+        writer.text("{\"type\":\"throttle\",\"data\":{\"name\":\"T");
+        writer.text(std::string_view(&throttleId, 1));
+        writer.text("\"");
+        return true;
+    }
+}
+
+JmriJsonThrottle::JmriJsonThrottle(JmriJsonClient& client)
+    : m_client(client)
+    , m_throttleRouter(*this, ElementKind::THROTTLE)
+    , m_rosterRouter(*this, ElementKind::ROSTER_ENTRY)
+    , m_registered(false)
+    , m_roster(nullptr)
+    , m_rosterMutex(nullptr)
+    , m_throttleCallback(nullptr)
+    , m_functionLabelsCallback(nullptr)
+    , m_sessionCallback(nullptr)
+{
+    for (auto& address : m_slotAddress) {
+        address.store(NO_ADDRESS, std::memory_order_relaxed);
+    }
+    resetElement();
+
+    m_rosterMutex = xSemaphoreCreateMutex();
+    if (!m_rosterMutex) {
+        ESP_LOGE(TAG, "Failed to create roster mutex");
+    }
+}
+
+JmriJsonThrottle::~JmriJsonThrottle()
+{
+    if (m_registered) {
+        m_client.removeElementListener(&m_throttleRouter);
+        m_client.removeElementListener(&m_rosterRouter);
+    }
+    if (m_rosterMutex) {
+        vSemaphoreDelete(m_rosterMutex);
+        m_rosterMutex = nullptr;
+    }
+}
+
+esp_err_t JmriJsonThrottle::initialize()
+{
+    if (m_registered) {
+        return ESP_OK;
+    }
+
+    esp_err_t err = m_client.addElementListener("throttle", &m_throttleRouter);
+    if (err == ESP_OK) {
+        err = m_client.addElementListener("rosterEntry", &m_rosterRouter);
+        if (err != ESP_OK) {
+            m_client.removeElementListener(&m_throttleRouter);
+        }
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to register with the JSON client: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    m_registered = true;
+    ESP_LOGI(TAG, "JSON throttle transport initialized");
+    return ESP_OK;
+}
+
+bool JmriJsonThrottle::encodeAcquire(Message& message, char throttleId, int address, bool isLongAddress)
+{
+    // {"type":"throttle","data":{"name":"T0","address":3,"isLongAddress":false}}
+    MessageWriter writer(message);
+    if (beginThrottle(writer, throttleId)) {
+        writer.text(",\"address\":");
+        writer.number(address);
+        writer.text(isLongAddress ? ",\"isLongAddress\":true}}" : ",\"isLongAddress\":false}}");
+    }
+    return writer.finish();
+}
+
+bool JmriJsonThrottle::encodeRelease(Message& message, char throttleId)
+{
+    // {"type":"throttle","data":{"name":"T0","release":null}}
+    MessageWriter writer(message);
+    if (beginThrottle(writer, throttleId)) {
+        writer.text(",\"release\":null}}");
+    }
+    return writer.finish();
+}
+
+bool JmriJsonThrottle::encodeSpeed(Message& message, char throttleId, int speed)
+{
+    // JSON speed is a fraction of full speed: step 63 -> {"...","speed":0.500}
+    if (speed < 0) speed = 0;
+    if (speed > MAX_SPEED) speed = MAX_SPEED;
+    int thousandths = (speed * 1000 + MAX_SPEED / 2) / MAX_SPEED;
+
+    MessageWriter writer(message);
+    if (beginThrottle(writer, throttleId)) {
+        writer.text(",\"speed\":");
+        writer.text(thousandths >= 1000 ? "1." : "0.");
+        char digits[3] = { static_cast<char>('0' + (thousandths / 100) % 10),
+                           static_cast<char>('0' + (thousandths / 10) % 10),
+                           static_cast<char>('0' + thousandths % 10) };
+        writer.text(std::string_view(digits, sizeof(digits)));
+        writer.text("}}");
+    }
+    return writer.finish();
+}
+
+bool JmriJsonThrottle::encodeDirection(Message& message, char throttleId, bool forward)
+{
+    // {"type":"throttle","data":{"name":"T0","forward":true}}
+    MessageWriter writer(message);
+    if (beginThrottle(writer, throttleId)) {
+        writer.text(forward ? ",\"forward\":true}}" : ",\"forward\":false}}");
+    }
+    return writer.finish();
+}
+
+bool JmriJsonThrottle::encodeFunction(Message& message, char throttleId, int function, bool state)
+{
+    // {"type":"throttle","data":{"name":"T0","F12":true}}
+    MessageWriter writer(message);
+    if (function < 0 || function > MAX_FUNCTION) {
+        writer.fits = false;
+    } else if (beginThrottle(writer, throttleId)) {
+        writer.text(",\"F");
+        writer.number(function);
+        writer.text(state ? "\":true}}" : "\":false}}");
+    }
+    return writer.finish();
+}
+
+bool JmriJsonThrottle::encodeStatus(Message& message, char throttleId)
+{
+    // {"type":"throttle","data":{"name":"T0","status":true}}
+    MessageWriter writer(message);
+    if (beginThrottle(writer, throttleId)) {
+        writer.text(",\"status\":true}}");
+    }
+    return writer.finish();
+}
+
+esp_err_t JmriJsonThrottle::acquireLocomotive(char throttleId, int address, bool isLongAddress)
+{
+    int slot = throttleSlotIndex(throttleId);
+    if (slot < 0) {
+        ESP_LOGW(TAG, "Invalid throttle id %c", throttleId);
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!isConnected()) {
+        ESP_LOGW(TAG, "Not connected to server");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    Message message;
+    encodeAcquire(message, throttleId, address, isLongAddress);
+    esp_err_t err = send(message, true);
+    if (err == ESP_OK) {
+        m_slotAddress[slot].store(address, std::memory_order_release);
+        ESP_LOGI(TAG, "Acquiring loco %d on throttle %c", address, throttleId);
+    }
+    return err;
+}
+
+esp_err_t JmriJsonThrottle::releaseLocomotive(char throttleId)
+{
+    int slot = throttleSlotIndex(throttleId);
+    if (slot < 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (m_slotAddress[slot].exchange(NO_ADDRESS, std::memory_order_acq_rel) == NO_ADDRESS) {
+        return ESP_OK;  // Nothing acquired
+    }
+    if (!isConnected()) {
+        return ESP_ERR_INVALID_STATE;  // JMRI releases a closed session's throttles itself
+    }
+
+    Message message;
+    encodeRelease(message, throttleId);
+    ESP_LOGI(TAG, "Releasing throttle %c", throttleId);
+    return send(message, true);
+}
+
+esp_err_t JmriJsonThrottle::setSpeed(char throttleId, int speed)
+{
+    if (!isAcquired(throttleId)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    Message message;
+    return send(message, encodeSpeed(message, throttleId, speed));
+}
+
+esp_err_t JmriJsonThrottle::setDirection(char throttleId, bool forward)
+{
+    if (!isAcquired(throttleId)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    Message message;
+    return send(message, encodeDirection(message, throttleId, forward));
+}
+
+esp_err_t JmriJsonThrottle::setFunction(char throttleId, int function, bool state)
+{
+    if (!isAcquired(throttleId)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    Message message;
+    return send(message, encodeFunction(message, throttleId, function, state));
+}
+
+esp_err_t JmriJsonThrottle::querySpeed(char throttleId)
+{
+    if (!isAcquired(throttleId)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    Message message;
+    return send(message, encodeStatus(message, throttleId));
+}
+
+esp_err_t JmriJsonThrottle::queryDirection(char throttleId)
+{
+    // One status request reports speed and direction together
+    return querySpeed(throttleId);
+}
+
+esp_err_t JmriJsonThrottle::requestRoster()
+{
+    return m_client.sendMessage("{\"type\":\"roster\",\"method\":\"list\"}");
+}
+
+RosterHandle JmriJsonThrottle::getRosterSnapshot() const
+{
+    // Held only to copy the pointer, so waiting is always short; a timeout
+    // would report "no roster" to a caller while one exists
+    if (!m_rosterMutex) {
+        return nullptr;
+    }
+    xSemaphoreTake(m_rosterMutex, portMAX_DELAY);
+    RosterHandle snapshot = m_roster;
+    xSemaphoreGive(m_rosterMutex);
+    return snapshot;
+}
+
+esp_err_t JmriJsonThrottle::send(const Message& message, bool encoded)
+{
+    if (!encoded) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return m_client.sendMessage(std::string_view(message.data, message.length));
+}
+
+bool JmriJsonThrottle::isAcquired(char throttleId) const
+{
+    int slot = throttleSlotIndex(throttleId);
+    return slot >= 0 && m_slotAddress[slot].load(std::memory_order_acquire) != NO_ADDRESS;
+}
+
+int JmriJsonThrottle::throttleSlotIndex(char throttleId)
+{
+    int index = throttleIndex(throttleId);
+    if (index >= 0) {
+        return index;
+    }
+    if (throttleId == 'T') {
+        return MAX_THROTTLE_IDS;
+    }
+    return -1;
+}
+
+char JmriJsonThrottle::throttleIdFromName(std::string_view name)
+{
+    // Our throttles are named "T<id>"; anything else belongs to someone else
+    if (name.size() != 2 || name[0] != 'T' || throttleSlotIndex(name[1]) < 0) {
+        return 0;
+    }
+    return name[1];
+}
+
+void JmriJsonThrottle::ElementRouter::onElementData(const JsonTokenizer::Token& token, int depth)
+{
+    if (m_kind == ElementKind::THROTTLE) {
+        // A throttle's nested rosterEntry is not used
+        if (depth == 0) {
+            m_owner.onThrottleData(token);
+        }
+    } else {
+        m_owner.onRosterEntryData(token, depth);
+    }
+}
+
+void JmriJsonThrottle::ElementRouter::onElementEnd(bool inList, std::string_view method)
+{
+    if (m_kind == ElementKind::THROTTLE) {
+        m_owner.handleThrottleElement();
+    } else {
+        m_owner.handleRosterEntryElement(inList, method);
+    }
+    m_owner.resetElement();
+}
+
+void JmriJsonThrottle::ElementRouter::onMessageEnd(bool complete)
+{
+    if (m_kind == ElementKind::ROSTER_ENTRY) {
+        m_owner.finishRosterList(complete);
+    }
+    m_owner.resetElement();
+}
+
+void JmriJsonThrottle::ElementRouter::onSessionStart()
+{
+    if (m_kind == ElementKind::ROSTER_ENTRY) {
+        if (m_owner.requestRoster() != ESP_OK) {
+            ESP_LOGW(TAG, "Failed to request roster");
+        }
+    } else if (m_owner.m_sessionCallback) {
+        m_owner.m_sessionCallback(true);
+    }
+}
+
+void JmriJsonThrottle::ElementRouter::onSessionEnd()
+{
+    if (m_kind != ElementKind::THROTTLE) {
+        return;
+    }
+    // JMRI releases every throttle of a closed connection
+    for (auto& address : m_owner.m_slotAddress) {
+        address.store(NO_ADDRESS, std::memory_order_release);
+    }
+    if (m_owner.m_sessionCallback) {
+        m_owner.m_sessionCallback(false);
+    }
+}
+
+void JmriJsonThrottle::onThrottleData(const JsonTokenizer::Token& token)
+{
+    using TokenType = JsonTokenizer::TokenType;
+
+    if (token.type == TokenType::STRING && (token.is("name") || token.is("throttle"))) {
+        m_elementThrottleId = throttleIdFromName(token.text);
+    } else if (token.is("address")) {
+        token.getInt(m_elementAddress);
+    } else if (token.is("speed")) {
+        // Fraction of full speed; emergency stop is reported as -1
+        float speed;
+        if (token.getFloat(speed)) {
+            int step = speed <= 0.0f ? 0 : static_cast<int>(speed * MAX_SPEED + 0.5f);
+            m_elementSpeed = step > MAX_SPEED ? MAX_SPEED : step;
+        }
+    } else if (token.is("forward")) {
+        bool forward;
+        if (token.getBool(forward)) {
+            m_elementDirection = forward ? 1 : 0;
+        }
+    } else if (token.is("release")) {
+        m_elementReleased = true;
+    } else if (token.type == TokenType::BOOLEAN && token.key.size() >= 2 && token.key[0] == 'F') {
+        int function = -1;
+        auto result = std::from_chars(token.key.data() + 1, token.key.data() + token.key.size(), function);
+        bool state;
+        if (result.ec == std::errc() && result.ptr == token.key.data() + token.key.size() &&
+            function >= 0 && function <= MAX_FUNCTION && token.getBool(state)) {
+            m_elementFunctions |= 1u << function;
+            if (state) {
+                m_elementFunctionStates |= 1u << function;
+            }
+        }
+    }
+}
+
+void JmriJsonThrottle::onRosterEntryData(const JsonTokenizer::Token& token, int depth)
+{
+    using TokenType = JsonTokenizer::TokenType;
+
+    if (depth == 0) {
+        if (token.type == TokenType::STRING && token.is("name")) {
+            m_elementNameLength = token.text.size() < sizeof(m_elementName) ? token.text.size() : sizeof(m_elementName);
+            memcpy(m_elementName, token.text.data(), m_elementNameLength);
+        } else if (token.is("address")) {
+            token.getInt(m_elementAddress);  // JMRI sends the address as a string
+        } else if (token.is("isLongAddress")) {
+            bool isLong;
+            if (token.getBool(isLong)) {
+                m_elementLongAddress = isLong ? 1 : 0;
+            }
+        } else if (token.type == TokenType::ARRAY_START && token.is("functionKeys")) {
+            m_inFunctionKeys = true;
+        } else if (token.type == TokenType::ARRAY_END) {
+            m_inFunctionKeys = false;
+        }
+        return;
+    }
+
+    if (!m_inFunctionKeys) {
+        return;
+    }
+
+    // One object per function key; its label is staged when the object closes
+    if (depth == 1) {
+        if (token.type == TokenType::OBJECT_START) {
+            m_keyFunction = -1;
+            m_keyLabelLength = 0;
+        } else if (token.type == TokenType::OBJECT_END && m_keyFunction >= 0) {
+            m_rosterBuilder.setFunctionLabel(m_keyFunction, std::string_view(m_keyLabel, m_keyLabelLength));
+        }
+    } else if (depth == 2 && token.type == TokenType::STRING) {
+        if (token.is("name") && token.text.size() >= 2 && token.text[0] == 'F') {
+            int function = -1;
+            auto result = std::from_chars(token.text.data() + 1, token.text.data() + token.text.size(), function);
+            if (result.ec == std::errc() && result.ptr == token.text.data() + token.text.size() &&
+                function >= 0 && function <= MAX_FUNCTION) {
+                m_keyFunction = function;
+            }
+        } else if (token.is("label")) {
+            m_keyLabelLength = token.text.size() < sizeof(m_keyLabel) ? token.text.size() : sizeof(m_keyLabel);
+            memcpy(m_keyLabel, token.text.data(), m_keyLabelLength);
+        }
+    }
+}
+
+void JmriJsonThrottle::handleThrottleElement()
+{
+    char throttleId = m_elementThrottleId;
+    int slot = throttleSlotIndex(throttleId);
+    if (slot < 0) {
+        ESP_LOGD(TAG, "Ignoring update for a throttle that is not ours");
+        return;
+    }
+
+    if (m_elementReleased) {
+        m_slotAddress[slot].store(NO_ADDRESS, std::memory_order_release);
+        ESP_LOGI(TAG, "Throttle %c released by server", throttleId);
+        return;
+    }
+
+    if (!m_throttleCallback) {
+        return;
+    }
+
+    ThrottleUpdate update{};
+    update.throttleId = throttleId;
+    update.address = m_elementAddress >= 0 ? m_elementAddress : m_slotAddress[slot].load(std::memory_order_acquire);
+    update.function = -1;
+
+    // Speed and direction together, then one update per reported function,
+    // the same shape the WiThrottle client produces
+    update.speed = m_elementSpeed;
+    update.direction = m_elementDirection;
+    if (update.speed >= 0 || update.direction >= 0) {
+        m_throttleCallback(update);
+    }
+
+    update.speed = -1;
+    update.direction = -1;
+    for (int function = 0; function <= MAX_FUNCTION; function++) {
+        if (m_elementFunctions & (1u << function)) {
+            update.function = function;
+            update.functionState = (m_elementFunctionStates & (1u << function)) != 0;
+            m_throttleCallback(update);
+        }
+    }
+}
+
+void JmriJsonThrottle::handleRosterEntryElement(bool inList, std::string_view method)
+{
+    std::string_view name(m_elementName, m_elementNameLength);
+
+    if (!inList && method == "delete") {
+        m_rosterBuilder.discardLabels();
+        RosterHandle current = m_roster;  // Only this task replaces m_roster
+        if (!name.empty() && current && current->find(name) >= 0) {
+            publishRoster(RosterSnapshot::withoutEntry(current, name));
+            ESP_LOGI(TAG, "Roster entry removed: %.*s", static_cast<int>(name.size()), name.data());
+        }
+        return;
+    }
+
+    if (name.empty() || m_elementAddress <= 0) {
+        ESP_LOGW(TAG, "Skipping roster entry without name or address");
+        m_rosterBuilder.discardLabels();
+        return;
+    }
+
+    bool isLong = m_elementLongAddress >= 0 ? (m_elementLongAddress == 1) : (m_elementAddress > 127);
+    if (inList) {
+        m_rosterBuilder.addEntry(name, m_elementAddress, isLong ? 'L' : 'S');
+        return;
+    }
+
+    // Added or edited in JMRI: stage it as a one-entry roster, then merge
+    m_rosterBuilder.addEntry(name, m_elementAddress, isLong ? 'L' : 'S');
+    RosterHandle single = m_rosterBuilder.finish();
+    if (!single) {
+        return;
+    }
+    RosterHandle updated = RosterSnapshot::withEntry(m_roster, (*single)[0]);
+    if (!updated) {
+        return;
+    }
+    publishRoster(updated);
+    ESP_LOGI(TAG, "Roster entry updated: %.*s", static_cast<int>(name.size()), name.data());
+
+    notifyFunctionLabels((*single)[0]);
+}
+
+void JmriJsonThrottle::finishRosterList(bool complete)
+{
+    if (m_rosterBuilder.empty()) {
+        m_rosterBuilder.discardLabels();
+        return;
+    }
+    if (!complete) {
+        ESP_LOGW(TAG, "Roster list incomplete, keeping the previous roster");
+        m_rosterBuilder.clear();
+        return;
+    }
+
+    RosterHandle roster = m_rosterBuilder.finish();
+    if (!roster) {
+        return;
+    }
+    publishRoster(roster);
+    ESP_LOGI(TAG, "Roster received: %u locos (%u bytes)", (unsigned)roster->size(), (unsigned)roster->getArenaBytes());
+
+    for (size_t i = 0; i < roster->size(); i++) {
+        notifyFunctionLabels((*roster)[i]);
+    }
+}
+
+void JmriJsonThrottle::publishRoster(const RosterHandle& roster)
+{
+    // The old snapshot is released after the lock, outside the readers' wait
+    RosterHandle previous;
+    if (m_rosterMutex && xSemaphoreTake(m_rosterMutex, portMAX_DELAY) == pdTRUE) {
+        previous = std::move(m_roster);
+        m_roster = roster;
+        xSemaphoreGive(m_rosterMutex);
+    }
+}
+
+void JmriJsonThrottle::notifyFunctionLabels(const RosterSnapshot::Entry& entry)
+{
+    if (!m_functionLabelsCallback || entry.functionLabels.empty()) {
+        return;
+    }
+
+    // Refresh the labels of every throttle holding this loco
+    std::vector<std::string> labels;
+    for (int slot = 0; slot < MAX_THROTTLE_SLOTS; slot++) {
+        if (m_slotAddress[slot].load(std::memory_order_acquire) != entry.address) {
+            continue;
+        }
+        if (labels.empty()) {
+            entry.getFunctionLabels(labels);
+        }
+        m_functionLabelsCallback(slot < MAX_THROTTLE_IDS ? throttleIdChar(slot) : 'T', labels);
+    }
+}
+
+void JmriJsonThrottle::resetElement()
+{
+    m_elementThrottleId = 0;
+    m_elementAddress = -1;
+    m_elementSpeed = -1;
+    m_elementDirection = -1;
+    m_elementFunctions = 0;
+    m_elementFunctionStates = 0;
+    m_elementReleased = false;
+    m_elementLongAddress = -1;
+    m_elementNameLength = 0;
+    m_inFunctionKeys = false;
+    m_keyFunction = -1;
+    m_keyLabelLength = 0;
+}
@@ -0,0 +1,174 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "JmriJsonClient.h"
+#include "RosterSnapshot.h"
+#include "ThrottleTransport.h"
+
+/**
+ * @brief Throttle transport over the JMRI JSON WebSocket
+ *
+ * Drives locos with JMRI's JSON "throttle" type on the connection that
+ * JmriJsonClient already holds for power and layout items, so no second
+ * socket, receive task or TX queue is needed. Commands are encoded into a
+ * fixed buffer and handed to JmriJsonClient::sendMessage(), which never
+ * blocks. The server pushes every speed, direction and function change of
+ * an acquired loco, so ThrottleController does not poll this transport.
+ *
+ * The roster is requested with a "roster" list on every session start.
+ * Entries are streamed into a RosterSnapshot::Builder as they arrive, with
+ * the labels from each entry's functionKeys, and published when the list
+ * ends. A rosterEntry pushed on its own later (an edit in JMRI) is applied
+ * to the current snapshot in place of that entry; with method "delete" the
+ * entry is removed. Label changes for a loco that is acquired are passed on
+ * through the FunctionLabelsCallback.
+ *
+ * Throttle ids map to JSON throttle names "T<id>" (e.g. "T0"). Incoming
+ * "throttle" and "rosterEntry" elements are streamed in by JmriJsonClient
+ * (see JmriJsonClient::ElementListener) and handled on the WebSocket task.
+ *
+ * Protocol documentation: https://www.jmri.org/help/en/html/web/JsonServlet.shtml
+ */
+class JmriJsonThrottle : public ThrottleTransport {
+public:
+    /**
+     * @brief One encoded JSON message (not terminated)
+     */
+    struct Message {
+        uint16_t length;
+        char data[JmriJsonClient::MAX_TX_MESSAGE_LENGTH];
+    };
+
+    // Message encoders; each returns false (length 0) for an unknown throttle id
+    static bool encodeAcquire(Message& message, char throttleId, int address, bool isLongAddress);
+    static bool encodeRelease(Message& message, char throttleId);
+    static bool encodeSpeed(Message& message, char throttleId, int speed);
+    static bool encodeDirection(Message& message, char throttleId, bool forward);
+    static bool encodeFunction(Message& message, char throttleId, int function, bool state);
+    static bool encodeStatus(Message& message, char throttleId);
+
+    /**
+     * @param client JSON client that carries the messages (must outlive this object)
+     */
+    explicit JmriJsonThrottle(JmriJsonClient& client);
+    ~JmriJsonThrottle() override;
+
+    JmriJsonThrottle(const JmriJsonThrottle&) = delete;
+    JmriJsonThrottle& operator=(const JmriJsonThrottle&) = delete;
+
+    /**
+     * @brief Register with the JSON client (call before it connects)
+     * @return ESP_OK on success
+     */
+    esp_err_t initialize();
+
+    const char* getTransportName() const override { return "JMRI JSON"; }
+    bool isConnected() const override { return m_client.isConnected(); }
+
+    /**
+     * @brief JMRI pushes every change to a JSON throttle; only unconfirmed throttles are queried
+     */
+    bool pushesThrottleState() const override { return true; }
+
+    esp_err_t acquireLocomotive(char throttleId, int address, bool isLongAddress) override;
+    esp_err_t releaseLocomotive(char throttleId) override;
+    esp_err_t setSpeed(char throttleId, int speed) override;
+    esp_err_t setDirection(char throttleId, bool forward) override;
+    esp_err_t setFunction(char throttleId, int function, bool state) override;
+
+    /**
+     * @brief Ask for a full status report (speed, direction and functions)
+     */
+    esp_err_t querySpeed(char throttleId) override;
+    esp_err_t queryDirection(char throttleId) override;
+
+    void setThrottleStateCallback(ThrottleStateCallback callback) override { m_throttleCallback = callback; }
+    void setFunctionLabelsCallback(FunctionLabelsCallback callback) override { m_functionLabelsCallback = callback; }
+    void setSessionCallback(SessionCallback callback) override { m_sessionCallback = callback; }
+
+    RosterHandle getRosterSnapshot() const override;
+
+    /**
+     * @brief Request the roster list (also sent automatically on every session start)
+     * @return ESP_OK if queued
+     */
+    esp_err_t requestRoster();
+
+private:
+    enum class ElementKind : uint8_t { THROTTLE, ROSTER_ENTRY };
+
+    // Routes one JSON type's elements back to this object (WebSocket task)
+    class ElementRouter : public JmriJsonClient::ElementListener {
+    public:
+        ElementRouter(JmriJsonThrottle& owner, ElementKind kind) : m_owner(owner), m_kind(kind) {}
+        void onElementData(const JsonTokenizer::Token& token, int depth) override;
+        void onElementEnd(bool inList, std::string_view method) override;
+        void onMessageEnd(bool complete) override;
+        void onSessionStart() override;
+        void onSessionEnd() override;
+
+    private:
+        JmriJsonThrottle& m_owner;
+        ElementKind m_kind;
+    };
+
+    void onThrottleData(const JsonTokenizer::Token& token);
+    void onRosterEntryData(const JsonTokenizer::Token& token, int depth);
+    void handleThrottleElement();
+    void handleRosterEntryElement(bool inList, std::string_view method);
+    void finishRosterList(bool complete);
+    void publishRoster(const RosterHandle& roster);
+    void notifyFunctionLabels(const RosterSnapshot::Entry& entry);
+    void resetElement();
+    esp_err_t send(const Message& message, bool encoded);
+    bool isAcquired(char throttleId) const;
+
+    static int throttleSlotIndex(char throttleId);
+    static char throttleIdFromName(std::string_view name);
+
+    JmriJsonClient& m_client;
+    ElementRouter m_throttleRouter;
+    ElementRouter m_rosterRouter;
+    bool m_registered;
+
+    // DCC address acquired per throttle slot ('0'-'9', 'a'-'z', 'T'), or NO_ADDRESS.
+    // Written by acquire/release, read lock-free by the command methods.
+    static constexpr int MAX_THROTTLE_SLOTS = MAX_THROTTLE_IDS + 1;
+    static constexpr int NO_ADDRESS = -1;
+    std::atomic<int> m_slotAddress[MAX_THROTTLE_SLOTS];
+
+    // Element being received (WebSocket task only); fields not reported stay -1
+    char m_elementThrottleId;
+    int m_elementAddress;
+    int m_elementSpeed;          // 0-126, -1 if not reported
+    int m_elementDirection;      // 1 forward, 0 reverse, -1 if not reported
+    uint32_t m_elementFunctions; // Bit n: Fn reported
+    uint32_t m_elementFunctionStates;
+    bool m_elementReleased;
+    int m_elementLongAddress;    // 1 long, 0 short, -1 if not reported
+    char m_elementName[64];
+    size_t m_elementNameLength;
+
+    // Roster entry's functionKeys array: [{"name":"F0","label":"Lights",...}, ...]
+    bool m_inFunctionKeys;
+    int m_keyFunction;
+    char m_keyLabel[48];
+    size_t m_keyLabelLength;
+
+    // Roster list being received, published when the list message ends.
+    // Also stages the labels of a single pushed entry.
+    RosterSnapshot::Builder m_rosterBuilder;
+
+    RosterHandle m_roster;  // Replaced by pointer when a roster list arrives
+    mutable SemaphoreHandle_t m_rosterMutex;  // Held only to copy or swap m_roster
+
+    ThrottleStateCallback m_throttleCallback;
+    FunctionLabelsCallback m_functionLabelsCallback;
+    SessionCallback m_sessionCallback;
+};
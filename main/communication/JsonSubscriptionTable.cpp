@@ -0,0 +1,256 @@
+#include "JsonSubscriptionTable.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include <cstring>
+#include <new>
+
+static const char* TAG = "JsonSubscriptionTable";
+
+namespace {
+    const char* const TYPE_NAMES[] = { "power", "sensor", "turnout", "light", "block" };
+    static_assert(sizeof(TYPE_NAMES) / sizeof(TYPE_NAMES[0]) ==
+                  static_cast<size_t>(JsonSubscriptionTable::ItemType::COUNT), "TYPE_NAMES out of date");
+
+    constexpr size_t MAX_ITEMS = JsonSubscriptionTable::INVALID_ID;
+    constexpr size_t MAX_POOL_SIZE = UINT16_MAX;
+    constexpr size_t MAX_NAME_LENGTH = UINT8_MAX;
+
+    void* allocate(size_t bytes)
+    {
+        void* memory = heap_caps_malloc(bytes, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (!memory) {
+            memory = heap_caps_malloc(bytes, MALLOC_CAP_DEFAULT);
+        }
+        return memory;
+    }
+}
+
+JsonSubscriptionTable::JsonSubscriptionTable(size_t capacity, size_t namePoolSize)
+    : m_items(nullptr)
+    , m_capacity(capacity < MAX_ITEMS ? capacity : MAX_ITEMS)
+    , m_count(0)
+    , m_index(nullptr)
+    , m_indexMask(0)
+    , m_pool(nullptr)
+    , m_poolSize(namePoolSize < MAX_POOL_SIZE ? namePoolSize : MAX_POOL_SIZE)
+    , m_poolUsed(0)
+    , m_writeMutex(nullptr)
+{
+    // Keep the index at most half full so probes stay short
+    size_t indexSize = 1;
+    while (indexSize < m_capacity * 2) {
+        indexSize <<= 1;
+    }
+    m_indexMask = indexSize - 1;
+
+    void* items = allocate(m_capacity * sizeof(Item));
+    void* index = allocate(indexSize * sizeof(std::atomic<uint16_t>));
+    m_pool = static_cast<char*>(allocate(m_poolSize));
+    m_writeMutex = xSemaphoreCreateMutex();
+    if (!items || !index || !m_pool || !m_writeMutex) {
+        ESP_LOGE(TAG, "Failed to allocate table for %u items", (unsigned)m_capacity);
+        heap_caps_free(items);
+        heap_caps_free(index);
+        heap_caps_free(m_pool);
+        m_pool = nullptr;
+        if (m_writeMutex) {
+            vSemaphoreDelete(m_writeMutex);
+            m_writeMutex = nullptr;
+        }
+        return;
+    }
+
+    m_items = static_cast<Item*>(items);
+    for (size_t i = 0; i < m_capacity; i++) {
+        new (&m_items[i]) Item();
+    }
+    m_index = static_cast<std::atomic<uint16_t>*>(index);
+    for (size_t i = 0; i < indexSize; i++) {
+        new (&m_index[i]) std::atomic<uint16_t>(0);
+    }
+}
+
+JsonSubscriptionTable::~JsonSubscriptionTable()
+{
+    heap_caps_free(m_items);
+    heap_caps_free(m_index);
+    heap_caps_free(m_pool);
+    if (m_writeMutex) {
+        vSemaphoreDelete(m_writeMutex);
+    }
+}
+
+uint32_t JsonSubscriptionTable::hash(ItemType type, std::string_view name)
+{
+    // FNV-1a over the type and the name
+    uint32_t h = 2166136261u ^ static_cast<uint8_t>(type);
+    h *= 16777619u;
+    for (char c : name) {
+        h ^= static_cast<uint8_t>(c);
+        h *= 16777619u;
+    }
+    return h;
+}
+
+bool JsonSubscriptionTable::matches(uint16_t id, ItemType type, std::string_view name) const
+{
+    const Item& item = m_items[id];
+    return item.type == type &&
+           std::string_view(m_pool + item.systemNameOffset, item.systemNameLength) == name;
+}
+
+uint16_t JsonSubscriptionTable::find(ItemType type, std::string_view systemName) const
+{
+    if (!m_items) {
+        return INVALID_ID;
+    }
+
+    for (size_t slot = hash(type, systemName) & m_indexMask;; slot = (slot + 1) & m_indexMask) {
+        uint16_t entry = m_index[slot].load(std::memory_order_acquire);
+        if (entry == 0) {
+            return INVALID_ID;
+        }
+        if (matches(entry - 1, type, systemName)) {
+            return entry - 1;
+        }
+    }
+}
+
+bool JsonSubscriptionTable::appendName(std::string_view name, uint16_t& outOffset, uint8_t& outLength)
+{
+    if (name.size() > MAX_NAME_LENGTH || m_poolUsed + name.size() > m_poolSize) {
+        return false;
+    }
+    memcpy(m_pool + m_poolUsed, name.data(), name.size());
+    outOffset = static_cast<uint16_t>(m_poolUsed);
+    outLength = static_cast<uint8_t>(name.size());
+    m_poolUsed += name.size();
+    return true;
+}
+
+uint16_t JsonSubscriptionTable::intern(ItemType type, std::string_view systemName)
+{
+    if (!m_items || systemName.empty()) {
+        return INVALID_ID;
+    }
+
+    uint16_t id = find(type, systemName);
+    if (id != INVALID_ID) {
+        return id;
+    }
+
+    xSemaphoreTake(m_writeMutex, portMAX_DELAY);
+
+    // Another writer may have added it while we waited
+    size_t slot = hash(type, systemName) & m_indexMask;
+    for (;; slot = (slot + 1) & m_indexMask) {
+        uint16_t entry = m_index[slot].load(std::memory_order_relaxed);
+        if (entry == 0) {
+            break;
+        }
+        if (matches(entry - 1, type, systemName)) {
+            xSemaphoreGive(m_writeMutex);
+            return entry - 1;
+        }
+    }
+
+    size_t count = m_count.load(std::memory_order_relaxed);
+    uint16_t nameOffset;
+    uint8_t nameLength;
+    if (count >= m_capacity || !appendName(systemName, nameOffset, nameLength)) {
+        xSemaphoreGive(m_writeMutex);
+        ESP_LOGW(TAG, "Table full, cannot add %s '%.*s'", getTypeName(type),
+                 static_cast<int>(systemName.size()), systemName.data());
+        return INVALID_ID;
+    }
+    Item& item = m_items[count];
+    item.type = type;
+    item.systemNameOffset = nameOffset;
+    item.systemNameLength = nameLength;
+    item.userName.store(0, std::memory_order_relaxed);
+    item.state.store(NO_STATE, std::memory_order_relaxed);
+
+    id = static_cast<uint16_t>(count);
+    m_count.store(count + 1, std::memory_order_release);
+    m_index[slot].store(id + 1, std::memory_order_release);
+
+    xSemaphoreGive(m_writeMutex);
+    return id;
+}
+
+bool JsonSubscriptionTable::update(uint16_t id, int state)
+{
+    if (id >= size()) {
+        return false;
+    }
+    return m_items[id].state.exchange(static_cast<int16_t>(state), std::memory_order_relaxed) != state;
+}
+
+void JsonSubscriptionTable::setUserName(uint16_t id, std::string_view userName)
+{
+    if (id >= size() || userName.empty() || m_items[id].userName.load(std::memory_order_relaxed) != 0) {
+        return;
+    }
+
+    xSemaphoreTake(m_writeMutex, portMAX_DELAY);
+    Item& item = m_items[id];
+    uint16_t offset;
+    uint8_t length;
+    if (item.userName.load(std::memory_order_relaxed) == 0 && appendName(userName, offset, length)) {
+        // Release: a reader that sees the word also sees the copied characters
+        item.userName.store((static_cast<uint32_t>(offset) << 8) | length, std::memory_order_release);
+    }
+    xSemaphoreGive(m_writeMutex);
+}
+
+void JsonSubscriptionTable::clearStates()
+{
+    size_t count = size();
+    for (size_t i = 0; i < count; i++) {
+        m_items[i].state.store(NO_STATE, std::memory_order_relaxed);
+    }
+}
+
+JsonSubscriptionTable::ItemType JsonSubscriptionTable::getType(uint16_t id) const
+{
+    return id < size() ? m_items[id].type : ItemType::COUNT;
+}
+
+std::string_view JsonSubscriptionTable::getSystemName(uint16_t id) const
+{
+    if (id >= size()) {
+        return {};
+    }
+    return std::string_view(m_pool + m_items[id].systemNameOffset, m_items[id].systemNameLength);
+}
+
+std::string_view JsonSubscriptionTable::getUserName(uint16_t id) const
+{
+    if (id >= size()) {
+        return {};
+    }
+    uint32_t userName = m_items[id].userName.load(std::memory_order_acquire);
+    return std::string_view(m_pool + (userName >> 8), userName & 0xFF);
+}
+
+int JsonSubscriptionTable::getState(uint16_t id) const
+{
+    return id < size() ? m_items[id].state.load(std::memory_order_relaxed) : NO_STATE;
+}
+
+const char* JsonSubscriptionTable::getTypeName(ItemType type)
+{
+    size_t index = static_cast<size_t>(type);
+    return index < static_cast<size_t>(ItemType::COUNT) ? TYPE_NAMES[index] : "?";
+}
+
+bool JsonSubscriptionTable::parseType(std::string_view name, ItemType& outType)
+{
+    for (size_t i = 0; i < static_cast<size_t>(ItemType::COUNT); i++) {
+        if (name == TYPE_NAMES[i]) {
+            outType = static_cast<ItemType>(i);
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+/**
+ * @brief Interned table of JMRI JSON items (power, sensors, turnouts, ...)
+ *
+ * Each subscribed item gets a small integer id. System and user names are
+ * copied once into a fixed name pool, and an open-addressed hash index maps
+ * (type, system name) to the id, so an incoming update is resolved and
+ * applied without string-keyed maps or allocation. Everything is allocated
+ * up front (PSRAM when available).
+ *
+ * Items are never removed; intern() and setUserName() are serialised by a
+ * mutex, while find(), update() and the getters are lock-free and may run on
+ * other tasks. New entries are published through the index with release
+ * ordering, so a reader that finds an id sees its names. A user name set
+ * later is published the same way, its offset and length in one word.
+ */
+class JsonSubscriptionTable {
+public:
+    enum class ItemType : uint8_t {
+        POWER,
+        SENSOR,
+        TURNOUT,
+        LIGHT,
+        BLOCK,
+        COUNT
+    };
+
+    static constexpr uint16_t INVALID_ID = 0xFFFF;
+    static constexpr int NO_STATE = -1;  // Not reported since subscribing or reconnecting
+
+    /**
+     * @param capacity Maximum number of items
+     * @param namePoolSize Bytes available for system and user names
+     */
+    JsonSubscriptionTable(size_t capacity, size_t namePoolSize);
+    ~JsonSubscriptionTable();
+
+    JsonSubscriptionTable(const JsonSubscriptionTable&) = delete;
+    JsonSubscriptionTable& operator=(const JsonSubscriptionTable&) = delete;
+
+    /**
+     * @brief Check the table was allocated
+     */
+    bool isValid() const { return m_items != nullptr; }
+
+    /**
+     * @brief Find or add an item
+     * @return Item id, or INVALID_ID if the table or name pool is full
+     */
+    uint16_t intern(ItemType type, std::string_view systemName);
+
+    /**
+     * @brief Find an item without adding it
+     * @return Item id, or INVALID_ID if not present
+     */
+    uint16_t find(ItemType type, std::string_view systemName) const;
+
+    /**
+     * @brief Record a reported state
+     * @return true if it differs from the previous state
+     */
+    bool update(uint16_t id, int state);
+
+    /**
+     * @brief Store the user name the first time the server reports one
+     */
+    void setUserName(uint16_t id, std::string_view userName);
+
+    /**
+     * @brief Forget all states (e.g. on disconnect); names and ids are kept
+     */
+    void clearStates();
+
+    size_t size() const { return m_count.load(std::memory_order_acquire); }
+    size_t capacity() const { return m_capacity; }
+    size_t getNamePoolUsed() const { return m_poolUsed; }
+
+    ItemType getType(uint16_t id) const;
+    std::string_view getSystemName(uint16_t id) const;
+    std::string_view getUserName(uint16_t id) const;
+    int getState(uint16_t id) const;
+
+    /**
+     * @brief JSON type string for @p type (e.g. "sensor")
+     */
+    static const char* getTypeName(ItemType type);
+
+    /**
+     * @brief Map a JSON type string to an item type
+     * @return false for types the table does not track
+     */
+    static bool parseType(std::string_view name, ItemType& outType);
+
+private:
+    struct Item {
+        std::atomic<int16_t> state;
+        ItemType type;
+        uint8_t systemNameLength;
+        uint16_t systemNameOffset;
+        std::atomic<uint32_t> userName;  // Offset << 8 | length, 0 until set
+    };
+
+    static uint32_t hash(ItemType type, std::string_view name);
+    bool appendName(std::string_view name, uint16_t& outOffset, uint8_t& outLength);
+    bool matches(uint16_t id, ItemType type, std::string_view name) const;
+
+    Item* m_items;
+    size_t m_capacity;
+    std::atomic<size_t> m_count;
+
+    // Open-addressed index: id + 1, or 0 for an empty slot
+    std::atomic<uint16_t>* m_index;
+    size_t m_indexMask;
+
+    char* m_pool;
+    size_t m_poolSize;
+    size_t m_poolUsed;
+
+    SemaphoreHandle_t m_writeMutex;
+};
@@ -0,0 +1,336 @@
+#include "JsonTokenizer.h"
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+    bool isWhitespace(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+    }
+
+    int hexValue(char c)
+    {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    }
+}
+
+bool JsonTokenizer::Token::getInt(int& outValue) const
+{
+    if (type != TokenType::NUMBER && type != TokenType::STRING) {
+        return false;
+    }
+    // All of it: "12abc" or "1.5" is not an integer
+    auto result = std::from_chars(text.data(), text.data() + text.size(), outValue);
+    return result.ec == std::errc() && result.ptr == text.data() + text.size();
+}
+
+bool JsonTokenizer::Token::getFloat(float& outValue) const
+{
+    if ((type != TokenType::NUMBER && type != TokenType::STRING) || text.empty() ||
+        text.size() >= MAX_TEXT_LENGTH) {
+        return false;
+    }
+    // strtof needs a terminated string; the text buffer is not terminated
+    char buffer[MAX_TEXT_LENGTH];
+    memcpy(buffer, text.data(), text.size());
+    buffer[text.size()] = '\0';
+    char* end = nullptr;
+    float value = strtof(buffer, &end);
+    if (end != buffer + text.size()) {
+        return false;
+    }
+    outValue = value;
+    return true;
+}
+
+bool JsonTokenizer::Token::getBool(bool& outValue) const
+{
+    if (type != TokenType::BOOLEAN) {
+        return false;
+    }
+    outValue = (text == "true");
+    return true;
+}
+
+JsonTokenizer::JsonTokenizer()
+{
+    reset();
+}
+
+void JsonTokenizer::reset()
+{
+    m_state = State::VALUE;
+    m_status = Status::IN_PROGRESS;
+    m_stringIsKey = false;
+    m_depth = 0;
+    m_textLength = 0;
+    m_truncated = false;
+    m_keyLength = 0;
+    m_hasKey = false;
+    m_unicode = 0;
+    m_unicodeDigits = 0;
+    m_tokenCount = 0;
+}
+
+JsonTokenizer::Status JsonTokenizer::feed(const char* data, size_t length, Handler& handler)
+{
+    if (m_status == Status::ERROR) {
+        return m_status;
+    }
+    for (size_t i = 0; i < length; i++) {
+        if (!processChar(data[i], handler)) {
+            m_status = Status::ERROR;
+            break;
+        }
+    }
+    return m_status;
+}
+
+JsonTokenizer::Status JsonTokenizer::finish(Handler& handler)
+{
+    if (m_status != Status::IN_PROGRESS || m_depth != 0) {
+        return m_status;
+    }
+    if (m_state == State::NUMBER) {
+        emit(TokenType::NUMBER, handler);
+        finishValue();
+    } else if (m_state == State::LITERAL) {
+        if (emitLiteral(handler)) {
+            finishValue();
+        } else {
+            m_status = Status::ERROR;
+        }
+    }
+    return m_status;
+}
+
+bool JsonTokenizer::processChar(char c, Handler& handler)
+{
+    switch (m_state) {
+        case State::VALUE:
+            return isWhitespace(c) || beginValue(c, handler);
+
+        case State::VALUE_OR_END:
+            if (isWhitespace(c)) return true;
+            if (c == ']') return endContainer(true, handler);
+            return beginValue(c, handler);
+
+        case State::KEY_OR_END:
+        case State::KEY:
+            if (isWhitespace(c)) return true;
+            if (c == '}' && m_state == State::KEY_OR_END) return endContainer(false, handler);
+            if (c != '"') return false;
+            m_stringIsKey = true;
+            m_textLength = 0;
+            m_truncated = false;
+            m_state = State::STRING;
+            return true;
+
+        case State::COLON:
+            if (isWhitespace(c)) return true;
+            if (c != ':') return false;
+            m_state = State::VALUE;
+            return true;
+
+        case State::COMMA_OR_END: {
+            if (isWhitespace(c)) return true;
+            bool inArray = m_isArray[m_depth - 1];
+            if (c == ',') {
+                m_state = inArray ? State::VALUE : State::KEY;
+                return true;
+            }
+            if (c == ']' && inArray) return endContainer(true, handler);
+            if (c == '}' && !inArray) return endContainer(false, handler);
+            return false;
+        }
+
+        case State::STRING:
+            if (c == '\\') {
+                m_state = State::STRING_ESCAPE;
+            } else if (c == '"') {
+                if (m_stringIsKey) {
+                    m_keyLength = m_textLength < MAX_KEY_LENGTH ? m_textLength : MAX_KEY_LENGTH;
+                    for (size_t i = 0; i < m_keyLength; i++) {
+                        m_key[i] = m_text[i];
+                    }
+                    m_hasKey = true;
+                    m_stringIsKey = false;
+                    m_state = State::COLON;
+                } else {
+                    emit(TokenType::STRING, handler);
+                    finishValue();
+                }
+            } else {
+                appendText(c);
+            }
+            return true;
+
+        case State::STRING_ESCAPE:
+            m_state = State::STRING;
+            switch (c) {
+                case '"':  appendText('"');  return true;
+                case '\\': appendText('\\'); return true;
+                case '/':  appendText('/');  return true;
+                case 'b':  appendText('\b'); return true;
+                case 'f':  appendText('\f'); return true;
+                case 'n':  appendText('\n'); return true;
+                case 'r':  appendText('\r'); return true;
+                case 't':  appendText('\t'); return true;
+                case 'u':
+                    m_unicode = 0;
+                    m_unicodeDigits = 0;
+                    m_state = State::UNICODE;
+                    return true;
+                default:
+                    return false;
+            }
+
+        case State::UNICODE: {
+            int digit = hexValue(c);
+            if (digit < 0) return false;
+            m_unicode = (m_unicode << 4) | static_cast<uint32_t>(digit);
+            if (++m_unicodeDigits < 4) return true;
+            // Encode the code unit as UTF-8 (surrogate halves pass through as-is)
+            if (m_unicode < 0x80) {
+                appendText(static_cast<char>(m_unicode));
+            } else if (m_unicode < 0x800) {
+                appendText(static_cast<char>(0xC0 | (m_unicode >> 6)));
+                appendText(static_cast<char>(0x80 | (m_unicode & 0x3F)));
+            } else {
+                appendText(static_cast<char>(0xE0 | (m_unicode >> 12)));
+                appendText(static_cast<char>(0x80 | ((m_unicode >> 6) & 0x3F)));
+                appendText(static_cast<char>(0x80 | (m_unicode & 0x3F)));
+            }
+            m_state = State::STRING;
+            return true;
+        }
+
+        case State::NUMBER:
+            if ((c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E') {
+                appendText(c);
+                return true;
+            }
+            emit(TokenType::NUMBER, handler);
+            finishValue();
+            return processChar(c, handler);  // c belongs to what follows the number
+
+        case State::LITERAL:
+            if (c >= 'a' && c <= 'z') {
+                appendText(c);
+                return true;
+            }
+            if (!emitLiteral(handler)) return false;
+            finishValue();
+            return processChar(c, handler);
+
+        case State::DONE:
+            return isWhitespace(c);
+    }
+    return false;
+}
+
+bool JsonTokenizer::beginValue(char c, Handler& handler)
+{
+    m_textLength = 0;
+    m_truncated = false;
+
+    if (c == '{' || c == '[') {
+        if (m_depth >= MAX_DEPTH) {
+            return false;
+        }
+        bool isArray = (c == '[');
+        emit(isArray ? TokenType::ARRAY_START : TokenType::OBJECT_START, handler);
+        m_isArray[m_depth++] = isArray;
+        m_hasKey = false;
+        m_state = isArray ? State::VALUE_OR_END : State::KEY_OR_END;
+        return true;
+    }
+    if (c == '"') {
+        m_stringIsKey = false;
+        m_state = State::STRING;
+        return true;
+    }
+    if (c == '-' || (c >= '0' && c <= '9')) {
+        appendText(c);
+        m_state = State::NUMBER;
+        return true;
+    }
+    if (c == 't' || c == 'f' || c == 'n') {
+        appendText(c);
+        m_state = State::LITERAL;
+        return true;
+    }
+    return false;
+}
+
+bool JsonTokenizer::endContainer(bool isArray, Handler& handler)
+{
+    if (m_depth == 0 || m_isArray[m_depth - 1] != isArray) {
+        return false;
+    }
+    m_depth--;
+    m_hasKey = false;
+    m_textLength = 0;
+    m_truncated = false;
+    emit(isArray ? TokenType::ARRAY_END : TokenType::OBJECT_END, handler);
+    finishValue();
+    return true;
+}
+
+void JsonTokenizer::finishValue()
+{
+    m_hasKey = false;
+    if (m_depth == 0) {
+        m_state = State::DONE;
+        m_status = Status::COMPLETE;
+    } else {
+        m_state = State::COMMA_OR_END;
+    }
+}
+
+void JsonTokenizer::appendText(char c)
+{
+    if (m_textLength < MAX_TEXT_LENGTH) {
+        m_text[m_textLength++] = c;
+    } else {
+        m_truncated = true;
+    }
+}
+
+void JsonTokenizer::emit(TokenType type, Handler& handler)
+{
+    Token token;
+    token.type = type;
+    token.key = currentKey();
+    token.text = std::string_view(m_text, m_textLength);
+    token.depth = m_depth;
+    token.truncated = m_truncated;
+    m_tokenCount++;
+    handler.onToken(token);
+}
+
+bool JsonTokenizer::emitLiteral(Handler& handler)
+{
+    std::string_view text(m_text, m_textLength);
+    if (text == "true" || text == "false") {
+        emit(TokenType::BOOLEAN, handler);
+        return true;
+    }
+    if (text == "null") {
+        emit(TokenType::NULL_VALUE, handler);
+        return true;
+    }
+    return false;
+}
+
+std::string_view JsonTokenizer::currentKey() const
+{
+    if (!m_hasKey || m_depth == 0 || m_isArray[m_depth - 1]) {
+        return std::string_view();
+    }
+    return std::string_view(m_key, m_keyLength);
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+/**
+ * @brief Incremental, allocation-free JSON tokenizer (SAX style)
+ *
+ * Input is fed in arbitrary chunks as it arrives (e.g. WebSocket fragments)
+ * and every syntactic element is reported to a Handler as a Token carrying
+ * the member key it belongs to and its nesting depth, so fields can be
+ * matched by position instead of searching the text. Keys and scalar values
+ * are assembled in fixed internal buffers; values longer than
+ * MAX_TEXT_LENGTH are truncated (Token::truncated) rather than allocated.
+ *
+ * Depth counts enclosing containers: members of the top-level object are at
+ * depth 1. A container's START and END tokens carry the depth at which the
+ * container itself sits.
+ */
+class JsonTokenizer {
+public:
+    static constexpr size_t MAX_TEXT_LENGTH = 128;
+    static constexpr size_t MAX_KEY_LENGTH = 32;
+    static constexpr int MAX_DEPTH = 16;
+
+    enum class TokenType {
+        OBJECT_START,
+        OBJECT_END,
+        ARRAY_START,
+        ARRAY_END,
+        STRING,
+        NUMBER,
+        BOOLEAN,
+        NULL_VALUE
+    };
+
+    struct Token {
+        TokenType type;
+        std::string_view key;   // Member name (empty for array elements and END tokens)
+        std::string_view text;  // Unescaped string, number text, "true"/"false"/"null"
+        int depth;
+        bool truncated;
+
+        bool is(std::string_view name) const { return key == name; }
+
+        /**
+         * @brief Read a NUMBER (or numeric STRING) as an integer
+         * @return false unless the whole text is an integer in range
+         */
+        bool getInt(int& outValue) const;
+
+        /**
+         * @brief Read a NUMBER (or numeric STRING) as a float
+         */
+        bool getFloat(float& outValue) const;
+
+        /**
+         * @brief Read a BOOLEAN
+         */
+        bool getBool(bool& outValue) const;
+    };
+
+    /**
+     * @brief Receives tokens; views are only valid during the call
+     */
+    class Handler {
+    public:
+        virtual ~Handler() = default;
+        virtual void onToken(const Token& token) = 0;
+    };
+
+    enum class Status {
+        IN_PROGRESS,  // Waiting for more input
+        COMPLETE,     // One complete top-level value has been read
+        ERROR         // Malformed input; call reset() before reuse
+    };
+
+    JsonTokenizer();
+
+    /**
+     * @brief Start a new document
+     */
+    void reset();
+
+    /**
+     * @brief Tokenize the next @p length bytes of the document
+     */
+    Status feed(const char* data, size_t length, Handler& handler);
+    Status feed(std::string_view data, Handler& handler) { return feed(data.data(), data.size(), handler); }
+
+    /**
+     * @brief Mark the end of the input
+     *
+     * A top-level number or literal has no closing delimiter, so it is only
+     * emitted here; anything else unfinished stays IN_PROGRESS.
+     */
+    Status finish(Handler& handler);
+
+    Status getStatus() const { return m_status; }
+    uint32_t getTokenCount() const { return m_tokenCount; }
+
+private:
+    enum class State : uint8_t {
+        VALUE,          // Expecting a value
+        KEY_OR_END,     // After '{'
+        KEY,            // After ',' in an object
+        COLON,          // After a key
+        VALUE_OR_END,   // After '['
+        COMMA_OR_END,   // After a value inside a container
+        STRING,         // Inside a string
+        STRING_ESCAPE,  // After '\' inside a string
+        UNICODE,        // Inside \uXXXX
+        NUMBER,
+        LITERAL,        // true / false / null
+        DONE
+    };
+
+    bool processChar(char c, Handler& handler);
+    bool beginValue(char c, Handler& handler);
+    bool endContainer(bool isArray, Handler& handler);
+    void finishValue();
+    void appendText(char c);
+    void emit(TokenType type, Handler& handler);
+    bool emitLiteral(Handler& handler);
+    std::string_view currentKey() const;
+
+    State m_state;
+    Status m_status;
+    bool m_stringIsKey;
+    int m_depth;
+    bool m_isArray[MAX_DEPTH];
+
+    char m_text[MAX_TEXT_LENGTH];
+    size_t m_textLength;
+    bool m_truncated;
+
+    char m_key[MAX_KEY_LENGTH];
+    size_t m_keyLength;
+    bool m_hasKey;
+
+    uint32_t m_unicode;
+    int m_unicodeDigits;
+    uint32_t m_tokenCount;
+};
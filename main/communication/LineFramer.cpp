@@ -0,0 +1,102 @@
+#include "LineFramer.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include <cstring>
+
+static const char* TAG = "LineFramer";
+
+LineFramer::LineFramer(size_t capacity)
+    : m_buffer(nullptr)
+    , m_capacity(capacity)
+    , m_head(0)
+    , m_scan(0)
+    , m_tail(0)
+    , m_discarding(false)
+    , m_overflowCount(0)
+{
+    // Large rosters produce long `RL` lines, so prefer PSRAM for the buffer
+    m_buffer = static_cast<char*>(heap_caps_malloc(capacity, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT));
+    if (!m_buffer) {
+        m_buffer = static_cast<char*>(heap_caps_malloc(capacity, MALLOC_CAP_DEFAULT));
+    }
+    if (!m_buffer) {
+        ESP_LOGE(TAG, "Failed to allocate %u byte receive buffer", (unsigned)capacity);
+        m_capacity = 0;
+    }
+}
+
+LineFramer::~LineFramer()
+{
+    if (m_buffer) {
+        heap_caps_free(m_buffer);
+        m_buffer = nullptr;
+    }
+}
+
+char* LineFramer::writePtr()
+{
+    if (m_head == m_tail) {
+        // Everything consumed - restart at the front for free
+        m_head = m_scan = m_tail = 0;
+    } else if (m_tail == m_capacity) {
+        if (m_head > 0) {
+            // Move the partial line back to the start so it stays contiguous
+            size_t pending = m_tail - m_head;
+            memmove(m_buffer, m_buffer + m_head, pending);
+            m_scan -= m_head;
+            m_head = 0;
+            m_tail = pending;
+        } else {
+            // A single line fills the whole buffer: drop it up to the next newline
+            if (!m_discarding) {
+                ESP_LOGW(TAG, "Line exceeds %u byte buffer, discarding", (unsigned)m_capacity);
+                m_overflowCount++;
+                m_discarding = true;
+            }
+            m_head = m_scan = m_tail = 0;
+        }
+    }
+    return m_buffer + m_tail;
+}
+
+void LineFramer::commit(size_t length)
+{
+    if (length > writeSpace()) {
+        length = writeSpace();
+    }
+    m_tail += length;
+}
+
+bool LineFramer::nextLine(std::string_view& outLine)
+{
+    while (m_scan < m_tail) {
+        const char* newline = static_cast<const char*>(memchr(m_buffer + m_scan, '\n', m_tail - m_scan));
+        if (!newline) {
+            m_scan = m_tail;
+            return false;
+        }
+
+        size_t end = static_cast<size_t>(newline - m_buffer);
+        size_t start = m_head;
+        m_head = m_scan = end + 1;
+
+        if (m_discarding) {
+            // Tail end of an overlong line
+            m_discarding = false;
+            continue;
+        }
+
+        if (end > start && m_buffer[end - 1] == '\r') {
+            end--;
+        }
+        outLine = std::string_view(m_buffer + start, end - start);
+        return true;
+    }
+    return false;
+}
+
+void LineFramer::reset()
+{
+    m_head = m_scan = m_tail = 0;
+    m_discarding = false;
+}
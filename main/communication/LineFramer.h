@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+/**
+ * @brief Fixed-capacity newline framer for the WiThrottle receive path
+ *
+ * recv() writes straight into the framer's buffer and complete lines are
+ * handed out as std::string_view slices of that buffer, so framing never
+ * copies or allocates per message. The buffer is allocated once (PSRAM when
+ * available) and reused for the lifetime of the connection.
+ *
+ * The read/write indices advance through the buffer like a ring; when the
+ * write index reaches the end, the unread partial line is moved back to the
+ * start so every line stays contiguous. Lines longer than the capacity are
+ * discarded up to the next newline and counted in getOverflowCount().
+ *
+ * Returned views are only valid until the next call to writePtr()/commit().
+ */
+class LineFramer {
+public:
+    /**
+     * @param capacity Buffer size in bytes (must exceed the longest line, e.g. `RL`)
+     */
+    explicit LineFramer(size_t capacity);
+    ~LineFramer();
+
+    LineFramer(const LineFramer&) = delete;
+    LineFramer& operator=(const LineFramer&) = delete;
+
+    /**
+     * @brief Check the buffer was allocated
+     */
+    bool isValid() const { return m_buffer != nullptr; }
+
+    /**
+     * @brief Get the contiguous region recv() may write into
+     * May compact the buffer; invalidates previously returned lines.
+     */
+    char* writePtr();
+
+    /**
+     * @brief Number of bytes available at writePtr()
+     */
+    size_t writeSpace() const { return m_capacity - m_tail; }
+
+    /**
+     * @brief Mark @p length bytes written at writePtr() as received
+     */
+    void commit(size_t length);
+
+    /**
+     * @brief Extract the next complete line (without '\n' or trailing '\r')
+     * @return true if a line was produced
+     */
+    bool nextLine(std::string_view& outLine);
+
+    /**
+     * @brief Discard all buffered data (e.g. on reconnect)
+     */
+    void reset();
+
+    size_t getCapacity() const { return m_capacity; }
+    size_t getBufferedBytes() const { return m_tail - m_head; }
+    uint32_t getOverflowCount() const { return m_overflowCount; }
+
+private:
+    char* m_buffer;
+    size_t m_capacity;
+    size_t m_head;         // Start of the unread data
+    size_t m_scan;         // Next byte to search for '\n' (avoids rescanning)
+    size_t m_tail;         // End of the received data
+    bool m_discarding;     // Dropping the remainder of an overlong line
+    uint32_t m_overflowCount;
+};
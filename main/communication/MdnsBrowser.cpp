@@ -0,0 +1,413 @@
+#include "MdnsBrowser.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include <algorithm>
+#include <cstring>
+#include <strings.h>
+
+static const char* TAG = "MdnsBrowser";
+
+namespace {
+    constexpr size_t HEADER_SIZE = 12;
+    constexpr uint16_t FLAG_RESPONSE = 0x8000;
+    constexpr uint16_t TYPE_A = 1;
+    constexpr uint16_t TYPE_PTR = 12;
+    constexpr uint16_t TYPE_SRV = 33;
+    constexpr uint16_t CLASS_IN = 1;
+    constexpr uint16_t CLASS_UNICAST_RESPONSE = 0x8000;  // "QU" bit of a question's class
+    constexpr int MAX_POINTER_JUMPS = 16;
+    constexpr const char* MDNS_GROUP = "224.0.0.251";
+
+    uint16_t read16(const uint8_t* data)
+    {
+        return static_cast<uint16_t>((data[0] << 8) | data[1]);
+    }
+
+    void write16(uint8_t* data, uint16_t value)
+    {
+        data[0] = static_cast<uint8_t>(value >> 8);
+        data[1] = static_cast<uint8_t>(value & 0xFF);
+    }
+
+    // Read a (possibly compressed) name at @p offset in dotted form.
+    // @p next is set to the offset just past the name in the record.
+    bool readName(const uint8_t* packet, size_t length, size_t offset, char* out, size_t outSize, size_t* next)
+    {
+        size_t used = 0;
+        int jumps = 0;
+        bool jumped = false;
+
+        while (true) {
+            if (offset >= length) {
+                return false;
+            }
+            uint8_t labelLength = packet[offset];
+            if ((labelLength & 0xC0) == 0xC0) {
+                if (offset + 1 >= length || ++jumps > MAX_POINTER_JUMPS) {
+                    return false;
+                }
+                if (!jumped && next) {
+                    *next = offset + 2;
+                }
+                jumped = true;
+                offset = (static_cast<size_t>(labelLength & 0x3F) << 8) | packet[offset + 1];
+                continue;
+            }
+            if (labelLength & 0xC0) {
+                return false;  // Reserved label types
+            }
+            if (labelLength == 0) {
+                if (!jumped && next) {
+                    *next = offset + 1;
+                }
+                break;
+            }
+            if (offset + 1 + labelLength > length || used + labelLength + 2 > outSize) {
+                return false;
+            }
+            if (used > 0) {
+                out[used++] = '.';
+            }
+            memcpy(out + used, packet + offset + 1, labelLength);
+            used += labelLength;
+            offset += 1 + labelLength;
+        }
+
+        if (outSize == 0) {
+            return false;
+        }
+        out[used] = '\0';
+        return true;
+    }
+
+    struct Record {
+        char name[MdnsBrowser::MAX_NAME_LENGTH + 1];
+        uint16_t type;
+        size_t dataOffset;
+        uint16_t dataLength;
+    };
+
+    // Walks the answer, authority and additional records of a response
+    class RecordReader {
+    public:
+        RecordReader(const uint8_t* packet, size_t length)
+            : m_packet(packet), m_length(length), m_offset(HEADER_SIZE), m_remaining(0)
+        {
+            if (length < HEADER_SIZE || !(read16(packet + 2) & FLAG_RESPONSE)) {
+                return;
+            }
+            int questions = read16(packet + 4);
+            m_remaining = read16(packet + 6) + read16(packet + 8) + read16(packet + 10);
+
+            char name[MdnsBrowser::MAX_NAME_LENGTH + 1];
+            for (int i = 0; i < questions; i++) {
+                size_t next = 0;
+                if (!readName(packet, length, m_offset, name, sizeof(name), &next) || next + 4 > length) {
+                    m_remaining = 0;
+                    return;
+                }
+                m_offset = next + 4;
+            }
+        }
+
+        bool next(Record& out)
+        {
+            while (m_remaining > 0) {
+                m_remaining--;
+                size_t next = 0;
+                if (!readName(m_packet, m_length, m_offset, out.name, sizeof(out.name), &next) ||
+                    next + 10 > m_length) {
+                    m_remaining = 0;
+                    return false;
+                }
+                out.type = read16(m_packet + next);
+                out.dataLength = read16(m_packet + next + 8);
+                out.dataOffset = next + 10;
+                m_offset = out.dataOffset + out.dataLength;
+                if (m_offset > m_length) {
+                    m_remaining = 0;
+                    return false;
+                }
+                if ((read16(m_packet + next + 2) & ~CLASS_UNICAST_RESPONSE) == CLASS_IN) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+    private:
+        const uint8_t* m_packet;
+        size_t m_length;
+        size_t m_offset;
+        int m_remaining;
+    };
+}
+
+MdnsBrowser::MdnsBrowser(const char* service)
+    : m_service(service)
+    , m_callback(nullptr)
+    , m_timeoutMs(CONFIG_JMRI_MDNS_TIMEOUT_MS)
+    , m_stats{}
+    , m_statsMutex(nullptr)
+    , m_browsing(false)
+    , m_running(false)
+{
+    memset(&m_responder, 0, sizeof(m_responder));
+    m_responder.sin_family = AF_INET;
+    m_responder.sin_port = htons(MDNS_PORT);
+    inet_aton(MDNS_GROUP, &m_responder.sin_addr);
+
+    m_statsMutex = xSemaphoreCreateMutex();
+    if (!m_statsMutex) {
+        ESP_LOGE(TAG, "Failed to create mDNS stats mutex");
+    }
+}
+
+MdnsBrowser::~MdnsBrowser()
+{
+    stop();
+    if (m_statsMutex) {
+        vSemaphoreDelete(m_statsMutex);
+        m_statsMutex = nullptr;
+    }
+}
+
+esp_err_t MdnsBrowser::start(ResultCallback callback, uint32_t timeoutMs)
+{
+    bool expected = false;
+    if (!m_browsing.compare_exchange_strong(expected, true)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    m_callback = callback;
+    m_timeoutMs = timeoutMs;
+    m_running = true;
+
+    if (xTaskCreate(browseTask, "mdns_browse", 3072, this, 4, nullptr) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create browse task");
+        m_running = false;
+        m_browsing = false;
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+void MdnsBrowser::stop()
+{
+    m_running = false;
+    for (int waitedMs = 0; waitedMs < TASK_EXIT_TIMEOUT_MS && m_browsing; waitedMs += 10) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    if (m_browsing) {
+        ESP_LOGW(TAG, "Browse task did not stop");
+    }
+}
+
+MdnsBrowser::Stats MdnsBrowser::getStats() const
+{
+    Stats stats{};
+    if (m_statsMutex) {
+        xSemaphoreTake(m_statsMutex, portMAX_DELAY);
+        stats = m_stats;
+        xSemaphoreGive(m_statsMutex);
+    }
+    return stats;
+}
+
+#if CONFIG_THROTTLE_TESTS
+void MdnsBrowser::testSetResponder(const struct in_addr& address, uint16_t port)
+{
+    m_responder.sin_addr = address;
+    m_responder.sin_port = htons(port);
+}
+#endif
+
+size_t MdnsBrowser::encodeQuery(uint8_t* buffer, size_t size, const char* service, uint16_t id)
+{
+    if (!service || size < HEADER_SIZE) {
+        return 0;
+    }
+
+    memset(buffer, 0, HEADER_SIZE);
+    write16(buffer, id);
+    write16(buffer + 4, 1);  // One question
+    size_t used = HEADER_SIZE;
+
+    // Dotted name to length-prefixed labels
+    const char* label = service;
+    while (*label) {
+        const char* dot = strchr(label, '.');
+        size_t labelLength = dot ? static_cast<size_t>(dot - label) : strlen(label);
+        if (labelLength == 0 || labelLength > 63 || used + 1 + labelLength >= size) {
+            return 0;
+        }
+        buffer[used++] = static_cast<uint8_t>(labelLength);
+        memcpy(buffer + used, label, labelLength);
+        used += labelLength;
+        label += labelLength + (dot ? 1 : 0);
+    }
+
+    if (used + 5 > size) {
+        return 0;
+    }
+    buffer[used++] = 0;
+    write16(buffer + used, TYPE_PTR);
+    write16(buffer + used + 2, CLASS_IN | CLASS_UNICAST_RESPONSE);
+    return used + 4;
+}
+
+bool MdnsBrowser::parseResponse(const uint8_t* packet, size_t length, const char* service, Result& outResult)
+{
+    memset(&outResult, 0, sizeof(outResult));
+    Record record;
+
+    // The PTR record names the service instance...
+    RecordReader pointers(packet, length);
+    while (outResult.instance[0] == '\0' && pointers.next(record)) {
+        if (record.type == TYPE_PTR && strcasecmp(record.name, service) == 0) {
+            if (!readName(packet, length, record.dataOffset, outResult.instance, sizeof(outResult.instance), nullptr)) {
+                outResult.instance[0] = '\0';
+            }
+        }
+    }
+    if (outResult.instance[0] == '\0') {
+        return false;
+    }
+
+    // ...its SRV record the port and host...
+    RecordReader services(packet, length);
+    while (outResult.port == 0 && services.next(record)) {
+        if (record.type == TYPE_SRV && record.dataLength > 6 && strcasecmp(record.name, outResult.instance) == 0) {
+            outResult.port = read16(packet + record.dataOffset + 4);
+            if (!readName(packet, length, record.dataOffset + 6, outResult.host, sizeof(outResult.host), nullptr)) {
+                outResult.host[0] = '\0';
+            }
+        }
+    }
+    if (outResult.port == 0) {
+        return false;
+    }
+
+    // ...and the host's A record the address, if the responder included it
+    RecordReader addresses(packet, length);
+    while (outResult.host[0] != '\0' && addresses.next(record)) {
+        if (record.type == TYPE_A && record.dataLength == 4 && strcasecmp(record.name, outResult.host) == 0) {
+            memcpy(&outResult.address.s_addr, packet + record.dataOffset, 4);
+            break;
+        }
+    }
+    return true;
+}
+
+void MdnsBrowser::browseTask(void* arg)
+{
+    MdnsBrowser* browser = static_cast<MdnsBrowser*>(arg);
+    browser->browse();
+    browser->m_browsing = false;
+    vTaskDelete(nullptr);
+}
+
+void MdnsBrowser::browse()
+{
+    int64_t startUs = esp_timer_get_time();
+    if (m_statsMutex) {
+        xSemaphoreTake(m_statsMutex, portMAX_DELAY);
+        m_stats.browses++;
+        xSemaphoreGive(m_statsMutex);
+    }
+
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock < 0) {
+        ESP_LOGE(TAG, "Failed to create socket: %d", errno);
+        return;
+    }
+    // Link-local multicast must reach the whole segment
+    uint8_t multicastTtl = 255;
+    setsockopt(sock, IPPROTO_IP, IP_MULTICAST_TTL, &multicastTtl, sizeof(multicastTtl));
+
+    uint16_t queryId = static_cast<uint16_t>(startUs) | 1;
+    uint8_t query[64];
+    size_t queryLength = encodeQuery(query, sizeof(query), m_service, queryId);
+    if (queryLength == 0) {
+        ESP_LOGE(TAG, "Cannot encode a query for %s", m_service);
+        close(sock);
+        return;
+    }
+
+    ESP_LOGI(TAG, "Browsing for %s", m_service);
+    int64_t deadline = startUs + static_cast<int64_t>(m_timeoutMs) * 1000;
+    int64_t nextQueryUs = startUs;
+    bool found = false;
+
+    while (m_running && !found) {
+        int64_t now = esp_timer_get_time();
+        if (now >= deadline) {
+            break;
+        }
+        if (now >= nextQueryUs) {
+            if (sendto(sock, query, queryLength, 0, (struct sockaddr*)&m_responder, sizeof(m_responder)) < 0) {
+                ESP_LOGW(TAG, "Query send failed: %d", errno);
+            } else if (m_statsMutex) {
+                xSemaphoreTake(m_statsMutex, portMAX_DELAY);
+                m_stats.queries++;
+                xSemaphoreGive(m_statsMutex);
+            }
+            nextQueryUs = now + static_cast<int64_t>(QUERY_INTERVAL_MS) * 1000;
+        }
+
+        int64_t waitUs = std::min(std::min(deadline, nextQueryUs) - now, RECEIVE_POLL_US);
+        if (waitUs < 0) waitUs = 0;
+        fd_set readSet;
+        FD_ZERO(&readSet);
+        FD_SET(sock, &readSet);
+        struct timeval timeout;
+        timeout.tv_sec = static_cast<long>(waitUs / 1000000);
+        timeout.tv_usec = static_cast<long>(waitUs % 1000000);
+        if (select(sock + 1, &readSet, nullptr, nullptr, &timeout) <= 0) {
+            continue;
+        }
+
+        struct sockaddr_in source;
+        socklen_t sourceLength = sizeof(source);
+        int len = recvfrom(sock, m_packet, sizeof(m_packet), 0, (struct sockaddr*)&source, &sourceLength);
+        if (len <= 0) {
+            continue;
+        }
+        // Multicast answers carry id 0; legacy unicast answers echo ours
+        uint16_t id = static_cast<uint16_t>(len >= 2 ? read16(m_packet) : 0);
+        Result result;
+        if ((id != 0 && id != queryId) || !parseResponse(m_packet, static_cast<size_t>(len), m_service, result)) {
+            continue;
+        }
+        if (result.address.s_addr == 0) {
+            result.address = source.sin_addr;  // JMRI serves from the host that answers
+        }
+
+        found = true;
+        uint32_t elapsedUs = static_cast<uint32_t>(esp_timer_get_time() - startUs);
+        if (m_statsMutex) {
+            xSemaphoreTake(m_statsMutex, portMAX_DELAY);
+            m_stats.found++;
+            m_stats.lastFoundUs = elapsedUs;
+            xSemaphoreGive(m_statsMutex);
+        }
+
+        char addressText[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &result.address, addressText, sizeof(addressText));
+        ESP_LOGI(TAG, "Found %s at %s:%u (%s) in %lu ms", result.instance, addressText,
+                 (unsigned)result.port, result.host, (unsigned long)(elapsedUs / 1000));
+        if (m_callback && m_running) {
+            m_callback(result);
+        }
+    }
+
+    close(sock);
+    if (!found && m_running) {
+        ESP_LOGW(TAG, "No %s responder within %lu ms", m_service, (unsigned long)m_timeoutMs);
+        if (m_statsMutex) {
+            xSemaphoreTake(m_statsMutex, portMAX_DELAY);
+            m_stats.timeouts++;
+            xSemaphoreGive(m_statsMutex);
+        }
+    }
+}
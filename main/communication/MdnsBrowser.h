@@ -0,0 +1,122 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include "esp_err.h"
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "lwip/sockets.h"
+
+/**
+ * @brief One-shot mDNS (Zeroconf) browser for a JMRI service
+ *
+ * JMRI advertises its WiThrottle server as "_withrottle._tcp.local". A
+ * browse sends a PTR query for the service and takes the first responder
+ * whose answer names a port: the SRV record gives the port and host name,
+ * the A record (or failing that the responder's own address) the IPv4
+ * address.
+ *
+ * Queries go out from an ephemeral port, so responders answer by unicast
+ * ("legacy unicast", RFC 6762 section 6.7). Nothing binds port 5353 or
+ * joins the multicast group, so the browser does not get in the way of
+ * another mDNS stack.
+ *
+ * start() never blocks: the browse runs on its own short-lived task, which
+ * resends the query every QUERY_INTERVAL_MS until a responder answers or
+ * the timeout expires. The callback runs on that task.
+ */
+class MdnsBrowser {
+public:
+    static constexpr const char* WITHROTTLE_SERVICE = "_withrottle._tcp.local";
+    static constexpr size_t MAX_NAME_LENGTH = 127;
+    static constexpr size_t MAX_PACKET_SIZE = 1500;
+    static constexpr uint16_t MDNS_PORT = 5353;
+
+    struct Result {
+        struct in_addr address;              // Server IPv4 address
+        uint16_t port;                       // Service port from the SRV record
+        char instance[MAX_NAME_LENGTH + 1];  // Service instance (e.g. "JMRI on layout-pc._withrottle._tcp.local")
+        char host[MAX_NAME_LENGTH + 1];      // SRV target host (e.g. "layout-pc.local")
+    };
+
+    struct Stats {
+        uint32_t browses;      // Browses started
+        uint32_t queries;      // Query packets sent (including resends)
+        uint32_t found;        // Browses answered by a responder
+        uint32_t timeouts;     // Browses that found nothing
+        uint32_t lastFoundUs;  // Time from start() to the first responder
+    };
+
+    /**
+     * @brief Called once per browse with the first responder's answer
+     */
+    using ResultCallback = std::function<void(const Result& result)>;
+
+    /**
+     * @param service Service to browse for (dotted, without trailing dot)
+     */
+    explicit MdnsBrowser(const char* service = WITHROTTLE_SERVICE);
+    ~MdnsBrowser();
+
+    MdnsBrowser(const MdnsBrowser&) = delete;
+    MdnsBrowser& operator=(const MdnsBrowser&) = delete;
+
+    /**
+     * @brief Start a browse in the background
+     * @param timeoutMs Give up after this long without an answer
+     * @return ESP_OK if started, ESP_ERR_INVALID_STATE if a browse is running
+     */
+    esp_err_t start(ResultCallback callback, uint32_t timeoutMs = CONFIG_JMRI_MDNS_TIMEOUT_MS);
+
+    /**
+     * @brief Cancel a running browse and wait for its task to finish
+     */
+    void stop();
+
+    bool isBrowsing() const { return m_browsing; }
+
+    Stats getStats() const;
+
+    /**
+     * @brief Encode a PTR query for @p service with the unicast-response bit set
+     * @return Packet length, or 0 if @p buffer is too small or the name invalid
+     */
+    static size_t encodeQuery(uint8_t* buffer, size_t size, const char* service, uint16_t id);
+
+    /**
+     * @brief Extract the service's port, host and address from a response
+     * @return false if the packet does not answer for @p service with a port;
+     *         address is 0 if the packet carried no A record for the host
+     */
+    static bool parseResponse(const uint8_t* packet, size_t length, const char* service, Result& outResult);
+
+#if CONFIG_THROTTLE_TESTS
+    /**
+     * @brief Test-only hook to send queries to a stand-in responder instead of the multicast group
+     */
+    void testSetResponder(const struct in_addr& address, uint16_t port);
+#endif
+
+private:
+    static constexpr uint32_t QUERY_INTERVAL_MS = 1000;
+    static constexpr int64_t RECEIVE_POLL_US = 100000;  // stop() is noticed within this
+    static constexpr int TASK_EXIT_TIMEOUT_MS = 300;
+
+    void browse();
+    static void browseTask(void* arg);
+
+    const char* m_service;
+    struct sockaddr_in m_responder;  // 224.0.0.251:5353 unless a test overrides it
+    ResultCallback m_callback;
+    uint32_t m_timeoutMs;
+    uint8_t m_packet[MAX_PACKET_SIZE];
+
+    Stats m_stats;
+    mutable SemaphoreHandle_t m_statsMutex;
+    std::atomic<bool> m_browsing;
+    std::atomic<bool> m_running;
+};
@@ -0,0 +1,346 @@
+#include "RosterSnapshot.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include <charconv>
+#include <cstring>
+
+static const char* TAG = "RosterSnapshot";
+
+namespace {
+    // Shortest possible entry: \[ + }|{ + one digit + }|{ + type
+    constexpr size_t MIN_ENTRY_BYTES = 10;
+
+    bool isFieldDelimiter(std::string_view message, size_t pos)
+    {
+        return pos + 2 < message.length() &&
+               message[pos] == '}' && message[pos + 1] == '|' && message[pos + 2] == '{';
+    }
+
+    void* allocateArena(size_t bytes)
+    {
+        size_t allocBytes = bytes > 0 ? bytes : 1;  // An empty roster still gets a valid snapshot
+        void* arena = heap_caps_malloc(allocBytes, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (!arena) {
+            arena = heap_caps_malloc(allocBytes, MALLOC_CAP_DEFAULT);
+        }
+        if (!arena) {
+            ESP_LOGE(TAG, "Failed to allocate %u byte roster arena", (unsigned)bytes);
+        }
+        return arena;
+    }
+}
+
+RosterSnapshot::RosterSnapshot(void* arena, size_t arenaBytes, size_t capacity)
+    : m_arena(arena)
+    , m_arenaBytes(arenaBytes)
+    , m_records(static_cast<Record*>(arena))
+    , m_names(static_cast<char*>(arena) + capacity * sizeof(Record))
+    , m_count(0)
+{
+}
+
+RosterSnapshot::~RosterSnapshot()
+{
+    if (m_arena) {
+        heap_caps_free(m_arena);
+        m_arena = nullptr;
+    }
+}
+
+RosterSnapshot::Entry RosterSnapshot::operator[](size_t index) const
+{
+    const Record& record = m_records[index];
+    return Entry{ std::string_view(m_names + record.nameOffset, record.nameLength),
+                  record.address, record.addressType,
+                  std::string_view(m_names + record.labelsOffset, record.labelsLength) };
+}
+
+RosterHandle RosterSnapshot::parse(std::string_view message)
+{
+    // Roster format: RL<count>]\[<name1>}|{<addr1>}|{<type1>]\[<name2>}|{<addr2>}|{<type2>...
+    // Delimiters: ]\[ separates entries, }|{ separates fields
+    if (message.length() < 3 || message.substr(0, 2) != "RL") {
+        ESP_LOGW(TAG, "Invalid roster message format");
+        return nullptr;
+    }
+
+    size_t pos = 2;
+    int count = 0;
+    auto countResult = std::from_chars(message.data() + pos, message.data() + message.length(), count);
+    pos = countResult.ptr - message.data();
+    if (pos >= message.length() || message[pos] != ']' || count < 0) {
+        ESP_LOGW(TAG, "No count delimiter found");
+        return nullptr;
+    }
+    pos++;
+
+    // Size the arena once: names are substrings of the message, and the
+    // message cannot hold more entries than its length allows
+    size_t capacity = static_cast<size_t>(count);
+    size_t maxEntries = message.length() / MIN_ENTRY_BYTES;
+    if (capacity > maxEntries) {
+        capacity = maxEntries;
+    }
+    size_t arenaBytes = capacity * sizeof(Record) + (message.length() - pos);
+
+    void* arena = allocateArena(arenaBytes);
+    if (!arena) {
+        return nullptr;
+    }
+    std::shared_ptr<RosterSnapshot> handle(new RosterSnapshot(arena, arenaBytes, capacity));
+    RosterSnapshot& snapshot = *handle;
+
+    uint32_t nameBytes = 0;
+    while (snapshot.m_count < capacity) {
+        // Each entry starts with \[ (the ] was consumed with the previous field)
+        if (pos + 1 >= message.length() || message[pos] != '\\' || message[pos + 1] != '[') {
+            ESP_LOGW(TAG, "Expected \\[ at position %u", (unsigned)pos);
+            break;
+        }
+        pos += 2;
+
+        // Name: copied straight into the arena while scanning for }|{
+        Record& record = snapshot.m_records[snapshot.m_count];
+        record.nameOffset = nameBytes;
+        while (pos < message.length() && !isFieldDelimiter(message, pos)) {
+            snapshot.m_names[nameBytes++] = message[pos++];
+        }
+        if (pos >= message.length()) {
+            ESP_LOGW(TAG, "No name delimiter in entry %u", (unsigned)snapshot.m_count);
+            break;
+        }
+        record.nameLength = static_cast<uint16_t>(nameBytes - record.nameOffset);
+        pos += 3;
+
+        // Address
+        int address = 0;
+        auto addressResult = std::from_chars(message.data() + pos, message.data() + message.length(), address);
+        pos = addressResult.ptr - message.data();
+        while (pos < message.length() && !isFieldDelimiter(message, pos)) {
+            pos++;
+        }
+        if (pos >= message.length()) {
+            ESP_LOGW(TAG, "No address delimiter in entry %u", (unsigned)snapshot.m_count);
+            break;
+        }
+        record.address = static_cast<uint16_t>(address);
+        record.labelsOffset = 0;  // WiThrottle sends labels only after acquire
+        record.labelsLength = 0;
+        pos += 3;
+
+        // Address type (S or L), then the ] that ends this entry
+        record.addressType = 'S';
+        if (pos < message.length()) {
+            record.addressType = message[pos++];
+        }
+        if (pos < message.length() && message[pos] == ']') {
+            pos++;
+        }
+
+        snapshot.m_count++;
+    }
+
+    if (snapshot.m_count != static_cast<size_t>(count)) {
+        ESP_LOGW(TAG, "Roster announced %d entries, parsed %u", count, (unsigned)snapshot.m_count);
+    }
+    return handle;
+}
+
+RosterHandle RosterSnapshot::withEntry(const RosterHandle& base, const Entry& entry)
+{
+    Builder builder;
+    size_t baseCount = base ? base->size() : 0;
+    builder.reserve(baseCount + 1, (base ? base->getArenaBytes() : 0) +
+                                   entry.name.size() + entry.functionLabels.size());
+
+    bool replaced = false;
+    for (size_t i = 0; i < baseCount; i++) {
+        Entry existing = (*base)[i];
+        if (!replaced && existing.name == entry.name) {
+            builder.addEntry(entry);
+            replaced = true;
+        } else {
+            builder.addEntry(existing);
+        }
+    }
+    if (!replaced) {
+        builder.addEntry(entry);
+    }
+    return builder.finish();
+}
+
+RosterHandle RosterSnapshot::withoutEntry(const RosterHandle& base, std::string_view name)
+{
+    int index = base ? base->find(name) : -1;
+    if (index < 0) {
+        return base;
+    }
+
+    Builder builder;
+    builder.reserve(base->size() - 1, base->getArenaBytes());
+    for (size_t i = 0; i < base->size(); i++) {
+        if (i != static_cast<size_t>(index)) {
+            builder.addEntry((*base)[i]);
+        }
+    }
+    return builder.finish();
+}
+
+int RosterSnapshot::find(std::string_view name) const
+{
+    for (size_t i = 0; i < m_count; i++) {
+        const Record& record = m_records[i];
+        if (std::string_view(m_names + record.nameOffset, record.nameLength) == name) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+std::string_view RosterSnapshot::Entry::functionLabel(int function) const
+{
+    if (function < 0) {
+        return std::string_view();
+    }
+    size_t start = 0;
+    for (int i = 0; i < function; i++) {
+        size_t end = functionLabels.find('\n', start);
+        if (end == std::string_view::npos) {
+            return std::string_view();
+        }
+        start = end + 1;
+    }
+    size_t end = functionLabels.find('\n', start);
+    return functionLabels.substr(start, end == std::string_view::npos ? std::string_view::npos : end - start);
+}
+
+void RosterSnapshot::Entry::getFunctionLabels(std::vector<std::string>& outLabels) const
+{
+    outLabels.assign(MAX_FUNCTION_LABELS, std::string());
+    size_t start = 0;
+    for (int function = 0; function < MAX_FUNCTION_LABELS && start < functionLabels.size(); function++) {
+        size_t end = functionLabels.find('\n', start);
+        if (end == std::string_view::npos) {
+            end = functionLabels.size();
+        }
+        outLabels[function].assign(functionLabels.data() + start, end - start);
+        start = end + 1;
+    }
+}
+
+RosterSnapshot::Builder::Builder()
+    : m_labelOffset{}
+    , m_labelLength{}
+    , m_labelCount(0)
+{
+}
+
+void RosterSnapshot::Builder::reserve(size_t entries, size_t textBytes)
+{
+    m_records.reserve(entries);
+    m_text.reserve(textBytes);
+}
+
+void RosterSnapshot::Builder::setFunctionLabel(int function, std::string_view label)
+{
+    if (function < 0 || function >= MAX_FUNCTION_LABELS) {
+        return;
+    }
+    if (label.size() > UINT16_MAX - m_labelText.size()) {
+        label = label.substr(0, UINT16_MAX - m_labelText.size());
+    }
+    m_labelOffset[function] = static_cast<uint16_t>(m_labelText.size());
+    m_labelLength[function] = static_cast<uint16_t>(label.size());
+    m_labelText.append(label.data(), label.size());
+    if (function >= m_labelCount) {
+        m_labelCount = function + 1;
+    }
+}
+
+void RosterSnapshot::Builder::discardLabels()
+{
+    for (int function = 0; function < m_labelCount; function++) {
+        m_labelLength[function] = 0;
+    }
+    m_labelCount = 0;
+    m_labelText.clear();
+}
+
+void RosterSnapshot::Builder::appendText(std::string_view text, uint32_t& outOffset, uint16_t& outLength)
+{
+    outOffset = static_cast<uint32_t>(m_text.size());
+    outLength = static_cast<uint16_t>(text.size() < UINT16_MAX ? text.size() : UINT16_MAX);
+    m_text.append(text.data(), outLength);
+}
+
+void RosterSnapshot::Builder::addEntry(std::string_view name, int address, char addressType)
+{
+    Record record{};
+    appendText(name, record.nameOffset, record.nameLength);
+    record.address = static_cast<uint16_t>(address);
+    record.addressType = addressType;
+
+    // Labels are packed as F0\nF1\n...; newlines inside a label become spaces
+    record.labelsOffset = static_cast<uint32_t>(m_text.size());
+    for (int function = 0; function < m_labelCount; function++) {
+        if (function > 0) {
+            m_text.push_back('\n');
+        }
+        size_t begin = m_text.size();
+        m_text.append(m_labelText, m_labelOffset[function], m_labelLength[function]);
+        for (size_t i = begin; i < m_text.size(); i++) {
+            if (m_text[i] == '\n') {
+                m_text[i] = ' ';
+            }
+        }
+    }
+    size_t labelsLength = m_text.size() - record.labelsOffset;
+    record.labelsLength = static_cast<uint16_t>(labelsLength < UINT16_MAX ? labelsLength : UINT16_MAX);
+
+    m_records.push_back(record);
+    discardLabels();
+}
+
+void RosterSnapshot::Builder::addEntry(const Entry& entry)
+{
+    discardLabels();
+
+    Record record{};
+    appendText(entry.name, record.nameOffset, record.nameLength);
+    record.address = static_cast<uint16_t>(entry.address);
+    record.addressType = entry.addressType;
+    appendText(entry.functionLabels, record.labelsOffset, record.labelsLength);
+    m_records.push_back(record);
+}
+
+RosterHandle RosterSnapshot::Builder::finish()
+{
+    size_t count = m_records.size();
+    size_t arenaBytes = count * sizeof(Record) + m_text.size();
+
+    RosterHandle result;
+    void* arena = allocateArena(arenaBytes);
+    if (arena) {
+        std::shared_ptr<RosterSnapshot> handle(new RosterSnapshot(arena, arenaBytes, count));
+        if (count > 0) {
+            memcpy(handle->m_records, m_records.data(), count * sizeof(Record));
+        }
+        if (!m_text.empty()) {
+            memcpy(handle->m_names, m_text.data(), m_text.size());
+        }
+        handle->m_count = count;
+        result = handle;
+    }
+
+    clear();
+    return result;
+}
+
+void RosterSnapshot::Builder::clear()
+{
+    // Give the staging memory back; a roster list is only received now and then
+    std::vector<Record>().swap(m_records);
+    std::string().swap(m_text);
+    discardLabels();
+    std::string().swap(m_labelText);
+}
@@ -0,0 +1,179 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class RosterSnapshot;
+
+/**
+ * @brief Shared, immutable handle to a parsed roster
+ */
+using RosterHandle = std::shared_ptr<const RosterSnapshot>;
+
+/**
+ * @brief Immutable roster parsed from one WiThrottle `RL` message or JSON roster list
+ *
+ * parse() walks the message once and writes every entry into a single arena
+ * (PSRAM when available): a fixed-size record per entry followed by all the
+ * names packed back to back. Nothing is allocated per entry, and the arena is
+ * never modified after parsing, so any number of readers can share one
+ * snapshot through a RosterHandle without locking or copying. A new `RL`
+ * message produces a new snapshot that is swapped in by pointer; the old one
+ * is freed when its last reader lets go.
+ *
+ * JSON roster entries are streamed into a Builder one at a time, together
+ * with their function labels. withEntry() / withoutEntry() apply a single
+ * add, update or removal by copying the arena once, so an edit in JMRI does
+ * not need the whole roster to be fetched again.
+ */
+class RosterSnapshot {
+    struct Record;  // Fixed-size arena record, defined below
+
+public:
+    /**
+     * @brief View of one roster entry (name points into the arena)
+     */
+    struct Entry {
+        std::string_view name;
+        int address;
+        char addressType;  // 'S' = short, 'L' = long
+        std::string_view functionLabels;  // F0, F1, ... labels separated by '\n'; empty if not known
+
+        /**
+         * @brief Label of function @p function (empty if not known)
+         */
+        std::string_view functionLabel(int function) const;
+
+        /**
+         * @brief Unpack the labels the way WiThrottle reports them (index = function number)
+         */
+        void getFunctionLabels(std::vector<std::string>& outLabels) const;
+    };
+
+    static constexpr int MAX_FUNCTION_LABELS = 29;  // F0-F28
+
+    /**
+     * @brief Collects entries one at a time, then packs them into one snapshot
+     *
+     * Staging buffers are reused from entry to entry, so streaming a roster
+     * list costs no allocation per entry once they have grown.
+     */
+    class Builder {
+    public:
+        Builder();
+
+        /**
+         * @brief Pre-size staging for @p entries entries and @p textBytes of names and labels
+         */
+        void reserve(size_t entries, size_t textBytes);
+
+        /**
+         * @brief Stage a function label for the next addEntry() call
+         */
+        void setFunctionLabel(int function, std::string_view label);
+
+        /**
+         * @brief Drop labels staged for an entry that will not be added
+         */
+        void discardLabels();
+
+        /**
+         * @brief Add an entry with the labels staged since the last entry
+         */
+        void addEntry(std::string_view name, int address, char addressType);
+
+        /**
+         * @brief Add a copy of an entry from another snapshot (staged labels are dropped)
+         */
+        void addEntry(const Entry& entry);
+
+        size_t size() const { return m_records.size(); }
+        bool empty() const { return m_records.empty(); }
+
+        /**
+         * @brief Pack everything added into a snapshot and release the staging buffers
+         * @return Snapshot, or nullptr if memory is short
+         */
+        RosterHandle finish();
+
+        /**
+         * @brief Forget everything added and staged
+         */
+        void clear();
+
+    private:
+        void appendText(std::string_view text, uint32_t& outOffset, uint16_t& outLength);
+
+        std::vector<Record> m_records;
+        std::string m_text;
+
+        // Labels staged for the next entry, as slices of m_labelText
+        std::string m_labelText;
+        uint16_t m_labelOffset[MAX_FUNCTION_LABELS];
+        uint16_t m_labelLength[MAX_FUNCTION_LABELS];
+        int m_labelCount;  // Highest staged function + 1
+    };
+
+    /**
+     * @brief Parse an `RL<count>]\[<name>}|{<addr>}|{<type>...` message
+     * @return Snapshot, or nullptr if the message is malformed or memory is short
+     */
+    static RosterHandle parse(std::string_view message);
+
+    /**
+     * @brief Copy of @p base with @p entry added, or replacing the entry with the same name
+     * @return New snapshot, or nullptr if memory is short
+     */
+    static RosterHandle withEntry(const RosterHandle& base, const Entry& entry);
+
+    /**
+     * @brief Copy of @p base without the entry named @p name
+     * @return New snapshot (@p base itself if there is no such entry), or nullptr if memory is short
+     */
+    static RosterHandle withoutEntry(const RosterHandle& base, std::string_view name);
+
+    ~RosterSnapshot();
+
+    RosterSnapshot(const RosterSnapshot&) = delete;
+    RosterSnapshot& operator=(const RosterSnapshot&) = delete;
+
+    size_t size() const { return m_count; }
+    bool empty() const { return m_count == 0; }
+
+    /**
+     * @brief Entry at @p index (must be < size())
+     */
+    Entry operator[](size_t index) const;
+
+    /**
+     * @brief Index of the entry named @p name, or -1
+     */
+    int find(std::string_view name) const;
+
+    /**
+     * @brief Bytes held by the arena (records + names + labels)
+     */
+    size_t getArenaBytes() const { return m_arenaBytes; }
+
+private:
+    struct Record {
+        uint32_t nameOffset;
+        uint16_t nameLength;
+        uint16_t address;
+        char addressType;
+        uint32_t labelsOffset;
+        uint16_t labelsLength;
+    };
+
+    RosterSnapshot(void* arena, size_t arenaBytes, size_t capacity);
+
+    void* m_arena;
+    size_t m_arenaBytes;
+    Record* m_records;
+    char* m_names;
+    size_t m_count;
+};
@@ -0,0 +1,18 @@
+#include "ThrottleTransport.h"
+
+size_t ThrottleTransport::getRosterSize() const
+{
+    RosterHandle roster = getRosterSnapshot();
+    return roster ? roster->size() : 0;
+}
+
+bool ThrottleTransport::getRosterEntry(int index, Locomotive& outEntry) const
+{
+    RosterHandle roster = getRosterSnapshot();
+    if (!roster || index < 0 || index >= static_cast<int>(roster->size())) {
+        return false;
+    }
+    RosterSnapshot::Entry entry = (*roster)[static_cast<size_t>(index)];
+    outEntry = Locomotive(entry.address, std::string(entry.name), entry.addressType);
+    return true;
+}
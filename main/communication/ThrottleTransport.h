@@ -0,0 +1,201 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include "esp_err.h"
+#include "RosterSnapshot.h"
+
+/**
+ * @brief Protocol used to drive throttles
+ */
+enum class ThrottleProtocol : uint8_t {
+    WITHROTTLE = 0,  // WiThrottle TCP connection (second socket next to JSON)
+    JMRI_JSON = 1    // JMRI JSON "throttle" type over the JSON WebSocket
+};
+
+/**
+ * @brief Throttle control and roster access, independent of the wire protocol
+ *
+ * ThrottleController and the UI drive locos through this interface, so the
+ * WiThrottle client and the JSON throttle (JmriJsonThrottle) are
+ * interchangeable. Throttle ids are characters: '0'-'9' then 'a'-'z' for
+ * the controller's throttle slots (see throttleIdChar()), 'T' for the main
+ * screen's debug controls.
+ *
+ * Command methods never block on the network. Callbacks fire on the
+ * transport's receive task; callers handle their own locking.
+ */
+class ThrottleTransport {
+public:
+    /// Throttle slots that have an id: '0'-'9', then 'a'-'z'
+    static constexpr int MAX_THROTTLE_IDS = 36;
+
+    /**
+     * @brief Throttle id for a controller slot
+     *
+     * Lower case letters carry on after the digits so upper case stays free
+     * for the protocols' own throttles ('T', 'S').
+     * @param index Slot index (0-35)
+     * @return '0'-'9', 'a'-'z', or '\0' when the index has no id
+     */
+    static constexpr char throttleIdChar(int index)
+    {
+        return index < 0 || index >= MAX_THROTTLE_IDS ? '\0'
+             : index < 10 ? static_cast<char>('0' + index)
+             : static_cast<char>('a' + index - 10);
+    }
+
+    /**
+     * @brief Controller slot for a throttle id (inverse of throttleIdChar())
+     * @return Slot index (0-35), or -1 for any other character
+     */
+    static constexpr int throttleIndex(char throttleId)
+    {
+        return throttleId >= '0' && throttleId <= '9' ? throttleId - '0'
+             : throttleId >= 'a' && throttleId <= 'z' ? throttleId - 'a' + 10
+             : -1;
+    }
+
+    /**
+     * @brief Locomotive entry from roster
+     */
+    struct Locomotive {
+        int address;           // DCC address
+        std::string name;      // Loco name/number
+        char addressType;      // 'S' = short, 'L' = long
+
+        Locomotive() : address(0), addressType('S') {}
+        Locomotive(int addr, const std::string& n, char type)
+            : address(addr), name(n), addressType(type) {}
+    };
+
+    /**
+     * @brief Throttle state change notification
+     */
+    struct ThrottleUpdate {
+        char throttleId;           // Throttle identifier (see throttleIdChar())
+        int address;               // Loco DCC address
+        int speed;                 // Speed (0-126), -1 if not in message
+        int direction;             // Direction (0=reverse, 1=forward), -1 if not in message
+        int function;              // Function number (0-28), -1 if not in message
+        bool functionState;        // Function state (only valid if function >= 0)
+    };
+
+    /**
+     * @brief Callback for throttle state changes
+     * Called when throttle speed/direction/function changes are received
+     * @param update Throttle update information
+     */
+    using ThrottleStateCallback = std::function<void(const ThrottleUpdate& update)>;
+
+    /**
+     * @brief Callback for function label updates
+     * @param throttleId Throttle identifier (see throttleIdChar())
+     * @param labels Function labels (index = function number)
+     */
+    using FunctionLabelsCallback = std::function<void(char throttleId, const std::vector<std::string>& labels)>;
+
+    /**
+     * @brief Callback for server sessions
+     * Called with true once a new session can take throttle commands (first
+     * connection and every reconnect), and with false when the session ends.
+     * The server releases every loco of an ended session.
+     * @param started True when a session starts, false when it ends
+     */
+    using SessionCallback = std::function<void(bool started)>;
+
+    virtual ~ThrottleTransport() = default;
+
+    /**
+     * @brief Short protocol name for logs and the UI (e.g. "WiThrottle")
+     */
+    virtual const char* getTransportName() const = 0;
+
+    /**
+     * @brief Check the transport can carry commands
+     */
+    virtual bool isConnected() const = 0;
+
+    /**
+     * @brief Whether the server pushes every speed and direction change
+     *
+     * Either way ThrottleController queries a throttle whose commands go
+     * unconfirmed. When false it also checks confirmed throttles that have
+     * been idle, at backed-off intervals, to pick up changes made elsewhere
+     * (WiThrottle only reports some of them).
+     */
+    virtual bool pushesThrottleState() const = 0;
+
+    /**
+     * @brief Acquire a locomotive for throttle control
+     * @param throttleId Throttle identifier (see throttleIdChar())
+     * @param address Locomotive DCC address
+     * @param isLongAddress True for a long address, false for short
+     * @return ESP_OK if the request was queued
+     */
+    virtual esp_err_t acquireLocomotive(char throttleId, int address, bool isLongAddress) = 0;
+
+    /**
+     * @brief Release a locomotive from throttle control
+     */
+    virtual esp_err_t releaseLocomotive(char throttleId) = 0;
+
+    /**
+     * @brief Set locomotive speed (0-126)
+     */
+    virtual esp_err_t setSpeed(char throttleId, int speed) = 0;
+
+    /**
+     * @brief Set locomotive direction
+     */
+    virtual esp_err_t setDirection(char throttleId, bool forward) = 0;
+
+    /**
+     * @brief Set locomotive function state (0-28)
+     */
+    virtual esp_err_t setFunction(char throttleId, int function, bool state) = 0;
+
+    /**
+     * @brief Ask the server to report the current speed
+     */
+    virtual esp_err_t querySpeed(char throttleId) = 0;
+
+    /**
+     * @brief Ask the server to report the current direction
+     */
+    virtual esp_err_t queryDirection(char throttleId) = 0;
+
+    /**
+     * @brief Set throttle state change callback
+     */
+    virtual void setThrottleStateCallback(ThrottleStateCallback callback) = 0;
+
+    /**
+     * @brief Set function labels callback
+     */
+    virtual void setFunctionLabelsCallback(FunctionLabelsCallback callback) = 0;
+
+    /**
+     * @brief Set session start/end callback
+     */
+    virtual void setSessionCallback(SessionCallback callback) = 0;
+
+    /**
+     * @brief Get a handle to the current roster (thread-safe, no copy)
+     * @return Immutable snapshot, or nullptr before the first roster arrives
+     */
+    virtual RosterHandle getRosterSnapshot() const = 0;
+
+    /**
+     * @brief Get number of roster entries (thread-safe)
+     */
+    size_t getRosterSize() const;
+
+    /**
+     * @brief Get a roster entry by index (thread-safe)
+     * @return true if index valid and entry copied
+     */
+    bool getRosterEntry(int index, Locomotive& outEntry) const;
+};
@@ -1,8 +1,7 @@
 #include "WiFiManager.h"
 #include "esp_log.h"
 #include "esp_netif.h"
-#include "nvs_flash.h"
-#include "nvs.h"
+#include "Settings.h"
 #include <cstring>
 
 WiFiManager::WiFiManager()
@@ -29,13 +28,8 @@ esp_err_t WiFiManager::initialize()
         return ESP_OK;
     }
 
-    // Initialize NVS
-    esp_err_t ret = nvs_flash_init();
-    if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
-        ESP_ERROR_CHECK(nvs_flash_erase());
-        ret = nvs_flash_init();
-    }
-    ESP_ERROR_CHECK(ret);
+    // Initialize NVS and read the stored credentials (no-op if already loaded)
+    ESP_ERROR_CHECK(Settings::instance().load());
 
     // Initialize TCP/IP stack
     ESP_ERROR_CHECK(esp_netif_init());
@@ -123,18 +117,9 @@ void WiFiManager::forgetNetwork()
     disconnect();
     
     // Clear stored credentials
-    nvs_handle_t handle;
-    esp_err_t ret = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
-    
-    if (ret == ESP_OK) {
-        nvs_erase_key(handle, NVS_SSID_KEY);
-        nvs_erase_key(handle, NVS_PASSWORD_KEY);
-        nvs_commit(handle);
-        nvs_close(handle);
-        ESP_LOGI(TAG, "Network forgotten - credentials cleared from NVS");
-    } else {
-        ESP_LOGW(TAG, "Failed to open NVS to forget network");
-    }
+    Settings::instance().erase(Settings::Key::WIFI_SSID);
+    Settings::instance().erase(Settings::Key::WIFI_PASSWORD);
+    ESP_LOGI(TAG, "Network forgotten - credentials cleared");
 }
 
 std::string WiFiManager::getIpAddress() const
@@ -175,15 +160,9 @@ bool WiFiManager::hasStoredCredentials() const
 
 void WiFiManager::clearStoredCredentials()
 {
-    nvs_handle_t handle;
-    esp_err_t ret = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
-    if (ret == ESP_OK) {
-        nvs_erase_key(handle, NVS_SSID_KEY);
-        nvs_erase_key(handle, NVS_PASSWORD_KEY);
-        nvs_commit(handle);
-        nvs_close(handle);
-        ESP_LOGI(TAG, "Credentials cleared");
-    }
+    Settings::instance().erase(Settings::Key::WIFI_SSID);
+    Settings::instance().erase(Settings::Key::WIFI_PASSWORD);
+    ESP_LOGI(TAG, "Credentials cleared");
 }
 
 void WiFiManager::setStateCallback(StateCallback callback)
@@ -274,53 +253,25 @@ void WiFiManager::handleWiFiEvent(esp_event_base_t event_base, int32_t event_id,
 
 esp_err_t WiFiManager::loadCredentials(std::string& ssid, std::string& password) const
 {
-    nvs_handle_t handle;
-    esp_err_t ret = nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle);
-    
-    if (ret != ESP_OK) {
-        return ret;
-    }
-
-    // Read SSID
-    size_t ssid_len = 0;
-    ret = nvs_get_str(handle, NVS_SSID_KEY, nullptr, &ssid_len);
-    if (ret == ESP_OK && ssid_len > 0) {
-        char* ssid_buf = new char[ssid_len];
-        nvs_get_str(handle, NVS_SSID_KEY, ssid_buf, &ssid_len);
-        ssid = std::string(ssid_buf);
-        delete[] ssid_buf;
-    }
-
-    // Read password
-    size_t pwd_len = 0;
-    ret = nvs_get_str(handle, NVS_PASSWORD_KEY, nullptr, &pwd_len);
-    if (ret == ESP_OK && pwd_len > 0) {
-        char* pwd_buf = new char[pwd_len];
-        nvs_get_str(handle, NVS_PASSWORD_KEY, pwd_buf, &pwd_len);
-        password = std::string(pwd_buf);
-        delete[] pwd_buf;
+    if (!Settings::instance().isStored(Settings::Key::WIFI_SSID)) {
+        return ESP_ERR_NOT_FOUND;
     }
-
-    nvs_close(handle);
+    ssid = Settings::instance().getString(Settings::Key::WIFI_SSID);
+    password = Settings::instance().getString(Settings::Key::WIFI_PASSWORD);
     return ESP_OK;
 }
 
 esp_err_t WiFiManager::saveCredentials(const std::string& ssid, const std::string& password)
 {
-    nvs_handle_t handle;
-    esp_err_t ret = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
-    
+    // Reconnecting with the stored credentials writes nothing
+    esp_err_t ret = Settings::instance().setString(Settings::Key::WIFI_SSID, ssid);
+    if (ret == ESP_OK) {
+        ret = Settings::instance().setString(Settings::Key::WIFI_PASSWORD, password);
+    }
     if (ret != ESP_OK) {
-        return ret;
+        ESP_LOGW(TAG, "Credentials not saved: %s", esp_err_to_name(ret));
     }
-
-    nvs_set_str(handle, NVS_SSID_KEY, ssid.c_str());
-    nvs_set_str(handle, NVS_PASSWORD_KEY, password.c_str());
-    nvs_commit(handle);
-    nvs_close(handle);
-
-    ESP_LOGI(TAG, "Credentials saved to NVS");
-    return ESP_OK;
+    return ret;
 }
 
 void WiFiManager::setState(State newState)
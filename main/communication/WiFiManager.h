@@ -13,7 +13,7 @@
  * - Configuration via UI
  * - Automatic reconnection
  * - Connection status callbacks
- * - NVS storage for credentials
+ * - Credentials kept in Settings (NVS, written only when they change)
  */
 class WiFiManager {
 public:
@@ -126,9 +126,6 @@ public:
 
 private:
     static constexpr const char* TAG = "WiFiManager";
-    static constexpr const char* NVS_NAMESPACE = "wifi";
-    static constexpr const char* NVS_SSID_KEY = "ssid";
-    static constexpr const char* NVS_PASSWORD_KEY = "password";
     static constexpr int MAX_RETRY_ATTEMPTS = 5;
 
     State m_state;
@@ -141,7 +138,7 @@ private:
                            int32_t event_id, void* event_data);
     void handleWiFiEvent(esp_event_base_t event_base, int32_t event_id, void* event_data);
 
-    // NVS helpers
+    // Credential helpers (backed by Settings)
     esp_err_t loadCredentials(std::string& ssid, std::string& password) const;
     esp_err_t saveCredentials(const std::string& ssid, const std::string& password);
 
@@ -1,14 +1,84 @@
 #include "WiThrottleClient.h"
+#include "DnsCache.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "lwip/sockets.h"
 #include "lwip/netdb.h"
+#include <charconv>
+#include <algorithm>
+#include <cstdlib>
 #include <cstring>
 
 static const char* TAG = "WiThrottleClient";
 
+namespace {
+    // atoi() equivalent for non-terminated views (0 if no leading digits)
+    int parseInt(std::string_view text)
+    {
+        int value = 0;
+        std::from_chars(text.data(), text.data() + text.size(), value);
+        return value;
+    }
+
+    // Match a dispatch prefix; '?' matches any single character
+    bool matchesPrefix(std::string_view message, std::string_view prefix)
+    {
+        if (message.length() < prefix.length()) {
+            return false;
+        }
+        for (size_t i = 0; i < prefix.length(); i++) {
+            if (prefix[i] != '?' && prefix[i] != message[i]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Call fn(systemName, state) for each ]\[system}|{user}|{state entry of a PTL/PRL list
+    template<typename Fn>
+    void forEachListEntry(std::string_view data, Fn&& fn)
+    {
+        constexpr std::string_view entryDelimiter = "]\\[";
+        constexpr std::string_view fieldDelimiter = "}|{";
+
+        size_t pos = 0;
+        while (pos < data.length()) {
+            if (data.compare(pos, entryDelimiter.size(), entryDelimiter) == 0) {
+                pos += entryDelimiter.size();
+            }
+            size_t end = data.find(entryDelimiter, pos);
+            std::string_view entry = data.substr(pos, end == std::string_view::npos ? std::string_view::npos : end - pos);
+
+            size_t nameEnd = entry.find(fieldDelimiter);
+            size_t stateStart = entry.rfind(fieldDelimiter);
+            if (nameEnd != std::string_view::npos && stateStart + fieldDelimiter.size() < entry.length()) {
+                fn(entry.substr(0, nameEnd), entry[stateStart + fieldDelimiter.size()]);
+            }
+
+            if (end == std::string_view::npos) {
+                break;
+            }
+            pos = end;
+        }
+    }
+}
+
 // WiThrottle protocol commands
 static const char* CMD_HEARTBEAT = "*";
-static const char* CMD_TRACK_POWER = "PPA";  // Power command
+static const char* CMD_HEARTBEAT_MONITOR_ON = "*+";
+static const char* CMD_DEVICE_NAME = "NESP32-Layout-Controller";  // Server answers with *<seconds>, once per connection
+
+// Longest the receive loop sleeps when no heartbeat deadline is pending
+static constexpr int64_t RX_IDLE_WAIT_US = 5 * 1000000;
+
+// Slice of the TCP handshake wait between checks for disconnect()
+static constexpr int64_t CONNECT_POLL_US = 100 * 1000;
+
+// Longest disconnect() waits for the receive and writer tasks to exit
+static constexpr int TASK_EXIT_TIMEOUT_MS = 200;
+
+// Commands drained from the TX queue into one send(); a multiple of the command size
+static constexpr size_t TX_BATCH_SIZE = 8 * WiThrottleCommandEncoder::MAX_COMMAND_LENGTH;
 
 WiThrottleClient::WiThrottleClient()
     : m_state(ConnectionState::DISCONNECTED)
@@ -23,14 +93,43 @@ WiThrottleClient::WiThrottleClient()
     , m_rosterCallback(nullptr)
     , m_webPortCallback(nullptr)
     , m_functionLabelsCallback(nullptr)
+    , m_sessionCallback(nullptr)
     , m_stateMutex(nullptr)
     , m_receiveTaskHandle(nullptr)
+    , m_receiveExited(nullptr)
     , m_running(false)
+    , m_connectTimings{}
+    , m_txQueue(nullptr)
+    , m_transmitTaskHandle(nullptr)
+    , m_transmitExited(nullptr)
+    , m_txDropped(0)
+    , m_txCommands(0)
+    , m_txSegments(0)
+    , m_rxFramer(CONFIG_WITHROTTLE_RX_BUFFER_SIZE)
+    , m_heartbeatMonitoring(false)
 {
+    for (std::atomic<uint32_t>& packed : m_throttleSlots) {
+        packed.store(0, std::memory_order_relaxed);
+    }
+    resetMessageStats();
+#if CONFIG_WITHROTTLE_LATENCY_TRACE
+    for (int i = 0; i < TRACE_THROTTLES; i++) {
+        m_speedSentUs[i] = 0;
+    }
+#endif
     m_stateMutex = xSemaphoreCreateMutex();
     if (!m_stateMutex) {
         ESP_LOGE(TAG, "Failed to create WiThrottle state mutex");
     }
+    m_txQueue = xQueueCreate(CONFIG_WITHROTTLE_TX_QUEUE_LENGTH, sizeof(WiThrottleCommandEncoder::Command));
+    if (!m_txQueue) {
+        ESP_LOGE(TAG, "Failed to create WiThrottle TX queue");
+    }
+    m_receiveExited = xSemaphoreCreateBinary();
+    m_transmitExited = xSemaphoreCreateBinary();
+    if (!m_receiveExited || !m_transmitExited) {
+        ESP_LOGE(TAG, "Failed to create WiThrottle task exit semaphores");
+    }
 }
 
 WiThrottleClient::~WiThrottleClient()
@@ -40,6 +139,18 @@ WiThrottleClient::~WiThrottleClient()
         vSemaphoreDelete(m_stateMutex);
         m_stateMutex = nullptr;
     }
+    if (m_txQueue) {
+        vQueueDelete(m_txQueue);
+        m_txQueue = nullptr;
+    }
+    if (m_receiveExited) {
+        vSemaphoreDelete(m_receiveExited);
+        m_receiveExited = nullptr;
+    }
+    if (m_transmitExited) {
+        vSemaphoreDelete(m_transmitExited);
+        m_transmitExited = nullptr;
+    }
 }
 
 esp_err_t WiThrottleClient::initialize()
@@ -54,9 +165,18 @@ esp_err_t WiThrottleClient::connect(const std::string& host, uint16_t port)
         ESP_LOGW(TAG, "Already connected or connecting");
         return ESP_ERR_INVALID_STATE;
     }
+    if (!m_receiveExited || !m_transmitExited) {
+        return ESP_ERR_NO_MEM;
+    }
+    
+    if (m_socket >= 0) {
+        // Previous connection was lost; release its socket and tasks first
+        disconnect();
+    }
     
     m_serverHost = host;
     m_serverPort = port;
+    m_connectTimings = ConnectTimings{};
     
     ESP_LOGI(TAG, "Connecting to WiThrottle server %s:%d", host.c_str(), port);
     setState(ConnectionState::CONNECTING);
@@ -69,55 +189,135 @@ esp_err_t WiThrottleClient::connect(const std::string& host, uint16_t port)
         return ESP_FAIL;
     }
     
-    // Set socket timeout
-    struct timeval timeout;
-    timeout.tv_sec = 5;
-    timeout.tv_usec = 0;
-    setsockopt(m_socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+#if CONFIG_WITHROTTLE_TCP_NODELAY
+    // Commands are tiny and latency-sensitive; don't let Nagle hold them
+    // waiting for the server's (delayed) ACK. Batching is done in transmitTask.
+    int noDelay = 1;
+    setsockopt(m_socket, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+#endif
+    
+    // Non-blocking until the handshake completes, so it can time out and be cancelled
+    fcntl(m_socket, F_SETFL, fcntl(m_socket, F_GETFL, 0) | O_NONBLOCK);
+    
+    if (m_txQueue) {
+        xQueueReset(m_txQueue);
+    }
+    m_rxFramer.reset();
+    m_heartbeatMonitoring = false;
+    // Drop exit signals from tasks that outlived an earlier disconnect()
+    xSemaphoreTake(m_receiveExited, 0);
+    xSemaphoreTake(m_transmitExited, 0);
+    m_running = true;
     
-    // Resolve hostname
-    struct hostent* server = gethostbyname(host.c_str());
-    if (server == nullptr) {
-        ESP_LOGE(TAG, "Failed to resolve hostname: %s", host.c_str());
+    // The receive task resolves, connects and then reads; the caller never waits on the network
+    TaskHandle_t task = nullptr;
+    if (xTaskCreate(receiveTask, "withrottle_rx", 4096, this, 5, &task) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create receive task");
+        m_running = false;
         close(m_socket);
         m_socket = -1;
         setState(ConnectionState::FAILED);
-        return ESP_FAIL;
+        return ESP_ERR_NO_MEM;
     }
+    m_receiveTaskHandle = task;
     
-    // Connect
-    struct sockaddr_in server_addr;
-    memset(&server_addr, 0, sizeof(server_addr));
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_port = htons(port);
-    memcpy(&server_addr.sin_addr.s_addr, server->h_addr, server->h_length);
+    return ESP_OK;
+}
+
+bool WiThrottleClient::establishConnection()
+{
+    // Resolve: cached across reconnects and shared with the JSON client
+    int64_t phaseStart = esp_timer_get_time();
+    struct sockaddr_in serverAddr;
+    memset(&serverAddr, 0, sizeof(serverAddr));
+    serverAddr.sin_family = AF_INET;
+    serverAddr.sin_port = htons(m_serverPort);
+    if (DnsCache::instance().resolve(m_serverHost, serverAddr.sin_addr) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to resolve hostname: %s", m_serverHost.c_str());
+        return false;
+    }
+    int64_t now = esp_timer_get_time();
+    m_connectTimings.resolveUs = static_cast<uint32_t>(now - phaseStart);
+    phaseStart = now;
     
-    int ret = ::connect(m_socket, (struct sockaddr*)&server_addr, sizeof(server_addr));
-    if (ret != 0) {
+    // TCP handshake, polled in short slices so disconnect() can cancel it
+    if (::connect(m_socket, (struct sockaddr*)&serverAddr, sizeof(serverAddr)) != 0 && errno != EINPROGRESS) {
         ESP_LOGE(TAG, "Failed to connect: %d", errno);
-        close(m_socket);
-        m_socket = -1;
-        setState(ConnectionState::FAILED);
-        return ESP_FAIL;
+        DnsCache::instance().invalidate(m_serverHost);
+        return false;
+    }
+    int64_t deadline = phaseStart + static_cast<int64_t>(CONFIG_JMRI_CONNECT_TIMEOUT_MS) * 1000;
+    while (true) {
+        if (!m_running) {
+            return false;
+        }
+        now = esp_timer_get_time();
+        if (now >= deadline) {
+            ESP_LOGE(TAG, "No answer from %s:%d within %d ms", m_serverHost.c_str(), m_serverPort,
+                     CONFIG_JMRI_CONNECT_TIMEOUT_MS);
+            DnsCache::instance().invalidate(m_serverHost);
+            return false;
+        }
+        int64_t waitUs = std::min(deadline - now, CONNECT_POLL_US);
+        
+        fd_set writeSet;
+        FD_ZERO(&writeSet);
+        FD_SET(m_socket, &writeSet);
+        struct timeval timeout;
+        timeout.tv_sec = static_cast<long>(waitUs / 1000000);
+        timeout.tv_usec = static_cast<long>(waitUs % 1000000);
+        
+        int ready = select(m_socket + 1, nullptr, &writeSet, nullptr, &timeout);
+        if (ready > 0) {
+            break;
+        } else if (ready < 0 && errno != EINTR) {
+            ESP_LOGE(TAG, "select error: %d", errno);
+            return false;
+        }
+    }
+    
+    int socketError = 0;
+    socklen_t errorLength = sizeof(socketError);
+    getsockopt(m_socket, SOL_SOCKET, SO_ERROR, &socketError, &errorLength);
+    if (socketError != 0) {
+        ESP_LOGE(TAG, "Failed to connect: %d", socketError);
+        DnsCache::instance().invalidate(m_serverHost);
+        return false;
+    }
+    
+    // Blocking again: the writer task relies on send() taking everything
+    fcntl(m_socket, F_SETFL, fcntl(m_socket, F_GETFL, 0) & ~O_NONBLOCK);
+    now = esp_timer_get_time();
+    m_connectTimings.tcpUs = static_cast<uint32_t>(now - phaseStart);
+    
+    ESP_LOGI(TAG, "Connected to WiThrottle server (resolve %lu ms, TCP %lu ms)",
+             (unsigned long)(m_connectTimings.resolveUs / 1000), (unsigned long)(m_connectTimings.tcpUs / 1000));
+    
+    // Start writer task before anything is queued
+    m_heartbeat.reset(now);
+    TaskHandle_t task = nullptr;
+    if (xTaskCreate(transmitTask, "withrottle_tx", 3072, this, 5, &task) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create transmit task");
+        return false;
     }
+    m_transmitTaskHandle = task;
     
-    ESP_LOGI(TAG, "Connected to WiThrottle server");
     setState(ConnectionState::CONNECTED);
     
     // Send device name (identifies us to JMRI)
     ESP_LOGI(TAG, "Sending device identification...");
-    sendCommand(std::string("N") + "ESP32-Layout-Controller");
+    sendRaw(CMD_DEVICE_NAME);
     
     // Send hardware identifier
-    sendCommand(std::string("H") + "ESP32-S3");
+    sendRaw("HESP32-S3");
     
-    ESP_LOGI(TAG, "Waiting for server messages (version, roster, etc.)...");
-    
-    // Start receive task
-    m_running = true;
-    xTaskCreate(receiveTask, "withrottle_rx", 4096, this, 5, &m_receiveTaskHandle);
+    // Commands queued from here on follow the identification
+    if (m_sessionCallback) {
+        m_sessionCallback(true);
+    }
     
-    return ESP_OK;
+    ESP_LOGI(TAG, "Waiting for server messages (version, roster, etc.)...");
+    return true;
 }
 
 void WiThrottleClient::disconnect()
@@ -126,14 +326,22 @@ void WiThrottleClient::disconnect()
         ESP_LOGI(TAG, "Disconnecting from WiThrottle server");
         m_running = false;
         
-        // Wait for receive task to finish
-        if (m_receiveTaskHandle) {
-            vTaskDelay(pdMS_TO_TICKS(100));
-            if (eTaskGetState(m_receiveTaskHandle) != eDeleted) {
-                vTaskDelete(m_receiveTaskHandle);
-            }
-            m_receiveTaskHandle = nullptr;
+        // Wake the receive task out of select()
+        shutdown(m_socket, SHUT_RDWR);
+        
+        // Wait for the tasks to see the flag and finish. The receive task goes
+        // first: it may still be starting the writer. A handle that is already
+        // clear belongs to a task that has exited (e.g. after the link dropped).
+        if (m_receiveTaskHandle != nullptr &&
+            xSemaphoreTake(m_receiveExited, pdMS_TO_TICKS(TASK_EXIT_TIMEOUT_MS)) != pdTRUE) {
+            ESP_LOGE(TAG, "Receive task did not exit in time");
         }
+        if (m_transmitTaskHandle != nullptr &&
+            xSemaphoreTake(m_transmitExited, pdMS_TO_TICKS(TASK_EXIT_TIMEOUT_MS)) != pdTRUE) {
+            ESP_LOGE(TAG, "Transmit task did not exit in time");
+        }
+        m_receiveTaskHandle = nullptr;
+        m_transmitTaskHandle = nullptr;
         
         close(m_socket);
         m_socket = -1;
@@ -142,9 +350,8 @@ void WiThrottleClient::disconnect()
     setState(ConnectionState::DISCONNECTED);
     m_mainTrackPower = PowerState::UNKNOWN;
     m_progTrackPower = PowerState::UNKNOWN;
-    if (lockState(pdMS_TO_TICKS(50))) {
-        m_throttleStates.clear();
-        unlockState();
+    for (std::atomic<uint32_t>& packed : m_throttleSlots) {
+        packed.store(0, std::memory_order_release);
     }
 }
 
@@ -158,11 +365,9 @@ esp_err_t WiThrottleClient::setTrackPower(const std::string& track, bool on)
     // WiThrottle protocol: PPA<X> where X is power state
     // PPA0 = power off, PPA1 = power on for all tracks
     // For individual tracks we use the same command (JMRI handles both)
-    std::string command = std::string(CMD_TRACK_POWER) + (on ? "1" : "0");
-    
     ESP_LOGI(TAG, "Setting %s track power: %s", track.c_str(), on ? "ON" : "OFF");
     
-    return sendCommand(command);
+    return sendRaw(on ? "PPA1" : "PPA0");
 }
 
 WiThrottleClient::PowerState WiThrottleClient::getTrackPower(const std::string& track) const
@@ -189,9 +394,15 @@ esp_err_t WiThrottleClient::acquireLocomotive(char throttleId, int address, bool
     // Address types: S (short, 1-127) or L (long, 128-9999)
     char addressType = isLongAddress ? 'L' : 'S';
     
-    std::string command = "M" + std::string(1, throttleId) + 
-                          "+" + std::string(1, addressType) + std::to_string(address) +
-                          "<;>" + std::string(1, addressType) + std::to_string(address);
+    if (throttleSlotIndex(throttleId) < 0) {
+        ESP_LOGW(TAG, "Unsupported throttle id '%c'", throttleId);
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    WiThrottleCommandEncoder::Command command;
+    if (!WiThrottleCommandEncoder::encodeAcquire(command, throttleId, addressType, address)) {
+        return ESP_ERR_INVALID_ARG;
+    }
     
     ESP_LOGI(TAG, "Acquiring loco %d (%c) on throttle %c", address, addressType, throttleId);
     
@@ -199,14 +410,7 @@ esp_err_t WiThrottleClient::acquireLocomotive(char throttleId, int address, bool
     
     // Track the acquired loco state for this throttle
     if (result == ESP_OK) {
-        if (lockState(pdMS_TO_TICKS(50))) {
-            m_throttleStates[throttleId].acquired = true;
-            m_throttleStates[throttleId].address = address;
-            m_throttleStates[throttleId].addressType = addressType;
-            unlockState();
-        } else {
-            ESP_LOGW(TAG, "Failed to lock state for acquire tracking");
-        }
+        storeThrottleSlot(throttleId, ThrottleSlot{ true, address, addressType });
     }
     
     return result;
@@ -222,7 +426,8 @@ esp_err_t WiThrottleClient::releaseLocomotive(char throttleId)
     // WiThrottle protocol: M<throttleId>-<addressType><address><;>r
     // Or to release ALL locos on throttle: M<throttleId>-*<;>r
     // Example: MT-*<;>r (release all locos on throttle T)
-    std::string command = "M" + std::string(1, throttleId) + "-*<;>r";
+    WiThrottleCommandEncoder::Command command;
+    WiThrottleCommandEncoder::encodeRelease(command, throttleId);
     
     ESP_LOGI(TAG, "Releasing throttle %c", throttleId);
     
@@ -230,14 +435,7 @@ esp_err_t WiThrottleClient::releaseLocomotive(char throttleId)
     
     // Clear the throttle state
     if (result == ESP_OK) {
-        if (lockState(pdMS_TO_TICKS(50))) {
-            m_throttleStates[throttleId].acquired = false;
-            m_throttleStates[throttleId].address = 0;
-            m_throttleStates[throttleId].addressType = 'S';
-            unlockState();
-        } else {
-            ESP_LOGW(TAG, "Failed to lock state for release tracking");
-        }
+        storeThrottleSlot(throttleId, ThrottleSlot{ false, 0, 'S' });
     }
     
     return result;
@@ -250,20 +448,12 @@ esp_err_t WiThrottleClient::setSpeed(char throttleId, int speed)
         return ESP_ERR_INVALID_STATE;
     }
     
-    // Check if throttle has an acquired loco
-    ThrottleState state;
-    if (!lockState(pdMS_TO_TICKS(50))) {
-        ESP_LOGW(TAG, "Failed to lock state for speed command");
-        return ESP_ERR_INVALID_STATE;
-    }
-    auto it = m_throttleStates.find(throttleId);
-    if (it == m_throttleStates.end() || !it->second.acquired) {
-        unlockState();
+    // Check if throttle has an acquired loco (lock-free; never waits on other tasks)
+    ThrottleSlot slot;
+    if (!loadThrottleSlot(throttleId, slot)) {
         ESP_LOGW(TAG, "No loco acquired on throttle %c", throttleId);
         return ESP_ERR_INVALID_STATE;
     }
-    state = it->second;
-    unlockState();
     
     // Clamp speed to valid range
     if (speed < 0) speed = 0;
@@ -271,13 +461,20 @@ esp_err_t WiThrottleClient::setSpeed(char throttleId, int speed)
     
     // WiThrottle protocol: M<throttleId>A<addressType><address><;>V<speed>
     // Example: MTAS3<;>V50 (set loco S3 on throttle T to speed 50)
-    std::string command = "M" + std::string(1, throttleId) + 
-                         "A" + std::string(1, state.addressType) + std::to_string(state.address) +
-                         "<;>V" + std::to_string(speed);
+    WiThrottleCommandEncoder::Command command;
+    WiThrottleCommandEncoder::encodeSpeed(command, throttleId, slot.addressType, slot.address, speed);
     
     ESP_LOGD(TAG, "Setting throttle %c speed to %d", throttleId, speed);
     
-    return sendCommand(command);
+    esp_err_t result = sendCommand(command);
+#if CONFIG_WITHROTTLE_LATENCY_TRACE
+    // Time from the oldest unanswered speed command to the server's speed report
+    int traceIndex = throttleIndex(throttleId);
+    if (result == ESP_OK && traceIndex >= 0 && traceIndex < TRACE_THROTTLES && m_speedSentUs[traceIndex] == 0) {
+        m_speedSentUs[traceIndex] = esp_timer_get_time();
+    }
+#endif
+    return result;
 }
 
 esp_err_t WiThrottleClient::setDirection(char throttleId, bool forward)
@@ -287,27 +484,18 @@ esp_err_t WiThrottleClient::setDirection(char throttleId, bool forward)
         return ESP_ERR_INVALID_STATE;
     }
     
-    // Check if throttle has an acquired loco
-    ThrottleState state;
-    if (!lockState(pdMS_TO_TICKS(50))) {
-        ESP_LOGW(TAG, "Failed to lock state for direction command");
-        return ESP_ERR_INVALID_STATE;
-    }
-    auto it = m_throttleStates.find(throttleId);
-    if (it == m_throttleStates.end() || !it->second.acquired) {
-        unlockState();
+    // Check if throttle has an acquired loco (lock-free; never waits on other tasks)
+    ThrottleSlot slot;
+    if (!loadThrottleSlot(throttleId, slot)) {
         ESP_LOGW(TAG, "No loco acquired on throttle %c", throttleId);
         return ESP_ERR_INVALID_STATE;
     }
-    state = it->second;
-    unlockState();
     
     // WiThrottle protocol: M<throttleId>A<addressType><address><;>R<direction>
     // R1 = forward, R0 = reverse
     // Example: MTAS3<;>R1 (set loco S3 on throttle T forward)
-    std::string command = "M" + std::string(1, throttleId) + 
-                         "A" + std::string(1, state.addressType) + std::to_string(state.address) +
-                         "<;>R" + (forward ? "1" : "0");
+    WiThrottleCommandEncoder::Command command;
+    WiThrottleCommandEncoder::encodeDirection(command, throttleId, slot.addressType, slot.address, forward);
     
     ESP_LOGI(TAG, "Setting throttle %c direction: %s", throttleId, forward ? "FORWARD" : "REVERSE");
     
@@ -321,20 +509,12 @@ esp_err_t WiThrottleClient::setFunction(char throttleId, int function, bool stat
         return ESP_ERR_INVALID_STATE;
     }
     
-    // Check if throttle has an acquired loco
-    ThrottleState throttleState;
-    if (!lockState(pdMS_TO_TICKS(50))) {
-        ESP_LOGW(TAG, "Failed to lock state for function command");
-        return ESP_ERR_INVALID_STATE;
-    }
-    auto it = m_throttleStates.find(throttleId);
-    if (it == m_throttleStates.end() || !it->second.acquired) {
-        unlockState();
+    // Check if throttle has an acquired loco (lock-free; never waits on other tasks)
+    ThrottleSlot slot;
+    if (!loadThrottleSlot(throttleId, slot)) {
         ESP_LOGW(TAG, "No loco acquired on throttle %c", throttleId);
         return ESP_ERR_INVALID_STATE;
     }
-    throttleState = it->second;
-    unlockState();
     
     // Validate function number
     if (function < 0 || function > 28) {
@@ -345,12 +525,11 @@ esp_err_t WiThrottleClient::setFunction(char throttleId, int function, bool stat
     // WiThrottle protocol: M<throttleId>A<addressType><address><;>F<state><function>
     // F1<function> = activate, F0<function> = deactivate
     // Example: MTAS3<;>F10 (activate F0 on loco S3, throttle T)
-    std::string command = "M" + std::string(1, throttleId) + 
-                         "A" + std::string(1, throttleState.addressType) + std::to_string(throttleState.address) +
-                         "<;>F" + (state ? "1" : "0") + std::to_string(function);
+    WiThrottleCommandEncoder::Command command;
+    WiThrottleCommandEncoder::encodeFunction(command, throttleId, slot.addressType, slot.address,
+                                             function, state);
     
     ESP_LOGI(TAG, "Sending function command: throttle %c F%d -> %s", throttleId, function, state ? "ON" : "OFF");
-    ESP_LOGD(TAG, "Function command payload: %s", command.c_str());
     
     return sendCommand(command);
 }
@@ -362,26 +541,17 @@ esp_err_t WiThrottleClient::querySpeed(char throttleId)
         return ESP_ERR_INVALID_STATE;
     }
     
-    // Check if throttle has an acquired loco
-    ThrottleState throttleState;
-    if (!lockState(pdMS_TO_TICKS(50))) {
-        ESP_LOGW(TAG, "Failed to lock state for speed query");
-        return ESP_ERR_INVALID_STATE;
-    }
-    auto it = m_throttleStates.find(throttleId);
-    if (it == m_throttleStates.end() || !it->second.acquired) {
-        unlockState();
+    // Check if throttle has an acquired loco (lock-free; never waits on other tasks)
+    ThrottleSlot slot;
+    if (!loadThrottleSlot(throttleId, slot)) {
         ESP_LOGW(TAG, "No loco acquired on throttle %c", throttleId);
         return ESP_ERR_INVALID_STATE;
     }
-    throttleState = it->second;
-    unlockState();
     
     // WiThrottle protocol: M<throttleId>A<addressType><address><;>qV
     // Response will be: M<throttleId>A<addressType><address><;>V<speed>
-    std::string command = "M" + std::string(1, throttleId) + 
-                         "A" + std::string(1, throttleState.addressType) + std::to_string(throttleState.address) +
-                         "<;>qV";
+    WiThrottleCommandEncoder::Command command;
+    WiThrottleCommandEncoder::encodeQuery(command, throttleId, slot.addressType, slot.address, 'V');
     
     ESP_LOGD(TAG, "Querying throttle %c speed", throttleId);
     
@@ -395,26 +565,17 @@ esp_err_t WiThrottleClient::queryDirection(char throttleId)
         return ESP_ERR_INVALID_STATE;
     }
     
-    // Check if throttle has an acquired loco
-    ThrottleState throttleState;
-    if (!lockState(pdMS_TO_TICKS(50))) {
-        ESP_LOGW(TAG, "Failed to lock state for direction query");
-        return ESP_ERR_INVALID_STATE;
-    }
-    auto it = m_throttleStates.find(throttleId);
-    if (it == m_throttleStates.end() || !it->second.acquired) {
-        unlockState();
+    // Check if throttle has an acquired loco (lock-free; never waits on other tasks)
+    ThrottleSlot slot;
+    if (!loadThrottleSlot(throttleId, slot)) {
         ESP_LOGW(TAG, "No loco acquired on throttle %c", throttleId);
         return ESP_ERR_INVALID_STATE;
     }
-    throttleState = it->second;
-    unlockState();
     
     // WiThrottle protocol: M<throttleId>A<addressType><address><;>qR
     // Response will be: M<throttleId>A<addressType><address><;>R<direction>
-    std::string command = "M" + std::string(1, throttleId) + 
-                         "A" + std::string(1, throttleState.addressType) + std::to_string(throttleState.address) +
-                         "<;>qR";
+    WiThrottleCommandEncoder::Command command;
+    WiThrottleCommandEncoder::encodeQuery(command, throttleId, slot.addressType, slot.address, 'R');
     
     ESP_LOGD(TAG, "Querying throttle %c direction", throttleId);
     
@@ -424,180 +585,452 @@ esp_err_t WiThrottleClient::queryDirection(char throttleId)
 void WiThrottleClient::sendHeartbeat()
 {
     if (isConnected()) {
-        sendCommand(CMD_HEARTBEAT);
+        sendRaw(CMD_HEARTBEAT);
     }
 }
 
 #if CONFIG_THROTTLE_TESTS
-void WiThrottleClient::testProcessMessage(const std::string& message)
+void WiThrottleClient::testProcessMessage(std::string_view message)
 {
     processMessage(message);
 }
 #endif
 
-bool WiThrottleClient::lockState(TickType_t timeout) const
+int WiThrottleClient::throttleSlotIndex(char throttleId)
 {
-    if (!m_stateMutex) {
-        return true;
+    int index = throttleIndex(throttleId);
+    if (index >= 0) {
+        return index;
     }
-    return xSemaphoreTake(m_stateMutex, timeout) == pdTRUE;
+    if (throttleId == 'T') {
+        return MAX_THROTTLE_IDS;
+    }
+    if (throttleId == 'S') {
+        return MAX_THROTTLE_IDS + 1;
+    }
+    return -1;
 }
 
-void WiThrottleClient::unlockState() const
+bool WiThrottleClient::loadThrottleSlot(char throttleId, ThrottleSlot& outSlot) const
 {
-    if (m_stateMutex) {
-        xSemaphoreGive(m_stateMutex);
+    int index = throttleSlotIndex(throttleId);
+    if (index < 0) {
+        return false;
     }
+    // One word holds the whole slot, so a reader can never see a torn address/type pair
+    uint32_t packed = m_throttleSlots[index].load(std::memory_order_acquire);
+    outSlot.acquired = (packed & SLOT_ACQUIRED) != 0;
+    outSlot.address = static_cast<int>(packed & 0xFFFF);
+    outSlot.addressType = static_cast<char>((packed >> 16) & 0xFF);
+    return outSlot.acquired;
 }
 
-std::vector<WiThrottleClient::Locomotive> WiThrottleClient::getRosterSnapshot() const
+void WiThrottleClient::storeThrottleSlot(char throttleId, const ThrottleSlot& slot)
 {
-    std::vector<Locomotive> snapshot;
-    if (!lockState(pdMS_TO_TICKS(50))) {
-        return snapshot;
+    int index = throttleSlotIndex(throttleId);
+    if (index < 0) {
+        return;
     }
-    snapshot = m_roster;
-    unlockState();
-    return snapshot;
+    uint32_t packed = 0;
+    if (slot.acquired) {
+        packed = SLOT_ACQUIRED |
+                 (static_cast<uint32_t>(static_cast<uint8_t>(slot.addressType)) << 16) |
+                 (static_cast<uint32_t>(slot.address) & 0xFFFF);
+    }
+    m_throttleSlots[index].store(packed, std::memory_order_release);
 }
 
-size_t WiThrottleClient::getRosterSize() const
+bool WiThrottleClient::lockState(TickType_t timeout) const
 {
-    if (!lockState(pdMS_TO_TICKS(50))) {
-        return 0;
+    if (!m_stateMutex) {
+        return true;
     }
-    size_t size = m_roster.size();
-    unlockState();
-    return size;
+    return xSemaphoreTake(m_stateMutex, timeout) == pdTRUE;
 }
 
-bool WiThrottleClient::getRosterEntry(int index, Locomotive& outEntry) const
+void WiThrottleClient::unlockState() const
 {
-    if (index < 0) {
-        return false;
+    if (m_stateMutex) {
+        xSemaphoreGive(m_stateMutex);
     }
+}
+
+RosterHandle WiThrottleClient::getRosterSnapshot() const
+{
     if (!lockState(pdMS_TO_TICKS(50))) {
-        return false;
-    }
-    if (index >= static_cast<int>(m_roster.size())) {
-        unlockState();
-        return false;
+        return nullptr;
     }
-    outEntry = m_roster[static_cast<size_t>(index)];
+    RosterHandle snapshot = m_roster;
     unlockState();
-    return true;
+    return snapshot;
 }
 
 void WiThrottleClient::receiveTask(void* arg)
 {
     WiThrottleClient* client = static_cast<WiThrottleClient*>(arg);
-    char buffer[512];
-    std::string messageBuffer;
+    LineFramer& framer = client->m_rxFramer;
+    HeartbeatMonitor& heartbeat = client->m_heartbeat;
+    
+    if (!framer.isValid()) {
+        ESP_LOGE(TAG, "No receive buffer, closing connection");
+        client->m_running = false;
+    } else if (!client->establishConnection()) {
+        // Not cancelled by disconnect(), so report it; the socket is released on the next connect()
+        if (client->m_running) {
+            client->setState(ConnectionState::FAILED);
+        }
+        client->m_running = false;
+    }
+    
+    // JMRI greets a new client straight away (VN, RL, PPA...); silence means a wrong port or a stuck server
+    int64_t openedUs = esp_timer_get_time();
+    int64_t greetingDeadline = openedUs + static_cast<int64_t>(CONFIG_JMRI_HANDSHAKE_TIMEOUT_MS) * 1000;
+    bool greeted = false;
     
     while (client->m_running) {
-        int len = recv(client->m_socket, buffer, sizeof(buffer) - 1, 0);
+        int64_t now = esp_timer_get_time();
+        
+        if (!greeted && now >= greetingDeadline) {
+            ESP_LOGW(TAG, "No greeting from server within %d ms", CONFIG_JMRI_HANDSHAKE_TIMEOUT_MS);
+            client->m_running = false;
+            continue;
+        }
+        
+        switch (heartbeat.poll(now)) {
+            case HeartbeatMonitor::Action::SEND_HEARTBEAT:
+                client->sendRaw(CMD_HEARTBEAT);
+                heartbeat.onHeartbeatSent(now);
+                break;
+            case HeartbeatMonitor::Action::NONE:
+                break;
+        }
+        
+        // Sleep until data arrives or the next heartbeat deadline
+        int64_t deadline = heartbeat.getNextDeadlineUs();
+        int64_t waitUs = deadline < 0 ? RX_IDLE_WAIT_US : deadline - now;
+        if (!greeted) waitUs = std::min(waitUs, greetingDeadline - now);
+        if (waitUs < 0) waitUs = 0;
+        if (waitUs > RX_IDLE_WAIT_US) waitUs = RX_IDLE_WAIT_US;
+        
+        fd_set readSet;
+        FD_ZERO(&readSet);
+        FD_SET(client->m_socket, &readSet);
+        struct timeval timeout;
+        timeout.tv_sec = static_cast<long>(waitUs / 1000000);
+        timeout.tv_usec = static_cast<long>(waitUs % 1000000);
+        
+        int ready = select(client->m_socket + 1, &readSet, nullptr, nullptr, &timeout);
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ESP_LOGE(TAG, "select error: %d", errno);
+            break;
+        } else if (ready == 0) {
+            continue;
+        }
+        
+        // Receive directly into the framer; lines are parsed in place
+        char* buffer = framer.writePtr();
+        int len = recv(client->m_socket, buffer, framer.writeSpace(), MSG_DONTWAIT);
         
         if (len < 0) {
             if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                // Timeout, continue
-                vTaskDelay(pdMS_TO_TICKS(10));
                 continue;
             }
-            ESP_LOGE(TAG, "Receive error: %d", errno);
+            if (errno == ETIMEDOUT) {
+                ESP_LOGW(TAG, "Server stopped answering keepalive probes, link is dead");
+            } else {
+                ESP_LOGE(TAG, "Receive error: %d", errno);
+            }
             break;
         } else if (len == 0) {
-            ESP_LOGW(TAG, "Connection closed by server");
+            if (client->m_running) {
+                ESP_LOGW(TAG, "Connection closed by server");
+            }
             break;
         }
         
-        buffer[len] = '\0';
-        messageBuffer += buffer;
+        now = esp_timer_get_time();
+        if (!greeted) {
+            greeted = true;
+            client->m_connectTimings.greetingUs = static_cast<uint32_t>(now - openedUs);
+        }
+        framer.commit(static_cast<size_t>(len));
         
         // Process complete messages (separated by newline)
-        size_t pos;
-        while ((pos = messageBuffer.find('\n')) != std::string::npos) {
-            std::string message = messageBuffer.substr(0, pos);
-            messageBuffer.erase(0, pos + 1);
-            
+        std::string_view message;
+        while (framer.nextLine(message)) {
             if (!message.empty()) {
                 client->processMessage(message);
             }
         }
     }
     
+    // Stop the writer task too; disconnect()/connect() release the socket
+    client->m_running = false;
+    
     // Connection lost
     if (client->m_state == ConnectionState::CONNECTED) {
         ESP_LOGW(TAG, "Connection lost");
         client->setState(ConnectionState::DISCONNECTED);
     }
     
+    // Signal last: disconnect() may release the client as soon as it wakes
+    client->m_receiveTaskHandle = nullptr;
+    xSemaphoreGive(client->m_receiveExited);
     vTaskDelete(nullptr);
 }
 
-void WiThrottleClient::processMessage(const std::string& message)
+// Longer prefixes first within each leading character; first match wins
+const WiThrottleClient::DispatchEntry WiThrottleClient::DISPATCH_TABLE[] = {
+    { "M?A", MessageType::THROTTLE_ACTION,    &WiThrottleClient::handleThrottleMessage },
+    { "M?+", MessageType::THROTTLE_ADDED,     &WiThrottleClient::handleThrottleEventMessage },
+    { "M?-", MessageType::THROTTLE_REMOVED,   &WiThrottleClient::handleThrottleEventMessage },
+    { "M?S", MessageType::THROTTLE_STEAL,     &WiThrottleClient::handleThrottleEventMessage },
+    { "M?L", MessageType::THROTTLE_LABELS,    &WiThrottleClient::handleFunctionLabelsMessage },
+    { "PPA", MessageType::POWER,              &WiThrottleClient::handlePowerMessage },
+    { "PTT", MessageType::TURNOUT_TITLES,     nullptr },
+    { "PTL", MessageType::TURNOUT_LIST,       &WiThrottleClient::handleTurnoutListMessage },
+    { "PTA", MessageType::TURNOUT_ACTION,     &WiThrottleClient::handleTurnoutActionMessage },
+    { "PRT", MessageType::ROUTE_TITLES,       nullptr },
+    { "PRL", MessageType::ROUTE_LIST,         &WiThrottleClient::handleRouteListMessage },
+    { "PRA", MessageType::ROUTE_ACTION,       &WiThrottleClient::handleRouteActionMessage },
+    { "PFT", MessageType::FAST_CLOCK,         &WiThrottleClient::handleFastClockMessage },
+    { "PW",  MessageType::WEB_PORT,           &WiThrottleClient::handleWebPortMessage },
+    { "RL",  MessageType::ROSTER,             &WiThrottleClient::handleRosterMessage },
+    { "RC",  MessageType::CONSIST,            nullptr },
+    { "HT",  MessageType::SERVER_TYPE,        &WiThrottleClient::handleServerInfoMessage },
+    { "Ht",  MessageType::SERVER_DESCRIPTION, &WiThrottleClient::handleServerInfoMessage },
+    { "Hm",  MessageType::INFO_MESSAGE,       &WiThrottleClient::handleAlertMessage },
+    { "HM",  MessageType::ALERT,              &WiThrottleClient::handleAlertMessage },
+    { "VN",  MessageType::VERSION,            &WiThrottleClient::handleVersionMessage },
+    { "*",   MessageType::HEARTBEAT,          &WiThrottleClient::handleHeartbeatMessage },
+};
+
+void WiThrottleClient::processMessage(std::string_view message)
 {
-    // Log at debug level for normal operation
-    ESP_LOGI(TAG, "RX: %s", message.c_str());
+    ESP_LOGV(TAG, "RX: %.*s", static_cast<int>(message.size()), message.data());
     
     if (message.empty()) {
         return;
     }
     
-    // Parse message type
-    char msgType = message[0];
-    
-    switch (msgType) {
-        case 'P':  // Power or Web Port
-            if (message.length() > 1 && message[1] == 'W') {
-                // Web Port (PW<port>)
-                if (message.length() > 2) {
-                    m_webPort = std::atoi(message.substr(2).c_str());
-                    ESP_LOGI(TAG, "Discovered JSON web server port: %d", m_webPort);
-                    if (m_webPortCallback) {
-                        m_webPortCallback(m_webPort);
-                    }
-                }
-            } else if (message.length() > 1 && message[1] == 'P') {
-                // Power message (PPA)
-                handlePowerMessage(message);
-            }
-            break;
-            
-        case 'V':  // Version
-            ESP_LOGI(TAG, "Server version: %s", message.substr(1).c_str());
-            break;
-            
-        case 'R':  // Roster or Routes
-            if (message.length() > 1 && message[1] == 'L') {
-                // Roster List
-                handleRosterMessage(message);
-            } else if (message.length() > 1 && message[1] == 'C') {
-                // Roster Consist (ignore for now)
-                ESP_LOGD(TAG, "Roster consist message (ignored)");
-            } else {
-                ESP_LOGD(TAG, "Other roster message: %s", message.c_str());
-            }
-            break;
-            
-        case 'H':  // Heartbeat response
-            ESP_LOGD(TAG, "Heartbeat acknowledged");
-            break;
-            
-        case '*':  // Heartbeat request from server
-            sendHeartbeat();
-            break;
-            
-        case 'M':  // Multi-throttle (throttle state changes)
-            handleThrottleMessage(message);
-            break;
-            
-        default:
-            ESP_LOGW(TAG, "Unhandled message type: %c", msgType);
+    const DispatchEntry* match = nullptr;
+    for (const DispatchEntry& entry : DISPATCH_TABLE) {
+        if (entry.prefix[0] == message[0] && matchesPrefix(message, entry.prefix)) {
+            match = &entry;
             break;
+        }
+    }
+    
+    MessageType type = match ? match->type : MessageType::UNKNOWN;
+    MessageStats& stats = m_messageStats[static_cast<size_t>(type)];
+    stats.messages++;
+    stats.bytes += static_cast<uint32_t>(message.size());
+    
+    if (!match) {
+        ESP_LOGD(TAG, "Unhandled message: %.*s", static_cast<int>(message.size()), message.data());
+        return;
+    }
+    if (match->handler) {
+        (this->*match->handler)(message);
+    }
+}
+
+WiThrottleClient::MessageStats WiThrottleClient::getMessageStats(MessageType type) const
+{
+    size_t index = static_cast<size_t>(type);
+    if (index >= static_cast<size_t>(MessageType::COUNT)) {
+        return MessageStats{ 0, 0 };
+    }
+    return m_messageStats[index];
+}
+
+const char* WiThrottleClient::getMessageTypeName(MessageType type)
+{
+    switch (type) {
+        case MessageType::VERSION:            return "VN";
+        case MessageType::ROSTER:             return "RL";
+        case MessageType::CONSIST:            return "RC";
+        case MessageType::POWER:              return "PPA";
+        case MessageType::WEB_PORT:           return "PW";
+        case MessageType::TURNOUT_TITLES:     return "PTT";
+        case MessageType::TURNOUT_LIST:       return "PTL";
+        case MessageType::TURNOUT_ACTION:     return "PTA";
+        case MessageType::ROUTE_TITLES:       return "PRT";
+        case MessageType::ROUTE_LIST:         return "PRL";
+        case MessageType::ROUTE_ACTION:       return "PRA";
+        case MessageType::FAST_CLOCK:         return "PFT";
+        case MessageType::SERVER_TYPE:        return "HT";
+        case MessageType::SERVER_DESCRIPTION: return "Ht";
+        case MessageType::INFO_MESSAGE:       return "Hm";
+        case MessageType::ALERT:              return "HM";
+        case MessageType::HEARTBEAT:          return "*";
+        case MessageType::THROTTLE_ACTION:    return "MA";
+        case MessageType::THROTTLE_ADDED:     return "M+";
+        case MessageType::THROTTLE_REMOVED:   return "M-";
+        case MessageType::THROTTLE_STEAL:     return "MS";
+        case MessageType::THROTTLE_LABELS:    return "ML";
+        case MessageType::UNKNOWN:            return "?";
+        default:                              return "";
     }
 }
 
-void WiThrottleClient::handlePowerMessage(const std::string& message)
+void WiThrottleClient::logMessageStats() const
+{
+    for (size_t i = 0; i < static_cast<size_t>(MessageType::COUNT); i++) {
+        const MessageStats& stats = m_messageStats[i];
+        if (stats.messages == 0) {
+            continue;
+        }
+        ESP_LOGI(TAG, "RX %-4s %6lu msgs %8lu bytes", getMessageTypeName(static_cast<MessageType>(i)),
+                 (unsigned long)stats.messages, (unsigned long)stats.bytes);
+    }
+}
+
+void WiThrottleClient::resetMessageStats()
+{
+    memset(m_messageStats, 0, sizeof(m_messageStats));
+}
+
+void WiThrottleClient::handleVersionMessage(std::string_view message)
+{
+    ESP_LOGI(TAG, "Server version: %.*s", static_cast<int>(message.size() - 2), message.data() + 2);
+}
+
+void WiThrottleClient::handleWebPortMessage(std::string_view message)
+{
+    // PW<port>
+    if (message.length() <= 2) {
+        return;
+    }
+    m_webPort = static_cast<uint16_t>(parseInt(message.substr(2)));
+    ESP_LOGI(TAG, "Discovered JSON web server port: %d", m_webPort);
+    if (m_webPortCallback) {
+        m_webPortCallback(m_webPort);
+    }
+}
+
+void WiThrottleClient::handleTurnoutListMessage(std::string_view message)
+{
+    // PTL]\[<system>}|{<user>}|{<state>]\[...
+    if (!m_turnoutCallback) {
+        return;
+    }
+    forEachListEntry(message.substr(3), [this](std::string_view systemName, char state) {
+        m_turnoutCallback(systemName, state);
+    });
+}
+
+void WiThrottleClient::handleTurnoutActionMessage(std::string_view message)
+{
+    // PTA<state><system>
+    if (!m_turnoutCallback || message.length() < 5) {
+        return;
+    }
+    m_turnoutCallback(message.substr(4), message[3]);
+}
+
+void WiThrottleClient::handleRouteListMessage(std::string_view message)
+{
+    // PRL]\[<system>}|{<user>}|{<state>]\[...
+    if (!m_routeCallback) {
+        return;
+    }
+    forEachListEntry(message.substr(3), [this](std::string_view systemName, char state) {
+        m_routeCallback(systemName, state);
+    });
+}
+
+void WiThrottleClient::handleRouteActionMessage(std::string_view message)
+{
+    // PRA<state><system>
+    if (!m_routeCallback || message.length() < 5) {
+        return;
+    }
+    m_routeCallback(message.substr(4), message[3]);
+}
+
+void WiThrottleClient::handleFastClockMessage(std::string_view message)
+{
+    // PFT<seconds><;><rate>
+    if (!m_fastClockCallback) {
+        return;
+    }
+    std::string_view data = message.substr(3);
+    uint32_t seconds = 0;
+    std::from_chars(data.data(), data.data() + data.size(), seconds);
+
+    float rate = 0.0f;
+    size_t delimPos = data.find("<;>");
+    if (delimPos != std::string_view::npos) {
+        char rateText[16];
+        size_t length = std::min(data.size() - delimPos - 3, sizeof(rateText) - 1);
+        memcpy(rateText, data.data() + delimPos + 3, length);
+        rateText[length] = '\0';
+        rate = strtof(rateText, nullptr);
+    }
+    m_fastClockCallback(seconds, rate);
+}
+
+void WiThrottleClient::handleServerInfoMessage(std::string_view message)
+{
+    // HT<type> / Ht<description>
+    ESP_LOGD(TAG, "Server %s: %.*s", message[1] == 'T' ? "type" : "description",
+             static_cast<int>(message.size() - 2), message.data() + 2);
+}
+
+void WiThrottleClient::handleAlertMessage(std::string_view message)
+{
+    // HM<alert> / Hm<info>
+    bool isAlert = message[1] == 'M';
+    std::string_view text = message.substr(2);
+    if (isAlert) {
+        ESP_LOGW(TAG, "Server alert: %.*s", static_cast<int>(text.size()), text.data());
+    }
+    if (m_alertCallback) {
+        m_alertCallback(isAlert, text);
+    }
+}
+
+void WiThrottleClient::handleHeartbeatMessage(std::string_view message)
+{
+    // *<seconds>: server E-stops our locos if it hears nothing for this long
+    int64_t now = esp_timer_get_time();
+    if (message.length() > 1) {
+        int seconds = parseInt(message.substr(1));
+        if (seconds != m_heartbeat.getIntervalSeconds()) {
+            ESP_LOGI(TAG, "Server heartbeat interval: %d s", seconds);
+            m_heartbeat.setIntervalSeconds(seconds);
+            applyKeepAlive();
+        }
+        
+        if (seconds > 0 && !m_heartbeatMonitoring) {
+            // Have the server stop our locos if this link dies
+            sendRaw(CMD_HEARTBEAT_MONITOR_ON);
+            m_heartbeatMonitoring = true;
+        }
+    }
+    
+    sendHeartbeat();
+    m_heartbeat.onHeartbeatSent(now);
+}
+
+void WiThrottleClient::applyKeepAlive()
+{
+    // JMRI does not answer '*', so a quiet server is only known to be alive from TCP
+    HeartbeatMonitor::KeepAlive keepAlive = m_heartbeat.getKeepAlive();
+    int enable = keepAlive.count > 0 ? 1 : 0;
+    setsockopt(m_socket, SOL_SOCKET, SO_KEEPALIVE, &enable, sizeof(enable));
+    if (enable) {
+        setsockopt(m_socket, IPPROTO_TCP, TCP_KEEPIDLE, &keepAlive.idleSeconds, sizeof(keepAlive.idleSeconds));
+        setsockopt(m_socket, IPPROTO_TCP, TCP_KEEPINTVL, &keepAlive.intervalSeconds, sizeof(keepAlive.intervalSeconds));
+        setsockopt(m_socket, IPPROTO_TCP, TCP_KEEPCNT, &keepAlive.count, sizeof(keepAlive.count));
+    }
+}
+
+void WiThrottleClient::handlePowerMessage(std::string_view message)
 {
     // Power message format: PPA<state>
     // PPA0 = power off
@@ -646,128 +1079,141 @@ void WiThrottleClient::handlePowerMessage(const std::string& message)
 void WiThrottleClient::setState(ConnectionState newState)
 {
     if (m_state != newState) {
+        bool sessionEnded = (m_state == ConnectionState::CONNECTED);
         m_state = newState;
         ESP_LOGI(TAG, "Connection state changed: %d", (int)newState);
         
+        if (sessionEnded) {
+            // JMRI releases every loco of a closed connection
+            for (std::atomic<uint32_t>& packed : m_throttleSlots) {
+                packed.store(0, std::memory_order_release);
+            }
+            if (m_sessionCallback) {
+                m_sessionCallback(false);
+            }
+        }
         if (m_connectionCallback) {
             m_connectionCallback(newState);
         }
     }
 }
 
-esp_err_t WiThrottleClient::sendCommand(const std::string& command)
+esp_err_t WiThrottleClient::sendCommand(const WiThrottleCommandEncoder::Command& command)
 {
-    if (m_socket < 0) {
+    if (m_socket < 0 || !m_txQueue) {
         ESP_LOGW(TAG, "Cannot send command - not connected");
         return ESP_ERR_INVALID_STATE;
     }
     
-    std::string fullCommand = command + "\n";
-    int len = send(m_socket, fullCommand.c_str(), fullCommand.length(), 0);
-    
-    if (len < 0) {
-        ESP_LOGE(TAG, "Failed to send command: %d", errno);
-        return ESP_FAIL;
+    if (command.length == 0) {
+        ESP_LOGW(TAG, "Cannot send command - encoding failed");
+        return ESP_ERR_INVALID_ARG;
     }
     
-    // Log all sent commands at INFO level for testing
-    ESP_LOGD(TAG, "TX: %s", command.c_str());
+    // Never block the caller (encoder/LVGL task); the writer task owns send()
+    if (xQueueSend(m_txQueue, &command, 0) != pdTRUE) {
+        m_txDropped.fetch_add(1, std::memory_order_relaxed);
+        ESP_LOGW(TAG, "TX queue full, dropping: %.*s",
+                 static_cast<int>(command.text().size()), command.text().data());
+        return ESP_ERR_NO_MEM;
+    }
     return ESP_OK;
 }
 
-void WiThrottleClient::handleRosterMessage(const std::string& message)
+esp_err_t WiThrottleClient::sendRaw(std::string_view text)
 {
-    // Roster format: RL<count>]\[<name1>}|{<addr1>}|{<type1>]\[<name2>}|{<addr2>}|{<type2>...
-    // Example: RL2]\[56086}|{3}|{S]\[Shunter}|{4}|{S
-    // Delimiters: ]\[ (3 chars) separates entries, }|{ (3 chars) separates fields
-    
-    ESP_LOGI(TAG, "Parsing roster message");
-    
-    if (message.length() < 3 || message.substr(0, 2) != "RL") {
-        ESP_LOGW(TAG, "Invalid roster message format");
-        return;
+    WiThrottleCommandEncoder::Command command;
+    if (!WiThrottleCommandEncoder::encodeRaw(command, text)) {
+        ESP_LOGW(TAG, "Command too long (%u bytes)", (unsigned)text.size());
+        return ESP_ERR_INVALID_SIZE;
     }
+    return sendCommand(command);
+}
+
+void WiThrottleClient::transmitTask(void* arg)
+{
+    WiThrottleClient* client = static_cast<WiThrottleClient*>(arg);
+    WiThrottleCommandEncoder::Command command;
+    char batch[TX_BATCH_SIZE];
     
-    std::vector<Locomotive> newRoster;
-    
-    // Find the count (ends with ])
-    size_t countEnd = message.find(']', 2);
-    if (countEnd == std::string::npos) {
-        ESP_LOGW(TAG, "No count delimiter found");
-        return;
-    }
-    
-    int count = std::atoi(message.substr(2, countEnd - 2).c_str());
-    ESP_LOGI(TAG, "Roster count: %d", count);
-    
-    // Parse each loco entry
-    // After count delimiter ], we start with ]\[ (backslash IS part of protocol)
-    size_t pos = countEnd + 1; // Position after the ]
-    
-    for (int i = 0; i < count; i++) {
-        // Expect ]\[ delimiter (3 characters: ], \, [)
-        if (pos + 2 >= message.length() || 
-            message[pos] != '\\' || message[pos + 1] != '[') {
-            ESP_LOGW(TAG, "Expected \\[ at position %d (got '%c%c')", 
-                     pos, message[pos], message[pos+1]);
-            break;
-        }
-        pos += 2; // Skip the \[
-        
-        // Find name (ends with }|{ delimiter)
-        size_t nameEnd = message.find("}|{", pos);
-        if (nameEnd == std::string::npos) {
-            ESP_LOGW(TAG, "No name delimiter at position %d", pos);
-            break;
+    while (client->m_running) {
+        if (xQueueReceive(client->m_txQueue, &command, pdMS_TO_TICKS(100)) != pdTRUE) {
+            continue;
         }
-        std::string name = message.substr(pos, nameEnd - pos);
-        pos = nameEnd + 3; // Skip the }|{
         
-        // Find address (ends with }|{)
-        size_t addrEnd = message.find("}|{", pos);
-        if (addrEnd == std::string::npos) {
-            ESP_LOGW(TAG, "No address delimiter at position %d", pos);
-            break;
-        }
-        std::string addrStr = message.substr(pos, addrEnd - pos);
-        int address = std::atoi(addrStr.c_str());
-        pos = addrEnd + 3;
+#if CONFIG_WITHROTTLE_TX_COALESCE_TICKS > 0
+        // Let producers finish this tick (e.g. speed + direction, or a poll of
+        // every throttle) so their commands share one segment
+        vTaskDelay(CONFIG_WITHROTTLE_TX_COALESCE_TICKS);
+#endif
         
-        // Get address type (S or L)
-        char addressType = 'S';
-        if (pos < message.length()) {
-            addressType = message[pos];
-            pos++;
-        }
+        // Write-combine: everything already queued goes out in the same segment
+        size_t used = 0;
+        uint32_t commands = 0;
+        do {
+            memcpy(batch + used, command.data, command.length);
+            used += command.length;
+            commands++;
+            ESP_LOGD(TAG, "TX: %.*s", static_cast<int>(command.text().size()), command.text().data());
+        } while (used + WiThrottleCommandEncoder::MAX_COMMAND_LENGTH <= sizeof(batch) &&
+                 xQueueReceive(client->m_txQueue, &command, 0) == pdTRUE);
         
-        // Skip the ] that ends this entry
-        if (pos < message.length() && message[pos] == ']') {
-            pos++; // Now positioned at \ for next entry's ]\[ delimiter
+        size_t sent = 0;
+        while (sent < used) {
+            int len = send(client->m_socket, batch + sent, used - sent, 0);
+            if (len < 0) {
+                ESP_LOGE(TAG, "Failed to send %lu command(s): %d", (unsigned long)commands, errno);
+                break;
+            }
+            sent += static_cast<size_t>(len);
         }
         
-        // Add to roster
-        Locomotive loco(address, name, addressType);
-    newRoster.push_back(loco);
-        
-        ESP_LOGD(TAG, "  Loco %d: '%s' addr=%d (%c)", i + 1, name.c_str(), address, addressType);
+        client->m_txCommands.fetch_add(commands, std::memory_order_relaxed);
+        client->m_txSegments.fetch_add(1, std::memory_order_relaxed);
     }
     
-    ESP_LOGI(TAG, "Roster loaded: %d locomotives", newRoster.size());
+    client->m_transmitTaskHandle = nullptr;
+    xSemaphoreGive(client->m_transmitExited);
+    vTaskDelete(nullptr);
+}
+
+#if CONFIG_WITHROTTLE_LATENCY_TRACE
+void WiThrottleClient::logLatencyStats() const
+{
+    m_speedRoundTrip.log(TAG, "Speed round trip");
+    ESP_LOGI(TAG, "TX: %lu commands in %lu segments, %lu dropped",
+             (unsigned long)getTxCommandCount(), (unsigned long)getTxSegmentCount(),
+             (unsigned long)getTxDroppedCount());
+    logMessageStats();
+}
+#endif
 
+void WiThrottleClient::handleRosterMessage(std::string_view message)
+{
+    // Roster format: RL<count>]\[<name1>}|{<addr1>}|{<type1>]\[<name2>}|{<addr2>}|{<type2>...
+    // Example: RL2]\[56086}|{3}|{S]\[Shunter}|{4}|{S
+    RosterHandle roster = RosterSnapshot::parse(message);
+    if (!roster) {
+        return;
+    }
+    
+    ESP_LOGI(TAG, "Roster loaded: %u locomotives (%u bytes)",
+             (unsigned)roster->size(), (unsigned)roster->getArenaBytes());
+    
+    // Swap in by pointer; readers holding the old roster keep it until they let go
     if (lockState(pdMS_TO_TICKS(50))) {
-        m_roster = newRoster;
+        m_roster = roster;
         unlockState();
     } else {
         ESP_LOGW(TAG, "Failed to lock state for roster update");
     }
     
-    // Notify callback with snapshot
     if (m_rosterCallback) {
-        m_rosterCallback(newRoster);
+        m_rosterCallback(roster);
     }
 }
 
-void WiThrottleClient::handleThrottleMessage(const std::string& message)
+void WiThrottleClient::handleThrottleMessage(std::string_view message)
 {
     // Multi-throttle message format: M<throttleId><command><data>
     // Examples:
@@ -776,78 +1222,32 @@ void WiThrottleClient::handleThrottleMessage(const std::string& message)
     //   M0AS3<;>F15     - Throttle 0, Action, address S3, function 1 on
 
     if (message.length() < 3) {
-        ESP_LOGW(TAG, "Throttle message too short: %s", message.c_str());
+        ESP_LOGW(TAG, "Throttle message too short: %.*s", static_cast<int>(message.size()), message.data());
         return;
     }
     
-    char throttleId = message[1];  // '0', '1', '2', '3'
-    char command = message[2];     // 'A' = action, '+' = add, '-' = remove, 'L' = labels
-    
-    if (command == 'L') {
-        size_t delimPos = message.find("<;>");
-        if (delimPos == std::string::npos) {
-            ESP_LOGW(TAG, "Throttle label message missing delimiter: %s", message.c_str());
-            return;
-        }
-
-        std::string data = message.substr(delimPos + 3);
-        std::vector<std::string> labels;
-
-        const std::string delimiter = "]\\[";
-        size_t pos = 0;
-        if (data.rfind(delimiter, 0) == 0) {
-            pos = delimiter.size();
-        }
-
-        while (pos <= data.length()) {
-            size_t next = data.find(delimiter, pos);
-            if (next == std::string::npos) {
-                labels.push_back(data.substr(pos));
-                break;
-            }
-            labels.push_back(data.substr(pos, next - pos));
-            pos = next + delimiter.size();
-        }
-
-        if (labels.size() < 29) {
-            labels.resize(29);
-        }
-        if (labels.size() > 29) {
-            labels.resize(29);
-        }
-
-        if (m_functionLabelsCallback) {
-            m_functionLabelsCallback(throttleId, labels);
-        }
-        return;
-    }
-
-    // We only care about 'A' (action) messages for state updates
-    if (command != 'A') {
-        ESP_LOGD(TAG, "Ignoring non-action throttle message: %s", message.c_str());
-        return;
-    }
+    char throttleId = message[1];  // '0'-'9', 'a'-'z' (see throttleIdChar())
     
     // Find the <;> delimiter that separates address from data
     size_t delimPos = message.find("<;>");
-    if (delimPos == std::string::npos) {
-        ESP_LOGW(TAG, "Throttle message missing delimiter: %s", message.c_str());
+    if (delimPos == std::string_view::npos) {
+        ESP_LOGW(TAG, "Throttle message missing delimiter: %.*s", static_cast<int>(message.size()), message.data());
         return;
     }
     
     // Extract address (e.g., "S3" or "L41")
-    std::string addressPart = message.substr(3, delimPos - 3);
+    std::string_view addressPart = message.substr(3, delimPos - 3);
     if (addressPart.length() < 2) {
-        ESP_LOGW(TAG, "Throttle message invalid address: %s", message.c_str());
+        ESP_LOGW(TAG, "Throttle message invalid address: %.*s", static_cast<int>(message.size()), message.data());
         return;
     }
     
-    int address = std::atoi(addressPart.substr(1).c_str());
+    int address = parseInt(addressPart.substr(1));
     
     // Extract command data after delimiter
-    std::string data = message.substr(delimPos + 3);
+    std::string_view data = message.substr(delimPos + 3);
     if (data.empty()) {
-        ESP_LOGW(TAG, "Throttle message missing data: %s", message.c_str());
+        ESP_LOGW(TAG, "Throttle message missing data: %.*s", static_cast<int>(message.size()), message.data());
         return;
     }
     
@@ -865,8 +1265,20 @@ void WiThrottleClient::handleThrottleMessage(const std::string& message)
     switch (dataType) {
         case 'V':  // Speed
             if (data.length() > 1) {
-                update.speed = std::atoi(data.substr(1).c_str());
+                update.speed = parseInt(data.substr(1));
                 ESP_LOGD(TAG, "Throttle %c speed: %d", throttleId, update.speed);
+#if CONFIG_WITHROTTLE_LATENCY_TRACE
+                {
+                    int traceIndex = throttleIndex(throttleId);
+                    if (traceIndex >= 0 && traceIndex < TRACE_THROTTLES && m_speedSentUs[traceIndex] != 0) {
+                        m_speedRoundTrip.record(static_cast<uint32_t>(esp_timer_get_time() - m_speedSentUs[traceIndex]));
+                        m_speedSentUs[traceIndex] = 0;
+                        if (m_speedRoundTrip.getCount() % 32 == 0) {
+                            logLatencyStats();
+                        }
+                    }
+                }
+#endif
             }
             break;
             
@@ -881,7 +1293,7 @@ void WiThrottleClient::handleThrottleMessage(const std::string& message)
             if (data.length() > 2) {
                 // Format: F<state><function> e.g., F10 (F0 on), F110 (F10 on)
                 bool funcState = (data[1] == '1');
-                int funcNum = std::atoi(data.substr(2).c_str());
+                int funcNum = parseInt(data.substr(2));
                 update.function = funcNum;
                 update.functionState = funcState;
                 ESP_LOGD(TAG, "Throttle %c function %d: %s", throttleId, funcNum, funcState ? "on" : "off");
@@ -889,7 +1301,7 @@ void WiThrottleClient::handleThrottleMessage(const std::string& message)
             break;
             
         default:
-            ESP_LOGD(TAG, "Unknown throttle data type: %c in %s", dataType, message.c_str());
+            ESP_LOGD(TAG, "Unknown throttle data type: %c in %.*s", dataType, static_cast<int>(message.size()), message.data());
             return;
     }
     
@@ -898,3 +1310,63 @@ void WiThrottleClient::handleThrottleMessage(const std::string& message)
         m_throttleCallback(update);
     }
 }
+
+void WiThrottleClient::handleThrottleEventMessage(std::string_view message)
+{
+    // M<id>+<key><;>..., M<id>-<key><;>..., M<id>S<key><;><key>
+    if (!m_throttleEventCallback) {
+        return;
+    }
+    
+    size_t delimPos = message.find("<;>");
+    std::string_view key = message.substr(3, delimPos == std::string_view::npos ? std::string_view::npos : delimPos - 3);
+    if (key.length() < 2) {
+        ESP_LOGW(TAG, "Throttle event missing address: %.*s", static_cast<int>(message.size()), message.data());
+        return;
+    }
+    
+    ThrottleEvent event = ThrottleEvent::ADDED;
+    if (message[2] == '-') {
+        event = ThrottleEvent::REMOVED;
+    } else if (message[2] == 'S') {
+        event = ThrottleEvent::STEAL_REQUIRED;
+    }
+    m_throttleEventCallback(message[1], event, parseInt(key.substr(1)), key[0]);
+}
+
+void WiThrottleClient::handleFunctionLabelsMessage(std::string_view message)
+{
+    // M<id>L<key><;>]\[<F0 label>]\[<F1 label>...
+    if (!m_functionLabelsCallback) {
+        return;
+    }
+    
+    size_t delimPos = message.find("<;>");
+    if (delimPos == std::string_view::npos) {
+        ESP_LOGW(TAG, "Throttle label message missing delimiter: %.*s", static_cast<int>(message.size()), message.data());
+        return;
+    }
+
+    std::string_view data = message.substr(delimPos + 3);
+    std::vector<std::string> labels;
+
+    constexpr std::string_view delimiter = "]\\[";
+    size_t pos = 0;
+    if (data.rfind(delimiter, 0) == 0) {
+        pos = delimiter.size();
+    }
+
+    while (pos <= data.length()) {
+        size_t next = data.find(delimiter, pos);
+        if (next == std::string_view::npos) {
+            labels.emplace_back(data.substr(pos));
+            break;
+        }
+        labels.emplace_back(data.substr(pos, next - pos));
+        pos = next + delimiter.size();
+    }
+
+    labels.resize(29);
+
+    m_functionLabelsCallback(message[1], labels);
+}
@@ -1,38 +1,38 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <vector>
-#include <map>
+#include <atomic>
 #include <functional>
 #include "esp_err.h"
 #include "sdkconfig.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/semphr.h"
+#include "freertos/queue.h"
+#include "HeartbeatMonitor.h"
+#include "LineFramer.h"
+#include "RosterSnapshot.h"
+#include "ThrottleTransport.h"
+#include "WiThrottleCommandEncoder.h"
+#if CONFIG_WITHROTTLE_LATENCY_TRACE
+#include "LatencyHistogram.h"
+#endif
 
 /**
  * @brief WiThrottle Protocol Client for JMRI
  * 
  * Implements the WiThrottle protocol for communication with JMRI
  * and other DCC command stations.
- * 
+ *
+ * This is the default ThrottleTransport; JmriJsonThrottle is the
+ * alternative that runs over the JMRI JSON WebSocket instead.
+ *
  * Protocol documentation: https://www.jmriwireless.net/WiThrottle/Protocol
  */
-class WiThrottleClient {
+class WiThrottleClient : public ThrottleTransport {
 public:
-    /**
-     * @brief Locomotive entry from roster
-     */
-    struct Locomotive {
-        int address;           // DCC address
-        std::string name;      // Loco name/number
-        char addressType;      // 'S' = short, 'L' = long
-        
-        Locomotive() : address(0), addressType('S') {}
-        Locomotive(int addr, const std::string& n, char type) 
-            : address(addr), name(n), addressType(type) {}
-    };
-    
     /**
      * @brief Track power states
      */
@@ -67,9 +67,9 @@ public:
     
     /**
      * @brief Callback for roster updates
-     * @param roster Vector of locomotives
+     * @param roster Shared handle to the new roster (keep it to retain the roster)
      */
-    using RosterCallback = std::function<void(const std::vector<Locomotive>& roster)>;
+    using RosterCallback = std::function<void(const RosterHandle& roster)>;
     
     /**
      * @brief Callback for web server port discovery
@@ -78,33 +78,90 @@ public:
     using WebPortCallback = std::function<void(uint16_t port)>;
     
     /**
-     * @brief Throttle state change notification
+     * @brief Throttle allocation events reported by the server
      */
-    struct ThrottleUpdate {
-        char throttleId;           // Throttle identifier (0-3)
-        int address;               // Loco DCC address
-        int speed;                 // Speed (0-126), -1 if not in message
-        int direction;             // Direction (0=reverse, 1=forward), -1 if not in message
-        int function;              // Function number (0-28), -1 if not in message
-        bool functionState;        // Function state (only valid if function >= 0)
+    enum class ThrottleEvent {
+        ADDED,           // M<id>+ : loco attached to the throttle
+        REMOVED,         // M<id>- : loco released
+        STEAL_REQUIRED   // M<id>S : loco is in use elsewhere
     };
-    
+
+    /**
+     * @brief Callback for throttle allocation events
+     */
+    using ThrottleEventCallback = std::function<void(char throttleId, ThrottleEvent event, int address, char addressType)>;
+
     /**
-     * @brief Callback for throttle state changes
-     * Called when throttle speed/direction/function changes are received
-     * @param update Throttle update information
+     * @brief Callback for turnout or route state (from list or action messages)
+     * @param systemName JMRI system name (valid only during the callback)
+     * @param state Protocol state character (turnouts: 1=unknown 2=closed 4=thrown;
+     *              routes: 2=active 4=inactive 8=inconsistent)
      */
-    using ThrottleStateCallback = std::function<void(const ThrottleUpdate& update)>;
+    using LayoutItemCallback = std::function<void(std::string_view systemName, char state)>;
 
     /**
-     * @brief Callback for function label updates
-     * @param throttleId Throttle identifier (0-3)
-     * @param labels Function labels (index = function number)
+     * @brief Callback for the layout fast clock
+     * @param seconds Fast time in seconds since the epoch
+     * @param rate Fast clock rate (0 = stopped)
      */
-    using FunctionLabelsCallback = std::function<void(char throttleId, const std::vector<std::string>& labels)>;
+    using FastClockCallback = std::function<void(uint32_t seconds, float rate)>;
+
+    /**
+     * @brief Callback for server messages to the user
+     * @param isAlert true for an alert (HM), false for an informational message (Hm)
+     * @param text Message text (valid only during the callback)
+     */
+    using AlertCallback = std::function<void(bool isAlert, std::string_view text)>;
+
+    /**
+     * @brief Server message types recognised by the dispatcher
+     */
+    enum class MessageType : uint8_t {
+        VERSION,             // VN
+        ROSTER,              // RL
+        CONSIST,             // RC*
+        POWER,               // PPA
+        WEB_PORT,            // PW
+        TURNOUT_TITLES,      // PTT
+        TURNOUT_LIST,        // PTL
+        TURNOUT_ACTION,      // PTA
+        ROUTE_TITLES,        // PRT
+        ROUTE_LIST,          // PRL
+        ROUTE_ACTION,        // PRA
+        FAST_CLOCK,          // PFT
+        SERVER_TYPE,         // HT
+        SERVER_DESCRIPTION,  // Ht
+        INFO_MESSAGE,        // Hm
+        ALERT,               // HM
+        HEARTBEAT,           // *
+        THROTTLE_ACTION,     // M<id>A
+        THROTTLE_ADDED,      // M<id>+
+        THROTTLE_REMOVED,    // M<id>-
+        THROTTLE_STEAL,      // M<id>S
+        THROTTLE_LABELS,     // M<id>L
+        UNKNOWN,
+        COUNT
+    };
+
+    /**
+     * @brief Received traffic for one message type
+     */
+    struct MessageStats {
+        uint32_t messages;
+        uint32_t bytes;
+    };
+
+    /**
+     * @brief Time spent in each phase of the last connection attempt
+     */
+    struct ConnectTimings {
+        uint32_t resolveUs;   // Host name to address (near 0 when cached or numeric)
+        uint32_t tcpUs;       // TCP handshake
+        uint32_t greetingUs;  // Socket open to the server's first line (0 until it arrives)
+    };
     
     WiThrottleClient();
-    ~WiThrottleClient();
+    ~WiThrottleClient() override;
     
     // Delete copy/move
     WiThrottleClient(const WiThrottleClient&) = delete;
@@ -118,6 +175,11 @@ public:
     
     /**
      * @brief Connect to JMRI WiThrottle server
+     *
+     * Returns at once. Resolving the host, the TCP handshake and waiting for
+     * the server's greeting run on the receive task, each bounded by its own
+     * timeout; the state moves to CONNECTED when the socket opens, or to
+     * FAILED. The resolved address is kept in DnsCache for reconnects.
      * @param host Server hostname or IP address
      * @param port Server port (default 12090)
      * @return ESP_OK if connection initiated
@@ -132,7 +194,14 @@ public:
     /**
      * @brief Check if connected
      */
-    bool isConnected() const { return m_state == ConnectionState::CONNECTED; }
+    bool isConnected() const override { return m_state == ConnectionState::CONNECTED; }
+
+    const char* getTransportName() const override { return "WiThrottle"; }
+
+    /**
+     * @brief WiThrottle does not report every change; ThrottleController also checks idle throttles
+     */
+    bool pushesThrottleState() const override { return false; }
     
     /**
      * @brief Get current connection state
@@ -156,58 +225,58 @@ public:
     
     /**
      * @brief Acquire a locomotive for throttle control
-     * @param throttleId Throttle identifier (0-3 for our 4 throttles)
+     * @param throttleId Throttle identifier (see throttleIdChar())
      * @param address Locomotive DCC address
      * @param isLongAddress True for long address (L), false for short (S)
      * @return ESP_OK on success
      */
-    esp_err_t acquireLocomotive(char throttleId, int address, bool isLongAddress);
+    esp_err_t acquireLocomotive(char throttleId, int address, bool isLongAddress) override;
     
     /**
      * @brief Release a locomotive from throttle control
-     * @param throttleId Throttle identifier (0-3)
+     * @param throttleId Throttle identifier (see throttleIdChar())
      * @return ESP_OK on success
      */
-    esp_err_t releaseLocomotive(char throttleId);
+    esp_err_t releaseLocomotive(char throttleId) override;
     
     /**
      * @brief Set locomotive speed
-     * @param throttleId Throttle identifier (0-3)
+     * @param throttleId Throttle identifier (see throttleIdChar())
      * @param speed Speed value (0-126, where 0=stop, 1=emergency stop)
      * @return ESP_OK on success
      */
-    esp_err_t setSpeed(char throttleId, int speed);
+    esp_err_t setSpeed(char throttleId, int speed) override;
     
     /**
      * @brief Set locomotive direction
-     * @param throttleId Throttle identifier (0-3)
+     * @param throttleId Throttle identifier (see throttleIdChar())
      * @param forward True for forward, false for reverse
      * @return ESP_OK on success
      */
-    esp_err_t setDirection(char throttleId, bool forward);
+    esp_err_t setDirection(char throttleId, bool forward) override;
     
     /**
      * @brief Set locomotive function state
-     * @param throttleId Throttle identifier (0-3)
+     * @param throttleId Throttle identifier (see throttleIdChar())
      * @param function Function number (0-28)
      * @param state True to activate, false to deactivate
      * @return ESP_OK on success
      */
-    esp_err_t setFunction(char throttleId, int function, bool state);
+    esp_err_t setFunction(char throttleId, int function, bool state) override;
     
     /**
      * @brief Query locomotive speed
-     * @param throttleId Throttle identifier (0-3)
+     * @param throttleId Throttle identifier (see throttleIdChar())
      * @return ESP_OK on success
      */
-    esp_err_t querySpeed(char throttleId);
+    esp_err_t querySpeed(char throttleId) override;
     
     /**
      * @brief Query locomotive direction
-     * @param throttleId Throttle identifier (0-3)
+     * @param throttleId Throttle identifier (see throttleIdChar())
      * @return ESP_OK on success
      */
-    esp_err_t queryDirection(char throttleId);
+    esp_err_t queryDirection(char throttleId) override;
     
     /**
      * @brief Set power state change callback
@@ -232,39 +301,54 @@ public:
     /**
      * @brief Set throttle state change callback
      */
-    void setThrottleStateCallback(ThrottleStateCallback callback) { m_throttleCallback = callback; }
+    void setThrottleStateCallback(ThrottleStateCallback callback) override { m_throttleCallback = callback; }
 
     /**
      * @brief Set function labels callback
      */
-    void setFunctionLabelsCallback(FunctionLabelsCallback callback) { m_functionLabelsCallback = callback; }
-    
+    void setFunctionLabelsCallback(FunctionLabelsCallback callback) override { m_functionLabelsCallback = callback; }
+
     /**
-    * @brief Get current roster (not thread-safe; prefer getRosterSnapshot/getRosterEntry)
+     * @brief Set session callback (starts once identification is queued, ends when the link drops)
      */
-    const std::vector<Locomotive>& getRoster() const { return m_roster; }
+    void setSessionCallback(SessionCallback callback) override { m_sessionCallback = callback; }
 
     /**
-    * @brief Get a copy of the current roster (thread-safe)
-    */
-    std::vector<Locomotive> getRosterSnapshot() const;
+     * @brief Set throttle allocation event callback
+     */
+    void setThrottleEventCallback(ThrottleEventCallback callback) { m_throttleEventCallback = callback; }
 
     /**
-    * @brief Get number of roster entries (thread-safe)
-    */
-    size_t getRosterSize() const;
+     * @brief Set turnout state callback (PTL/PTA)
+     */
+    void setTurnoutCallback(LayoutItemCallback callback) { m_turnoutCallback = callback; }
+
+    /**
+     * @brief Set route state callback (PRL/PRA)
+     */
+    void setRouteCallback(LayoutItemCallback callback) { m_routeCallback = callback; }
+
+    /**
+     * @brief Set fast clock callback (PFT)
+     */
+    void setFastClockCallback(FastClockCallback callback) { m_fastClockCallback = callback; }
 
     /**
-    * @brief Get a roster entry by index (thread-safe)
-    * @return true if index valid and entry copied
+     * @brief Set server message/alert callback (Hm/HM)
+     */
+    void setAlertCallback(AlertCallback callback) { m_alertCallback = callback; }
+    
+    /**
+    * @brief Get a handle to the current roster (thread-safe, no copy)
+    * @return Immutable snapshot, or nullptr before the first roster arrives
     */
-    bool getRosterEntry(int index, Locomotive& outEntry) const;
+    RosterHandle getRosterSnapshot() const override;
 
 #if CONFIG_THROTTLE_TESTS
     /**
      * @brief Test-only hook to process a raw protocol message
      */
-    void testProcessMessage(const std::string& message);
+    void testProcessMessage(std::string_view message);
 #endif
     
     /**
@@ -278,28 +362,107 @@ public:
      */
     void sendHeartbeat();
 
+    /**
+     * @brief Phase timings of the last connection attempt
+     */
+    ConnectTimings getConnectTimings() const { return m_connectTimings; }
+
+    /**
+     * @brief Number of commands dropped because the TX queue was full
+     */
+    uint32_t getTxDroppedCount() const { return m_txDropped.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Number of commands written to the socket
+     */
+    uint32_t getTxCommandCount() const { return m_txCommands.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Number of send() calls (one per batch of queued commands)
+     */
+    uint32_t getTxSegmentCount() const { return m_txSegments.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Received message and byte counts for one message type
+     * Updated by the receive task; values may lag by one message.
+     */
+    MessageStats getMessageStats(MessageType type) const;
+
+    /**
+     * @brief Short name of a message type (e.g. "PTL")
+     */
+    static const char* getMessageTypeName(MessageType type);
+
+    /**
+     * @brief Log received traffic per message type
+     */
+    void logMessageStats() const;
+
+    /**
+     * @brief Zero all per-type counters
+     */
+    void resetMessageStats();
+
+#if CONFIG_WITHROTTLE_LATENCY_TRACE
+    /**
+     * @brief Log the speed command round-trip histogram and TX batching stats
+     */
+    void logLatencyStats() const;
+#endif
+
 private:
     bool lockState(TickType_t timeout) const;
     void unlockState() const;
 
-    void processMessage(const std::string& message);
-    void handlePowerMessage(const std::string& message);
-    void handleRosterMessage(const std::string& message);
-    void handleThrottleMessage(const std::string& message);
+    // Dispatch table entry; '?' in a prefix matches any character (throttle id)
+    using MessageHandler = void (WiThrottleClient::*)(std::string_view message);
+    struct DispatchEntry {
+        std::string_view prefix;
+        MessageType type;
+        MessageHandler handler;  // nullptr: counted only
+    };
+    static const DispatchEntry DISPATCH_TABLE[];
+
+    void processMessage(std::string_view message);
+    void handleVersionMessage(std::string_view message);
+    void handleWebPortMessage(std::string_view message);
+    void handleHeartbeatMessage(std::string_view message);
+    void applyKeepAlive();
+    void handlePowerMessage(std::string_view message);
+    void handleRosterMessage(std::string_view message);
+    void handleTurnoutListMessage(std::string_view message);
+    void handleTurnoutActionMessage(std::string_view message);
+    void handleRouteListMessage(std::string_view message);
+    void handleRouteActionMessage(std::string_view message);
+    void handleFastClockMessage(std::string_view message);
+    void handleServerInfoMessage(std::string_view message);
+    void handleAlertMessage(std::string_view message);
+    void handleThrottleMessage(std::string_view message);
+    void handleThrottleEventMessage(std::string_view message);
+    void handleFunctionLabelsMessage(std::string_view message);
     void setState(ConnectionState newState);
-    esp_err_t sendCommand(const std::string& command);
+    bool establishConnection();
+    esp_err_t sendCommand(const WiThrottleCommandEncoder::Command& command);
+    esp_err_t sendRaw(std::string_view text);
     
     static void receiveTask(void* arg);
+    static void transmitTask(void* arg);
     
-    // Throttle state tracking
-    struct ThrottleState {
+    // Acquired loco per throttle slot. Each slot is packed into one atomic word
+    // (bit 31 acquired, bits 16-23 address type, bits 0-15 address) so command
+    // methods read it without taking m_stateMutex.
+    struct ThrottleSlot {
         bool acquired;
         int address;
         char addressType;  // 'S' or 'L'
-        
-        ThrottleState() : acquired(false), address(0), addressType('S') {}
     };
-    std::map<char, ThrottleState> m_throttleStates;  // Key is throttleId
+    static constexpr int MAX_THROTTLE_SLOTS = MAX_THROTTLE_IDS + 2;  // Throttle ids '0'-'9', 'a'-'z', 'T', 'S'
+    static constexpr uint32_t SLOT_ACQUIRED = 1u << 31;
+    std::atomic<uint32_t> m_throttleSlots[MAX_THROTTLE_SLOTS];
+
+    static int throttleSlotIndex(char throttleId);
+    bool loadThrottleSlot(char throttleId, ThrottleSlot& outSlot) const;
+    void storeThrottleSlot(char throttleId, const ThrottleSlot& slot);
     
     ConnectionState m_state;
     int m_socket;
@@ -309,7 +472,7 @@ private:
     PowerState m_mainTrackPower;
     PowerState m_progTrackPower;
     
-    std::vector<Locomotive> m_roster;
+    RosterHandle m_roster;  // Replaced by pointer on each RL message
     uint16_t m_webPort;
     
     PowerStateCallback m_powerCallback;
@@ -318,9 +481,44 @@ private:
     WebPortCallback m_webPortCallback;
     FunctionLabelsCallback m_functionLabelsCallback;
     ThrottleStateCallback m_throttleCallback;
+    SessionCallback m_sessionCallback;
+    ThrottleEventCallback m_throttleEventCallback;
+    LayoutItemCallback m_turnoutCallback;
+    LayoutItemCallback m_routeCallback;
+    FastClockCallback m_fastClockCallback;
+    AlertCallback m_alertCallback;
+
+    MessageStats m_messageStats[static_cast<size_t>(MessageType::COUNT)];
 
     mutable SemaphoreHandle_t m_stateMutex;
     
-    TaskHandle_t m_receiveTaskHandle;
-    bool m_running;
+    // Both tasks delete themselves; each clears its handle and gives its exit
+    // semaphore first, so disconnect() never touches a handle of a dead task
+    std::atomic<TaskHandle_t> m_receiveTaskHandle;
+    SemaphoreHandle_t m_receiveExited;
+    std::atomic<bool> m_running;
+    ConnectTimings m_connectTimings;
+
+    // Encoded commands waiting for the writer task; callers never block on send()
+    QueueHandle_t m_txQueue;
+    std::atomic<TaskHandle_t> m_transmitTaskHandle;
+    SemaphoreHandle_t m_transmitExited;
+    // Bumped by every sending task and the writer; counters only, so relaxed
+    std::atomic<uint32_t> m_txDropped;
+    std::atomic<uint32_t> m_txCommands;
+    std::atomic<uint32_t> m_txSegments;
+
+#if CONFIG_WITHROTTLE_LATENCY_TRACE
+    // Speed command enqueue time per throttle '0'-'9', 'a'-'z' until the server echoes a speed
+    static constexpr int TRACE_THROTTLES = MAX_THROTTLE_IDS;
+    int64_t m_speedSentUs[TRACE_THROTTLES];
+    LatencyHistogram m_speedRoundTrip;
+#endif
+
+    // Receive buffer; lines are parsed in place (owned by the receive task)
+    LineFramer m_rxFramer;
+
+    // Heartbeat schedule and liveness (owned by the receive task)
+    HeartbeatMonitor m_heartbeat;
+    bool m_heartbeatMonitoring;
 };
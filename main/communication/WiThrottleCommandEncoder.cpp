@@ -0,0 +1,140 @@
+#include "WiThrottleCommandEncoder.h"
+#include <charconv>
+#include <cstring>
+
+namespace {
+    using Command = WiThrottleCommandEncoder::Command;
+
+    // Append-only cursor over a Command; sticks at failed once it overflows
+    class Writer {
+    public:
+        explicit Writer(Command& out) : m_out(out), m_pos(0), m_failed(false) {}
+
+        void put(char c)
+        {
+            if (m_pos + 1 > sizeof(m_out.data)) {
+                m_failed = true;
+                return;
+            }
+            m_out.data[m_pos++] = c;
+        }
+
+        // Literal length is a compile-time constant (N includes the terminator)
+        template <size_t N>
+        void literal(const char (&text)[N])
+        {
+            put(text, N - 1);
+        }
+
+        void put(const char* text, size_t length)
+        {
+            if (m_pos + length > sizeof(m_out.data)) {
+                m_failed = true;
+                return;
+            }
+            memcpy(m_out.data + m_pos, text, length);
+            m_pos += length;
+        }
+
+        void number(int value)
+        {
+            auto result = std::to_chars(m_out.data + m_pos, m_out.data + sizeof(m_out.data), value);
+            if (result.ec != std::errc()) {
+                m_failed = true;
+                return;
+            }
+            m_pos = static_cast<size_t>(result.ptr - m_out.data);
+        }
+
+        bool finish()
+        {
+            put('\n');
+            m_out.length = m_failed ? 0 : static_cast<uint8_t>(m_pos);
+            return !m_failed;
+        }
+
+    private:
+        Command& m_out;
+        size_t m_pos;
+        bool m_failed;
+    };
+
+    // Common M<id>A<type><addr><;> prefix of every throttle action
+    void actionPrefix(Writer& w, char throttleId, char addressType, int address)
+    {
+        w.put('M');
+        w.put(throttleId);
+        w.put('A');
+        w.put(addressType);
+        w.number(address);
+        w.literal("<;>");
+    }
+}
+
+bool WiThrottleCommandEncoder::encodeAcquire(Command& out, char throttleId, char addressType, int address)
+{
+    Writer w(out);
+    w.put('M');
+    w.put(throttleId);
+    w.put('+');
+    w.put(addressType);
+    w.number(address);
+    w.literal("<;>");
+    w.put(addressType);
+    w.number(address);
+    return w.finish();
+}
+
+bool WiThrottleCommandEncoder::encodeRelease(Command& out, char throttleId)
+{
+    Writer w(out);
+    w.put('M');
+    w.put(throttleId);
+    w.literal("-*<;>r");
+    return w.finish();
+}
+
+bool WiThrottleCommandEncoder::encodeSpeed(Command& out, char throttleId, char addressType, int address, int speed)
+{
+    Writer w(out);
+    actionPrefix(w, throttleId, addressType, address);
+    w.put('V');
+    w.number(speed);
+    return w.finish();
+}
+
+bool WiThrottleCommandEncoder::encodeDirection(Command& out, char throttleId, char addressType, int address, bool forward)
+{
+    Writer w(out);
+    actionPrefix(w, throttleId, addressType, address);
+    w.put('R');
+    w.put(forward ? '1' : '0');
+    return w.finish();
+}
+
+bool WiThrottleCommandEncoder::encodeFunction(Command& out, char throttleId, char addressType, int address,
+                                              int function, bool state)
+{
+    Writer w(out);
+    actionPrefix(w, throttleId, addressType, address);
+    w.put('F');
+    w.put(state ? '1' : '0');
+    w.number(function);
+    return w.finish();
+}
+
+bool WiThrottleCommandEncoder::encodeQuery(Command& out, char throttleId, char addressType, int address, char property)
+{
+    Writer w(out);
+    actionPrefix(w, throttleId, addressType, address);
+    w.put('q');
+    w.put(property);
+    return w.finish();
+}
+
+bool WiThrottleCommandEncoder::encodeRaw(Command& out, std::string_view text)
+{
+    Writer w(out);
+    w.put(text.data(), text.size());
+    return w.finish();
+}
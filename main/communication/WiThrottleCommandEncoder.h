@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+/**
+ * @brief Allocation-free encoder for outgoing WiThrottle commands
+ *
+ * Builds complete, newline-terminated protocol lines into a fixed-size
+ * Command that can be copied by value into a FreeRTOS queue. Literal
+ * fragments of the grammar (e.g. "<;>V") are copied with lengths known at
+ * compile time and numbers are formatted with std::to_chars, so encoding
+ * never touches the heap.
+ *
+ * All encode functions return false (leaving @p out empty) if the result
+ * would not fit in MAX_COMMAND_LENGTH.
+ */
+class WiThrottleCommandEncoder {
+public:
+    static constexpr size_t MAX_COMMAND_LENGTH = 48;
+
+    /**
+     * @brief One encoded protocol line, including the trailing '\n'
+     */
+    struct Command {
+        char data[MAX_COMMAND_LENGTH];
+        uint8_t length;
+
+        Command() : length(0) {}
+
+        /**
+         * @brief Command text without the trailing newline (for logging)
+         */
+        std::string_view text() const
+        {
+            return std::string_view(data, length > 0 ? length - 1 : 0);
+        }
+    };
+
+    /**
+     * @brief M<id>+<type><addr><;><type><addr>
+     */
+    static bool encodeAcquire(Command& out, char throttleId, char addressType, int address);
+
+    /**
+     * @brief M<id>-*<;>r
+     */
+    static bool encodeRelease(Command& out, char throttleId);
+
+    /**
+     * @brief M<id>A<type><addr><;>V<speed>
+     */
+    static bool encodeSpeed(Command& out, char throttleId, char addressType, int address, int speed);
+
+    /**
+     * @brief M<id>A<type><addr><;>R<0|1>
+     */
+    static bool encodeDirection(Command& out, char throttleId, char addressType, int address, bool forward);
+
+    /**
+     * @brief M<id>A<type><addr><;>F<0|1><function>
+     */
+    static bool encodeFunction(Command& out, char throttleId, char addressType, int address,
+                               int function, bool state);
+
+    /**
+     * @brief M<id>A<type><addr><;>q<property> (property 'V' = speed, 'R' = direction)
+     */
+    static bool encodeQuery(Command& out, char throttleId, char addressType, int address, char property);
+
+    /**
+     * @brief Any other command line (device name, power, heartbeat)
+     */
+    static bool encodeRaw(Command& out, std::string_view text);
+};
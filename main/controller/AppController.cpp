@@ -4,10 +4,13 @@
 #include "../ui/JmriConfigScreen.h"
 #include "../communication/WiThrottleClient.h"
 #include "../communication/JmriJsonClient.h"
+#include "../communication/JmriJsonThrottle.h"
 #include "ThrottleController.h"
 #include "WiFiController.h"
 #include "JmriConnectionController.h"
 #include "../hardware/RotaryEncoderHal.h"
+#include "../utils/Scheduler.h"
+#include "../utils/Settings.h"
 
 AppController& AppController::instance()
 {
@@ -19,10 +22,12 @@ AppController::AppController()
     : m_mainScreen(nullptr)
     , m_wiThrottleClient(nullptr)
     , m_jmriClient(nullptr)
+    , m_jsonThrottle(nullptr)
     , m_throttleController(nullptr)
     , m_wifiController(nullptr)
     , m_jmriConnectionController(nullptr)
     , m_rotaryEncoderHal(nullptr)
+    , m_throttleProtocol(ThrottleProtocol::WITHROTTLE)
     , m_initialised(false)
 {
 }
@@ -33,6 +38,9 @@ void AppController::initialise()
         return;
     }
 
+    // Every setting is read from flash once, here; everything else reads RAM
+    Settings::instance().load();
+
     if (!m_wifiController) {
         m_wifiController = std::make_unique<WiFiController>();
         m_wifiController->autoConnect();
@@ -48,19 +56,31 @@ void AppController::initialise()
         m_jmriClient->initialize();
     }
 
+    if (!m_jsonThrottle) {
+        // Registers for throttle and roster messages before the socket opens
+        m_jsonThrottle = std::make_unique<JmriJsonThrottle>(*m_jmriClient);
+        m_jsonThrottle->initialize();
+    }
+
+    m_throttleProtocol = JmriConnectionController::loadThrottleProtocol();
+
     if (!m_jmriConnectionController) {
         m_jmriConnectionController = std::make_unique<JmriConnectionController>(
             m_jmriClient.get(),
             m_wiThrottleClient.get(),
             m_wifiController.get());
+        m_jmriConnectionController->setThrottleProtocol(m_throttleProtocol);
+        m_jmriConnectionController->setThrottleTransport(getThrottleTransport());
     }
 
     if (m_jmriConnectionController) {
-        m_jmriConnectionController->startAutoConnectTask();
+        m_jmriConnectionController->startAutoConnect();
     }
 
     if (!m_throttleController) {
-        m_throttleController = std::make_unique<ThrottleController>(m_wiThrottleClient.get());
+        m_throttleController = std::make_unique<ThrottleController>(getThrottleTransport());
+        // The JSON roster carries function labels; used in both throttle modes
+        m_throttleController->setRosterSource(m_jsonThrottle.get());
         m_throttleController->initialize();
     }
 
@@ -84,6 +104,9 @@ void AppController::initialise()
         m_rotaryEncoderHal->startPollingTask();
     }
 
+    // Task count and free internal heap once every service is up
+    Scheduler::instance().logStats();
+
     m_initialised = true;
 }
 
@@ -96,7 +119,7 @@ void AppController::showMainScreen()
     }
 
     m_mainScreen = std::make_unique<MainScreen>();
-    m_mainScreen->create(m_wiThrottleClient.get(), m_jmriClient.get(), m_throttleController.get());
+    m_mainScreen->create(getThrottleTransport(), m_jmriClient.get(), m_throttleController.get());
 }
 
 void AppController::showWiFiConfigScreen()
@@ -141,6 +164,28 @@ WiThrottleClient* AppController::getWiThrottleClient() const
     return m_wiThrottleClient.get();
 }
 
+ThrottleTransport* AppController::getThrottleTransport() const
+{
+    if (m_throttleProtocol == ThrottleProtocol::JMRI_JSON) {
+        return m_jsonThrottle.get();
+    }
+    return m_wiThrottleClient.get();
+}
+
+void AppController::setThrottleProtocol(ThrottleProtocol protocol)
+{
+    initialise();
+
+    m_throttleProtocol = protocol;
+    if (m_jmriConnectionController) {
+        m_jmriConnectionController->setThrottleProtocol(protocol);
+        m_jmriConnectionController->setThrottleTransport(getThrottleTransport());
+    }
+    if (m_throttleController) {
+        m_throttleController->setTransport(getThrottleTransport());
+    }
+}
+
 WiFiController* AppController::getWiFiController() const
 {
     return m_wifiController.get();
@@ -1,9 +1,11 @@
 #pragma once
 
 #include <memory>
+#include "../communication/ThrottleTransport.h"
 
 class WiThrottleClient;
 class JmriJsonClient;
+class JmriJsonThrottle;
 class ThrottleController;
 class MainScreen;
 class WiFiController;
@@ -30,6 +32,13 @@ public:
 
     JmriJsonClient* getJmriClient() const;
     WiThrottleClient* getWiThrottleClient() const;
+    ThrottleTransport* getThrottleTransport() const;
+
+    /**
+     * @brief Switch throttles between WiThrottle and the JMRI JSON socket
+     * Releases locos held on the previous transport.
+     */
+    void setThrottleProtocol(ThrottleProtocol protocol);
     WiFiController* getWiFiController() const;
     JmriConnectionController* getJmriConnectionController() const;
     RotaryEncoderHal* getRotaryEncoderHal() const;
@@ -40,9 +49,11 @@ private:
     std::unique_ptr<MainScreen> m_mainScreen;
     std::unique_ptr<WiThrottleClient> m_wiThrottleClient;
     std::unique_ptr<JmriJsonClient> m_jmriClient;
+    std::unique_ptr<JmriJsonThrottle> m_jsonThrottle;
     std::unique_ptr<ThrottleController> m_throttleController;
     std::unique_ptr<WiFiController> m_wifiController;
     std::unique_ptr<JmriConnectionController> m_jmriConnectionController;
     std::unique_ptr<RotaryEncoderHal> m_rotaryEncoderHal;
+    ThrottleProtocol m_throttleProtocol;
     bool m_initialised;
 };
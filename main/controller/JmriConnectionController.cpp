@@ -1,20 +1,20 @@
 #include "JmriConnectionController.h"
 #include "WiFiController.h"
+#include "../communication/DnsCache.h"
 #include "../communication/JmriJsonClient.h"
 #include "../communication/WiThrottleClient.h"
 #include "esp_log.h"
-#include "nvs_flash.h"
-#include "nvs.h"
-#include "freertos/FreeRTOS.h"
-#include "freertos/task.h"
+#include "esp_timer.h"
 
 static const char* TAG = "JmriConnCtrl";
 
-static const char* NVS_NAMESPACE = "jmri";
-static const char* NVS_KEY_SERVER_IP = "server_ip";
-static const char* NVS_KEY_JSON_PORT = "json_port";
-static const char* NVS_KEY_WITHROTTLE_PORT = "wt_port";
-static const char* NVS_KEY_POWER_MANAGER = "power_mgr";
+// Settings whose change (e.g. from the config screen) the reconnect job must follow
+static const Settings::Key SERVER_KEYS[] = {
+    Settings::Key::SERVER_IP,
+    Settings::Key::WITHROTTLE_PORT,
+    Settings::Key::JSON_PORT,
+    Settings::Key::POWER_MANAGER,
+};
 
 JmriConnectionController::JmriConnectionController(JmriJsonClient* jsonClient,
                                                    WiThrottleClient* wtClient,
@@ -27,12 +27,80 @@ JmriConnectionController::JmriConnectionController(JmriJsonClient* jsonClient,
     , m_savedJsonPort(12080)
     , m_savedWtPort(12090)
     , m_savedPowerMgr("DCC++")
-    , m_reconnectTaskHandle(nullptr)
-    , m_autoConnectTaskHandle(nullptr)
+    , m_throttleProtocol(ThrottleProtocol::WITHROTTLE)
+    , m_reconnectJob(Scheduler::INVALID_JOB)
+    , m_autoConnectJob(Scheduler::INVALID_JOB)
+    , m_autoConnectPolls(0)
+    , m_failedAttempts(0)
+    , m_retryCountdown(-1)
+    , m_throttleTransport(nullptr)
+    , m_readyJob(Scheduler::INVALID_JOB)
+    , m_readyWatchStartUs(0)
+    , m_firstThrottleMs(0)
+    , m_browser(MdnsBrowser::WITHROTTLE_SERVICE)
+    , m_discoveryJob(Scheduler::INVALID_JOB)
+    , m_webPortJob(Scheduler::INVALID_JOB)
+    , m_settingsJob(Scheduler::INVALID_JOB)
+    , m_jsonConnectTask(nullptr)
+    , m_jsonConnectExited(nullptr)
+    , m_jsonRequestMutex(nullptr)
+    , m_jsonConnectRunning(false)
 {
+    static_assert(sizeof(SERVER_KEYS) / sizeof(SERVER_KEYS[0]) == SETTINGS_SUBSCRIPTIONS, "One subscription per key");
+    for (size_t i = 0; i < SETTINGS_SUBSCRIPTIONS; i++) {
+        m_settingsSubscriptions[i] = Settings::instance().subscribe(SERVER_KEYS[i], [this](Settings::Key) {
+            // Several keys usually change together; reread them once on the scheduler task
+            Scheduler::JobId job = Scheduler::instance().scheduleOnce(
+                0, Scheduler::Priority::NORMAL, [this]() { readSavedServer(); }, "jmri_settings");
+            Scheduler::instance().cancel(m_settingsJob.exchange(job));
+        });
+    }
+
+    m_jsonRequestMutex = xSemaphoreCreateMutex();
+    m_jsonConnectExited = xSemaphoreCreateBinary();
+    m_jsonConnectRunning = m_jsonRequestMutex && m_jsonConnectExited;
+    if (!m_jsonConnectRunning ||
+        xTaskCreate(jsonConnectTask, "jmri_json_conn", 4096, this, 4, &m_jsonConnectTask) != pdPASS) {
+        // JSON connects then run on the caller's task
+        ESP_LOGE(TAG, "Failed to create JSON connect task");
+        m_jsonConnectRunning = false;
+        m_jsonConnectTask = nullptr;
+    }
 }
 
-JmriConnectionController::~JmriConnectionController() = default;
+JmriConnectionController::~JmriConnectionController()
+{
+    // Stop the producers of discovery and settings jobs before cancelling them
+    for (Settings::SubscriptionId subscription : m_settingsSubscriptions) {
+        Settings::instance().unsubscribe(subscription);
+    }
+    m_browser.stop();
+    if (m_wtClient) {
+        m_wtClient->setWebPortCallback(nullptr);
+    }
+    Scheduler::instance().cancel(m_discoveryJob.exchange(Scheduler::INVALID_JOB));
+    Scheduler::instance().cancel(m_webPortJob.exchange(Scheduler::INVALID_JOB));
+    Scheduler::instance().cancel(m_settingsJob.exchange(Scheduler::INVALID_JOB));
+    Scheduler::instance().cancel(m_autoConnectJob.exchange(Scheduler::INVALID_JOB));
+    Scheduler::instance().cancel(m_readyJob.exchange(Scheduler::INVALID_JOB));
+    Scheduler::instance().cancel(m_reconnectJob);
+
+    // After the jobs, which could otherwise post another request; a connect in progress finishes first
+    if (m_jsonConnectTask) {
+        m_jsonConnectRunning = false;
+        xTaskNotifyGive(m_jsonConnectTask);
+        xSemaphoreTake(m_jsonConnectExited, portMAX_DELAY);
+        m_jsonConnectTask = nullptr;
+    }
+    if (m_jsonConnectExited) {
+        vSemaphoreDelete(m_jsonConnectExited);
+        m_jsonConnectExited = nullptr;
+    }
+    if (m_jsonRequestMutex) {
+        vSemaphoreDelete(m_jsonRequestMutex);
+        m_jsonRequestMutex = nullptr;
+    }
+}
 
 void JmriConnectionController::loadSettingsAndAutoConnect()
 {
@@ -41,175 +109,413 @@ void JmriConnectionController::loadSettingsAndAutoConnect()
         return;
     }
 
-    nvs_handle_t handle;
-    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle);
-    if (err != ESP_OK) {
-        ESP_LOGD(TAG, "No saved JMRI settings for auto-connect");
-        return;
-    }
-
-    char serverIp[64] = {0};
-    char jsonPortStr[8] = "12080";
-    char wtPortStr[8] = "12090";
-    char powerMgr[64] = "DCC++";
-    size_t length;
+    readSavedServer();
 
-    length = sizeof(serverIp);
-    err = nvs_get_str(handle, NVS_KEY_SERVER_IP, serverIp, &length);
-    if (err != ESP_OK || serverIp[0] == '\0') {
+#if !CONFIG_JMRI_MDNS_DISCOVERY
+    if (m_savedServerIp.empty()) {
         ESP_LOGD(TAG, "No server IP saved");
-        nvs_close(handle);
         return;
     }
+#endif
 
-    length = sizeof(jsonPortStr);
-    nvs_get_str(handle, NVS_KEY_JSON_PORT, jsonPortStr, &length);
+    m_throttleProtocol = loadThrottleProtocol();
+    bool useWiThrottle = (m_throttleProtocol == ThrottleProtocol::WITHROTTLE);
 
-    length = sizeof(wtPortStr);
-    nvs_get_str(handle, NVS_KEY_WITHROTTLE_PORT, wtPortStr, &length);
+    ESP_LOGI(TAG, "Auto-connecting to JMRI: %s (JSON:%d, WiThrottle:%d, Power:%s, Throttles:%s)",
+             m_savedServerIp.c_str(), m_savedJsonPort, m_savedWtPort, m_savedPowerMgr.c_str(),
+             useWiThrottle ? "WiThrottle" : "JSON");
 
-    length = sizeof(powerMgr);
-    nvs_get_str(handle, NVS_KEY_POWER_MANAGER, powerMgr, &length);
+    if (!m_jsonClient || !m_wtClient) {
+        ESP_LOGE(TAG, "Clients not initialized");
+        return;
+    }
 
-    nvs_close(handle);
+    m_jsonClient->setConfiguredPowerName(m_savedPowerMgr);
+    startReadyWatch();
 
-    uint16_t jsonPort = static_cast<uint16_t>(std::atoi(jsonPortStr));
-    uint16_t wtPort = static_cast<uint16_t>(std::atoi(wtPortStr));
+    // Look for the server while connecting to the saved address
+    startDiscovery();
+    if (m_savedServerIp.empty()) {
+        ESP_LOGI(TAG, "No JMRI server saved, waiting for discovery");
+        enableAutoReconnect(true);
+        return;
+    }
 
-    if (jsonPort == 0) jsonPort = 12080;
-    if (wtPort == 0) wtPort = 12090;
+    // Neither call waits for its handshake, so the two overlap
+    requestJsonConnect(false);
 
-    m_savedServerIp = serverIp;
-    m_savedJsonPort = jsonPort;
-    m_savedWtPort = wtPort;
-    m_savedPowerMgr = powerMgr;
+    if (useWiThrottle) {
+        connectWiThrottle();
+    }
 
-    ESP_LOGI(TAG, "Auto-connecting to JMRI: %s (JSON:%d, WiThrottle:%d, Power:%s)",
-             m_savedServerIp.c_str(), m_savedJsonPort, m_savedWtPort, m_savedPowerMgr.c_str());
+    enableAutoReconnect(true);
+}
 
-    if (!m_jsonClient || !m_wtClient) {
-        ESP_LOGE(TAG, "Clients not initialized");
+void JmriConnectionController::startReadyWatch()
+{
+    // Measured once per boot; later reconnects are not a startup
+    if (m_firstThrottleMs != 0 || m_readyJob != Scheduler::INVALID_JOB) {
         return;
     }
+    if (m_readyWatchStartUs == 0) {
+        m_readyWatchStartUs = esp_timer_get_time();
+    }
 
-    m_jsonClient->setConfiguredPowerName(m_savedPowerMgr);
+    Scheduler::JobId job = Scheduler::instance().schedulePeriodic(
+        READY_POLL_MS, Scheduler::Priority::NORMAL,
+        [this]() { onReadyPoll(); },
+        "jmri_ready");
+    Scheduler::JobId expected = Scheduler::INVALID_JOB;
+    if (!m_readyJob.compare_exchange_strong(expected, job)) {
+        Scheduler::instance().cancel(job);
+    }
+}
 
-    err = m_jsonClient->connect(m_savedServerIp.c_str(), m_savedJsonPort);
-    if (err != ESP_OK) {
-        ESP_LOGW(TAG, "JSON client auto-connect failed (will remain disconnected)");
+void JmriConnectionController::onReadyPoll()
+{
+    int64_t elapsedUs = esp_timer_get_time() - m_readyWatchStartUs;
+    ThrottleTransport* transport = m_throttleTransport;
+    bool ready = transport && transport->isConnected() && transport->getRosterSnapshot();
+
+    if (!ready && elapsedUs < static_cast<int64_t>(READY_WATCH_MAX_MS) * 1000) {
+        return;
     }
+    Scheduler::instance().cancel(m_readyJob.exchange(Scheduler::INVALID_JOB));
 
-    err = m_wtClient->connect(m_savedServerIp.c_str(), m_savedWtPort);
-    if (err != ESP_OK) {
-        ESP_LOGW(TAG, "WiThrottle client auto-connect failed (will remain disconnected)");
+    if (!ready) {
+        ESP_LOGW(TAG, "No usable throttle %lu s after WiFi up", (unsigned long)(READY_WATCH_MAX_MS / 1000));
+        return;
     }
 
-    enableAutoReconnect(true);
+    uint32_t elapsedMs = static_cast<uint32_t>(elapsedUs / 1000);
+    m_firstThrottleMs = elapsedMs > 0 ? elapsedMs : 1;
+
+    WiThrottleClient::ConnectTimings wt = m_wtClient->getConnectTimings();
+    JmriJsonClient::ConnectTimings json = m_jsonClient->getConnectTimings();
+    ESP_LOGI(TAG, "First usable throttle (%s) %lu ms after WiFi up", transport->getTransportName(),
+             (unsigned long)m_firstThrottleMs);
+    ESP_LOGI(TAG, "  WiThrottle: resolve %lu ms, TCP %lu ms, greeting %lu ms",
+             (unsigned long)(wt.resolveUs / 1000), (unsigned long)(wt.tcpUs / 1000),
+             (unsigned long)(wt.greetingUs / 1000));
+    ESP_LOGI(TAG, "  JSON: open %lu ms, hello %lu ms",
+             (unsigned long)(json.openUs / 1000), (unsigned long)(json.helloUs / 1000));
 }
 
 void JmriConnectionController::enableAutoReconnect(bool enable)
 {
     m_autoReconnectEnabled = enable;
-    if (enable && m_reconnectTaskHandle == nullptr) {
-        startReconnectTask();
+    if (enable && m_reconnectJob == Scheduler::INVALID_JOB) {
+        m_reconnectJob = Scheduler::instance().schedulePeriodic(
+            RECONNECT_CHECK_MS, Scheduler::Priority::NORMAL,
+            [this]() { onReconnectCheck(); },
+            "jmri_reconnect");
+        if (m_reconnectJob != Scheduler::INVALID_JOB) {
+            ESP_LOGI(TAG, "Auto-reconnect started");
+        }
+    }
+}
+
+void JmriConnectionController::setThrottleProtocol(ThrottleProtocol protocol)
+{
+    m_throttleProtocol = protocol;
+}
+
+ThrottleProtocol JmriConnectionController::loadThrottleProtocol()
+{
+    int32_t protocol = Settings::instance().getInt(Settings::Key::THROTTLE_PROTOCOL);
+    return (protocol == static_cast<int32_t>(ThrottleProtocol::JMRI_JSON))
+        ? ThrottleProtocol::JMRI_JSON
+        : ThrottleProtocol::WITHROTTLE;
+}
+
+void JmriConnectionController::startAutoConnect()
+{
+    if (m_autoConnectJob != Scheduler::INVALID_JOB) {
+        return;
+    }
+
+    m_autoConnectPolls = 0;
+    m_autoConnectJob = Scheduler::instance().schedulePeriodic(
+        AUTO_CONNECT_POLL_MS, Scheduler::Priority::NORMAL,
+        [this]() { onAutoConnectPoll(); },
+        "jmri_autoconn");
+}
+
+void JmriConnectionController::onAutoConnectPoll()
+{
+    if (m_autoConnectPolls < 0) {
+        return;  // Already finished; cancel pending
+    }
+
+    bool wifiConnected = m_wifiController && m_wifiController->isConnected();
+    if (!wifiConnected && ++m_autoConnectPolls < AUTO_CONNECT_MAX_POLLS) {
+        return;
+    }
+
+    m_autoConnectPolls = -1;
+    Scheduler::instance().cancel(m_autoConnectJob.exchange(Scheduler::INVALID_JOB));
+
+    if (!wifiConnected) {
+        ESP_LOGI(TAG, "WiFi not connected after %lu ms, giving up JMRI auto-connect",
+                 (unsigned long)(AUTO_CONNECT_POLL_MS * AUTO_CONNECT_MAX_POLLS));
+        return;
     }
+
+    // No settling delay: both connects are non-blocking and time out on their own
+    ESP_LOGI(TAG, "WiFi connected, attempting JMRI auto-connect");
+    m_readyWatchStartUs = esp_timer_get_time();
+    loadSettingsAndAutoConnect();
 }
 
-void JmriConnectionController::startAutoConnectTask()
+void JmriConnectionController::onReconnectCheck()
 {
-    if (m_autoConnectTaskHandle != nullptr) {
+    if (!m_autoReconnectEnabled ||
+        !m_wifiController ||
+        !m_wifiController->isConnected()) {
+        m_failedAttempts = 0;
+        m_retryCountdown = -1;
+        return;
+    }
+
+    if (!m_jsonClient || !m_wtClient) {
         return;
     }
 
-    xTaskCreate([](void* arg) {
-        auto* controller = static_cast<JmriConnectionController*>(arg);
-        if (!controller) {
-            vTaskDelete(NULL);
-            return;
+    bool jsonConnected = m_jsonClient->isConnected();
+    // In JSON mode throttles ride on the JSON socket; WiThrottle stays closed
+    bool useWiThrottle = (m_throttleProtocol == ThrottleProtocol::WITHROTTLE);
+    bool wtConnected = !useWiThrottle || m_wtClient->isConnected();
+
+    if (jsonConnected && wtConnected) {
+        if (m_failedAttempts > 0) {
+            ESP_LOGI(TAG, "Connection restored");
         }
+        m_failedAttempts = 0;
+        m_retryCountdown = -1;
+        return;
+    }
 
-        for (int i = 0; i < 60; i++) {
-            if (controller->m_wifiController && controller->m_wifiController->isConnected()) {
-                ESP_LOGI(TAG, "WiFi connected, attempting JMRI auto-connect");
-                vTaskDelay(pdMS_TO_TICKS(1000));
-                controller->loadSettingsAndAutoConnect();
-                break;
-            }
-            vTaskDelay(pdMS_TO_TICKS(500));
+    if (m_retryCountdown < 0) {
+        // Back off 5, 10, 20, 40, then 60 seconds between attempts
+        int backoffChecks = 1 << (m_failedAttempts < 4 ? m_failedAttempts : 4);
+        if (backoffChecks > RECONNECT_MAX_BACKOFF_CHECKS) {
+            backoffChecks = RECONNECT_MAX_BACKOFF_CHECKS;
         }
+        m_retryCountdown = backoffChecks;
+        ESP_LOGW(TAG, "JMRI disconnected (attempt %d, next retry in %lus)",
+                 m_failedAttempts + 1, (unsigned long)(backoffChecks * RECONNECT_CHECK_MS / 1000));
+        return;
+    }
 
-        controller->m_autoConnectTaskHandle = nullptr;
-        vTaskDelete(NULL);
-    }, "jmri_autoconn", 4096, this, 5, reinterpret_cast<TaskHandle_t*>(&m_autoConnectTaskHandle));
+    if (--m_retryCountdown > 0) {
+        return;
+    }
+
+    m_retryCountdown = -1;
+    reconnectClients(!jsonConnected, !wtConnected);
+    m_failedAttempts++;
 }
 
-void JmriConnectionController::startReconnectTask()
+void JmriConnectionController::reconnectClients(bool reconnectJson, bool reconnectWiThrottle)
 {
-    xTaskCreate(reconnectTask, "jmri_reconnect", 3072, this, 4, reinterpret_cast<TaskHandle_t*>(&m_reconnectTaskHandle));
+    // The server may have moved since the address was saved
+    startDiscovery();
+    if (m_savedServerIp.empty()) {
+        return;
+    }
+
+    if (reconnectJson) {
+        ESP_LOGI(TAG, "Attempting to reconnect JSON client...");
+        // Replacing a stalled attempt is deliberate here
+        requestJsonConnect(true);
+    }
+
+    if (reconnectWiThrottle) {
+        ESP_LOGI(TAG, "Attempting to reconnect WiThrottle client...");
+        connectWiThrottle();
+    }
 }
 
-void JmriConnectionController::reconnectTask(void* arg)
+void JmriConnectionController::connectWiThrottle()
 {
-    auto* controller = static_cast<JmriConnectionController*>(arg);
-    if (!controller) return;
+    // The server names its JSON port in PW; handled on the scheduler task like everything else here
+    m_wtClient->setWebPortCallback([this](uint16_t port) {
+        Scheduler::JobId job = Scheduler::instance().scheduleOnce(
+            0, Scheduler::Priority::NORMAL,
+            [this, port]() { onWebPortDiscovered(port); },
+            "jmri_webport");
+        Scheduler::instance().cancel(m_webPortJob.exchange(job));
+    });
+
+    esp_err_t err = m_wtClient->connect(m_savedServerIp.c_str(), m_savedWtPort);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "WiThrottle connect to %s:%u failed (%s)", m_savedServerIp.c_str(),
+                 (unsigned)m_savedWtPort, esp_err_to_name(err));
+    }
+}
 
-    ESP_LOGI(TAG, "Auto-reconnect task started");
+void JmriConnectionController::startDiscovery()
+{
+#if CONFIG_JMRI_MDNS_DISCOVERY
+    // The first responder is handed to the scheduler task, which owns the settings
+    esp_err_t err = m_browser.start([this](const MdnsBrowser::Result& result) {
+        Scheduler::JobId job = Scheduler::instance().scheduleOnce(
+            0, Scheduler::Priority::NORMAL,
+            [this, result]() { onServerDiscovered(result); },
+            "jmri_found");
+        Scheduler::instance().cancel(m_discoveryJob.exchange(job));
+    });
+    if (err == ESP_ERR_INVALID_STATE) {
+        ESP_LOGD(TAG, "JMRI discovery already running");
+    }
+#endif
+}
 
-    int failedAttempts = 0;
-    const int maxBackoff = 60;
+void JmriConnectionController::onServerDiscovered(const MdnsBrowser::Result& result)
+{
+    char address[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &result.address, address, sizeof(address));
 
-    while (true) {
-        vTaskDelay(pdMS_TO_TICKS(5000));
+    // lwIP's resolver does not answer .local names, so a host name typed into the config screen needs this
+    if (result.host[0] != '\0') {
+        DnsCache::instance().store(result.host, result.address);
+    }
 
-        if (!controller->m_autoReconnectEnabled ||
-            !controller->m_wifiController ||
-            !controller->m_wifiController->isConnected()) {
-            failedAttempts = 0;
-            continue;
-        }
+    if (m_savedServerIp == address && m_savedWtPort == result.port) {
+        ESP_LOGI(TAG, "Discovered JMRI server matches the saved address");
+        return;
+    }
 
-        if (!controller->m_jsonClient || !controller->m_wtClient) {
-            continue;
-        }
+    // A working connection to the saved server is kept: there may be more than one JMRI on the network
+    bool useWiThrottle = (m_throttleProtocol == ThrottleProtocol::WITHROTTLE);
+    bool wtConnected = m_wtClient->isConnected();
+    bool jsonConnected = m_jsonClient->isConnected();
+    if (useWiThrottle ? wtConnected : jsonConnected) {
+        ESP_LOGI(TAG, "JMRI server also found at %s:%u; keeping %s", address, (unsigned)result.port,
+                 m_savedServerIp.c_str());
+        return;
+    }
+    bool connecting = useWiThrottle
+        ? m_wtClient->getState() == WiThrottleClient::ConnectionState::CONNECTING
+        : m_jsonClient->getState() == JmriJsonClient::ConnectionState::CONNECTING;
+    if (connecting && !m_savedServerIp.empty()) {
+        // Let the saved address finish its attempt first
+        Scheduler::JobId job = Scheduler::instance().scheduleOnce(
+            DISCOVERY_RECHECK_MS, Scheduler::Priority::NORMAL,
+            [this, result]() { onServerDiscovered(result); },
+            "jmri_found");
+        Scheduler::instance().cancel(m_discoveryJob.exchange(job));
+        return;
+    }
 
-        bool jsonConnected = controller->m_jsonClient->isConnected();
-        bool wtConnected = controller->m_wtClient->isConnected();
+    ESP_LOGW(TAG, "Using discovered JMRI server %s:%u (saved: %s:%u)", address, (unsigned)result.port,
+             m_savedServerIp.empty() ? "none" : m_savedServerIp.c_str(), (unsigned)m_savedWtPort);
+    m_savedServerIp = address;
+    m_savedWtPort = result.port;
+    saveServerAddress();
 
-        if (jsonConnected && wtConnected) {
-            if (failedAttempts > 0) {
-                ESP_LOGI(TAG, "Connection restored");
-                failedAttempts = 0;
-            }
-            continue;
-        }
+    // Connect now instead of waiting out the backoff
+    m_failedAttempts = 0;
+    m_retryCountdown = -1;
+    reconnectClients(!jsonConnected, useWiThrottle && !wtConnected);
+}
 
-        int backoffDelay = 5 * (1 << failedAttempts);
-        if (backoffDelay > maxBackoff) {
-            backoffDelay = maxBackoff;
-        }
+void JmriConnectionController::onWebPortDiscovered(uint16_t port)
+{
+    if (port == 0 || m_savedServerIp.empty()) {
+        return;
+    }
+
+    if (port != m_savedJsonPort) {
+        ESP_LOGI(TAG, "WiThrottle server reports JSON port %u (saved: %u)", (unsigned)port, (unsigned)m_savedJsonPort);
+        m_savedJsonPort = port;
+        saveServerAddress();
+    } else if (m_jsonClient->getState() == JmriJsonClient::ConnectionState::CONNECTING) {
+        return;  // Already on its way to this port
+    }
 
-        ESP_LOGW(TAG, "JMRI disconnected (attempt %d, next retry in %ds)",
-                 failedAttempts + 1, backoffDelay);
+    if (!m_jsonClient->isConnected()) {
+        // An attempt on the old port is abandoned
+        requestJsonConnect(true);
+    }
+}
+
+void JmriConnectionController::requestJsonConnect(bool replaceAttempt)
+{
+    JsonConnectRequest request;
+    request.host = m_savedServerIp;
+    request.port = m_savedJsonPort;
+    request.powerName = m_savedPowerMgr;
+    request.replaceAttempt = replaceAttempt;
+    request.pending = true;
+
+    if (!m_jsonConnectRunning) {
+        runJsonConnect(request);
+        return;
+    }
 
-        vTaskDelay(pdMS_TO_TICKS(backoffDelay * 1000));
+    xSemaphoreTake(m_jsonRequestMutex, portMAX_DELAY);
+    m_jsonRequest = std::move(request);
+    xSemaphoreGive(m_jsonRequestMutex);
+    xTaskNotifyGive(m_jsonConnectTask);
+}
 
-        if (!jsonConnected && !controller->m_savedServerIp.empty()) {
-            ESP_LOGI(TAG, "Attempting to reconnect JSON client...");
-            controller->m_jsonClient->setConfiguredPowerName(controller->m_savedPowerMgr);
-            esp_err_t err = controller->m_jsonClient->connect(controller->m_savedServerIp.c_str(), controller->m_savedJsonPort);
-            if (err == ESP_OK) {
-                ESP_LOGI(TAG, "JSON client reconnected");
-            }
-        }
+void JmriConnectionController::runJsonConnect(const JsonConnectRequest& request)
+{
+    // connect() refuses while an attempt is in flight, so one being replaced is stopped first
+    if (request.replaceAttempt &&
+        m_jsonClient->getState() == JmriJsonClient::ConnectionState::CONNECTING) {
+        m_jsonClient->disconnect();
+    }
+    m_jsonClient->setConfiguredPowerName(request.powerName);
+    esp_err_t err = m_jsonClient->connect(request.host, request.port);
+    if (err == ESP_OK) {
+        ESP_LOGI(TAG, "JSON client connecting to %s:%u", request.host.c_str(), (unsigned)request.port);
+    } else {
+        ESP_LOGW(TAG, "JSON connect to %s:%u failed (%s)", request.host.c_str(), (unsigned)request.port,
+                 esp_err_to_name(err));
+    }
+}
 
-        if (!wtConnected && !controller->m_savedServerIp.empty()) {
-            ESP_LOGI(TAG, "Attempting to reconnect WiThrottle client...");
-            esp_err_t err = controller->m_wtClient->connect(controller->m_savedServerIp.c_str(), controller->m_savedWtPort);
-            if (err == ESP_OK) {
-                ESP_LOGI(TAG, "WiThrottle client reconnected");
-            }
+void JmriConnectionController::jsonConnectTask(void* arg)
+{
+    auto* controller = static_cast<JmriConnectionController*>(arg);
+
+    while (controller->m_jsonConnectRunning) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        if (!controller->m_jsonConnectRunning) {
+            break;
         }
 
-        failedAttempts++;
+        xSemaphoreTake(controller->m_jsonRequestMutex, portMAX_DELAY);
+        JsonConnectRequest request = std::move(controller->m_jsonRequest);
+        controller->m_jsonRequest = JsonConnectRequest{};
+        xSemaphoreGive(controller->m_jsonRequestMutex);
+
+        if (request.pending) {
+            controller->runJsonConnect(request);
+        }
     }
+
+    // Signal last: the destructor frees everything as soon as it wakes
+    xSemaphoreGive(controller->m_jsonConnectExited);
+    vTaskDelete(NULL);
+}
+
+void JmriConnectionController::saveServerAddress()
+{
+    // Written to flash by the settings write-behind, in one commit
+    Settings& settings = Settings::instance();
+    settings.setString(Settings::Key::SERVER_IP, m_savedServerIp);
+    settings.setInt(Settings::Key::WITHROTTLE_PORT, m_savedWtPort);
+    settings.setInt(Settings::Key::JSON_PORT, m_savedJsonPort);
+}
+
+void JmriConnectionController::readSavedServer()
+{
+    Settings& settings = Settings::instance();
+    m_savedServerIp = settings.getString(Settings::Key::SERVER_IP);
+    m_savedWtPort = static_cast<uint16_t>(settings.getInt(Settings::Key::WITHROTTLE_PORT));
+    m_savedJsonPort = static_cast<uint16_t>(settings.getInt(Settings::Key::JSON_PORT));
+    m_savedPowerMgr = settings.getString(Settings::Key::POWER_MANAGER);
 }
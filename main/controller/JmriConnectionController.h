@@ -1,6 +1,11 @@
 #pragma once
 
+#include <atomic>
 #include <string>
+#include "../communication/MdnsBrowser.h"
+#include "../communication/ThrottleTransport.h"
+#include "Scheduler.h"
+#include "Settings.h"
 
 class JmriJsonClient;
 class WiThrottleClient;
@@ -8,6 +13,30 @@ class WiFiController;
 
 /**
  * @brief Manages JMRI connection settings and auto-reconnect.
+ *
+ * Waiting for WiFi at startup and checking the connections every 5 seconds
+ * are jobs on the shared Scheduler, not tasks of their own. Reconnect
+ * attempts back off from 5 to 60 seconds while the server stays away.
+ *
+ * Both clients connect in the background, so the JSON and WiThrottle
+ * connections are opened in parallel as soon as WiFi is up. The time from
+ * WiFi up to the first usable throttle (transport connected and roster
+ * received) is measured once per boot and logged with each client's
+ * connection phase timings.
+ *
+ * Every connection attempt also browses mDNS for JMRI's WiThrottle
+ * service. While the saved address works it is kept; if the attempt fails
+ * (e.g. the JMRI PC got a new DHCP lease), the first responder's address
+ * and port are saved and connected straight away, without waiting out the
+ * backoff. The JSON port then follows from the WiThrottle server's PW
+ * message.
+ *
+ * The server address and ports come from Settings; when they change (e.g.
+ * on the config screen) the reconnect job follows the new values.
+ *
+ * JSON connects run on a small task of the controller's own: replacing a
+ * WebSocket client stops the old one, which can take seconds, and that
+ * must not hold up the shared Scheduler. Jobs only hand it the address.
  */
 class JmriConnectionController {
 public:
@@ -17,13 +46,78 @@ public:
     JmriConnectionController(const JmriConnectionController&) = delete;
     JmriConnectionController& operator=(const JmriConnectionController&) = delete;
 
+    /**
+     * @brief Read the saved server and open both connections (never blocks on the network)
+     */
     void loadSettingsAndAutoConnect();
     void enableAutoReconnect(bool enable);
-    void startAutoConnectTask();
+
+    /**
+     * @brief Wait (up to 30 s) for WiFi, then load settings and connect
+     */
+    void startAutoConnect();
+
+    /**
+     * @brief Choose which client carries throttles
+     * In JMRI_JSON mode the WiThrottle connection is neither opened nor
+     * reconnected.
+     */
+    void setThrottleProtocol(ThrottleProtocol protocol);
+    ThrottleProtocol getThrottleProtocol() const { return m_throttleProtocol; }
+
+    /**
+     * @brief The saved throttle protocol (WITHROTTLE if none saved), from RAM
+     */
+    static ThrottleProtocol loadThrottleProtocol();
+
+    /**
+     * @brief The transport the throttles use, watched for the startup measurement
+     */
+    void setThrottleTransport(ThrottleTransport* transport) { m_throttleTransport = transport; }
+
+    /**
+     * @brief Time from WiFi up to the first usable throttle (0 until measured)
+     */
+    uint32_t getTimeToFirstThrottleMs() const { return m_firstThrottleMs; }
+
+    /**
+     * @brief mDNS discovery statistics
+     */
+    MdnsBrowser::Stats getDiscoveryStats() const { return m_browser.getStats(); }
 
 private:
-    void startReconnectTask();
-    static void reconnectTask(void* arg);
+    static constexpr uint32_t AUTO_CONNECT_POLL_MS = 500;
+    static constexpr int AUTO_CONNECT_MAX_POLLS = 60;
+    static constexpr uint32_t RECONNECT_CHECK_MS = 5000;
+    static constexpr int RECONNECT_MAX_BACKOFF_CHECKS = 12;  // 60 s
+    static constexpr uint32_t READY_POLL_MS = 20;
+    static constexpr uint32_t READY_WATCH_MAX_MS = 60000;
+    static constexpr uint32_t DISCOVERY_RECHECK_MS = 250;
+    static constexpr size_t SETTINGS_SUBSCRIPTIONS = 4;
+
+    // Latest JSON connect asked for; older requests not yet started are replaced
+    struct JsonConnectRequest {
+        std::string host;
+        uint16_t port = 0;
+        std::string powerName;
+        bool replaceAttempt = false;  // Abandon an attempt still CONNECTING
+        bool pending = false;
+    };
+
+    void onAutoConnectPoll();
+    void startReadyWatch();
+    void onReadyPoll();
+    void onReconnectCheck();
+    void reconnectClients(bool reconnectJson, bool reconnectWiThrottle);
+    void connectWiThrottle();
+    void startDiscovery();
+    void onServerDiscovered(const MdnsBrowser::Result& result);
+    void onWebPortDiscovered(uint16_t port);
+    void saveServerAddress();
+    void readSavedServer();
+    void requestJsonConnect(bool replaceAttempt);
+    void runJsonConnect(const JsonConnectRequest& request);
+    static void jsonConnectTask(void* arg);
 
     JmriJsonClient* m_jsonClient;
     WiThrottleClient* m_wtClient;
@@ -34,6 +128,34 @@ private:
     uint16_t m_savedJsonPort;
     uint16_t m_savedWtPort;
     std::string m_savedPowerMgr;
-    void* m_reconnectTaskHandle;
-    void* m_autoConnectTaskHandle;
+    volatile ThrottleProtocol m_throttleProtocol;
+
+    // Scheduler jobs; the state below is only touched by the scheduler task
+    Scheduler::JobId m_reconnectJob;
+    std::atomic<Scheduler::JobId> m_autoConnectJob;
+    int m_autoConnectPolls;
+    int m_failedAttempts;
+    int m_retryCountdown;  // Checks left before the next attempt, -1 if none pending
+
+    // Startup measurement: from WiFi up (or the first connect) to a usable throttle
+    std::atomic<ThrottleTransport*> m_throttleTransport;
+    std::atomic<Scheduler::JobId> m_readyJob;
+    int64_t m_readyWatchStartUs;  // 0 until the first connect
+    std::atomic<uint32_t> m_firstThrottleMs;
+
+    // Discovery: results are handed from the browse and WiThrottle tasks to the scheduler task
+    MdnsBrowser m_browser;
+    std::atomic<Scheduler::JobId> m_discoveryJob;
+    std::atomic<Scheduler::JobId> m_webPortJob;
+
+    // Saved server changes are reread on the scheduler task
+    Settings::SubscriptionId m_settingsSubscriptions[SETTINGS_SUBSCRIPTIONS];
+    std::atomic<Scheduler::JobId> m_settingsJob;
+
+    // JSON connects, off the scheduler task
+    TaskHandle_t m_jsonConnectTask;
+    SemaphoreHandle_t m_jsonConnectExited;  // Given by the task just before it deletes itself
+    SemaphoreHandle_t m_jsonRequestMutex;
+    JsonConnectRequest m_jsonRequest;
+    std::atomic<bool> m_jsonConnectRunning;
 };
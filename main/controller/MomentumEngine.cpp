@@ -0,0 +1,318 @@
+#include "MomentumEngine.h"
+#include <algorithm>
+#include <cstdlib>
+
+uint32_t MomentumEngine::ThrottleStats::commandsPerSecond(uint32_t tickMs) const
+{
+    uint64_t rampMs = static_cast<uint64_t>(rampTicks) * tickMs;
+    return rampMs > 0 ? static_cast<uint32_t>(static_cast<uint64_t>(commands) * 1000 / rampMs) : 0;
+}
+
+MomentumEngine::MomentumEngine(int numThrottles, uint32_t tickMs, uint32_t commandIntervalMs, const Rates& defaults)
+    : m_slots(numThrottles > 0 ? numThrottles : 0)
+    , m_tickMs(tickMs > 0 ? tickMs : 1)
+    , m_commandIntervalTicks(1)
+    , m_running(false)
+    , m_epochUs(0)
+    , m_ticksRun(0)
+    , m_statsLock(portMUX_INITIALIZER_UNLOCKED)
+{
+    m_commandIntervalTicks = std::max<uint32_t>(1, (commandIntervalMs + m_tickMs - 1) / m_tickMs);
+    for (Slot& slot : m_slots) {
+        slot.rates = defaults;
+        slot.ticksSinceSent = m_commandIntervalTicks;
+    }
+}
+
+bool MomentumEngine::validId(int throttleId) const
+{
+    return throttleId >= 0 && throttleId < static_cast<int>(m_slots.size());
+}
+
+int32_t MomentumEngine::toFixed(int signedSpeed)
+{
+    signedSpeed = std::max(-MAX_SPEED, std::min(MAX_SPEED, signedSpeed));
+    return static_cast<int32_t>(signedSpeed) * (1 << FRACTION_BITS);
+}
+
+int MomentumEngine::wholeSteps(int32_t fixed)
+{
+    // Rounded to the nearest step, away from zero at the half
+    int32_t magnitude = fixed < 0 ? -fixed : fixed;
+    int steps = static_cast<int>((magnitude + (1 << (FRACTION_BITS - 1))) >> FRACTION_BITS);
+    return std::min(steps, MAX_SPEED);
+}
+
+int32_t MomentumEngine::stepPerTick(uint16_t stepsPerSec) const
+{
+    int64_t increment = (static_cast<int64_t>(stepsPerSec) << FRACTION_BITS) * m_tickMs / 1000;
+    return static_cast<int32_t>(std::max<int64_t>(1, increment));
+}
+
+void MomentumEngine::setRates(int throttleId, const Rates& rates)
+{
+    if (!validId(throttleId)) return;
+    m_slots[throttleId].rates = rates;
+}
+
+MomentumEngine::Rates MomentumEngine::getRates(int throttleId) const
+{
+    return validId(throttleId) ? m_slots[throttleId].rates : Rates{};
+}
+
+bool MomentumEngine::hasMomentum(int throttleId) const
+{
+    if (!validId(throttleId)) return false;
+    const Rates& rates = m_slots[throttleId].rates;
+    return rates.accelStepsPerSec > 0 || rates.decelStepsPerSec > 0;
+}
+
+void MomentumEngine::reset(int throttleId, int speed, bool forward)
+{
+    if (!validId(throttleId)) return;
+
+    Slot& slot = m_slots[throttleId];
+    speed = std::max(0, std::min(MAX_SPEED, speed));
+    slot.current = toFixed(forward ? speed : -speed);
+    slot.target = slot.current;
+    slot.forward = forward;
+    slot.ramping = false;
+    slot.braking = false;
+    slot.sentSpeed = speed;
+    slot.sentForward = forward;
+    // The next ramp may send its first step at once
+    slot.ticksSinceSent = m_commandIntervalTicks;
+}
+
+bool MomentumEngine::adopt(int throttleId, int speed, bool forward)
+{
+    if (!validId(throttleId)) return false;
+
+    const Slot& slot = m_slots[throttleId];
+    if (speed == slot.sentSpeed && forward == slot.sentForward) {
+        return false;  // Our own command echoed back
+    }
+    reset(throttleId, speed, forward);
+    return true;
+}
+
+void MomentumEngine::hold(int throttleId)
+{
+    if (!validId(throttleId)) return;
+
+    const Slot& slot = m_slots[throttleId];
+    reset(throttleId, slot.sentSpeed, slot.sentForward);
+}
+
+void MomentumEngine::setTarget(int throttleId, int signedSpeed, int64_t nowUs)
+{
+    if (!validId(throttleId)) return;
+
+    Slot& slot = m_slots[throttleId];
+    slot.target = toFixed(signedSpeed);
+    slot.braking = false;
+    slot.ramping = slot.current != slot.target;
+    if (slot.ramping) {
+        startClock(nowUs);
+    }
+}
+
+void MomentumEngine::brake(int throttleId, int64_t nowUs)
+{
+    if (!validId(throttleId)) return;
+
+    Slot& slot = m_slots[throttleId];
+    slot.target = 0;
+    slot.ramping = slot.current != 0;
+    slot.braking = slot.ramping;
+    if (slot.ramping) {
+        startClock(nowUs);
+    }
+}
+
+int MomentumEngine::getTarget(int throttleId) const
+{
+    if (!validId(throttleId)) return 0;
+    int32_t target = m_slots[throttleId].target;
+    return target < 0 ? -wholeSteps(target) : wholeSteps(target);
+}
+
+int MomentumEngine::getSpeed(int throttleId) const
+{
+    if (!validId(throttleId)) return 0;
+    int32_t current = m_slots[throttleId].current;
+    return current < 0 ? -wholeSteps(current) : wholeSteps(current);
+}
+
+bool MomentumEngine::isRamping(int throttleId) const
+{
+    return validId(throttleId) && m_slots[throttleId].ramping;
+}
+
+bool MomentumEngine::isBraking(int throttleId) const
+{
+    return validId(throttleId) && m_slots[throttleId].braking;
+}
+
+void MomentumEngine::startClock(int64_t nowUs)
+{
+    if (!m_running) {
+        m_running = true;
+        m_epochUs = nowUs;
+        m_ticksRun = 0;
+    }
+}
+
+bool MomentumEngine::step(Slot& slot, Command& outCommand)
+{
+    int32_t current = slot.current;
+    int32_t target = slot.target;
+    bool reversing = current != 0 && target != 0 && (current > 0) != (target > 0);
+    bool slowing = current != 0 && (target == 0 || reversing || std::abs(target) < std::abs(current));
+
+    // A reversal stops at zero first; the direction changes on the way back up
+    int32_t limit = reversing ? 0 : target;
+    uint16_t rate = slot.braking ? slot.rates.brakeStepsPerSec
+                  : slowing ? slot.rates.decelStepsPerSec
+                  : slot.rates.accelStepsPerSec;
+    if (rate == 0) {
+        current = limit;
+    } else if (current < limit) {
+        current = std::min(current + stepPerTick(rate), limit);
+    } else {
+        current = std::max(current - stepPerTick(rate), limit);
+    }
+
+    slot.current = current;
+    if (current != 0) {
+        slot.forward = current > 0;
+    }
+    bool settled = current == target;
+    int speed = wholeSteps(current);
+    slot.ticksSinceSent++;
+    slot.stats.rampTicks++;
+
+    bool send = false;
+    if (speed == slot.sentSpeed && slot.forward == slot.sentForward) {
+        slot.stats.unchanged++;
+    } else if (settled || speed == 0 || slot.ticksSinceSent >= m_commandIntervalTicks) {
+        // The end of a ramp and every stop go out at once; only the steps between wait
+        outCommand.speed = speed;
+        outCommand.forward = slot.forward;
+        outCommand.directionChanged = slot.forward != slot.sentForward;
+        slot.sentSpeed = speed;
+        slot.sentForward = slot.forward;
+        slot.ticksSinceSent = 0;
+        slot.stats.commands++;
+        send = true;
+    } else {
+        slot.stats.deferred++;
+    }
+
+    if (settled) {
+        slot.ramping = false;
+        slot.braking = false;
+    }
+    return send;
+}
+
+int MomentumEngine::advance(int64_t nowUs, Command* out, int maxCommands)
+{
+    if (!m_running) return 0;
+
+    int64_t periodUs = static_cast<int64_t>(m_tickMs) * 1000;
+    int64_t due = (nowUs - m_epochUs) / periodUs;
+    if (due <= m_ticksRun) {
+        return 0;
+    }
+
+    // Measured from the oldest tick still to run, so a missed tick shows up in full
+    int64_t lateUs = nowUs - (m_epochUs + (m_ticksRun + 1) * periodUs);
+    int64_t pending = due - m_ticksRun;
+    int64_t skipped = 0;
+    if (pending > MAX_CATCH_UP_TICKS) {
+        skipped = pending - MAX_CATCH_UP_TICKS;
+        pending = MAX_CATCH_UP_TICKS;
+    }
+    m_ticksRun = due;
+
+    int count = 0;
+    uint32_t maxRamping = 0;
+    int64_t ran = 0;
+    bool ramping = true;
+    portENTER_CRITICAL(&m_statsLock);
+    while (ramping && ran < pending) {
+        ran++;
+        uint32_t rampingCount = 0;
+        for (size_t i = 0; i < m_slots.size(); i++) {
+            Slot& slot = m_slots[i];
+            if (!slot.ramping) continue;
+            rampingCount++;
+
+            Command command;
+            if (!step(slot, command)) continue;
+            command.throttleId = static_cast<int>(i);
+
+            // After a catch-up only the newest command per throttle is worth sending
+            int index = 0;
+            while (index < count && out[index].throttleId != command.throttleId) {
+                index++;
+            }
+            if (index < count) {
+                command.directionChanged = command.directionChanged || out[index].directionChanged;
+                out[index] = command;
+            } else if (count < maxCommands) {
+                out[count++] = command;
+            }
+        }
+        maxRamping = std::max(maxRamping, rampingCount);
+        ramping = false;
+        for (const Slot& slot : m_slots) {
+            ramping = ramping || slot.ramping;
+        }
+    }
+
+    m_stats.ticks += static_cast<uint32_t>(ran);
+    m_stats.caughtUp += static_cast<uint32_t>(ran - 1);
+    m_stats.skipped += static_cast<uint32_t>(skipped);
+    m_stats.maxRamping = std::max(m_stats.maxRamping, maxRamping);
+    m_stats.jitter.record(static_cast<uint32_t>(lateUs));
+    portEXIT_CRITICAL(&m_statsLock);
+
+    // The clock restarts with the next ramp
+    m_running = ramping;
+    return count;
+}
+
+MomentumEngine::ThrottleStats MomentumEngine::getThrottleStats(int throttleId) const
+{
+    ThrottleStats stats;
+    if (!validId(throttleId)) return stats;
+
+    portENTER_CRITICAL(&m_statsLock);
+    stats = m_slots[throttleId].stats;
+    portEXIT_CRITICAL(&m_statsLock);
+    return stats;
+}
+
+MomentumEngine::Stats MomentumEngine::getStats() const
+{
+    portENTER_CRITICAL(&m_statsLock);
+    Stats stats = m_stats;
+    portEXIT_CRITICAL(&m_statsLock);
+    return stats;
+}
+
+void MomentumEngine::resetStats()
+{
+    portENTER_CRITICAL(&m_statsLock);
+    m_stats.ticks = 0;
+    m_stats.caughtUp = 0;
+    m_stats.skipped = 0;
+    m_stats.maxRamping = 0;
+    m_stats.jitter.reset();
+    for (Slot& slot : m_slots) {
+        slot.stats = ThrottleStats();
+    }
+    portEXIT_CRITICAL(&m_statsLock);
+}
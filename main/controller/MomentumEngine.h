@@ -0,0 +1,178 @@
+#pragma once
+
+#include "LatencyHistogram.h"
+#include "freertos/FreeRTOS.h"
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief Per-throttle momentum and braking on a fixed-rate tick
+ *
+ * Each throttle has a target speed (set from the knob) and a current speed
+ * that moves towards it at the throttle's acceleration rate, or its
+ * deceleration rate when slowing down, in speed steps per second. A brake
+ * sets the target to zero and slows at the brake rate instead. Speeds are
+ * signed, forward positive, so a reversal runs down to zero, changes
+ * direction there and then accelerates the other way, as a real loco would.
+ *
+ * The current speed is kept in Q16.16 fixed point, so slow rates advance by a
+ * fraction of a step per tick without drift, and every tick adds exactly the
+ * same increment: the ramp depends only on how many ticks have run, never on
+ * when they were handled. advance() runs every tick due since the clock was
+ * started, catching up after a late wake-up.
+ *
+ * A speed command is produced only when the whole step (or the direction)
+ * differs from the last one sent, and at most once per command interval per
+ * throttle; reaching zero or the target is always sent at once, so the
+ * intermediate steps are the only ones ever dropped.
+ *
+ * Owned by the controller task; only the statistics may be read from other
+ * tasks. Times are passed in so ramps can be tested without waiting.
+ */
+class MomentumEngine {
+public:
+    struct Rates {
+        uint16_t accelStepsPerSec;  // 0 = jump straight to a higher target
+        uint16_t decelStepsPerSec;  // 0 = jump straight to a lower target
+        uint16_t brakeStepsPerSec;  // 0 = a brake stops at once
+    };
+
+    /**
+     * @brief A speed (and possibly direction) to send for one throttle
+     */
+    struct Command {
+        int throttleId;
+        int speed;              // 0-126
+        bool forward;
+        bool directionChanged;  // Send the direction before the speed
+    };
+
+    /**
+     * @brief Counters for one throttle since construction (or resetStats())
+     */
+    struct ThrottleStats {
+        uint32_t commands = 0;   // Speed commands produced by ramps
+        uint32_t unchanged = 0;  // Ramp ticks whose whole step matched the last command
+        uint32_t deferred = 0;   // Ramp ticks whose new step waited for the command interval
+        uint32_t rampTicks = 0;  // Ticks this throttle spent ramping
+
+        /**
+         * @brief Commands per second while ramping
+         */
+        uint32_t commandsPerSecond(uint32_t tickMs) const;
+    };
+
+    /**
+     * @brief Tick timing since construction (or resetStats())
+     */
+    struct Stats {
+        uint32_t ticks = 0;         // Ticks run
+        uint32_t caughtUp = 0;      // Ticks run late, together with a later one
+        uint32_t skipped = 0;       // Ticks dropped after a stall longer than MAX_CATCH_UP_TICKS
+        uint32_t maxRamping = 0;    // Most throttles ramping in the same tick
+        LatencyHistogram jitter;    // How late each wake-up ran its oldest due tick
+    };
+
+    static constexpr int MAX_SPEED = 126;
+    static constexpr int FRACTION_BITS = 16;
+    static constexpr int MAX_CATCH_UP_TICKS = 50;
+
+    /**
+     * @param numThrottles Number of throttle slots
+     * @param tickMs Tick period
+     * @param commandIntervalMs Minimum time between commands per throttle (rounded up to whole ticks)
+     * @param defaults Rates every throttle starts with
+     */
+    MomentumEngine(int numThrottles, uint32_t tickMs, uint32_t commandIntervalMs, const Rates& defaults);
+
+    MomentumEngine(const MomentumEngine&) = delete;
+    MomentumEngine& operator=(const MomentumEngine&) = delete;
+
+    uint32_t getTickMs() const { return m_tickMs; }
+
+    void setRates(int throttleId, const Rates& rates);
+    Rates getRates(int throttleId) const;
+
+    /**
+     * @brief Check whether knob changes on this throttle ramp (acceleration or deceleration set)
+     */
+    bool hasMomentum(int throttleId) const;
+
+    /**
+     * @brief Put a throttle at rest at a known speed, ending any ramp (acquire, release, direct change)
+     */
+    void reset(int throttleId, int speed, bool forward);
+
+    /**
+     * @brief Take a speed the server reported
+     * @return true if it differed from the last command, ending any ramp
+     */
+    bool adopt(int throttleId, int speed, bool forward);
+
+    /**
+     * @brief End a ramp where it is, at the last speed sent
+     */
+    void hold(int throttleId);
+
+    /**
+     * @brief Ramp towards a signed speed (forward positive); ends a brake
+     */
+    void setTarget(int throttleId, int signedSpeed, int64_t nowUs);
+
+    /**
+     * @brief Ramp down to a stop at the brake rate
+     */
+    void brake(int throttleId, int64_t nowUs);
+
+    int getTarget(int throttleId) const;
+    int getSpeed(int throttleId) const;
+    bool isRamping(int throttleId) const;
+    bool isBraking(int throttleId) const;
+
+    /**
+     * @brief Check whether the tick clock is running (some throttle is ramping)
+     */
+    bool isRunning() const { return m_running; }
+
+    /**
+     * @brief Run every tick due by now
+     * @param out Commands to send, at most one per throttle
+     * @param maxCommands Capacity of out
+     * @return Number of commands written; the clock stops once nothing is ramping
+     */
+    int advance(int64_t nowUs, Command* out, int maxCommands);
+
+    ThrottleStats getThrottleStats(int throttleId) const;
+    Stats getStats() const;
+    void resetStats();
+
+private:
+    struct Slot {
+        Rates rates{};
+        int32_t current = 0;       // Signed Q16.16
+        int32_t target = 0;        // Signed Q16.16
+        bool forward = true;       // Direction at zero
+        bool ramping = false;
+        bool braking = false;
+        int sentSpeed = 0;
+        bool sentForward = true;
+        uint32_t ticksSinceSent = 0;
+        ThrottleStats stats;
+    };
+
+    bool validId(int throttleId) const;
+    void startClock(int64_t nowUs);
+    bool step(Slot& slot, Command& outCommand);
+    int32_t stepPerTick(uint16_t stepsPerSec) const;
+    static int32_t toFixed(int signedSpeed);
+    static int wholeSteps(int32_t fixed);
+
+    std::vector<Slot> m_slots;
+    uint32_t m_tickMs;
+    uint32_t m_commandIntervalTicks;
+    bool m_running;
+    int64_t m_epochUs;       // When the clock started; tick n is due at m_epochUs + n * period
+    int64_t m_ticksRun;      // Ticks run since m_epochUs
+    Stats m_stats;
+    mutable portMUX_TYPE m_statsLock;  // Guards the stats against readers on other tasks
+};
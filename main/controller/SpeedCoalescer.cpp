@@ -0,0 +1,196 @@
+#include "SpeedCoalescer.h"
+#include "esp_log.h"
+
+static const char* TAG = "SpeedCoalescer";
+
+SpeedCoalescer::SpeedCoalescer(int numThrottles, uint32_t minIntervalMs, SendCallback send)
+    : m_slots(numThrottles > 0 ? numThrottles : 0)
+    , m_minIntervalUs(static_cast<int64_t>(minIntervalMs) * 1000)
+    , m_send(std::move(send))
+    , m_mutex(nullptr)
+    , m_timer(nullptr)
+    , m_timerArmed(false)
+    , m_timerDueUs(0)
+    , m_sentCount(0)
+    , m_suppressedCount(0)
+{
+    m_mutex = xSemaphoreCreateMutex();
+    if (!m_mutex) {
+        ESP_LOGE(TAG, "Failed to create coalescer mutex");
+    }
+
+    if (m_minIntervalUs > 0) {
+        esp_timer_create_args_t timerArgs = {
+            .callback = timerCallback,
+            .arg = this,
+            .dispatch_method = ESP_TIMER_TASK,
+            .name = "speed_flush",
+            .skip_unhandled_events = false
+        };
+        esp_err_t err = esp_timer_create(&timerArgs, &m_timer);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to create flush timer: %s - coalescing disabled", esp_err_to_name(err));
+            m_timer = nullptr;
+            m_minIntervalUs = 0;
+        }
+    }
+}
+
+SpeedCoalescer::~SpeedCoalescer()
+{
+    if (m_timer) {
+        esp_timer_stop(m_timer);
+        esp_timer_delete(m_timer);
+        m_timer = nullptr;
+    }
+    if (m_mutex) {
+        vSemaphoreDelete(m_mutex);
+        m_mutex = nullptr;
+    }
+}
+
+void SpeedCoalescer::submit(int throttleId, int speed)
+{
+    if (throttleId < 0 || throttleId >= static_cast<int>(m_slots.size())) return;
+
+    lock();
+    Slot& slot = m_slots[throttleId];
+    int64_t now = esp_timer_get_time();
+
+    if (slot.pendingSpeed >= 0) {
+        // Timer is already armed for this throttle; newest value wins
+        slot.pendingSpeed = speed;
+        m_suppressedCount++;
+    } else if (!slot.hasSent || now - slot.lastSentUs >= m_minIntervalUs) {
+        sendLocked(throttleId, speed, now);
+    } else {
+        slot.pendingSpeed = speed;
+        armTimerLocked(slot.lastSentUs + m_minIntervalUs, now);
+    }
+    unlock();
+}
+
+void SpeedCoalescer::sendNow(int throttleId, int speed)
+{
+    if (throttleId < 0 || throttleId >= static_cast<int>(m_slots.size())) return;
+
+    lock();
+    Slot& slot = m_slots[throttleId];
+    if (slot.pendingSpeed >= 0) {
+        slot.pendingSpeed = -1;
+        m_suppressedCount++;
+    }
+    sendLocked(throttleId, speed, esp_timer_get_time());
+    unlock();
+}
+
+void SpeedCoalescer::flush(int throttleId)
+{
+    if (throttleId < 0 || throttleId >= static_cast<int>(m_slots.size())) return;
+
+    lock();
+    Slot& slot = m_slots[throttleId];
+    if (slot.pendingSpeed >= 0) {
+        int speed = slot.pendingSpeed;
+        slot.pendingSpeed = -1;
+        sendLocked(throttleId, speed, esp_timer_get_time());
+    }
+    unlock();
+}
+
+void SpeedCoalescer::flushAll()
+{
+    for (int i = 0; i < static_cast<int>(m_slots.size()); i++) {
+        flush(i);
+    }
+}
+
+void SpeedCoalescer::lock() const
+{
+    if (m_mutex) {
+        xSemaphoreTake(m_mutex, portMAX_DELAY);
+    }
+}
+
+void SpeedCoalescer::unlock() const
+{
+    if (m_mutex) {
+        xSemaphoreGive(m_mutex);
+    }
+}
+
+void SpeedCoalescer::sendLocked(int throttleId, int speed, int64_t nowUs)
+{
+    // Sending under the lock keeps per-throttle ordering; the client only enqueues
+    Slot& slot = m_slots[throttleId];
+    slot.lastSentUs = nowUs;
+    slot.hasSent = true;
+    m_sentCount++;
+    if (m_send) {
+        m_send(throttleId, speed);
+    }
+}
+
+void SpeedCoalescer::armTimerLocked(int64_t dueUs, int64_t nowUs)
+{
+    if (!m_timer) {
+        return;
+    }
+    if (m_timerArmed) {
+        // Another throttle may fall due before the armed one (it sent earlier)
+        if (dueUs >= m_timerDueUs) {
+            return;
+        }
+        // Fails only if the timer has already fired; onTimer() then re-arms for the earliest slot
+        if (esp_timer_stop(m_timer) != ESP_OK) {
+            return;
+        }
+        m_timerArmed = false;
+    }
+    int64_t delayUs = dueUs - nowUs;
+    if (delayUs < 1) {
+        delayUs = 1;
+    }
+    if (esp_timer_start_once(m_timer, static_cast<uint64_t>(delayUs)) == ESP_OK) {
+        m_timerArmed = true;
+        m_timerDueUs = nowUs + delayUs;
+    } else {
+        ESP_LOGW(TAG, "Failed to arm flush timer");
+    }
+}
+
+void SpeedCoalescer::onTimer()
+{
+    lock();
+    m_timerArmed = false;
+    int64_t now = esp_timer_get_time();
+    int64_t nextDelayUs = -1;
+
+    for (int i = 0; i < static_cast<int>(m_slots.size()); i++) {
+        Slot& slot = m_slots[i];
+        if (slot.pendingSpeed < 0) {
+            continue;
+        }
+        int64_t dueIn = slot.lastSentUs + m_minIntervalUs - now;
+        if (dueIn <= 0) {
+            int speed = slot.pendingSpeed;
+            slot.pendingSpeed = -1;
+            sendLocked(i, speed, now);
+        } else if (nextDelayUs < 0 || dueIn < nextDelayUs) {
+            nextDelayUs = dueIn;
+        }
+    }
+
+    if (nextDelayUs > 0) {
+        armTimerLocked(now + nextDelayUs, now);
+    }
+    unlock();
+}
+
+void SpeedCoalescer::timerCallback(void* arg)
+{
+    SpeedCoalescer* coalescer = static_cast<SpeedCoalescer*>(arg);
+    if (coalescer) {
+        coalescer->onTimer();
+    }
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+/**
+ * @brief Latest-wins rate limiter for outgoing speed commands
+ *
+ * Sits between ThrottleController and the WiThrottle client. A speed is sent
+ * straight away if the throttle has not sent one within the minimum interval;
+ * otherwise it is held as the throttle's single pending speed, replacing any
+ * older pending value, and sent by a one-shot esp_timer when the interval has
+ * elapsed. A fast encoder spin therefore produces at most one command per
+ * interval per throttle, always carrying the newest speed.
+ *
+ * Commands that must keep their order relative to speed (direction,
+ * functions, release) call flush() first so the pending speed goes out
+ * before them. Stops use sendNow(), which drops any pending speed.
+ */
+class SpeedCoalescer {
+public:
+    /**
+     * @brief Called to actually send a speed (from the caller's task or the timer task)
+     */
+    using SendCallback = std::function<void(int throttleId, int speed)>;
+
+    /**
+     * @param numThrottles Number of throttle slots
+     * @param minIntervalMs Minimum time between speed commands per throttle (0 = no coalescing)
+     * @param send Callback that transmits a speed command
+     */
+    SpeedCoalescer(int numThrottles, uint32_t minIntervalMs, SendCallback send);
+    ~SpeedCoalescer();
+
+    SpeedCoalescer(const SpeedCoalescer&) = delete;
+    SpeedCoalescer& operator=(const SpeedCoalescer&) = delete;
+
+    /**
+     * @brief Submit a new speed; may be sent now or held as the pending speed
+     */
+    void submit(int throttleId, int speed);
+
+    /**
+     * @brief Send a speed immediately, discarding any pending speed (stop / E-stop)
+     */
+    void sendNow(int throttleId, int speed);
+
+    /**
+     * @brief Send the throttle's pending speed now, if any
+     * Call before any command that must be ordered after speed changes.
+     */
+    void flush(int throttleId);
+
+    /**
+     * @brief Send all pending speeds now
+     */
+    void flushAll();
+
+    /**
+     * @brief Speed commands actually sent
+     */
+    uint32_t getSentCount() const { return m_sentCount; }
+
+    /**
+     * @brief Speed commands replaced by a newer speed before being sent
+     */
+    uint32_t getSuppressedCount() const { return m_suppressedCount; }
+
+private:
+    struct Slot {
+        int pendingSpeed = -1;     // -1 = nothing pending
+        int64_t lastSentUs = 0;
+        bool hasSent = false;
+    };
+
+    void lock() const;
+    void unlock() const;
+    void sendLocked(int throttleId, int speed, int64_t nowUs);
+    void armTimerLocked(int64_t dueUs, int64_t nowUs);
+    void onTimer();
+    static void timerCallback(void* arg);
+
+    std::vector<Slot> m_slots;
+    int64_t m_minIntervalUs;
+    SendCallback m_send;
+
+    mutable SemaphoreHandle_t m_mutex;
+    esp_timer_handle_t m_timer;
+    bool m_timerArmed;
+    int64_t m_timerDueUs;     // When the armed timer fires
+
+    uint32_t m_sentCount;
+    uint32_t m_suppressedCount;
+};
@@ -0,0 +1,300 @@
+#include "StateReconciler.h"
+#include <algorithm>
+
+StateReconciler::StateReconciler(int numThrottles, const Config& config)
+    : m_slots(numThrottles > 0 ? numThrottles : 0)
+    , m_config(config)
+    , m_idleVerification(false)
+    , m_lock(portMUX_INITIALIZER_UNLOCKED)
+{
+    if (m_config.ackTimeoutMs == 0) {
+        m_config.ackTimeoutMs = 1;
+    }
+    m_config.retryMaxMs = std::max(m_config.retryMaxMs, m_config.ackTimeoutMs);
+    m_config.verifyMaxMs = std::max(m_config.verifyMaxMs, m_config.verifyIntervalMs);
+}
+
+int64_t StateReconciler::FieldState::deadlineUs(int64_t ackTimeoutUs) const
+{
+    // Measured from the oldest unanswered command, or from when the value became uncertain
+    return (count > 0 ? inFlight[0].sentUs : sinceUs) + ackTimeoutUs;
+}
+
+bool StateReconciler::validId(int throttleId) const
+{
+    return throttleId >= 0 && throttleId < static_cast<int>(m_slots.size());
+}
+
+void StateReconciler::setIdleVerification(bool enabled)
+{
+    portENTER_CRITICAL(&m_lock);
+    m_idleVerification = enabled;
+    portEXIT_CRITICAL(&m_lock);
+}
+
+void StateReconciler::track(int throttleId, int64_t nowUs)
+{
+    if (!validId(throttleId)) return;
+
+    portENTER_CRITICAL(&m_lock);
+    Slot& slot = m_slots[throttleId];
+    slot.tracked = true;
+    for (FieldState& field : slot.fields) {
+        field.count = 0;
+        field.reported = -1;
+        field.diverged = false;
+        field.sinceUs = nowUs;
+        field.queriedUs = 0;
+    }
+    restartBackoffLocked(slot);
+    portEXIT_CRITICAL(&m_lock);
+}
+
+void StateReconciler::untrack(int throttleId)
+{
+    if (!validId(throttleId)) return;
+
+    portENTER_CRITICAL(&m_lock);
+    m_slots[throttleId].tracked = false;
+    portEXIT_CRITICAL(&m_lock);
+}
+
+void StateReconciler::untrackAll()
+{
+    portENTER_CRITICAL(&m_lock);
+    for (Slot& slot : m_slots) {
+        slot.tracked = false;
+    }
+    portEXIT_CRITICAL(&m_lock);
+}
+
+bool StateReconciler::isTracked(int throttleId) const
+{
+    if (!validId(throttleId)) return false;
+
+    portENTER_CRITICAL(&m_lock);
+    bool tracked = m_slots[throttleId].tracked;
+    portEXIT_CRITICAL(&m_lock);
+    return tracked;
+}
+
+bool StateReconciler::isConfirmed(int throttleId) const
+{
+    if (!validId(throttleId)) return false;
+
+    portENTER_CRITICAL(&m_lock);
+    const Slot& slot = m_slots[throttleId];
+    bool confirmed = slot.tracked && !slot.unconfirmed();
+    portEXIT_CRITICAL(&m_lock);
+    return confirmed;
+}
+
+void StateReconciler::recordCommand(int throttleId, Field field, int value, int64_t nowUs)
+{
+    if (!validId(throttleId)) return;
+
+    portENTER_CRITICAL(&m_lock);
+    Slot& slot = m_slots[throttleId];
+    if (!slot.tracked) {
+        portEXIT_CRITICAL(&m_lock);
+        return;
+    }
+
+    // A burst of commands on an unconfirmed throttle keeps the back-off it already has
+    if (!slot.unconfirmed()) {
+        restartBackoffLocked(slot);
+    }
+    slot.verifyIntervalMs = m_config.verifyIntervalMs;
+
+    FieldState& state = slot.fields[fieldIndex(field)];
+    if (state.count == MAX_IN_FLIGHT) {
+        std::copy(state.inFlight + 1, state.inFlight + MAX_IN_FLIGHT, state.inFlight);
+        state.count--;
+    }
+    state.inFlight[state.count++] = Pending{ value, nowUs };
+    slot.stats.commands++;
+    portEXIT_CRITICAL(&m_lock);
+}
+
+StateReconciler::Report StateReconciler::recordReport(int throttleId, Field field, int value, int64_t nowUs)
+{
+    if (!validId(throttleId)) return Report::REPORTED;
+
+    portENTER_CRITICAL(&m_lock);
+    Slot& slot = m_slots[throttleId];
+    if (!slot.tracked) {
+        portEXIT_CRITICAL(&m_lock);
+        return Report::REPORTED;
+    }
+
+    bool wasUnconfirmed = slot.unconfirmed();
+    FieldState& state = slot.fields[fieldIndex(field)];
+    Report result = Report::REPORTED;
+
+    if (state.count > 0) {
+        // Echoes arrive in send order, so the oldest match is the one answered
+        int match = -1;
+        for (int i = 0; i < state.count; i++) {
+            if (state.inFlight[i].value == value) {
+                match = i;
+                break;
+            }
+        }
+
+        if (match >= 0) {
+            const Pending& answered = state.inFlight[match];
+            bool queried = state.queriedUs > answered.sentUs;
+            int64_t startUs = queried ? state.queriedUs : answered.sentUs;
+            slot.stats.roundTrip.record(nowUs > startUs ? static_cast<uint32_t>(nowUs - startUs) : 0);
+
+            std::copy(state.inFlight + match + 1, state.inFlight + state.count, state.inFlight);
+            state.count -= match + 1;
+            state.reported = value;
+            if (state.count == 0) {
+                if (queried) {
+                    slot.stats.queryConfirmed++;
+                } else {
+                    slot.stats.echoConfirmed++;
+                }
+                state.diverged = false;
+                state.queriedUs = 0;
+                result = Report::CONFIRMED;
+            } else {
+                result = Report::STALE;
+            }
+        } else {
+            // The command was lost or overridden: take the server's value and ask once more
+            slot.stats.diverged++;
+            state.count = 0;
+            state.reported = value;
+            state.diverged = true;
+            state.sinceUs = nowUs;
+            state.queriedUs = 0;
+            result = Report::DIVERGED;
+        }
+    } else {
+        state.reported = value;
+        state.diverged = false;
+        state.queriedUs = 0;
+    }
+
+    if (wasUnconfirmed && !slot.unconfirmed()) {
+        onConfirmedLocked(slot, nowUs);
+    }
+    portEXIT_CRITICAL(&m_lock);
+    return result;
+}
+
+uint8_t StateReconciler::takeDueQueries(int throttleId, int64_t nowUs)
+{
+    if (!validId(throttleId)) return 0;
+
+    portENTER_CRITICAL(&m_lock);
+    Slot& slot = m_slots[throttleId];
+    uint8_t fields = 0;
+
+    if (slot.tracked && nowUs >= dueUsLocked(slot)) {
+        if (slot.unconfirmed()) {
+            int64_t ackTimeoutUs = static_cast<int64_t>(m_config.ackTimeoutMs) * 1000;
+            for (int i = 0; i < 2; i++) {
+                FieldState& state = slot.fields[i];
+                if (state.unconfirmed() && nowUs >= state.deadlineUs(ackTimeoutUs)) {
+                    state.queriedUs = nowUs;
+                    fields |= (i == 0) ? SPEED : DIRECTION;
+                    slot.stats.retryQueries++;
+                }
+            }
+            slot.nextRetryUs = nowUs + static_cast<int64_t>(slot.retryIntervalMs) * 1000;
+            slot.retryIntervalMs = std::min(slot.retryIntervalMs * 2, m_config.retryMaxMs);
+        } else {
+            fields = ALL_FIELDS;
+            slot.stats.verifyQueries += 2;
+            slot.verifyIntervalMs = std::min(slot.verifyIntervalMs * 2, m_config.verifyMaxMs);
+            slot.nextVerifyUs = nowUs + static_cast<int64_t>(slot.verifyIntervalMs) * 1000;
+        }
+    }
+    portEXIT_CRITICAL(&m_lock);
+    return fields;
+}
+
+int64_t StateReconciler::nextDueUs(bool* outRetry) const
+{
+    int64_t earliest = NEVER;
+    bool retry = false;
+    portENTER_CRITICAL(&m_lock);
+    for (const Slot& slot : m_slots) {
+        int64_t dueUs = dueUsLocked(slot);
+        if (dueUs < earliest) {
+            earliest = dueUs;
+            retry = slot.unconfirmed();
+        }
+    }
+    portEXIT_CRITICAL(&m_lock);
+    if (outRetry) {
+        *outRetry = retry;
+    }
+    return earliest;
+}
+
+int64_t StateReconciler::dueUsLocked(const Slot& slot) const
+{
+    if (!slot.tracked) {
+        return NEVER;
+    }
+
+    if (slot.unconfirmed()) {
+        int64_t ackTimeoutUs = static_cast<int64_t>(m_config.ackTimeoutMs) * 1000;
+        int64_t earliest = NEVER;
+        for (const FieldState& state : slot.fields) {
+            if (state.unconfirmed()) {
+                earliest = std::min(earliest, state.deadlineUs(ackTimeoutUs));
+            }
+        }
+        return std::max(earliest, slot.nextRetryUs);
+    }
+
+    if (m_idleVerification && m_config.verifyIntervalMs > 0) {
+        return slot.nextVerifyUs;
+    }
+    return NEVER;
+}
+
+void StateReconciler::restartBackoffLocked(Slot& slot)
+{
+    slot.nextRetryUs = 0;
+    slot.retryIntervalMs = m_config.ackTimeoutMs;
+    slot.verifyIntervalMs = m_config.verifyIntervalMs;
+}
+
+void StateReconciler::onConfirmedLocked(Slot& slot, int64_t nowUs)
+{
+    slot.nextRetryUs = 0;
+    slot.retryIntervalMs = m_config.ackTimeoutMs;
+    slot.nextVerifyUs = nowUs + static_cast<int64_t>(slot.verifyIntervalMs) * 1000;
+}
+
+StateReconciler::Stats StateReconciler::getStats(int throttleId) const
+{
+    Stats stats;
+    if (!validId(throttleId)) return stats;
+
+    portENTER_CRITICAL(&m_lock);
+    stats = m_slots[throttleId].stats;
+    portEXIT_CRITICAL(&m_lock);
+    return stats;
+}
+
+void StateReconciler::resetStats()
+{
+    portENTER_CRITICAL(&m_lock);
+    for (Slot& slot : m_slots) {
+        slot.stats.commands = 0;
+        slot.stats.echoConfirmed = 0;
+        slot.stats.queryConfirmed = 0;
+        slot.stats.diverged = 0;
+        slot.stats.retryQueries = 0;
+        slot.stats.verifyQueries = 0;
+        slot.stats.roundTrip.reset();
+    }
+    portEXIT_CRITICAL(&m_lock);
+}
@@ -0,0 +1,161 @@
+#pragma once
+
+#include "LatencyHistogram.h"
+#include "freertos/FreeRTOS.h"
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief Tracks which throttle states the server has confirmed and when to ask
+ *
+ * Every speed and direction command sent is recorded as in flight. A report
+ * from the server (the echo of a command, or the answer to a query) that
+ * matches an in-flight value confirms it and every older command for that
+ * field; a report that matches none of them means the server disagrees, and
+ * its value wins. A throttle is confirmed once neither field has anything in
+ * flight and both have been reported since the loco was acquired.
+ *
+ * Only unconfirmed throttles are queried: first when the oldest command has
+ * gone unanswered for the ack timeout, then with exponential back-off. With
+ * idle verification on (transports that do not push changes made elsewhere)
+ * a confirmed throttle is re-checked after the verify interval, backing off
+ * to the maximum while it stays quiet; any new command restarts both.
+ *
+ * Times are passed in so the policy can be tested without waiting. Calls are
+ * safe from any task: commands are recorded from the speed coalescer's timer
+ * as well as the controller task.
+ */
+class StateReconciler {
+public:
+    /**
+     * @brief Reconciled throttle fields (bit flags)
+     */
+    enum Field : uint8_t {
+        SPEED = 0x01,
+        DIRECTION = 0x02,
+        ALL_FIELDS = SPEED | DIRECTION
+    };
+
+    /**
+     * @brief What a server report meant
+     */
+    enum class Report : uint8_t {
+        CONFIRMED,  ///< Matched the newest command in flight
+        STALE,      ///< Matched an older command; newer ones are still in flight
+        DIVERGED,   ///< Matched no command in flight; the server's value wins
+        REPORTED    ///< Nothing was in flight (first report, query answer or a change made elsewhere)
+    };
+
+    struct Config {
+        uint32_t ackTimeoutMs;       // Wait this long for an echo before querying
+        uint32_t retryMaxMs;         // Back-off limit while unconfirmed
+        uint32_t verifyIntervalMs;   // First idle check of a confirmed throttle (0 = never)
+        uint32_t verifyMaxMs;        // Back-off limit while confirmed and idle
+    };
+
+    /**
+     * @brief Per-throttle counters since construction (or resetStats())
+     */
+    struct Stats {
+        uint32_t commands = 0;           // Speed and direction commands sent
+        uint32_t echoConfirmed = 0;      // Confirmed by a report without being queried
+        uint32_t queryConfirmed = 0;     // Confirmed only after a query
+        uint32_t diverged = 0;           // Reports that matched no command in flight
+        uint32_t retryQueries = 0;       // Field queries for unconfirmed state
+        uint32_t verifyQueries = 0;      // Field queries for confirmed, idle state
+        LatencyHistogram roundTrip;      // Command (or its last query) to the matching report
+    };
+
+    static constexpr int MAX_IN_FLIGHT = 4;     // Per field; the oldest is forgotten beyond this
+    static constexpr int64_t NEVER = INT64_MAX;
+
+    StateReconciler(int numThrottles, const Config& config);
+
+    StateReconciler(const StateReconciler&) = delete;
+    StateReconciler& operator=(const StateReconciler&) = delete;
+
+    /**
+     * @brief Turn idle verification of confirmed throttles on or off
+     */
+    void setIdleVerification(bool enabled);
+
+    /**
+     * @brief Start tracking a throttle whose state is not yet known (acquire, re-acquire)
+     */
+    void track(int throttleId, int64_t nowUs);
+
+    /**
+     * @brief Stop tracking a throttle (released, or the session ended)
+     */
+    void untrack(int throttleId);
+    void untrackAll();
+
+    bool isTracked(int throttleId) const;
+    bool isConfirmed(int throttleId) const;
+
+    /**
+     * @brief Note a command sent to the server
+     */
+    void recordCommand(int throttleId, Field field, int value, int64_t nowUs);
+
+    /**
+     * @brief Match a value reported by the server against the commands in flight
+     */
+    Report recordReport(int throttleId, Field field, int value, int64_t nowUs);
+
+    /**
+     * @brief Fields to query now; marks them queried and backs off
+     * @return Field flags (0 = nothing due)
+     */
+    uint8_t takeDueQueries(int throttleId, int64_t nowUs);
+
+    /**
+     * @brief Earliest time any throttle has a query due, or NEVER
+     * @param outRetry If not null, set when that query is for unconfirmed state (not an idle check)
+     */
+    int64_t nextDueUs(bool* outRetry = nullptr) const;
+
+    Stats getStats(int throttleId) const;
+    void resetStats();
+
+private:
+    struct Pending {
+        int value;
+        int64_t sentUs;
+    };
+
+    struct FieldState {
+        Pending inFlight[MAX_IN_FLIGHT];  // Oldest first
+        int count = 0;
+        int reported = -1;         // Last value the server reported; -1 = unknown
+        bool diverged = false;     // Server disagreed mid-flight; ask once more
+        int64_t sinceUs = 0;       // When it became unknown or diverged
+        int64_t queriedUs = 0;     // Last query while unconfirmed; 0 = not queried
+
+        bool unconfirmed() const { return count > 0 || reported < 0 || diverged; }
+        int64_t deadlineUs(int64_t ackTimeoutUs) const;
+    };
+
+    struct Slot {
+        bool tracked = false;
+        FieldState fields[2];
+        int64_t nextRetryUs = 0;         // Back-off while unconfirmed
+        uint32_t retryIntervalMs = 0;
+        int64_t nextVerifyUs = 0;        // Back-off while confirmed
+        uint32_t verifyIntervalMs = 0;
+        Stats stats;
+
+        bool unconfirmed() const { return fields[0].unconfirmed() || fields[1].unconfirmed(); }
+    };
+
+    static int fieldIndex(Field field) { return field == DIRECTION ? 1 : 0; }
+    bool validId(int throttleId) const;
+    int64_t dueUsLocked(const Slot& slot) const;
+    void restartBackoffLocked(Slot& slot);
+    void onConfirmedLocked(Slot& slot, int64_t nowUs);
+
+    std::vector<Slot> m_slots;
+    Config m_config;
+    bool m_idleVerification;
+    mutable portMUX_TYPE m_lock;
+};
@@ -1,22 +1,119 @@
 #include "ThrottleController.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
-#include "nvs_flash.h"
-#include "nvs.h"
+#include "Settings.h"
+#include "sdkconfig.h"
+#include <algorithm>
+#include <cstring>
 
 static const char* TAG = "ThrottleController";
-static const char* NVS_NAMESPACE = "jmri";
-static const char* NVS_KEY_SPEED_STEPS = "speed_steps";
 
-ThrottleController::ThrottleController(WiThrottleClient* wiThrottleClient)
-    : m_wiThrottleClient(wiThrottleClient)
+namespace {
+    constexpr int SNAPSHOT_SPIN_ATTEMPTS = 4;
+    constexpr int SNAPSHOT_MAX_WAIT_MS = 50;
+
+    // A write takes well under a microsecond, but the controller task may be
+    // pre-empted mid-write by a reader of higher priority on the same core, so
+    // after a few spins the reader sleeps to let it finish.
+    template <typename T>
+    bool readPublished(const SeqLock<T>& published, T& outValue, uint32_t* outVersion)
+    {
+        for (int attempt = 0; attempt < SNAPSHOT_SPIN_ATTEMPTS + SNAPSHOT_MAX_WAIT_MS; attempt++) {
+            if (published.tryRead(outValue, outVersion)) {
+                return true;
+            }
+            if (attempt >= SNAPSHOT_SPIN_ATTEMPTS) {
+                vTaskDelay(1);
+            }
+        }
+        return false;
+    }
+}
+
+ThrottleController::ThrottleController(ThrottleTransport* transport, int numThrottles)
+    : m_numThrottles(std::max(1, std::min(MAX_THROTTLES, numThrottles)))
+    , m_transport(transport)
+    , m_rosterSource(nullptr)
     , m_stateMutex(nullptr)
+    , m_snapshots(new SeqLock<ThrottleSnapshot>[m_numThrottles])
+    , m_lastPublished(new ThrottleSnapshot[m_numThrottles])
+    , m_publishedRevision(new uint32_t[m_numThrottles])
+    , m_events(CONFIG_THROTTLE_EVENT_QUEUE_LENGTH)
+    , m_task(nullptr)
+    , m_taskExited(nullptr)
+    , m_running(false)
+    , m_posted(0)
+    , m_handled(0)
+    , m_queueFullWaits(0)
+    , m_maxDepth(0)
+    , m_statsLock(portMUX_INITIALIZER_UNLOCKED)
     , m_uiUpdateCallback(nullptr)
     , m_uiUpdateUserData(nullptr)
-    , m_pollingTimer(nullptr)
+    , m_reconcileJob(Scheduler::INVALID_JOB)
+    , m_reconcileDueUs(StateReconciler::NEVER)
+    , m_reconcileSequence(0)
+    , m_reconcileFired(0)
+    , m_reconcileWakeUs(StateReconciler::NEVER)
+    , m_momentumTimer(nullptr)
+    , m_momentumTimerRunning(false)
+    , m_momentumPeakRamping(0)
+    , m_momentumTickPending(false)
+    , m_momentumCommands(new MomentumEngine::Command[m_numThrottles])
+    , m_resumePending(new uint8_t[m_numThrottles])
+    , m_linkLostUs(0)
+    , m_resumeStats{}
 {
+    std::fill(m_resumePending.get(), m_resumePending.get() + m_numThrottles, 0);
+    for (std::atomic<uint32_t>& bucket : m_depthBuckets) {
+        bucket.store(0);
+    }
+
+    StateReconciler::Config reconcileConfig;
+    reconcileConfig.ackTimeoutMs = CONFIG_THROTTLE_ACK_TIMEOUT_MS;
+    reconcileConfig.retryMaxMs = CONFIG_THROTTLE_ACK_RETRY_MAX_MS;
+    reconcileConfig.verifyIntervalMs = CONFIG_THROTTLE_VERIFY_INTERVAL_MS;
+    reconcileConfig.verifyMaxMs = CONFIG_THROTTLE_VERIFY_MAX_INTERVAL_MS;
+    m_reconciler = std::make_unique<StateReconciler>(m_numThrottles, reconcileConfig);
+    updateIdleVerification();
+
+    // Rate-limit knob speed changes; only the newest speed per throttle is sent
+    m_speedCoalescer = std::make_unique<SpeedCoalescer>(
+        m_numThrottles, CONFIG_THROTTLE_SPEED_MIN_INTERVAL_MS,
+        [this](int throttleId, int speed) {
+            ThrottleTransport* transport = m_transport.load();
+            if (transport) {
+                // Recorded first so an echo that overtakes the send still finds it
+                m_reconciler->recordCommand(throttleId, StateReconciler::SPEED, speed, esp_timer_get_time());
+                transport->setSpeed(ThrottleTransport::throttleIdChar(throttleId), speed);
+            }
+        }
+    );
+
+    // Ramps send through the coalescer too, but already at no more than its rate
+    MomentumEngine::Rates momentumRates;
+    momentumRates.accelStepsPerSec = CONFIG_THROTTLE_MOMENTUM_ACCEL_RATE;
+    momentumRates.decelStepsPerSec = CONFIG_THROTTLE_MOMENTUM_DECEL_RATE;
+    momentumRates.brakeStepsPerSec = CONFIG_THROTTLE_MOMENTUM_BRAKE_RATE;
+    m_momentum = std::make_unique<MomentumEngine>(
+        m_numThrottles, CONFIG_THROTTLE_MOMENTUM_TICK_MS, CONFIG_THROTTLE_SPEED_MIN_INTERVAL_MS, momentumRates);
+
+    esp_timer_create_args_t timerArgs = {
+        .callback = momentumTimerCallback,
+        .arg = this,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "momentum_tick",
+        .skip_unhandled_events = true
+    };
+    esp_err_t err = esp_timer_create(&timerArgs, &m_momentumTimer);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create momentum timer: %s - knob sets speed directly", esp_err_to_name(err));
+        m_momentumTimer = nullptr;
+    }
+
     // Create throttles
-    for (int i = 0; i < NUM_THROTTLES; i++) {
+    m_throttles.reserve(m_numThrottles);
+    for (int i = 0; i < m_numThrottles; i++) {
         m_throttles.push_back(std::make_unique<Throttle>(i));
     }
     
@@ -25,57 +122,605 @@ ThrottleController::ThrottleController(WiThrottleClient* wiThrottleClient)
         m_knobs.push_back(std::make_unique<Knob>(i));
     }
     
-    // Register throttle state change callback
-    if (m_wiThrottleClient) {
-        m_wiThrottleClient->setThrottleStateCallback(
-            [this](const WiThrottleClient::ThrottleUpdate& update) {
-                this->onThrottleStateChanged(update);
-            }
-        );
-        m_wiThrottleClient->setFunctionLabelsCallback(
-            [this](char throttleId, const std::vector<std::string>& labels) {
-                this->onFunctionLabelsReceived(throttleId, labels);
-            }
-        );
-    }
-
     m_stateMutex = xSemaphoreCreateMutex();
     if (!m_stateMutex) {
         ESP_LOGE(TAG, "Failed to create ThrottleController state mutex");
     }
+
+    // Zeroed so the first publish of each snapshot differs
+    std::memset(m_lastPublished.get(), 0, sizeof(ThrottleSnapshot) * m_numThrottles);
+    std::fill(m_publishedRevision.get(), m_publishedRevision.get() + m_numThrottles, UINT32_MAX);
+    std::memset(&m_lastSelection, 0, sizeof(m_lastSelection));
+    publishSnapshots();
+
+    m_taskExited = xSemaphoreCreateBinary();
+    m_running = m_taskExited != nullptr;
+    if (!m_running ||
+        xTaskCreate(taskEntry, "throttle_ctrl", CONFIG_THROTTLE_CONTROLLER_TASK_STACK_SIZE, this, 5, &m_task) != pdPASS) {
+        // Inputs are then handled on the caller's task, as before the queue
+        ESP_LOGE(TAG, "Failed to create throttle controller task");
+        m_running = false;
+        m_task = nullptr;
+    }
+
+    // Register throttle state change callback (posts from here on reach the task)
+    attachTransport(transport);
 }
 
 ThrottleController::~ThrottleController()
 {
-    stopPollingTimer();
+    detachTransport(m_transport.load());
+    if (m_task) {
+        // The task checks the flag between events. It deletes itself, so its handle is
+        // not used again; nothing below may run while it could still touch the models.
+        m_running = false;
+        xTaskNotifyGive(m_task);
+        xSemaphoreTake(m_taskExited, portMAX_DELAY);
+    }
+    // After the task, which could otherwise arm it again; a run in between posts to a stopped queue
+    stopReconcileTimer();
+    if (m_momentumTimer) {
+        esp_timer_stop(m_momentumTimer);
+        esp_timer_delete(m_momentumTimer);
+        m_momentumTimer = nullptr;
+    }
+    m_task = nullptr;
+    Event event;
+    while (m_events.tryPop(event)) {
+        discardEvent(event);
+    }
     if (m_stateMutex) {
         vSemaphoreDelete(m_stateMutex);
         m_stateMutex = nullptr;
     }
+    if (m_taskExited) {
+        vSemaphoreDelete(m_taskExited);
+        m_taskExited = nullptr;
+    }
 }
 
 void ThrottleController::initialize()
 {
     ESP_LOGI(TAG, "ThrottleController initialized with %d throttles and %d knobs",
-             NUM_THROTTLES, NUM_KNOBS);
-    
-    // Start polling timer for state synchronization
-    startPollingTimer();
+             m_numThrottles, NUM_KNOBS);
 }
 
-void ThrottleController::onKnobIndicatorTouched(int throttleId, int knobId)
+bool ThrottleController::waitUntilIdle(uint32_t timeoutMs) const
 {
-    if (throttleId < 0 || throttleId >= NUM_THROTTLES) return;
-    if (knobId < 0 || knobId >= NUM_KNOBS) return;
+    if (!m_task || xTaskGetCurrentTaskHandle() == m_task) {
+        return true;
+    }
+    // Events are handled in queue order, so this covers everything posted so far
+    uint32_t target = m_events.pushCount();
+    for (uint32_t waitedMs = 0; static_cast<int32_t>(m_handled.load(std::memory_order_acquire) - target) < 0;
+         waitedMs++) {
+        if (waitedMs >= timeoutMs) {
+            return false;
+        }
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+    return true;
+}
 
-    if (!lockState(pdMS_TO_TICKS(50))) {
-        ESP_LOGW(TAG, "Failed to lock state for knob indicator touch");
+void ThrottleController::post(Event& event)
+{
+    if (!m_task) {
+        dispatch(event);
+        return;
+    }
+    if (!m_running) {
+        discardEvent(event);  // Shutting down
+        return;
+    }
+
+    event.postedUs = esp_timer_get_time();
+    uint32_t depth = 0;
+    if (!m_events.tryPush(event, &depth)) {
+        if (xTaskGetCurrentTaskHandle() == m_task) {
+            // Posted from a handler: waiting for space would wait for this very task
+            m_posted.fetch_add(1, std::memory_order_relaxed);
+            dispatch(event);
+            return;
+        }
+        // Never drop an input; the controller task frees a cell within one event.
+        // Only input and transport tasks get here: timer and scheduler producers signal()
+        m_queueFullWaits.fetch_add(1, std::memory_order_relaxed);
+        do {
+            xTaskNotifyGive(m_task);
+            vTaskDelay(1);
+            if (!m_running) {
+                discardEvent(event);
+                return;
+            }
+        } while (!m_events.tryPush(event, &depth));
+    }
+
+    recordDepth(depth);
+    m_posted.fetch_add(1, std::memory_order_relaxed);
+    xTaskNotifyGive(m_task);
+}
+
+void ThrottleController::signal(const Event& event)
+{
+    // The caller has set the event's pending flag; it is handled between queued events.
+    // Timer and Scheduler callbacks come here so they never wait for queue space.
+    if (!m_task) {
+        dispatch(event);
+        return;
+    }
+    if (m_running) {
+        xTaskNotifyGive(m_task);
+    }
+}
+
+void ThrottleController::handleSignals()
+{
+    uint32_t sequence = m_reconcileFired.exchange(0);
+    if (sequence != 0) {
+        Event event{};
+        event.type = EventType::RECONCILE;
+        event.value = static_cast<int32_t>(sequence);
+        dispatch(event);
+    }
+    if (m_momentumTickPending.load()) {
+        Event event{};
+        event.type = EventType::MOMENTUM_TICK;
+        dispatch(event);
+    }
+}
+
+void ThrottleController::recordDepth(uint32_t depth)
+{
+    int bucket = 0;
+    while (bucket < DEPTH_BUCKETS - 1 && depth >= (1u << bucket)) {
+        bucket++;
+    }
+    m_depthBuckets[bucket].fetch_add(1, std::memory_order_relaxed);
+
+    uint32_t maxDepth = m_maxDepth.load(std::memory_order_relaxed);
+    while (depth > maxDepth && !m_maxDepth.compare_exchange_weak(maxDepth, depth, std::memory_order_relaxed)) {
+    }
+}
+
+void ThrottleController::taskEntry(void* arg)
+{
+    auto* controller = static_cast<ThrottleController*>(arg);
+    Event event;
+
+    while (controller->m_running) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        while (controller->m_running) {
+            controller->handleSignals();
+            if (!controller->m_events.tryPop(event)) {
+                break;
+            }
+            controller->handleQueuedEvent(event);
+        }
+    }
+
+    // Signal last: the destructor frees everything as soon as it wakes
+    xSemaphoreGive(controller->m_taskExited);
+    vTaskDelete(NULL);
+}
+
+void ThrottleController::handleQueuedEvent(const Event& event)
+{
+    int64_t waitedUs = esp_timer_get_time() - event.postedUs;
+    portENTER_CRITICAL(&m_statsLock);
+    m_latency.record(waitedUs > 0 ? static_cast<uint32_t>(waitedUs) : 0);
+    portEXIT_CRITICAL(&m_statsLock);
+
+    dispatch(event);
+    m_handled.fetch_add(1, std::memory_order_release);
+}
+
+void ThrottleController::dispatch(const Event& event)
+{
+    switch (event.type) {
+        case EventType::KNOB_INDICATOR_TOUCHED:
+            handleKnobIndicatorTouched(event.throttleId, event.knobId);
+            break;
+        case EventType::KNOB_ROTATION:
+            handleKnobRotation(event.knobId, event.value);
+            break;
+        case EventType::KNOB_PRESS:
+            handleKnobPress(event.knobId);
+            break;
+        case EventType::THROTTLE_RELEASE:
+            handleThrottleRelease(event.throttleId);
+            break;
+        case EventType::SET_FUNCTION:
+            handleSetFunction(event.throttleId, event.value, event.flag);
+            break;
+        case EventType::THROTTLE_UPDATE:
+            onThrottleStateChanged(event.update);
+            break;
+        case EventType::FUNCTION_LABELS:
+            onFunctionLabelsReceived(ThrottleTransport::throttleIdChar(event.throttleId), *event.labels);
+            delete event.labels;
+            break;
+        case EventType::SESSION:
+            onTransportSession(event.flag);
+            break;
+        case EventType::RECONCILE:
+            reconcileThrottleStates(static_cast<uint32_t>(event.value));
+            break;
+        case EventType::SET_TRANSPORT:
+            handleSetTransport(event.transport);
+            break;
+        case EventType::ROSTER_SOURCE:
+            updateUI(ALL_THROTTLES, UI_ROSTER_SELECTION);
+            break;
+        case EventType::SET_MOMENTUM:
+            handleSetMomentum(event.throttleId, event.rates);
+            break;
+        case EventType::MOMENTUM_TICK:
+            handleMomentumTick();
+            break;
+    }
+
+    // Catches changes that did not refresh the UI (e.g. a resumed session giving up)
+    publishSnapshots();
+
+    // Commands and reports may have moved the next query earlier (or cancelled it)
+    armReconcileTimer();
+}
+
+void ThrottleController::buildThrottleSnapshot(int throttleId, ThrottleSnapshot& outSnapshot) const
+{
+    // Zero the padding too: snapshots are compared byte for byte
+    std::memset(&outSnapshot, 0, sizeof(outSnapshot));
+
+    const Throttle* throttle = m_throttles[throttleId].get();
+    outSnapshot.throttleId = throttleId;
+    outSnapshot.state = throttle->getState();
+    outSnapshot.assignedKnob = throttle->getAssignedKnob();
+    outSnapshot.currentSpeed = throttle->getCurrentSpeed();
+    outSnapshot.direction = throttle->getDirection();
+    outSnapshot.hasLocomotive = throttle->hasLocomotive();
+    const Locomotive* loco = outSnapshot.hasLocomotive ? throttle->getLocomotive() : nullptr;
+    if (loco) {
+        std::strncpy(outSnapshot.locoName, loco->getName().c_str(), LOCO_NAME_LENGTH - 1);
+        outSnapshot.locoAddress = loco->getAddress();
+    }
+}
+
+void ThrottleController::publishSnapshots()
+{
+    // Only throttles that changed get a new generation. The revision check
+    // keeps this to one compare per untouched slot, however many there are.
+    for (int i = 0; i < m_numThrottles; i++) {
+        uint32_t revision = m_throttles[i]->getRevision();
+        if (revision == m_publishedRevision[i]) {
+            continue;
+        }
+        m_publishedRevision[i] = revision;
+
+        ThrottleSnapshot snapshot;
+        buildThrottleSnapshot(i, snapshot);
+        if (std::memcmp(&snapshot, &m_lastPublished[i], sizeof(snapshot)) != 0) {
+            m_snapshots[i].write(snapshot);
+            m_lastPublished[i] = snapshot;
+        }
+    }
+
+    SelectionState selection;
+    std::memset(&selection, 0, sizeof(selection));
+    selection.throttleId = -1;
+    selection.knobId = -1;
+    for (int i = 0; i < NUM_KNOBS; i++) {
+        const Knob* knob = m_knobs[i].get();
+        if (knob->getState() == Knob::State::SELECTING) {
+            selection.active = true;
+            selection.knobId = static_cast<int8_t>(i);
+            selection.throttleId = static_cast<int8_t>(knob->getAssignedThrottleId());
+            selection.rosterIndex = knob->getRosterIndex();
+            break;
+        }
+    }
+    if (std::memcmp(&selection, &m_lastSelection, sizeof(selection)) != 0) {
+        m_selection.write(selection);
+        m_lastSelection = selection;
+    }
+}
+
+void ThrottleController::discardEvent(const Event& event)
+{
+    if (event.type == EventType::FUNCTION_LABELS) {
+        delete event.labels;
+    }
+}
+
+ThrottleController::EventStats ThrottleController::getEventStats() const
+{
+    EventStats stats{};
+    stats.posted = m_posted.load();
+    stats.handled = m_handled.load();
+    stats.queueFullWaits = m_queueFullWaits.load();
+    stats.maxDepth = m_maxDepth.load();
+    for (int i = 0; i < DEPTH_BUCKETS; i++) {
+        stats.depthBuckets[i] = m_depthBuckets[i].load();
+    }
+    portENTER_CRITICAL(&m_statsLock);
+    stats.latency = m_latency;
+    portEXIT_CRITICAL(&m_statsLock);
+    return stats;
+}
+
+void ThrottleController::resetEventStats()
+{
+    // Posted and handled keep counting; waitUntilIdle() relies on the latter
+    m_queueFullWaits = 0;
+    m_maxDepth = 0;
+    for (std::atomic<uint32_t>& bucket : m_depthBuckets) {
+        bucket.store(0);
+    }
+    portENTER_CRITICAL(&m_statsLock);
+    m_latency.reset();
+    portEXIT_CRITICAL(&m_statsLock);
+}
+
+void ThrottleController::setTransport(ThrottleTransport* transport)
+{
+    Event event{};
+    event.type = EventType::SET_TRANSPORT;
+    event.transport = transport;
+    post(event);
+}
+
+void ThrottleController::handleSetTransport(ThrottleTransport* transport)
+{
+    ThrottleTransport* previous = m_transport.load();
+    if (transport == previous) return;
+
+    // Locos acquired on the old transport stay there; hand them back first
+    for (int i = 0; i < m_numThrottles; i++) {
+        if (m_throttles[i]->hasLocomotive()) {
+            handleThrottleRelease(i);
+        }
+    }
+
+    detachTransport(previous);
+    attachTransport(transport);
+    m_transport.store(transport);
+
+    ESP_LOGI(TAG, "Throttle transport: %s", transport ? transport->getTransportName() : "none");
+    updateIdleVerification();
+    updateUI(ALL_THROTTLES, UI_ALL);
+}
+
+void ThrottleController::setRosterSource(ThrottleTransport* source)
+{
+    // Readers see the new source at once; snapshots are only published by the controller task
+    m_rosterSource.store(source);
+    Event event{};
+    event.type = EventType::ROSTER_SOURCE;
+    post(event);
+}
+
+RosterHandle ThrottleController::getRosterSnapshot() const
+{
+    ThrottleTransport* source = m_rosterSource.load();
+    if (source) {
+        RosterHandle roster = source->getRosterSnapshot();
+        if (roster) {
+            return roster;
+        }
+    }
+    ThrottleTransport* transport = m_transport.load();
+    return transport ? transport->getRosterSnapshot() : nullptr;
+}
+
+void ThrottleController::attachTransport(ThrottleTransport* transport)
+{
+    if (!transport) return;
+
+    // Called on the transport's receive task; handled on the controller task
+    transport->setThrottleStateCallback(
+        [this](const ThrottleTransport::ThrottleUpdate& update) {
+            Event event{};
+            event.type = EventType::THROTTLE_UPDATE;
+            event.update = update;
+            this->post(event);
+        }
+    );
+    transport->setFunctionLabelsCallback(
+        [this](char throttleId, const std::vector<std::string>& labels) {
+            int index = ThrottleTransport::throttleIndex(throttleId);
+            if (index < 0 || index >= m_numThrottles) {
+                return;  // Another throttle on the connection (e.g. the debug controls' 'T')
+            }
+            Event event{};
+            event.type = EventType::FUNCTION_LABELS;
+            event.throttleId = static_cast<int8_t>(index);
+            event.labels = new std::vector<std::string>(labels);
+            this->post(event);
+        }
+    );
+    transport->setSessionCallback(
+        [this](bool started) {
+            Event event{};
+            event.type = EventType::SESSION;
+            event.flag = started;
+            this->post(event);
+        }
+    );
+}
+
+void ThrottleController::detachTransport(ThrottleTransport* transport)
+{
+    if (!transport) return;
+
+    transport->setThrottleStateCallback(nullptr);
+    transport->setFunctionLabelsCallback(nullptr);
+    transport->setSessionCallback(nullptr);
+}
+
+void ThrottleController::onTransportSession(bool started)
+{
+    if (started) {
+        resumeSession();
+        return;
+    }
+
+    int allocated = 0;
+    for (int i = 0; i < m_numThrottles; i++) {
+        if (m_throttles[i]->hasLocomotive()) {
+            allocated++;
+        }
+        // A resume cut short by another drop starts over on the next session
+        m_resumePending[i] = 0;
+    }
+    if (allocated > 0 && m_linkLostUs == 0) {
+        m_linkLostUs = esp_timer_get_time();
+    }
+
+    // Nothing is confirmed or answered without a session; resumeSession() tracks them again
+    m_reconciler->untrackAll();
+
+    // Ramps stop where they are; the resumed session reports what the locos are doing
+    for (int i = 0; i < m_numThrottles; i++) {
+        m_momentum->hold(i);
+    }
+
+    if (allocated > 0) {
+        ESP_LOGW(TAG, "Session ended with %d locos allocated; re-acquiring on reconnect", allocated);
+    }
+}
+
+void ThrottleController::resumeSession()
+{
+    struct Reacquire {
+        char throttleId;
+        int address;
+        bool isLongAddress;
+    };
+    std::vector<Reacquire> reacquire(m_numThrottles);
+    int count = 0;
+
+    // The local model still shows the locos the server released with the old session
+    int64_t nowUs = esp_timer_get_time();
+    for (int i = 0; i < m_numThrottles; i++) {
+        const Locomotive* loco = m_throttles[i]->getLocomotive();
+        m_resumePending[i] = 0;
+        if (m_throttles[i]->hasLocomotive() && loco) {
+            reacquire[count].throttleId = ThrottleTransport::throttleIdChar(i);
+            reacquire[count].address = loco->getAddress();
+            reacquire[count].isLongAddress = loco->isLongAddress();
+            count++;
+            m_resumePending[i] = RESUME_SPEED | RESUME_DIRECTION;
+            m_reconciler->track(i, nowUs);
+        }
+    }
+    if (count == 0) {
+        m_linkLostUs = 0;
+    } else {
+        lockState(portMAX_DELAY);
+        m_resumeStats.locosReacquired += count;
+        unlockState();
+    }
+
+    ThrottleTransport* transport = m_transport.load();
+    if (count == 0 || !transport) {
+        return;
+    }
+
+    ESP_LOGI(TAG, "Session started; re-acquiring %d locos", count);
+    for (int i = 0; i < count; i++) {
+        const Reacquire& entry = reacquire[i];
+        if (transport->acquireLocomotive(entry.throttleId, entry.address, entry.isLongAddress) != ESP_OK) {
+            ESP_LOGW(TAG, "Failed to re-acquire loco #%d on throttle %c", entry.address, entry.throttleId);
+            continue;
+        }
+        // Servers that push state answer the acquire with it; the others are asked
+        if (!transport->pushesThrottleState()) {
+            transport->querySpeed(entry.throttleId);
+            transport->queryDirection(entry.throttleId);
+        }
+    }
+}
+
+void ThrottleController::reconcileResumedThrottle(int throttleId, const ThrottleTransport::ThrottleUpdate& update)
+{
+    // The server's state is what the loco is actually doing (it may have
+    // stopped it when the link dropped), so it replaces the local model
+    Throttle* throttle = m_throttles[throttleId].get();
+    uint8_t& pending = m_resumePending[throttleId];
+    uint32_t corrections = 0;
+
+    if (update.speed >= 0 && (pending & RESUME_SPEED)) {
+        if (update.speed != throttle->getCurrentSpeed()) {
+            ESP_LOGW(TAG, "Throttle %d resumed at server speed %d (was %d)",
+                     throttleId, update.speed, throttle->getCurrentSpeed());
+            corrections++;
+        }
+        pending &= ~RESUME_SPEED;
+    }
+    if (update.direction >= 0 && (pending & RESUME_DIRECTION)) {
+        if ((update.direction == 1) != throttle->getDirection()) {
+            ESP_LOGW(TAG, "Throttle %d resumed in server direction %s",
+                     throttleId, update.direction ? "forward" : "reverse");
+            corrections++;
+        }
+        pending &= ~RESUME_DIRECTION;
+    }
+    if (corrections > 0) {
+        lockState(portMAX_DELAY);
+        m_resumeStats.corrections += corrections;
+        unlockState();
+    }
+
+    if (pending == 0) {
+        finishResume(throttleId, true);
+    }
+}
+
+void ThrottleController::finishResume(int throttleId, bool reported)
+{
+    m_resumePending[throttleId] = 0;
+    for (int i = 0; i < m_numThrottles; i++) {
+        if (m_resumePending[i] != 0) {
+            return;
+        }
+    }
+    if (m_linkLostUs == 0) {
         return;
     }
 
+    if (reported) {
+        uint32_t recoveryMs = static_cast<uint32_t>((esp_timer_get_time() - m_linkLostUs) / 1000);
+        lockState(portMAX_DELAY);
+        m_resumeStats.sessionsResumed++;
+        m_resumeStats.lastRecoveryMs = recoveryMs;
+        if (recoveryMs > m_resumeStats.maxRecoveryMs) {
+            m_resumeStats.maxRecoveryMs = recoveryMs;
+        }
+        uint32_t corrections = m_resumeStats.corrections;
+        unlockState();
+        ESP_LOGI(TAG, "Session resumed: throttles controllable %lu ms after link loss (%lu corrections)",
+                 (unsigned long)recoveryMs, (unsigned long)corrections);
+    }
+    m_linkLostUs = 0;
+}
+
+void ThrottleController::onKnobIndicatorTouched(int throttleId, int knobId)
+{
+    if (throttleId < 0 || throttleId >= m_numThrottles) return;
+    if (knobId < 0 || knobId >= NUM_KNOBS) return;
+
+    Event event{};
+    event.type = EventType::KNOB_INDICATOR_TOUCHED;
+    event.throttleId = static_cast<int8_t>(throttleId);
+    event.knobId = static_cast<int8_t>(knobId);
+    post(event);
+}
+
+void ThrottleController::handleKnobIndicatorTouched(int throttleId, int knobId)
+{
     Throttle* throttle = m_throttles[throttleId].get();
     Knob* knob = m_knobs[knobId].get();
     bool shouldUpdate = false;
+    int previousThrottleId = -1;
 
     ESP_LOGI(TAG, "Knob %d touched on throttle %d (throttle state=%d, knob state=%d)",
              knobId, throttleId, (int)throttle->getState(), (int)knob->getState());
@@ -94,6 +739,7 @@ void ThrottleController::onKnobIndicatorTouched(int throttleId, int knobId)
 
                 ESP_LOGI(TAG, "Moved knob %d from throttle %d to throttle %d (control)",
                          knobId, currentThrottleId, throttleId);
+                previousThrottleId = currentThrottleId;
                 shouldUpdate = true;
             } else if (throttle->getState() == Throttle::State::UNALLOCATED) {
                 // Move knob to unallocated throttle for roster selection
@@ -103,6 +749,7 @@ void ThrottleController::onKnobIndicatorTouched(int throttleId, int knobId)
 
                 ESP_LOGI(TAG, "Moved knob %d from throttle %d to throttle %d (selecting)",
                          knobId, currentThrottleId, throttleId);
+                previousThrottleId = currentThrottleId;
                 shouldUpdate = true;
             }
         }
@@ -131,10 +778,11 @@ void ThrottleController::onKnobIndicatorTouched(int throttleId, int knobId)
         shouldUpdate = true;
     }
 
-    unlockState();
-
     if (shouldUpdate) {
-        updateUI();
+        if (previousThrottleId >= 0) {
+            updateUI(previousThrottleId, UI_THROTTLE);
+        }
+        updateUI(throttleId, UI_THROTTLE | UI_ROSTER_SELECTION);
     } else {
         ESP_LOGW(TAG, "Knob assignment not allowed in current states");
     }
@@ -144,11 +792,15 @@ void ThrottleController::onKnobRotation(int knobId, int delta)
 {
     if (knobId < 0 || knobId >= NUM_KNOBS) return;
 
-    if (!lockState(pdMS_TO_TICKS(50))) {
-        ESP_LOGW(TAG, "Failed to lock state for knob rotation");
-        return;
-    }
+    Event event{};
+    event.type = EventType::KNOB_ROTATION;
+    event.knobId = static_cast<int8_t>(knobId);
+    event.value = delta;
+    post(event);
+}
 
+void ThrottleController::handleKnobRotation(int knobId, int delta)
+{
     Knob* knob = m_knobs[knobId].get();
     bool shouldUpdate = false;
     bool shouldSendSpeed = false;
@@ -164,6 +816,7 @@ void ThrottleController::onKnobRotation(int knobId, int delta)
         // Scroll through roster
         size_t rosterSize = getRosterSize();
         knob->handleRotation(delta, rosterSize);
+        throttleId = knob->getAssignedThrottleId();
 
         ESP_LOGD(TAG, "Knob %d roster index: %d / %d", knobId, knob->getRosterIndex(), rosterSize);
         shouldUpdate = true;
@@ -179,6 +832,22 @@ void ThrottleController::onKnobRotation(int knobId, int delta)
             // Get configured speed steps per click
             stepsPerClick = getSpeedStepsPerClick();
 
+            if (m_momentum->hasMomentum(throttleId) && m_momentumTimer) {
+                // With momentum the knob moves the target; the ramp moves the loco
+                int target = m_momentum->getTarget(throttleId) + (delta * stepsPerClick);
+                if (target > 126) target = 126;
+                if (target < -126) target = -126;
+                m_momentum->setTarget(throttleId, target, esp_timer_get_time());
+
+                ESP_LOGI(TAG, "Knob %d set throttle %d target: %d (speed %d %s, steps: %d)",
+                         knobId, throttleId, target, currentSpeed,
+                         currentDirection ? "forward" : "reverse", stepsPerClick);
+                if (m_momentum->isRunning()) {
+                    startMomentumTimer();
+                }
+                return;
+            }
+
             // Signed speed: forward is positive, reverse is negative
             int signedSpeed = currentDirection ? currentSpeed : -currentSpeed;
             int newSignedSpeed = signedSpeed + (delta * stepsPerClick);
@@ -201,23 +870,22 @@ void ThrottleController::onKnobRotation(int knobId, int delta)
             // Optimistic update (JMRI doesn't always send speed notifications)
             throttle->setSpeed(newSpeed);
             throttle->setDirection(newDirection);
+            m_momentum->reset(throttleId, newSpeed, newDirection);
             shouldSendSpeed = true;
             shouldSendDirection = (newDirection != currentDirection);
             shouldUpdate = true;
         }
     }
 
-    unlockState();
-
     if (shouldSendSpeed && throttleId >= 0) {
-        // Send command to WiThrottle
+        // Send command to the throttle transport
         sendSpeedCommand(throttleId, newSpeed);
 
         if (shouldSendDirection) {
             sendDirectionCommand(throttleId, newDirection);
         }
 
-    ESP_LOGI(TAG, "Knob %d changed throttle %d speed: %d -> %d (dir: %s -> %s, steps: %d, optimistic + polling)",
+    ESP_LOGI(TAG, "Knob %d changed throttle %d speed: %d -> %d (dir: %s -> %s, steps: %d, optimistic until confirmed)",
          knobId,
          throttleId,
          currentSpeed,
@@ -229,7 +897,7 @@ void ThrottleController::onKnobRotation(int knobId, int delta)
 
     if (shouldUpdate) {
         // Update UI immediately for responsive feel
-        updateUI();
+        updateUI(throttleId, shouldSendSpeed ? UI_THROTTLE : UI_ROSTER_SELECTION);
     }
 }
 
@@ -237,11 +905,14 @@ void ThrottleController::onKnobPress(int knobId)
 {
     if (knobId < 0 || knobId >= NUM_KNOBS) return;
 
-    if (!lockState(pdMS_TO_TICKS(50))) {
-        ESP_LOGW(TAG, "Failed to lock state for knob press");
-        return;
-    }
+    Event event{};
+    event.type = EventType::KNOB_PRESS;
+    event.knobId = static_cast<int8_t>(knobId);
+    post(event);
+}
 
+void ThrottleController::handleKnobPress(int knobId)
+{
     Knob* knob = m_knobs[knobId].get();
 
     if (knob->getState() == Knob::State::SELECTING) {
@@ -249,62 +920,89 @@ void ThrottleController::onKnobPress(int knobId)
         int throttleId = knob->getAssignedThrottleId();
         int rosterIndex = knob->getRosterIndex();
 
-        WiThrottleClient::Locomotive rosterLoco;
-        bool hasRosterEntry = getLocoAtRosterIndex(rosterIndex, rosterLoco);
+        RosterHandle roster = getRosterSnapshot();
+        bool hasRosterEntry = roster && rosterIndex >= 0 && rosterIndex < static_cast<int>(roster->size());
 
         if (hasRosterEntry && throttleId >= 0) {
             // Convert roster entry to our Locomotive model
+            RosterSnapshot::Entry entry = (*roster)[static_cast<size_t>(rosterIndex)];
+            ThrottleTransport::Locomotive rosterLoco(entry.address, std::string(entry.name), entry.addressType);
             auto loco = createLocomotiveFromRoster(rosterLoco);
 
-            // Update models
+            // Labels prefetched with the roster fill the function panel before the server answers
+            std::vector<std::string> labels;
+            if (!entry.functionLabels.empty()) {
+                entry.getFunctionLabels(labels);
+            }
+
+            // Update models; the lock covers the function list, which readers copy
             Throttle* throttle = m_throttles[throttleId].get();
+            lockState(portMAX_DELAY);
             throttle->assignLocomotive(std::move(loco));
-            knob->startControlling();
-
+            if (!labels.empty()) {
+                applyFunctionLabels(throttle, labels);
+            }
             unlockState();
+            knob->startControlling();
+            m_momentum->reset(throttleId, throttle->getCurrentSpeed(), throttle->getDirection());
 
-            // Send acquire command to WiThrottle
+            // Send acquire command to the throttle transport; its state is unknown until reported
+            m_reconciler->track(throttleId, esp_timer_get_time());
             bool isLongAddress = (rosterLoco.addressType == 'L');
-            m_wiThrottleClient->acquireLocomotive('0' + throttleId, rosterLoco.address,
-                                                   isLongAddress);
+            ThrottleTransport* transport = m_transport.load();
+            if (transport) {
+                transport->acquireLocomotive(ThrottleTransport::throttleIdChar(throttleId), rosterLoco.address,
+                                             isLongAddress);
+            }
 
             ESP_LOGI(TAG, "Knob %d acquired loco '%s' (#%d) on throttle %d",
                      knobId, rosterLoco.name.c_str(), rosterLoco.address, throttleId);
-            updateUI();
+            updateUI(throttleId, UI_ALL);
             return;
         }
     } else if (knob->getState() == Knob::State::CONTROLLING) {
-        // Normal stop (set speed to 0 with optimistic UI update)
         int throttleId = knob->getAssignedThrottleId();
+        if (throttleId >= 0 && m_momentum->hasMomentum(throttleId) && m_momentumTimer &&
+            m_momentum->getRates(throttleId).brakeStepsPerSec > 0 &&
+            !m_momentum->isBraking(throttleId) && m_momentum->getSpeed(throttleId) != 0) {
+            // Brake at the brake rate; a second press while braking stops at once
+            m_momentum->brake(throttleId, esp_timer_get_time());
+
+            ESP_LOGI(TAG, "Knob %d brake on throttle %d", knobId, throttleId);
+            startMomentumTimer();
+            return;
+        }
+
+        // Normal stop (set speed to 0 with optimistic UI update)
         if (throttleId >= 0) {
             Throttle* throttle = m_throttles[throttleId].get();
             if (throttle) {
                 throttle->setSpeed(0);
+                m_momentum->reset(throttleId, 0, throttle->getDirection());
             }
         }
 
-        unlockState();
-
         if (throttleId >= 0) {
-            sendSpeedCommand(throttleId, 0);
+            sendStopCommand(throttleId);
             ESP_LOGI(TAG, "Knob %d stop on throttle %d", knobId, throttleId);
-            updateUI();
+            updateUI(throttleId, UI_THROTTLE);
         }
         return;
     }
-
-    unlockState();
 }
 
 void ThrottleController::onThrottleRelease(int throttleId)
 {
-    if (throttleId < 0 || throttleId >= NUM_THROTTLES) return;
+    if (throttleId < 0 || throttleId >= m_numThrottles) return;
 
-    if (!lockState(pdMS_TO_TICKS(50))) {
-        ESP_LOGW(TAG, "Failed to lock state for throttle release");
-        return;
-    }
+    Event event{};
+    event.type = EventType::THROTTLE_RELEASE;
+    event.throttleId = static_cast<int8_t>(throttleId);
+    post(event);
+}
 
+void ThrottleController::handleThrottleRelease(int throttleId)
+{
     Throttle* throttle = m_throttles[throttleId].get();
     int knobId = throttle->getAssignedKnob();
 
@@ -313,28 +1011,80 @@ void ThrottleController::onThrottleRelease(int throttleId)
         m_knobs[knobId]->release();
     }
 
-    // Release throttle
+    // Release throttle; its function list goes with the loco
+    lockState(portMAX_DELAY);
     throttle->releaseLocomotive();
-
     unlockState();
+    m_momentum->reset(throttleId, throttle->getCurrentSpeed(), throttle->getDirection());
+    if (m_resumePending[throttleId] != 0) {
+        finishResume(throttleId, false);
+    }
 
-    // Release loco in WiThrottle
-    m_wiThrottleClient->releaseLocomotive('0' + throttleId);
+    // Release loco on the transport (after any speed still waiting to go out)
+    m_speedCoalescer->flush(throttleId);
+    ThrottleTransport* transport = m_transport.load();
+    if (transport) {
+        transport->releaseLocomotive(ThrottleTransport::throttleIdChar(throttleId));
+    }
+
+    logReconcileStats(throttleId);
+    m_reconciler->untrack(throttleId);
 
     ESP_LOGI(TAG, "Released throttle %d", throttleId);
-    updateUI();
+    updateUI(throttleId, UI_ALL);
 }
 
 void ThrottleController::onThrottleFunctions(int throttleId)
 {
-    if (throttleId < 0 || throttleId >= NUM_THROTTLES) return;
+    if (throttleId < 0 || throttleId >= m_numThrottles) return;
     
     ESP_LOGI(TAG, "Functions button pressed for throttle %d", throttleId);
 }
 
+void ThrottleController::setFunction(int throttleId, int functionNumber, bool state)
+{
+    if (throttleId < 0 || throttleId >= m_numThrottles) return;
+
+    Event event{};
+    event.type = EventType::SET_FUNCTION;
+    event.throttleId = static_cast<int8_t>(throttleId);
+    event.value = functionNumber;
+    event.flag = state;
+    post(event);
+}
+
+void ThrottleController::handleSetFunction(int throttleId, int functionNumber, bool state)
+{
+    ThrottleTransport* transport = m_transport.load();
+    if (!transport) return;
+
+    m_speedCoalescer->flush(throttleId);
+    transport->setFunction(ThrottleTransport::throttleIdChar(throttleId), functionNumber, state);
+}
+
+uint32_t ThrottleController::getSpeedCommandsSent() const
+{
+    return m_speedCoalescer->getSentCount();
+}
+
+uint32_t ThrottleController::getSpeedCommandsSuppressed() const
+{
+    return m_speedCoalescer->getSuppressedCount();
+}
+
+ThrottleController::ResumeStats ThrottleController::getResumeStats() const
+{
+    ResumeStats stats{};
+    if (lockState(pdMS_TO_TICKS(50))) {
+        stats = m_resumeStats;
+        unlockState();
+    }
+    return stats;
+}
+
 Throttle* ThrottleController::getThrottle(int throttleId)
 {
-    if (throttleId >= 0 && throttleId < NUM_THROTTLES) {
+    if (throttleId >= 0 && throttleId < m_numThrottles) {
         return m_throttles[throttleId].get();
     }
     return nullptr;
@@ -350,30 +1100,33 @@ Knob* ThrottleController::getKnob(int knobId)
 
 size_t ThrottleController::getRosterSize() const
 {
-    if (!m_wiThrottleClient) {
-        return 0;
-    }
-    return m_wiThrottleClient->getRosterSize();
+    RosterHandle roster = getRosterSnapshot();
+    return roster ? roster->size() : 0;
 }
 
-bool ThrottleController::getLocoAtRosterIndex(int index, WiThrottleClient::Locomotive& outEntry) const
+bool ThrottleController::getLocoAtRosterIndex(int index, ThrottleTransport::Locomotive& outEntry) const
 {
-    if (!m_wiThrottleClient) {
+    RosterHandle roster = getRosterSnapshot();
+    if (!roster || index < 0 || index >= static_cast<int>(roster->size())) {
         return false;
     }
-    return m_wiThrottleClient->getRosterEntry(index, outEntry);
+    RosterSnapshot::Entry entry = (*roster)[static_cast<size_t>(index)];
+    outEntry = ThrottleTransport::Locomotive(entry.address, std::string(entry.name), entry.addressType);
+    return true;
 }
 
-void ThrottleController::setUIUpdateCallback(void (*callback)(void*), void* userData)
+void ThrottleController::setUIUpdateCallback(UIUpdateCallback callback, void* userData)
 {
     m_uiUpdateCallback = callback;
     m_uiUpdateUserData = userData;
 }
 
-void ThrottleController::updateUI()
+void ThrottleController::updateUI(int throttleId, uint8_t changes)
 {
+    // Published before the UI hears of the change, so the redraw sees it
+    publishSnapshots();
     if (m_uiUpdateCallback) {
-        m_uiUpdateCallback(m_uiUpdateUserData);
+        m_uiUpdateCallback(m_uiUpdateUserData, throttleId, changes);
     }
 }
 
@@ -394,75 +1147,56 @@ void ThrottleController::unlockState() const
 
 bool ThrottleController::getThrottleSnapshot(int throttleId, ThrottleSnapshot& outSnapshot) const
 {
-    if (throttleId < 0 || throttleId >= NUM_THROTTLES) {
-        return false;
-    }
-    if (!lockState(pdMS_TO_TICKS(50))) {
+    if (throttleId < 0 || throttleId >= m_numThrottles) {
         return false;
     }
 
-    const Throttle* throttle = m_throttles[throttleId].get();
-    if (!throttle) {
-        unlockState();
+    uint32_t generation = 0;
+    if (!readPublished(m_snapshots[throttleId], outSnapshot, &generation)) {
         return false;
     }
+    outSnapshot.generation = generation;
+    return true;
+}
 
-    outSnapshot.throttleId = throttleId;
-    outSnapshot.state = throttle->getState();
-    outSnapshot.assignedKnob = throttle->getAssignedKnob();
-    outSnapshot.currentSpeed = throttle->getCurrentSpeed();
-    outSnapshot.direction = throttle->getDirection();
-    outSnapshot.hasLocomotive = throttle->hasLocomotive();
-    if (outSnapshot.hasLocomotive) {
-        const Locomotive* loco = throttle->getLocomotive();
-        if (loco) {
-            outSnapshot.locoName = loco->getName();
-            outSnapshot.locoAddress = loco->getAddress();
-        }
-    } else {
-        outSnapshot.locoName.clear();
-        outSnapshot.locoAddress = 0;
+uint32_t ThrottleController::getThrottleGeneration(int throttleId) const
+{
+    if (throttleId < 0 || throttleId >= m_numThrottles) {
+        return 0;
     }
-
-    unlockState();
-    return true;
+    return m_snapshots[throttleId].version();
 }
 
 bool ThrottleController::getRosterSelectionSnapshot(RosterSelectionSnapshot& outSnapshot) const
 {
     outSnapshot = RosterSelectionSnapshot{};
 
-    if (!lockState(pdMS_TO_TICKS(50))) {
+    SelectionState selection;
+    if (!readPublished(m_selection, selection, nullptr)) {
         return false;
     }
-
-    for (int i = 0; i < NUM_KNOBS; i++) {
-        Knob* knob = m_knobs[i].get();
-        if (knob && knob->getState() == Knob::State::SELECTING) {
-            outSnapshot.active = true;
-            outSnapshot.knobId = i;
-            outSnapshot.throttleId = knob->getAssignedThrottleId();
-            outSnapshot.rosterIndex = knob->getRosterIndex();
-            break;
-        }
+    if (!selection.active) {
+        return true;
     }
 
-    if (outSnapshot.active && m_wiThrottleClient) {
-        WiThrottleClient::Locomotive entry;
-        if (m_wiThrottleClient->getRosterEntry(outSnapshot.rosterIndex, entry)) {
-            outSnapshot.hasRosterEntry = true;
-            outSnapshot.rosterName = entry.name;
-            outSnapshot.rosterAddress = entry.address;
-        }
+    outSnapshot.active = true;
+    outSnapshot.throttleId = selection.throttleId;
+    outSnapshot.knobId = selection.knobId;
+    outSnapshot.rosterIndex = selection.rosterIndex;
+
+    // The roster is an immutable shared snapshot; no controller lock is held here
+    ThrottleTransport::Locomotive entry;
+    if (getLocoAtRosterIndex(outSnapshot.rosterIndex, entry)) {
+        outSnapshot.hasRosterEntry = true;
+        outSnapshot.rosterName = entry.name;
+        outSnapshot.rosterAddress = entry.address;
     }
-
-    unlockState();
     return true;
 }
 
 bool ThrottleController::getFunctionsSnapshot(int throttleId, std::vector<Function>& outFunctions) const
 {
-    if (throttleId < 0 || throttleId >= NUM_THROTTLES) {
+    if (throttleId < 0 || throttleId >= m_numThrottles) {
         return false;
     }
 
@@ -483,7 +1217,7 @@ bool ThrottleController::getFunctionsSnapshot(int throttleId, std::vector<Functi
 
 bool ThrottleController::getFunctionState(int throttleId, int functionNumber, bool& outState) const
 {
-    if (throttleId < 0 || throttleId >= NUM_THROTTLES) {
+    if (throttleId < 0 || throttleId >= m_numThrottles) {
         return false;
     }
 
@@ -511,19 +1245,37 @@ bool ThrottleController::getFunctionState(int throttleId, int functionNumber, bo
 
 void ThrottleController::sendSpeedCommand(int throttleId, int speed)
 {
-    // '0' + throttleId gives '0', '1', '2', or '3' - used to convert to char
-    m_wiThrottleClient->setSpeed('0' + throttleId, speed);
+    m_speedCoalescer->submit(throttleId, speed);
+
+    // A held speed is sent (and recorded) on the coalescer's timer, which does not
+    // re-arm the reconcile job; check by the time its echo is due
+    int64_t wakeUs = esp_timer_get_time() +
+        static_cast<int64_t>(CONFIG_THROTTLE_SPEED_MIN_INTERVAL_MS + CONFIG_THROTTLE_ACK_TIMEOUT_MS) * 1000;
+    if (wakeUs < m_reconcileWakeUs) {
+        m_reconcileWakeUs = wakeUs;
+    }
+}
+
+void ThrottleController::sendStopCommand(int throttleId)
+{
+    // Stops bypass coalescing and drop any stale pending speed
+    m_speedCoalescer->sendNow(throttleId, 0);
 }
 
 void ThrottleController::sendDirectionCommand(int throttleId, bool forward)
 {
-    // '0' + throttleId gives '0', '1', '2', or '3' - used to convert to char
-    m_wiThrottleClient->setDirection('0' + throttleId, forward);
+    // Direction must follow the speed that crossed zero
+    m_speedCoalescer->flush(throttleId);
+    ThrottleTransport* transport = m_transport.load();
+    if (transport) {
+        m_reconciler->recordCommand(throttleId, StateReconciler::DIRECTION, forward ? 1 : 0, esp_timer_get_time());
+        transport->setDirection(ThrottleTransport::throttleIdChar(throttleId), forward);
+    }
 }
 
-std::unique_ptr<Locomotive> ThrottleController::createLocomotiveFromRoster(const WiThrottleClient::Locomotive& rosterEntry)
+std::unique_ptr<Locomotive> ThrottleController::createLocomotiveFromRoster(const ThrottleTransport::Locomotive& rosterEntry)
 {
-    // Convert WiThrottle address type to our enum
+    // Convert roster address type to our enum
     Locomotive::AddressType addressType = (rosterEntry.addressType == 'L') 
         ? Locomotive::AddressType::LONG 
         : Locomotive::AddressType::SHORT;
@@ -531,59 +1283,73 @@ std::unique_ptr<Locomotive> ThrottleController::createLocomotiveFromRoster(const
     return std::make_unique<Locomotive>(rosterEntry.name, rosterEntry.address, addressType);
 }
 
-void ThrottleController::onThrottleStateChanged(const WiThrottleClient::ThrottleUpdate& update)
+void ThrottleController::onThrottleStateChanged(const ThrottleTransport::ThrottleUpdate& update)
 {
-    // Convert char throttleId '0'-'3' to int 0-3
-    int throttleId = update.throttleId - '0';
+    int throttleId = ThrottleTransport::throttleIndex(update.throttleId);
     
-    if (throttleId < 0 || throttleId >= NUM_THROTTLES) {
+    if (throttleId < 0 || throttleId >= m_numThrottles) {
         ESP_LOGW(TAG, "Invalid throttle ID in update: %c", update.throttleId);
         return;
     }
     
-    if (!lockState(pdMS_TO_TICKS(50))) {
-        ESP_LOGW(TAG, "Failed to lock state for throttle update");
-        return;
-    }
+    // The echo of an older command is not applied: a newer one is already shown and in flight
+    int64_t nowUs = esp_timer_get_time();
+    bool applySpeed = update.speed >= 0 &&
+        m_reconciler->recordReport(throttleId, StateReconciler::SPEED, update.speed, nowUs) != StateReconciler::Report::STALE;
+    bool applyDirection = update.direction >= 0 &&
+        m_reconciler->recordReport(throttleId, StateReconciler::DIRECTION, update.direction, nowUs) != StateReconciler::Report::STALE;
 
     Throttle* throttle = m_throttles[throttleId].get();
 
+    // First report after a re-acquire: note where the server disagrees before taking its values
+    if (m_resumePending[throttleId] != 0) {
+        reconcileResumedThrottle(throttleId, update);
+    }
+
     // Update speed if present
-    if (update.speed >= 0) {
+    if (applySpeed) {
         throttle->setSpeed(update.speed);
         ESP_LOGI(TAG, "Throttle %d speed updated: %d", throttleId, update.speed);
     }
 
     // Update direction if present
-    if (update.direction >= 0) {
+    if (applyDirection) {
         throttle->setDirection(update.direction == 1);
         ESP_LOGI(TAG, "Throttle %d direction updated: %s", throttleId, update.direction ? "forward" : "reverse");
     }
 
+    // Another throttle (or the server) changed the loco: any ramp gives way to it
+    if ((applySpeed || applyDirection) &&
+        m_momentum->adopt(throttleId, throttle->getCurrentSpeed(), throttle->getDirection()) &&
+        m_momentum->hasMomentum(throttleId)) {
+        ESP_LOGI(TAG, "Throttle %d ramp ended by server speed %d", throttleId, throttle->getCurrentSpeed());
+    }
+
     // Update function if present
     if (update.function >= 0) {
+        lockState(portMAX_DELAY);
         throttle->setFunctionState(update.function, update.functionState);
+        unlockState();
         ESP_LOGI(TAG, "Throttle %d function %d: %s", throttleId, update.function, update.functionState ? "on" : "off");
     }
 
-    unlockState();
-
-    // Update UI to reflect changes
-    updateUI();
+    // Update UI to reflect changes (a function-only report leaves the meter alone)
+    uint8_t changes = (update.function >= 0) ? UI_FUNCTIONS : 0;
+    if (update.speed >= 0 || update.direction >= 0 || changes == 0) {
+        changes |= UI_THROTTLE;
+    }
+    updateUI(throttleId, changes);
 }
 
 void ThrottleController::onFunctionLabelsReceived(char throttleIdChar, const std::vector<std::string>& labels)
 {
-    int throttleId = throttleIdChar - '0';
-    if (throttleId < 0 || throttleId >= NUM_THROTTLES) {
+    int throttleId = ThrottleTransport::throttleIndex(throttleIdChar);
+    if (throttleId < 0 || throttleId >= m_numThrottles) {
         ESP_LOGW(TAG, "Invalid throttle ID for function labels: %c", throttleIdChar);
         return;
     }
 
-    if (!lockState(pdMS_TO_TICKS(50))) {
-        ESP_LOGW(TAG, "Failed to lock state for function labels");
-        return;
-    }
+    lockState(portMAX_DELAY);
 
     Throttle* throttle = m_throttles[throttleId].get();
     if (!throttle) {
@@ -591,6 +1357,15 @@ void ThrottleController::onFunctionLabelsReceived(char throttleIdChar, const std
         return;
     }
 
+    applyFunctionLabels(throttle, labels);
+
+    unlockState();
+    updateUI(throttleId, UI_FUNCTIONS);
+}
+
+void ThrottleController::applyFunctionLabels(Throttle* throttle, const std::vector<std::string>& labels)
+{
+    // Caller holds the state lock; function states already known are kept
     std::vector<Function> existing = throttle->getFunctions();
     throttle->clearFunctions();
     for (size_t i = 0; i < labels.size(); ++i) {
@@ -604,100 +1379,253 @@ void ThrottleController::onFunctionLabelsReceived(char throttleIdChar, const std
         Function function(static_cast<int>(i), labels[i], state);
         throttle->addFunction(function);
     }
+}
 
-    unlockState();
-    updateUI();
+void ThrottleController::reconcileThrottleStates(uint32_t sequence)
+{
+    // The armed job has fired (it may still be finishing on the scheduler task)
+    if (sequence == m_reconcileSequence) {
+        m_reconcileJob.store(Scheduler::INVALID_JOB);
+        m_reconcileDueUs = StateReconciler::NEVER;
+    }
+
+    int64_t nowUs = esp_timer_get_time();
+    if (nowUs >= m_reconcileWakeUs) {
+        m_reconcileWakeUs = StateReconciler::NEVER;
+    }
+
+    // Due queries are taken even while disconnected so their back-off still advances
+    ThrottleTransport* transport = m_transport.load();
+    bool connected = transport && transport->isConnected();
+    for (int i = 0; i < m_numThrottles; i++) {
+        uint8_t fields = m_reconciler->takeDueQueries(i, nowUs);
+        if (fields == 0 || !connected) {
+            continue;
+        }
+
+        char throttleId = ThrottleTransport::throttleIdChar(i);
+        if (fields & StateReconciler::SPEED) {
+            transport->querySpeed(throttleId);
+        }
+        if (fields & StateReconciler::DIRECTION) {
+            transport->queryDirection(throttleId);
+        }
+        ESP_LOGD(TAG, "Throttle %d: queried %s%s (%s)", i,
+                 (fields & StateReconciler::SPEED) ? "speed " : "",
+                 (fields & StateReconciler::DIRECTION) ? "direction " : "",
+                 m_reconciler->isConfirmed(i) ? "idle check" : "unconfirmed");
+    }
 }
 
-void ThrottleController::pollThrottleStates()
+void ThrottleController::updateIdleVerification()
 {
-    if (!m_wiThrottleClient || !m_wiThrottleClient->isConnected()) {
+    // Transports that push changes made elsewhere need no idle checks
+    ThrottleTransport* transport = m_transport.load();
+    m_reconciler->setIdleVerification(transport && !transport->pushesThrottleState());
+}
+
+void ThrottleController::armReconcileTimer()
+{
+    bool retry = false;
+    int64_t dueUs = m_reconciler->nextDueUs(&retry);
+    if (m_reconcileWakeUs < dueUs) {
+        dueUs = m_reconcileWakeUs;
+        retry = true;
+    }
+
+    if (dueUs == StateReconciler::NEVER) {
+        stopReconcileTimer();
         return;
     }
-    
-    // Poll speed and direction for all allocated throttles
-    for (int i = 0; i < NUM_THROTTLES; i++) {
-        Throttle* throttle = m_throttles[i].get();
-        
-        if (throttle->getState() == Throttle::State::ALLOCATED_WITH_KNOB ||
-            throttle->getState() == Throttle::State::ALLOCATED_NO_KNOB) {
-            
-            // Query speed and direction
-            char throttleId = '0' + i;
-            m_wiThrottleClient->querySpeed(throttleId);
-            m_wiThrottleClient->queryDirection(throttleId);
-            
-            ESP_LOGD(TAG, "Polling throttle %d state", i);
-        }
+    if (m_reconcileJob.load() != Scheduler::INVALID_JOB && m_reconcileDueUs <= dueUs) {
+        return;  // The armed job comes first and re-arms from there
+    }
+
+    int64_t delayUs = dueUs - esp_timer_get_time();
+    uint32_t delayMs = delayUs > 0 ? static_cast<uint32_t>((delayUs + 999) / 1000) : 0;
+
+    // Idle checks may wait a little to share a wake-up with other jobs; retries may not
+    uint32_t sequence = m_reconcileSequence + 1;
+    if (sequence == 0) {
+        sequence = 1;  // 0 means nothing fired
+    }
+    Scheduler::JobId job = Scheduler::instance().scheduleOnce(
+        delayMs, retry ? Scheduler::Priority::NORMAL : Scheduler::Priority::LOW,
+        [this, sequence]() {
+            // Runs on the shared Scheduler task, which must not wait for queue space:
+            // the newest fired sequence is left for the controller task instead
+            uint32_t fired = m_reconcileFired.load();
+            while ((fired == 0 || static_cast<int32_t>(sequence - fired) > 0) &&
+                   !m_reconcileFired.compare_exchange_weak(fired, sequence)) {
+            }
+            Event event{};
+            event.type = EventType::RECONCILE;
+            event.value = static_cast<int32_t>(sequence);
+            signal(event);
+        },
+        "throttle_reconcile");
+    if (job == Scheduler::INVALID_JOB) {
+        ESP_LOGE(TAG, "Failed to schedule throttle state reconciliation");
+        return;
     }
+    Scheduler::instance().cancel(m_reconcileJob.exchange(job));
+    m_reconcileSequence = sequence;
+    m_reconcileDueUs = dueUs;
 }
 
-void ThrottleController::pollingTimerCallback(void* arg)
+void ThrottleController::stopReconcileTimer()
 {
-    ThrottleController* controller = static_cast<ThrottleController*>(arg);
-    if (controller) {
-        controller->pollThrottleStates();
+    Scheduler::JobId job = m_reconcileJob.exchange(Scheduler::INVALID_JOB);
+    if (job != Scheduler::INVALID_JOB) {
+        Scheduler::instance().cancel(job);
     }
+    m_reconcileDueUs = StateReconciler::NEVER;
 }
 
-void ThrottleController::startPollingTimer()
+void ThrottleController::logReconcileStats(int throttleId) const
 {
-    if (m_pollingTimer != nullptr) {
-        ESP_LOGW(TAG, "Polling timer already started");
+    StateReconciler::Stats stats = m_reconciler->getStats(throttleId);
+    if (stats.commands == 0) {
         return;
     }
-    
-    // Create timer that fires every 10 seconds
-    esp_timer_create_args_t timerArgs = {
-        .callback = pollingTimerCallback,
-        .arg = this,
-        .dispatch_method = ESP_TIMER_TASK,
-        .name = "throttle_poll",
-        .skip_unhandled_events = false
-    };
-    
-    esp_err_t err = esp_timer_create(&timerArgs, &m_pollingTimer);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to create polling timer: %s", esp_err_to_name(err));
-        return;
+    ESP_LOGI(TAG, "Throttle %d: %lu commands, %lu echoed, %lu confirmed by query, %lu diverged, "
+             "%lu retry + %lu idle queries, round trip p50 %lu us p95 %lu us max %lu us",
+             throttleId, (unsigned long)stats.commands, (unsigned long)stats.echoConfirmed,
+             (unsigned long)stats.queryConfirmed, (unsigned long)stats.diverged,
+             (unsigned long)stats.retryQueries, (unsigned long)stats.verifyQueries,
+             (unsigned long)stats.roundTrip.getPercentileUs(50),
+             (unsigned long)stats.roundTrip.getPercentileUs(95),
+             (unsigned long)stats.roundTrip.getMaxUs());
+}
+
+void ThrottleController::setMomentum(int throttleId, const MomentumEngine::Rates& rates)
+{
+    if (throttleId < 0 || throttleId >= m_numThrottles) return;
+
+    Event event{};
+    event.type = EventType::SET_MOMENTUM;
+    event.throttleId = static_cast<int8_t>(throttleId);
+    event.rates = rates;
+    post(event);
+}
+
+void ThrottleController::handleSetMomentum(int throttleId, const MomentumEngine::Rates& rates)
+{
+    m_momentum->setRates(throttleId, rates);
+    if (!m_momentum->hasMomentum(throttleId) && m_momentum->isRamping(throttleId)) {
+        m_momentum->hold(throttleId);  // The knob sets the speed directly from here
     }
-    
-    // Start periodic timer (10 seconds = 10,000,000 microseconds)
-    err = esp_timer_start_periodic(m_pollingTimer, 10 * 1000000);
+    ESP_LOGI(TAG, "Throttle %d momentum: accel %u, decel %u, brake %u steps/s", throttleId,
+             rates.accelStepsPerSec, rates.decelStepsPerSec, rates.brakeStepsPerSec);
+}
+
+void ThrottleController::momentumTimerCallback(void* arg)
+{
+    auto* controller = static_cast<ThrottleController*>(arg);
+    // One pending tick is enough: the engine catches up on every tick due. A flag,
+    // not a queued event, so the esp_timer task never waits for queue space.
+    if (!controller->m_momentumTickPending.exchange(true)) {
+        Event event{};
+        event.type = EventType::MOMENTUM_TICK;
+        controller->signal(event);
+    }
+}
+
+void ThrottleController::handleMomentumTick()
+{
+    m_momentumTickPending.store(false);
+
+    int ramping = 0;
+    for (int i = 0; i < m_numThrottles; i++) {
+        if (m_momentum->isRamping(i)) {
+            ramping++;
+        }
+    }
+    if (ramping > m_momentumPeakRamping) {
+        m_momentumPeakRamping = ramping;
+    }
+
+    MomentumEngine::Command* commands = m_momentumCommands.get();
+    int count = m_momentum->advance(esp_timer_get_time(), commands, m_numThrottles);
+
+    for (int i = 0; i < count; i++) {
+        Throttle* throttle = m_throttles[commands[i].throttleId].get();
+        throttle->setSpeed(commands[i].speed);
+        throttle->setDirection(commands[i].forward);
+    }
+
+    for (int i = 0; i < count; i++) {
+        const MomentumEngine::Command& command = commands[i];
+        // A reversal has passed through zero, so the new direction goes before the speed
+        if (command.directionChanged) {
+            sendDirectionCommand(command.throttleId, command.forward);
+        }
+        if (command.speed == 0) {
+            sendStopCommand(command.throttleId);
+        } else {
+            sendSpeedCommand(command.throttleId, command.speed);
+        }
+        updateUI(command.throttleId, UI_THROTTLE);
+    }
+
+    if (!m_momentum->isRunning()) {
+        stopMomentumTimer();
+        // Reported when enough locos ramped together to load the link
+        if (m_momentumPeakRamping >= MOMENTUM_REPORT_RAMPING) {
+            logMomentumStats();
+        }
+        m_momentumPeakRamping = 0;
+    }
+}
+
+void ThrottleController::startMomentumTimer()
+{
+    if (m_momentumTimerRunning || !m_momentumTimer) return;
+
+    esp_err_t err = esp_timer_start_periodic(m_momentumTimer, static_cast<uint64_t>(m_momentum->getTickMs()) * 1000);
     if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to start polling timer: %s", esp_err_to_name(err));
-        esp_timer_delete(m_pollingTimer);
-        m_pollingTimer = nullptr;
+        // Without ticks the ramps would never finish; leave every loco where it is
+        ESP_LOGE(TAG, "Failed to start momentum timer: %s", esp_err_to_name(err));
+        for (int i = 0; i < m_numThrottles; i++) {
+            m_momentum->hold(i);
+        }
         return;
     }
-    
-    ESP_LOGI(TAG, "Started throttle state polling (10 second interval)");
+    m_momentumTimerRunning = true;
 }
 
-void ThrottleController::stopPollingTimer()
+void ThrottleController::stopMomentumTimer()
 {
-    if (m_pollingTimer != nullptr) {
-        esp_timer_stop(m_pollingTimer);
-        esp_timer_delete(m_pollingTimer);
-        m_pollingTimer = nullptr;
-        ESP_LOGI(TAG, "Stopped throttle state polling");
+    if (!m_momentumTimerRunning) return;
+
+    esp_timer_stop(m_momentumTimer);
+    m_momentumTimerRunning = false;
+}
+
+void ThrottleController::logMomentumStats() const
+{
+    MomentumEngine::Stats stats = m_momentum->getStats();
+    ESP_LOGI(TAG, "Momentum ticks: %lu run (%lu caught up, %lu skipped), %d throttles ramping, "
+             "jitter p50 %lu us p99 %lu us max %lu us",
+             (unsigned long)stats.ticks, (unsigned long)stats.caughtUp, (unsigned long)stats.skipped,
+             m_momentumPeakRamping, (unsigned long)stats.jitter.getPercentileUs(50),
+             (unsigned long)stats.jitter.getPercentileUs(99), (unsigned long)stats.jitter.getMaxUs());
+
+    uint32_t tickMs = m_momentum->getTickMs();
+    for (int i = 0; i < m_numThrottles; i++) {
+        MomentumEngine::ThrottleStats throttle = m_momentum->getThrottleStats(i);
+        if (throttle.rampTicks == 0) {
+            continue;
+        }
+        ESP_LOGI(TAG, "Throttle %d ramps: %lu commands in %lu ms (%lu/s), %lu ticks unchanged, %lu deferred",
+                 i, (unsigned long)throttle.commands, (unsigned long)(throttle.rampTicks * tickMs),
+                 (unsigned long)throttle.commandsPerSecond(tickMs), (unsigned long)throttle.unchanged,
+                 (unsigned long)throttle.deferred);
     }
 }
 
 int ThrottleController::getSpeedStepsPerClick()
 {
-    nvs_handle_t handle;
-    int32_t speedSteps = 4; // default
-    
-    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle);
-    if (err == ESP_OK) {
-        nvs_get_i32(handle, NVS_KEY_SPEED_STEPS, &speedSteps);
-        nvs_close(handle);
-    }
-    
-    // Clamp to reasonable range
-    if (speedSteps < 1) speedSteps = 1;
-    if (speedSteps > 20) speedSteps = 20;
-    
-    return (int)speedSteps;
+    // Read on every detent: served from RAM, range-checked when saved
+    return static_cast<int>(Settings::instance().getInt(Settings::Key::SPEED_STEPS));
 }
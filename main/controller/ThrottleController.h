@@ -1,11 +1,21 @@
 #pragma once
 
 #include "Knob.h"
+#include "MomentumEngine.h"
+#include "SpeedCoalescer.h"
+#include "StateReconciler.h"
 #include "Throttle.h"
-#include "WiThrottleClient.h"
+#include "ThrottleTransport.h"
+#include "Scheduler.h"
+#include "LatencyHistogram.h"
+#include "MpscQueue.h"
+#include "SeqLock.h"
 #include "esp_timer.h"
+#include "sdkconfig.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
+#include "freertos/task.h"
+#include <atomic>
 #include <memory>
 #include <vector>
 
@@ -13,28 +23,79 @@
  * @brief Controller for managing throttle and knob interactions
  * 
  * Coordinates between:
- * - 4 Throttle models (state, loco assignments)
+ * - Throttle models (state, loco assignments), one per slot
  * - 2 Knob models (state, assignments)
- * - WiThrottle client (network communication)
+ * - Throttle transport (WiThrottle or JMRI JSON network communication)
  * - UI (ThrottleMeter widgets)
+ *
+ * The controller owns its models on a single task ("throttle_ctrl").
+ * Every input - knob rotation and presses from the encoder task, touches
+ * from the LVGL task, state reports from the transport's receive task,
+ * the reconcile job - is posted as a typed event to a lock-free
+ * multi-producer queue and handled in order on that task. Producers never
+ * take a lock; when the queue is full they wait for space rather than drop
+ * the input. After each change the task publishes an immutable snapshot of
+ * every throttle (and of the knob selecting from the roster) through a
+ * SeqLock, so UI readers copy consistent state without a lock or an
+ * allocation and can skip a throttle whose generation has not moved. The
+ * state mutex only guards the function lists and resume statistics.
+ *
+ * Speed and direction commands are tracked until the server reports them
+ * back (see StateReconciler); only throttles whose state is unconfirmed, or
+ * idle ones on transports that do not push changes, are queried.
+ *
+ * A throttle with momentum set turns knob changes into a target speed that
+ * MomentumEngine ramps towards on a fixed-rate tick, and a knob press into a
+ * brake (a second press while braking stops at once).
+ *
+ * The number of throttle slots is fixed at construction (NUM_THROTTLES,
+ * from CONFIG_THROTTLE_SLOT_COUNT, unless given). Every per-slot table is
+ * allocated then and indexed by throttle ID, so lookups stay O(1) and
+ * nothing grows while running.
  */
 class ThrottleController
 {
 public:
-    static constexpr int NUM_THROTTLES = 4;
+    static constexpr int NUM_THROTTLES = CONFIG_THROTTLE_SLOT_COUNT;  // Default slot count
+    static constexpr int MAX_THROTTLES = 32;                          // Also one bit each in UI dirty masks
+    static_assert(MAX_THROTTLES <= ThrottleTransport::MAX_THROTTLE_IDS, "Every throttle slot needs a wire id");
+    static_assert(NUM_THROTTLES >= 1 && NUM_THROTTLES <= MAX_THROTTLES, "CONFIG_THROTTLE_SLOT_COUNT out of range");
     static constexpr int NUM_KNOBS = 2;
 
+    static constexpr size_t LOCO_NAME_LENGTH = 32;  // Including the terminator; longer names are truncated
+
     struct ThrottleSnapshot {
+        uint32_t generation;  // Changes each time the published state changes
         int throttleId;
         Throttle::State state;
         int assignedKnob;
         int currentSpeed;
         bool direction;
         bool hasLocomotive;
-        std::string locoName;
+        char locoName[LOCO_NAME_LENGTH];
         int locoAddress;
     };
 
+    struct ResumeStats {
+        uint32_t sessionsResumed;  // Reconnects that re-acquired at least one loco
+        uint32_t locosReacquired;
+        uint32_t corrections;      // Speeds or directions taken from the server because they differed
+        uint32_t lastRecoveryMs;   // Link loss until every re-acquired throttle reported its state
+        uint32_t maxRecoveryMs;
+    };
+
+    static constexpr int DEPTH_BUCKETS = 8;
+
+    struct EventStats {
+        uint32_t posted;          // Events queued (or handled in place)
+        uint32_t handled;         // Events taken off the queue and handled
+        uint32_t queueFullWaits;  // Posts that found the queue full and waited for space
+        uint32_t maxDepth;        // Most events ever waiting ahead of a new one
+        // Events already waiting when one was posted: [0] none, [n] 2^(n-1) to 2^n - 1, last 64 or more
+        uint32_t depthBuckets[DEPTH_BUCKETS];
+        LatencyHistogram latency;  // Post to start of handling
+    };
+
     struct RosterSelectionSnapshot {
         bool active = false;
         int throttleId = -1;
@@ -47,19 +108,57 @@ public:
     
     /**
      * @brief Constructor
-     * @param wiThrottleClient WiThrottle client for network communication
+     * @param transport Throttle transport for network communication
+     * @param numThrottles Throttle slots (clamped to 1-MAX_THROTTLES)
      */
-    explicit ThrottleController(WiThrottleClient* wiThrottleClient);
+    explicit ThrottleController(ThrottleTransport* transport, int numThrottles = NUM_THROTTLES);
     ~ThrottleController();
     
     /**
      * @brief Initialize controller
      */
     void initialize();
+
+    /**
+     * @brief Number of throttle slots; throttle IDs run from 0 to one less
+     */
+    int getNumThrottles() const { return m_numThrottles; }
+
+    /**
+     * @brief Wait until every event posted before the call has been handled
+     * @return false on timeout
+     */
+    bool waitUntilIdle(uint32_t timeoutMs = 1000) const;
+    
+    /**
+     * @brief Switch to another throttle transport
+     * Locos acquired on the current transport are released first, and idle
+     * throttles are re-checked only if the new transport does not push changes. Queued
+     * like any input, so commands already posted still go to the old one.
+     */
+    void setTransport(ThrottleTransport* transport);
+
+    /**
+     * @brief Transport currently carrying throttle commands
+     */
+    ThrottleTransport* getTransport() const { return m_transport.load(); }
+
+    /**
+     * @brief Prefer another transport's roster (e.g. the JSON roster, which carries function labels)
+     * The throttle transport's own roster is used until this one has arrived.
+     * Takes effect at once; the UI is refreshed from the controller task.
+     */
+    void setRosterSource(ThrottleTransport* source);
+
+    /**
+     * @brief Check whether a throttle's speed and direction match what the server last reported
+     * False while commands are unanswered, and until the server first reports after an acquire.
+     */
+    bool isThrottleStateConfirmed(int throttleId) const { return m_reconciler->isConfirmed(throttleId); }
     
     /**
      * @brief Handle knob indicator touch on a throttle
-     * @param throttleId Throttle ID (0-3)
+     * @param throttleId Throttle ID (0 to getNumThrottles() - 1)
      * @param knobId Knob ID (0-1)
      */
     void onKnobIndicatorTouched(int throttleId, int knobId);
@@ -73,35 +172,95 @@ public:
     
     /**
      * @brief Handle knob button press
+     * Acquires the selected loco, or stops the controlled one (brakes it, with momentum).
      * @param knobId Knob ID (0-1)
      */
     void onKnobPress(int knobId);
     
     /**
      * @brief Handle throttle release button
-     * @param throttleId Throttle ID (0-3)
+     * @param throttleId Throttle ID (0 to getNumThrottles() - 1)
      */
     void onThrottleRelease(int throttleId);
     
     /**
      * @brief Handle throttle functions button
-     * @param throttleId Throttle ID (0-3)
+     * @param throttleId Throttle ID (0 to getNumThrottles() - 1)
      */
     void onThrottleFunctions(int throttleId);
+
+    /**
+     * @brief Set a function on a throttle's loco
+     * Sent after any pending speed for the throttle so ordering is preserved.
+     * @param throttleId Throttle ID (0 to getNumThrottles() - 1)
+     * @param functionNumber Function number (0-28)
+     * @param state True to activate, false to deactivate
+     */
+    void setFunction(int throttleId, int functionNumber, bool state);
+
+    /**
+     * @brief Speed commands sent to the server
+     */
+    uint32_t getSpeedCommandsSent() const;
+
+    /**
+     * @brief Speed commands replaced by a newer speed before being sent
+     */
+    uint32_t getSpeedCommandsSuppressed() const;
+
+    /**
+     * @brief Command round trips, confirmations and queries for one throttle
+     */
+    StateReconciler::Stats getReconcileStats(int throttleId) const { return m_reconciler->getStats(throttleId); }
+
+    /**
+     * @brief Set a throttle's acceleration, deceleration and brake rates
+     * With acceleration and deceleration both 0 the knob sets the speed
+     * directly and a press stops at once. Queued like any input.
+     */
+    void setMomentum(int throttleId, const MomentumEngine::Rates& rates);
+
+    /**
+     * @brief Momentum tick timing, and ramp commands for one throttle
+     */
+    MomentumEngine::Stats getMomentumStats() const { return m_momentum->getStats(); }
+    MomentumEngine::ThrottleStats getMomentumStats(int throttleId) const { return m_momentum->getThrottleStats(throttleId); }
+    void resetMomentumStats() { m_momentum->resetStats(); }
+
+    /**
+     * @brief Statistics of locos re-acquired after the transport reconnected
+     */
+    ResumeStats getResumeStats() const;
+
+    /**
+     * @brief Event queue depth and latency statistics (for load testing)
+     */
+    EventStats getEventStats() const;
+
+    /**
+     * @brief Clear the event queue statistics
+     */
+    void resetEventStats();
     
     /**
      * @brief Get throttle model
-     * @param throttleId Throttle ID (0-3)
+     * @param throttleId Throttle ID (0 to getNumThrottles() - 1)
      * @return Throttle pointer or nullptr
      */
     Throttle* getThrottle(int throttleId);
 
     /**
-     * @brief Get a thread-safe snapshot of a throttle's state
-     * @return true if snapshot was captured
+     * @brief Copy the last published state of a throttle (any task, no lock, no allocation)
+     * @return false for an invalid ID, or if the controller kept republishing for 50 ms
      */
     bool getThrottleSnapshot(int throttleId, ThrottleSnapshot& outSnapshot) const;
 
+    /**
+     * @brief Generation of a throttle's published snapshot (one atomic load)
+     * Equal to a snapshot's generation while that throttle is unchanged.
+     */
+    uint32_t getThrottleGeneration(int throttleId) const;
+
     /**
      * @brief Get current roster selection (if any knob is selecting)
      * @return true if snapshot was captured
@@ -133,50 +292,196 @@ public:
     /**
      * @brief Get loco at roster index
      */
-    bool getLocoAtRosterIndex(int index, WiThrottleClient::Locomotive& outEntry) const;
+    bool getLocoAtRosterIndex(int index, ThrottleTransport::Locomotive& outEntry) const;
     
+    /**
+     * @brief Parts of the UI a change affects (bit flags passed to the UI update callback)
+     */
+    enum UIChange : uint8_t {
+        UI_THROTTLE = 0x01,          ///< Speed, direction, loco or knob assignment
+        UI_FUNCTIONS = 0x02,         ///< Function states or labels
+        UI_ROSTER_SELECTION = 0x04,  ///< Knob roster selection or roster source
+        UI_ALL = UI_THROTTLE | UI_FUNCTIONS | UI_ROSTER_SELECTION
+    };
+
+    /// Throttle ID passed to the UI update callback when every throttle is affected
+    static constexpr int ALL_THROTTLES = -1;
+
+    /**
+     * @brief Called on the controller task after each change the UI should show
+     * @param userData User data given to setUIUpdateCallback()
+     * @param throttleId Throttle that changed, or ALL_THROTTLES
+     * @param changes UIChange flags
+     *
+     * Runs on the controller task: it must only record what to redraw, not touch LVGL.
+     */
+    using UIUpdateCallback = void (*)(void* userData, int throttleId, uint8_t changes);
+
     /**
      * @brief Set UI update callback
      * @param callback Function to call when UI needs updating
      * @param userData User data to pass to callback
      */
-    void setUIUpdateCallback(void (*callback)(void*), void* userData);
+    void setUIUpdateCallback(UIUpdateCallback callback, void* userData);
     
     /**
-     * @brief Get configured speed steps per knob click from NVS
-     * @return Speed steps (default 4 if not configured)
+     * @brief Get configured speed steps per knob click (no flash access)
+     * @return Speed steps, 1-20 (default 4 if not configured)
      */
     static int getSpeedStepsPerClick();
 
 private:
+    enum class EventType : uint8_t {
+        KNOB_INDICATOR_TOUCHED,
+        KNOB_ROTATION,
+        KNOB_PRESS,
+        THROTTLE_RELEASE,
+        SET_FUNCTION,
+        THROTTLE_UPDATE,
+        FUNCTION_LABELS,
+        SESSION,
+        RECONCILE,
+        SET_TRANSPORT,
+        ROSTER_SOURCE,
+        SET_MOMENTUM,
+        MOMENTUM_TICK
+    };
+
+    struct Event {
+        EventType type;
+        int8_t throttleId;
+        int8_t knobId;
+        bool flag;          // Function state, session started
+        int32_t value;      // Rotation delta, function number, reconcile job sequence
+        int64_t postedUs;
+        union {
+            ThrottleTransport::ThrottleUpdate update;  // THROTTLE_UPDATE
+            std::vector<std::string>* labels;          // FUNCTION_LABELS, freed by the handler
+            ThrottleTransport* transport;              // SET_TRANSPORT
+            MomentumEngine::Rates rates;               // SET_MOMENTUM
+        };
+    };
+
+    void post(Event& event);
+    void signal(const Event& event);
+    void handleSignals();
+    void dispatch(const Event& event);
+    void handleQueuedEvent(const Event& event);
+    void discardEvent(const Event& event);
+    void recordDepth(uint32_t depth);
+    static void taskEntry(void* arg);
+
+    // Event handlers; run on the controller task only
+    void handleKnobIndicatorTouched(int throttleId, int knobId);
+    void handleKnobRotation(int knobId, int delta);
+    void handleKnobPress(int knobId);
+    void handleThrottleRelease(int throttleId);
+    void handleSetFunction(int throttleId, int functionNumber, bool state);
+    void handleSetTransport(ThrottleTransport* transport);
+
     bool lockState(TickType_t timeout) const;
     void unlockState() const;
 
-    void updateUI();
+    void updateUI(int throttleId, uint8_t changes);
     void sendSpeedCommand(int throttleId, int speed);
+    void sendStopCommand(int throttleId);
     void sendDirectionCommand(int throttleId, bool forward);
-    std::unique_ptr<Locomotive> createLocomotiveFromRoster(const WiThrottleClient::Locomotive& rosterEntry);
+    std::unique_ptr<Locomotive> createLocomotiveFromRoster(const ThrottleTransport::Locomotive& rosterEntry);
     
-    // WiThrottle callback handlers
-    void onThrottleStateChanged(const WiThrottleClient::ThrottleUpdate& update);
-    static void throttleStateCallbackWrapper(void* userData, const WiThrottleClient::ThrottleUpdate& update);
+    // Transport callback handlers
+    void onThrottleStateChanged(const ThrottleTransport::ThrottleUpdate& update);
+    static void throttleStateCallbackWrapper(void* userData, const ThrottleTransport::ThrottleUpdate& update);
 
     void onFunctionLabelsReceived(char throttleId, const std::vector<std::string>& labels);
+    void applyFunctionLabels(Throttle* throttle, const std::vector<std::string>& labels);
+    RosterHandle getRosterSnapshot() const;
+
+    // Published after each event; the controller task is the only writer
+    struct SelectionState {
+        bool active;
+        int8_t throttleId;
+        int8_t knobId;
+        int32_t rosterIndex;
+    };
+    void publishSnapshots();
+    void buildThrottleSnapshot(int throttleId, ThrottleSnapshot& outSnapshot) const;
     
-    // Polling for state synchronization
-    void pollThrottleStates();
-    static void pollingTimerCallback(void* arg);
-    void startPollingTimer();
-    void stopPollingTimer();
+    void attachTransport(ThrottleTransport* transport);
+    void detachTransport(ThrottleTransport* transport);
+
+    // Session resume: re-acquire allocated locos when the transport reconnects
+    static constexpr uint8_t RESUME_SPEED = 0x01;      // Waiting for the server's speed
+    static constexpr uint8_t RESUME_DIRECTION = 0x02;  // Waiting for the server's direction
+    void onTransportSession(bool started);
+    void resumeSession();
+    void reconcileResumedThrottle(int throttleId, const ThrottleTransport::ThrottleUpdate& update);
+    void finishResume(int throttleId, bool reported);
+
+    // State reconciliation: query only throttles whose state is unconfirmed (or idle, if not pushed)
+    void updateIdleVerification();
+    void reconcileThrottleStates(uint32_t sequence);
+    void armReconcileTimer();
+    void stopReconcileTimer();
+    void logReconcileStats(int throttleId) const;
+
+    // Momentum: ramps run on a periodic timer only while some throttle is ramping
+    static constexpr int MOMENTUM_REPORT_RAMPING = 4;  // Log tick and command rates when this many ramped together
+    void handleSetMomentum(int throttleId, const MomentumEngine::Rates& rates);
+    void handleMomentumTick();
+    void startMomentumTimer();
+    void stopMomentumTimer();
+    void logMomentumStats() const;
+    static void momentumTimerCallback(void* arg);
     
-    WiThrottleClient* m_wiThrottleClient;
+    const int m_numThrottles;
+    std::atomic<ThrottleTransport*> m_transport;
+    std::atomic<ThrottleTransport*> m_rosterSource;
+    std::unique_ptr<SpeedCoalescer> m_speedCoalescer;
+    std::unique_ptr<StateReconciler> m_reconciler;
+    std::unique_ptr<MomentumEngine> m_momentum;   // Controller task only, apart from its stats
     std::vector<std::unique_ptr<Throttle>> m_throttles;
     std::vector<std::unique_ptr<Knob>> m_knobs;
 
+    // Held only while the controller task changes a function list or m_resumeStats, and
+    // by readers copying them; speed, direction and knob state go through the snapshots
     mutable SemaphoreHandle_t m_stateMutex;
+
+    // Per-slot tables, m_numThrottles entries each
+    std::unique_ptr<SeqLock<ThrottleSnapshot>[]> m_snapshots;
+    std::unique_ptr<ThrottleSnapshot[]> m_lastPublished;  // Controller task only
+    std::unique_ptr<uint32_t[]> m_publishedRevision;      // Throttle revision m_lastPublished was built from
+    SeqLock<SelectionState> m_selection;
+    SelectionState m_lastSelection;                   // Controller task only
+
+    MpscQueue<Event> m_events;
+    TaskHandle_t m_task;
+    SemaphoreHandle_t m_taskExited;  // Given by the task just before it deletes itself
+    std::atomic<bool> m_running;
+    std::atomic<uint32_t> m_posted;
+    std::atomic<uint32_t> m_handled;
+    std::atomic<uint32_t> m_queueFullWaits;
+    std::atomic<uint32_t> m_maxDepth;
+    std::atomic<uint32_t> m_depthBuckets[DEPTH_BUCKETS];
+    LatencyHistogram m_latency;         // Recorded by the controller task
+    mutable portMUX_TYPE m_statsLock;   // Guards m_latency against getEventStats()
     
-    void (*m_uiUpdateCallback)(void*);
+    UIUpdateCallback m_uiUpdateCallback;
     void* m_uiUpdateUserData;
     
-    esp_timer_handle_t m_pollingTimer;
+    std::atomic<Scheduler::JobId> m_reconcileJob;  // One-shot job on the shared Scheduler
+    int64_t m_reconcileDueUs;                      // When m_reconcileJob fires; controller task only
+    uint32_t m_reconcileSequence;                  // Tells the armed job's event from cancelled ones
+    std::atomic<uint32_t> m_reconcileFired;        // Newest fired job's sequence, 0 when none is pending
+    int64_t m_reconcileWakeUs;                     // Check by then for a deferred speed; controller task only
+
+    esp_timer_handle_t m_momentumTimer;
+    bool m_momentumTimerRunning;                   // Controller task only
+    int m_momentumPeakRamping;                     // Most throttles ramping at once since all last settled
+    std::atomic<bool> m_momentumTickPending;       // A tick is due; the timer does not signal another
+    std::unique_ptr<MomentumEngine::Command[]> m_momentumCommands;  // One per slot; controller task only
+
+    // Controller task only
+    std::unique_ptr<uint8_t[]> m_resumePending;  // RESUME_* flags per re-acquired throttle
+    int64_t m_linkLostUs;                    // Session ended with locos allocated; 0 when none are lost
+    ResumeStats m_resumeStats;               // Written by the controller task under m_stateMutex
 };
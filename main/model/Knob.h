@@ -48,13 +48,13 @@ public:
     
     /**
      * @brief Assign knob to throttle for selection
-     * @param throttleId Throttle ID (0-3)
+     * @param throttleId Throttle ID (0 to slot count - 1)
      */
     void assignToThrottle(int throttleId);
 
     /**
      * @brief Reassign knob to a different throttle without forcing IDLE
-     * @param throttleId Throttle ID (0-3)
+     * @param throttleId Throttle ID (0 to slot count - 1)
      * @param newState Target knob state after reassignment
      * @param resetRosterIndex Reset roster index when entering SELECTING
      */
@@ -87,6 +87,6 @@ public:
 private:
     int m_id;                    // 0 or 1 (left/right)
     State m_state;
-    int m_assignedThrottleId;    // -1 if not assigned, 0-3 otherwise
+    int m_assignedThrottleId;    // -1 if not assigned, else the throttle slot
     int m_rosterIndex;           // Current position when SELECTING
 };
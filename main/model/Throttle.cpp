@@ -7,6 +7,7 @@ Throttle::Throttle()
     , m_locomotive(nullptr)
     , m_currentSpeed(0)
     , m_direction(true)
+    , m_revision(0)
 {
 }
 
@@ -17,6 +18,7 @@ Throttle::Throttle(int throttleId)
     , m_locomotive(nullptr)
     , m_currentSpeed(0)
     , m_direction(true)
+    , m_revision(0)
 {
 }
 
@@ -28,6 +30,7 @@ bool Throttle::assignKnob(int knobId)
     }
 
     m_assignedKnob = knobId;
+    m_revision++;
     
     // If we don't have a loco, enter selection mode
     if (!m_locomotive) {
@@ -43,6 +46,7 @@ bool Throttle::assignKnob(int knobId)
 void Throttle::unassignKnob()
 {
     m_assignedKnob = KNOB_NONE;
+    m_revision++;
     
     // If we were just selecting, go back to unallocated
     if (m_state == State::SELECTING) {
@@ -69,6 +73,7 @@ bool Throttle::assignLocomotive(std::unique_ptr<Locomotive> loco)
     m_currentSpeed = 0;
     m_direction = true;
     m_functions.clear();
+    m_revision++;
     
     return true;
 }
@@ -82,6 +87,7 @@ std::unique_ptr<Locomotive> Throttle::releaseLocomotive()
     m_currentSpeed = 0;
     m_direction = true;
     m_functions.clear();
+    m_revision++;
     
     return loco;
 }
@@ -96,11 +102,13 @@ void Throttle::setSpeed(int speed)
     if (speed < 0) speed = 0;
     if (speed > 126) speed = 126;
     m_currentSpeed = speed;
+    m_revision++;
 }
 
 void Throttle::setDirection(bool forward)
 {
     m_direction = forward;
+    m_revision++;
 }
 
 void Throttle::setFunctionState(int functionNumber, bool state)
@@ -73,6 +73,14 @@ public:
     bool getDirection() const { return m_direction; }
     const std::vector<Function>& getFunctions() const { return m_functions; }
 
+    /**
+     * @brief Counter bumped by every change to the state, knob, loco, speed or direction
+     *
+     * Lets a reader skip an unchanged throttle without comparing its fields.
+     * Function changes do not count.
+     */
+    uint32_t getRevision() const { return m_revision; }
+
     // State transitions
     /**
      * @brief Assign a knob to this throttle for loco selection
@@ -138,7 +146,7 @@ public:
     void clearFunctions();
 
 private:
-    int m_throttleId;                        // 0-3
+    int m_throttleId;                        // 0 to slot count - 1
     State m_state;
     int m_assignedKnob;                      // KNOB_NONE, KNOB_1, or KNOB_2
     std::unique_ptr<Locomotive> m_locomotive;
@@ -147,4 +155,5 @@ private:
     int m_currentSpeed;                      // 0-126
     bool m_direction;                        // true=forward, false=reverse
     std::vector<Function> m_functions;       // Available functions for this loco
+    uint32_t m_revision;                     // See getRevision()
 };
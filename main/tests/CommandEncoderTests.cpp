@@ -0,0 +1,159 @@
+#include "unity.h"
+#include "WiThrottleCommandEncoder.h"
+#include "WiThrottleClient.h"
+#include "LoopbackServer.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include <cstring>
+#include <string>
+
+static const char* TAG = "CommandEncoderTests";
+
+static void assertCommand(const char* expected, const WiThrottleCommandEncoder::Command& command)
+{
+    TEST_ASSERT_EQUAL(strlen(expected) + 1, command.length);
+    TEST_ASSERT_EQUAL_STRING_LEN(expected, command.data, strlen(expected));
+    TEST_ASSERT_EQUAL('\n', command.data[command.length - 1]);
+}
+
+static void test_encoder_throttle_commands(void)
+{
+    WiThrottleCommandEncoder::Command command;
+
+    TEST_ASSERT_TRUE(WiThrottleCommandEncoder::encodeAcquire(command, '0', 'S', 3));
+    assertCommand("M0+S3<;>S3", command);
+
+    TEST_ASSERT_TRUE(WiThrottleCommandEncoder::encodeRelease(command, '1'));
+    assertCommand("M1-*<;>r", command);
+
+    TEST_ASSERT_TRUE(WiThrottleCommandEncoder::encodeSpeed(command, '2', 'L', 4014, 126));
+    assertCommand("M2AL4014<;>V126", command);
+
+    TEST_ASSERT_TRUE(WiThrottleCommandEncoder::encodeDirection(command, '3', 'S', 41, false));
+    assertCommand("M3AS41<;>R0", command);
+
+    TEST_ASSERT_TRUE(WiThrottleCommandEncoder::encodeFunction(command, '0', 'L', 1234, 12, true));
+    assertCommand("M0AL1234<;>F112", command);
+
+    TEST_ASSERT_TRUE(WiThrottleCommandEncoder::encodeQuery(command, '0', 'S', 3, 'R'));
+    assertCommand("M0AS3<;>qR", command);
+
+    TEST_ASSERT_TRUE(WiThrottleCommandEncoder::encodeRaw(command, "PPA1"));
+    assertCommand("PPA1", command);
+}
+
+static void test_encoder_rejects_oversized_command(void)
+{
+    WiThrottleCommandEncoder::Command command;
+    std::string tooLong(WiThrottleCommandEncoder::MAX_COMMAND_LENGTH, 'N');
+
+    TEST_ASSERT_FALSE(WiThrottleCommandEncoder::encodeRaw(command, tooLong));
+    TEST_ASSERT_EQUAL(0, command.length);
+}
+
+static void test_encoder_speed_is_allocation_free(void)
+{
+    WiThrottleCommandEncoder::Command command;
+    const int iterations = 1000;
+
+    size_t heapBefore = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    int64_t start = esp_timer_get_time();
+    for (int i = 0; i < iterations; i++) {
+        WiThrottleCommandEncoder::encodeSpeed(command, '0' + (i % 4), 'L', 1000 + i, i % 127);
+    }
+    int64_t elapsedUs = esp_timer_get_time() - start;
+    size_t heapAfter = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+
+    TEST_ASSERT_EQUAL(heapBefore, heapAfter);
+    ESP_LOGI(TAG, "encodeSpeed: %d commands in %lld us", iterations, (long long)elapsedUs);
+}
+
+static void test_withrottle_send_does_not_block_caller(void)
+{
+    LoopbackServer server;
+    TEST_ASSERT_TRUE(server.listen());
+
+    WiThrottleClient client;
+    client.initialize();
+    TEST_ASSERT_EQUAL(ESP_OK, client.connect("127.0.0.1", server.port));
+    TEST_ASSERT_TRUE(acceptClient(server, client));
+
+    TEST_ASSERT_EQUAL(ESP_OK, client.acquireLocomotive('0', 3, false));
+
+    // Time only the caller side; let the writer drain between bursts
+    const int bursts = 5;
+    const int perBurst = 16;
+    int64_t totalUs = 0;
+    int64_t worstUs = 0;
+    for (int b = 0; b < bursts; b++) {
+        for (int i = 0; i < perBurst; i++) {
+            int64_t start = esp_timer_get_time();
+            esp_err_t err = client.setSpeed('0', b * perBurst + i);
+            int64_t elapsedUs = esp_timer_get_time() - start;
+            TEST_ASSERT_EQUAL(ESP_OK, err);
+            totalUs += elapsedUs;
+            if (elapsedUs > worstUs) {
+                worstUs = elapsedUs;
+            }
+        }
+        vTaskDelay(pdMS_TO_TICKS(20));
+    }
+    int64_t averageUs = totalUs / (bursts * perBurst);
+    ESP_LOGI(TAG, "setSpeed caller latency: avg %lld us, worst %lld us",
+             (long long)averageUs, (long long)worstUs);
+    TEST_ASSERT_TRUE(averageUs < 50);
+    TEST_ASSERT_EQUAL(0, client.getTxDroppedCount());
+
+    // Everything queued must reach the server, in order
+    const std::string last = "M0AS3<;>V79\n";
+    std::string received = server.readUntil(last);
+    TEST_ASSERT_EQUAL(0, received.find("NESP32-Layout-Controller\nHESP32-S3\nM0+S3<;>S3\nM0AS3<;>V0\n"));
+    TEST_ASSERT_TRUE(received.size() >= last.size());
+    TEST_ASSERT_EQUAL(received.size() - last.size(), received.find(last));
+
+    shutdownClient(server, client);
+}
+
+static void test_withrottle_combines_commands_into_segments(void)
+{
+    LoopbackServer server;
+    TEST_ASSERT_TRUE(server.listen());
+
+    WiThrottleClient client;
+    client.initialize();
+    TEST_ASSERT_EQUAL(ESP_OK, client.connect("127.0.0.1", server.port));
+    TEST_ASSERT_TRUE(acceptClient(server, client));
+    TEST_ASSERT_EQUAL(ESP_OK, client.acquireLocomotive('1', 41, false));
+    server.readUntil("M1+S41<;>S41\n");
+    vTaskDelay(pdMS_TO_TICKS(20));  // Let the acquire batch be counted first
+
+    uint32_t commandsBefore = client.getTxCommandCount();
+    uint32_t segmentsBefore = client.getTxSegmentCount();
+
+    // Same shape as a poll of every throttle: many commands in one tick
+    const int burst = 16;
+    for (int i = 0; i < burst; i++) {
+        TEST_ASSERT_EQUAL(ESP_OK, (i % 2) ? client.queryDirection('1') : client.querySpeed('1'));
+    }
+    std::string received = server.readUntil("M1AS41<;>qR\n");
+    TEST_ASSERT_EQUAL(burst * strlen("M1AS41<;>qV\n"), received.size());
+    vTaskDelay(pdMS_TO_TICKS(20));  // Counters are updated after send() returns
+
+    uint32_t commands = client.getTxCommandCount() - commandsBefore;
+    uint32_t segments = client.getTxSegmentCount() - segmentsBefore;
+    ESP_LOGI(TAG, "TX batching: %lu commands in %lu segments", (unsigned long)commands, (unsigned long)segments);
+    TEST_ASSERT_EQUAL(burst, commands);
+    TEST_ASSERT_TRUE(segments * 2 <= commands);
+
+    shutdownClient(server, client);
+}
+
+extern "C" void register_command_encoder_tests(void)
+{
+    RUN_TEST(test_encoder_throttle_commands);
+    RUN_TEST(test_encoder_rejects_oversized_command);
+    RUN_TEST(test_encoder_speed_is_allocation_free);
+    RUN_TEST(test_withrottle_send_does_not_block_caller);
+    RUN_TEST(test_withrottle_combines_commands_into_segments);
+}
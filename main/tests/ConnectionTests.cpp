@@ -0,0 +1,217 @@
+#include "unity.h"
+#include "DnsCache.h"
+#include "JmriJsonClient.h"
+#include "WiThrottleClient.h"
+#include "LoopbackServer.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+static const char* TAG = "ConnectionTests";
+
+namespace {
+    struct in_addr makeAddress(const char* text)
+    {
+        struct in_addr address;
+        inet_aton(text, &address);
+        return address;
+    }
+
+    // A loopback port with nothing listening on it
+    uint16_t closedPort()
+    {
+        LoopbackServer server;
+        server.listen();
+        uint16_t port = server.port;
+        server.close();
+        return port;
+    }
+
+    bool waitForState(WiThrottleClient& client, WiThrottleClient::ConnectionState state, int timeoutMs)
+    {
+        for (int waitedMs = 0; waitedMs < timeoutMs && client.getState() != state; waitedMs += 5) {
+            vTaskDelay(pdMS_TO_TICKS(5));
+        }
+        return client.getState() == state;
+    }
+}
+
+static void test_dns_cache_numeric_hosts_skip_resolver(void)
+{
+    DnsCache cache(60000);
+    struct in_addr address;
+
+    TEST_ASSERT_TRUE(cache.lookup("192.168.1.20", address));
+    TEST_ASSERT_EQUAL_UINT32(makeAddress("192.168.1.20").s_addr, address.s_addr);
+    TEST_ASSERT_EQUAL(ESP_OK, cache.resolve("10.0.0.7", address));
+    TEST_ASSERT_EQUAL_UINT32(makeAddress("10.0.0.7").s_addr, address.s_addr);
+
+    // Names are not answered without the resolver
+    TEST_ASSERT_FALSE(cache.lookup("jmri.local", address));
+    TEST_ASSERT_EQUAL(0, cache.getStats().misses);
+}
+
+static void test_dns_cache_expiry_and_invalidate(void)
+{
+    DnsCache cache(100);
+    struct in_addr address;
+
+    cache.store("jmri.local", makeAddress("10.0.0.5"));
+    TEST_ASSERT_TRUE(cache.lookup("jmri.local", address));
+    TEST_ASSERT_EQUAL_UINT32(makeAddress("10.0.0.5").s_addr, address.s_addr);
+    TEST_ASSERT_EQUAL(1, cache.getStats().hits);
+
+    // A failed connection drops the entry
+    cache.invalidate("jmri.local");
+    TEST_ASSERT_FALSE(cache.lookup("jmri.local", address));
+
+    cache.store("jmri.local", makeAddress("10.0.0.6"));
+    TEST_ASSERT_TRUE(cache.lookup("jmri.local", address));
+    TEST_ASSERT_EQUAL_UINT32(makeAddress("10.0.0.6").s_addr, address.s_addr);
+    vTaskDelay(pdMS_TO_TICKS(150));
+    TEST_ASSERT_FALSE(cache.lookup("jmri.local", address));
+}
+
+static void test_dns_cache_replaces_oldest_entry(void)
+{
+    DnsCache cache(60000);
+    struct in_addr address;
+    const char* hosts[DnsCache::MAX_ENTRIES + 1] = { "a.local", "b.local", "c.local", "d.local", "e.local" };
+    static_assert(DnsCache::MAX_ENTRIES == 4, "host list assumes four entries");
+
+    for (const char* host : hosts) {
+        cache.store(host, makeAddress("10.0.0.1"));
+        vTaskDelay(1);
+    }
+
+    TEST_ASSERT_FALSE(cache.lookup("a.local", address));
+    for (int i = 1; i <= DnsCache::MAX_ENTRIES; i++) {
+        TEST_ASSERT_TRUE(cache.lookup(hosts[i], address));
+    }
+}
+
+static void test_withrottle_connect_does_not_block_caller(void)
+{
+    WiThrottleClient client;
+    client.initialize();
+
+    // Nothing listens, so the attempt fails, but on the receive task
+    int64_t start = esp_timer_get_time();
+    TEST_ASSERT_EQUAL(ESP_OK, client.connect("127.0.0.1", closedPort()));
+    int64_t callUs = esp_timer_get_time() - start;
+    ESP_LOGI(TAG, "connect() returned after %lld us", (long long)callUs);
+    TEST_ASSERT_TRUE(callUs < 20000);
+
+    TEST_ASSERT_TRUE(waitForState(client, WiThrottleClient::ConnectionState::FAILED, 2000));
+    TEST_ASSERT_FALSE(client.isConnected());
+
+    // The failed attempt's socket is released by the next connect or disconnect
+    client.disconnect();
+    TEST_ASSERT_TRUE(client.getState() == WiThrottleClient::ConnectionState::DISCONNECTED);
+}
+
+static void test_withrottle_connect_records_phase_timings(void)
+{
+    LoopbackServer server;
+    TEST_ASSERT_TRUE(server.listen());
+
+    WiThrottleClient client;
+    client.initialize();
+    TEST_ASSERT_EQUAL(ESP_OK, client.connect("127.0.0.1", server.port));
+    TEST_ASSERT_TRUE(acceptClient(server, client));
+
+    // Identification goes out once the socket is open
+    std::string received = server.readUntil("HESP32-S3\n");
+    TEST_ASSERT_TRUE(received.find("NESP32-Layout-Controller\n") != std::string::npos);
+
+    for (int waitedMs = 0; waitedMs < 1000 && client.getConnectTimings().greetingUs == 0; waitedMs += 5) {
+        vTaskDelay(pdMS_TO_TICKS(5));
+    }
+    WiThrottleClient::ConnectTimings timings = client.getConnectTimings();
+    ESP_LOGI(TAG, "resolve %lu us, TCP %lu us, greeting %lu us", (unsigned long)timings.resolveUs,
+             (unsigned long)timings.tcpUs, (unsigned long)timings.greetingUs);
+    TEST_ASSERT_TRUE(timings.greetingUs > 0);
+    TEST_ASSERT_TRUE(timings.tcpUs < 1000000);
+
+    shutdownClient(server, client);
+}
+
+static void test_withrottle_parallel_connects(void)
+{
+    // Two clients connecting at once both come up, the second not waiting on the first
+    LoopbackServer servers[2];
+    WiThrottleClient clients[2];
+    for (int i = 0; i < 2; i++) {
+        TEST_ASSERT_TRUE(servers[i].listen());
+        clients[i].initialize();
+    }
+
+    int64_t start = esp_timer_get_time();
+    for (int i = 0; i < 2; i++) {
+        TEST_ASSERT_EQUAL(ESP_OK, clients[i].connect("127.0.0.1", servers[i].port));
+    }
+    int64_t callsUs = esp_timer_get_time() - start;
+    for (int i = 0; i < 2; i++) {
+        TEST_ASSERT_TRUE(acceptClient(servers[i], clients[i]));
+    }
+    ESP_LOGI(TAG, "Both connect() calls took %lld us; both up after %lld us",
+             (long long)callsUs, (long long)(esp_timer_get_time() - start));
+    TEST_ASSERT_TRUE(callsUs < 40000);
+
+    for (int i = 0; i < 2; i++) {
+        shutdownClient(servers[i], clients[i]);
+    }
+}
+
+static void test_withrottle_disconnect_during_connect(void)
+{
+    WiThrottleClient client;
+    client.initialize();
+
+    // Unroutable: the handshake either hangs until cancelled or fails at once
+    TEST_ASSERT_EQUAL(ESP_OK, client.connect("10.255.255.1", 12090));
+    vTaskDelay(pdMS_TO_TICKS(20));
+
+    int64_t start = esp_timer_get_time();
+    client.disconnect();
+    int64_t disconnectUs = esp_timer_get_time() - start;
+    ESP_LOGI(TAG, "Cancelled a pending connect in %lld us", (long long)disconnectUs);
+    TEST_ASSERT_TRUE(disconnectUs < 300000);
+    TEST_ASSERT_TRUE(client.getState() == WiThrottleClient::ConnectionState::DISCONNECTED);
+}
+
+static void test_jmri_second_connect_keeps_attempt(void)
+{
+    JmriJsonClient client;
+    client.initialize();
+
+    int stateChanges = 0;
+    client.setConnectionStateCallback([&stateChanges](JmriJsonClient::ConnectionState) { stateChanges++; });
+
+    // The WebSocket opens on its own task; until 'hello' the attempt is in flight
+    TEST_ASSERT_EQUAL(ESP_OK, client.connect("127.0.0.1", closedPort()));
+    TEST_ASSERT_TRUE(client.getState() == JmriJsonClient::ConnectionState::CONNECTING);
+    int changesWhileConnecting = stateChanges;
+
+    // A second call is refused without tearing the first one down
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, client.connect("127.0.0.1", closedPort()));
+    TEST_ASSERT_TRUE(client.getState() == JmriJsonClient::ConnectionState::CONNECTING);
+    TEST_ASSERT_EQUAL(changesWhileConnecting, stateChanges);
+
+    client.disconnect();
+    TEST_ASSERT_TRUE(client.getState() == JmriJsonClient::ConnectionState::DISCONNECTED);
+    TEST_ASSERT_EQUAL(ESP_OK, client.connect("127.0.0.1", closedPort()));
+    client.disconnect();
+    client.setConnectionStateCallback(nullptr);
+}
+
+extern "C" void register_connection_tests(void)
+{
+    RUN_TEST(test_dns_cache_numeric_hosts_skip_resolver);
+    RUN_TEST(test_dns_cache_expiry_and_invalidate);
+    RUN_TEST(test_dns_cache_replaces_oldest_entry);
+    RUN_TEST(test_withrottle_connect_does_not_block_caller);
+    RUN_TEST(test_withrottle_connect_records_phase_timings);
+    RUN_TEST(test_withrottle_parallel_connects);
+    RUN_TEST(test_withrottle_disconnect_during_connect);
+    RUN_TEST(test_jmri_second_connect_keeps_attempt);
+}
@@ -0,0 +1,129 @@
+#include "unity.h"
+#include "HeartbeatMonitor.h"
+#include "WiThrottleClient.h"
+#include "LoopbackServer.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include <string>
+
+static const char* TAG = "HeartbeatMonitorTests";
+
+static const int64_t SECOND_US = 1000000;
+
+static void test_heartbeat_disabled_until_negotiated(void)
+{
+    HeartbeatMonitor monitor;
+    monitor.reset(0);
+
+    TEST_ASSERT_FALSE(monitor.isEnabled());
+    TEST_ASSERT_EQUAL(-1, monitor.getNextDeadlineUs());
+    TEST_ASSERT_TRUE(monitor.poll(60 * SECOND_US) == HeartbeatMonitor::Action::NONE);
+    TEST_ASSERT_EQUAL(0, monitor.getKeepAlive().count);
+
+    monitor.setIntervalSeconds(10);
+    TEST_ASSERT_TRUE(monitor.isEnabled());
+    TEST_ASSERT_EQUAL(10, monitor.getIntervalSeconds());
+
+    monitor.setIntervalSeconds(0);
+    TEST_ASSERT_FALSE(monitor.isEnabled());
+    TEST_ASSERT_EQUAL(0, monitor.getKeepAlive().count);
+}
+
+static void test_heartbeat_schedule(void)
+{
+    HeartbeatMonitor monitor;
+    monitor.reset(0);
+    monitor.setIntervalSeconds(10);
+
+    TEST_ASSERT_EQUAL(5 * SECOND_US, monitor.getNextDeadlineUs());
+    TEST_ASSERT_TRUE(monitor.poll(4 * SECOND_US) == HeartbeatMonitor::Action::NONE);
+
+    // Every half interval, whatever the server has or has not sent
+    TEST_ASSERT_TRUE(monitor.poll(5 * SECOND_US) == HeartbeatMonitor::Action::SEND_HEARTBEAT);
+    monitor.onHeartbeatSent(5 * SECOND_US);
+    TEST_ASSERT_TRUE(monitor.poll(6 * SECOND_US) == HeartbeatMonitor::Action::NONE);
+    TEST_ASSERT_EQUAL(10 * SECOND_US, monitor.getNextDeadlineUs());
+    TEST_ASSERT_TRUE(monitor.poll(60 * SECOND_US) == HeartbeatMonitor::Action::SEND_HEARTBEAT);
+}
+
+static void test_heartbeat_keepalive_within_one_interval(void)
+{
+    // A silent link is dropped by TCP at most one interval (2 s for the shortest) after the last segment
+    const int intervals[] = { 1, 2, 4, 10, 15, 60 };
+    for (int seconds : intervals) {
+        HeartbeatMonitor monitor;
+        monitor.reset(0);
+        monitor.setIntervalSeconds(seconds);
+        HeartbeatMonitor::KeepAlive keepAlive = monitor.getKeepAlive();
+
+        TEST_ASSERT_TRUE(keepAlive.idleSeconds >= 1);
+        TEST_ASSERT_TRUE(keepAlive.intervalSeconds >= 1);
+        TEST_ASSERT_TRUE(keepAlive.count >= 1);
+        int dropSeconds = keepAlive.idleSeconds + keepAlive.intervalSeconds * keepAlive.count;
+        TEST_ASSERT_TRUE(dropSeconds <= (seconds > 2 ? seconds : 2));
+        // Probing starts about half an interval in, alongside our own heartbeat
+        TEST_ASSERT_EQUAL(seconds > 1 ? seconds / 2 : 1, keepAlive.idleSeconds);
+    }
+}
+
+namespace {
+    // Act as a server that never answers; collect what the client sends for @p durationMs
+    std::string collectLines(LoopbackServer& server, int durationMs)
+    {
+        struct timeval timeout = { 0, 50000 };
+        setsockopt(server.connection, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+        int64_t endUs = esp_timer_get_time() + static_cast<int64_t>(durationMs) * 1000;
+        std::string received;
+        char buffer[128];
+        while (esp_timer_get_time() < endUs) {
+            int len = recv(server.connection, buffer, sizeof(buffer), 0);
+            if (len > 0) {
+                received.append(buffer, len);
+            }
+        }
+        return received;
+    }
+}
+
+static void test_withrottle_heartbeat_against_quiet_server(void)
+{
+    LoopbackServer server;
+    TEST_ASSERT_TRUE(server.listen());
+
+    WiThrottleClient client;
+    client.initialize();
+    TEST_ASSERT_EQUAL(ESP_OK, client.connect("127.0.0.1", server.port));
+    TEST_ASSERT_TRUE(acceptClient(server, client));
+    server.readUntil("HESP32-S3\n");
+
+    // Negotiate a 2 s heartbeat; the client must enable monitoring and answer
+    TEST_ASSERT_TRUE(server.send("*2\n"));
+    std::string received = server.readUntil("*\n");
+    TEST_ASSERT_EQUAL(0, received.find("*+\n"));
+
+    // JMRI does not answer '*': a server that stays silent must stay connected,
+    // and hear nothing but heartbeats (no device name re-sent as a probe)
+    received = collectLines(server, 3000);
+    TEST_ASSERT_TRUE(client.isConnected());
+    int heartbeats = 0;
+    for (size_t start = 0; start < received.size();) {
+        size_t newline = received.find('\n', start);
+        TEST_ASSERT_TRUE(newline != std::string::npos);
+        TEST_ASSERT_TRUE(received.compare(start, newline - start, "*") == 0);
+        heartbeats++;
+        start = newline + 1;
+    }
+    ESP_LOGI(TAG, "%d heartbeats in 3 s to a silent server (interval 2000 ms)", heartbeats);
+    TEST_ASSERT_TRUE(heartbeats >= 2);
+
+    shutdownClient(server, client);
+}
+
+extern "C" void register_heartbeat_monitor_tests(void)
+{
+    RUN_TEST(test_heartbeat_disabled_until_negotiated);
+    RUN_TEST(test_heartbeat_schedule);
+    RUN_TEST(test_heartbeat_keepalive_within_one_interval);
+    RUN_TEST(test_withrottle_heartbeat_against_quiet_server);
+}
@@ -0,0 +1,212 @@
+#include "unity.h"
+#include "JsonSubscriptionTable.h"
+#include "JmriJsonClient.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include <cstdio>
+#include <string>
+
+static const char* TAG = "JsonSubscriptionTableTests";
+
+using ItemType = JsonSubscriptionTable::ItemType;
+
+namespace {
+    // Blocks and turnouts from docs/physical-layout/layout_topology.md
+    const char* const LAYOUT_BLOCKS[] = {
+        "FY_BK_01", "FY_BK_02", "FY_BK_03", "FY_BK_04", "GY_BK_01", "GY_BK_10",
+        "GY_BK_11", "GY_BK_12", "GY_BK_20", "GY_BK_30", "GY_BK_31"
+    };
+    const char* const LAYOUT_TURNOUTS[] = {
+        "FY_TO_01", "GY_TO_01", "GY_TO_02", "GY_TO_03", "GY_TO_04", "GY_TO_05"
+    };
+    constexpr int BLOCK_COUNT = sizeof(LAYOUT_BLOCKS) / sizeof(LAYOUT_BLOCKS[0]);
+    constexpr int TURNOUT_COUNT = sizeof(LAYOUT_TURNOUTS) / sizeof(LAYOUT_TURNOUTS[0]);
+
+    // Stand-in for the JMRI JSON server: formats state frames exactly as
+    // JMRI sends them, into a fixed buffer so the feed itself never allocates
+    struct StandInServer {
+        char frame[192];
+
+        std::string_view sensor(int block, int state)
+        {
+            int length = snprintf(frame, sizeof(frame),
+                                  "{\"type\":\"sensor\",\"data\":{\"name\":\"IS%d\",\"userName\":\"%s\","
+                                  "\"comment\":null,\"properties\":[],\"inverted\":false,\"state\":%d}}",
+                                  100 + block, LAYOUT_BLOCKS[block], state);
+            return std::string_view(frame, length);
+        }
+
+        std::string_view turnout(int index, int state)
+        {
+            int length = snprintf(frame, sizeof(frame),
+                                  "{\"type\":\"turnout\",\"data\":{\"name\":\"IT%d\",\"userName\":\"%s\","
+                                  "\"inverted\":false,\"state\":%d,\"feedbackMode\":1}}",
+                                  200 + index, LAYOUT_TURNOUTS[index], state);
+            return std::string_view(frame, length);
+        }
+    };
+}
+
+static void test_subscription_table_interns_names(void)
+{
+    JsonSubscriptionTable table(8, 64);
+    TEST_ASSERT_TRUE(table.isValid());
+
+    uint16_t sensor = table.intern(ItemType::SENSOR, "IS1");
+    uint16_t turnout = table.intern(ItemType::TURNOUT, "IS1");  // Same name, other type
+    TEST_ASSERT_EQUAL(0, sensor);
+    TEST_ASSERT_EQUAL(1, turnout);
+    TEST_ASSERT_EQUAL(sensor, table.intern(ItemType::SENSOR, "IS1"));
+    TEST_ASSERT_EQUAL(sensor, table.find(ItemType::SENSOR, "IS1"));
+    TEST_ASSERT_EQUAL(JsonSubscriptionTable::INVALID_ID, table.find(ItemType::LIGHT, "IS1"));
+    TEST_ASSERT_EQUAL(2, table.size());
+    TEST_ASSERT_EQUAL(6, table.getNamePoolUsed());
+
+    TEST_ASSERT_TRUE(ItemType::TURNOUT == table.getType(turnout));
+    TEST_ASSERT_EQUAL_STRING_LEN("IS1", table.getSystemName(turnout).data(), 3);
+
+    table.setUserName(sensor, "GY_BK_10");
+    table.setUserName(sensor, "Ignored once set");
+    TEST_ASSERT_EQUAL(8, table.getUserName(sensor).size());
+    TEST_ASSERT_EQUAL_STRING_LEN("GY_BK_10", table.getUserName(sensor).data(), 8);
+    TEST_ASSERT_EQUAL(0, table.getUserName(turnout).size());
+}
+
+static void test_subscription_table_reports_changes_only(void)
+{
+    JsonSubscriptionTable table(4, 64);
+    uint16_t id = table.intern(ItemType::SENSOR, "IS1");
+
+    TEST_ASSERT_EQUAL(JsonSubscriptionTable::NO_STATE, table.getState(id));
+    TEST_ASSERT_TRUE(table.update(id, 4));
+    TEST_ASSERT_FALSE(table.update(id, 4));
+    TEST_ASSERT_TRUE(table.update(id, 2));
+    TEST_ASSERT_EQUAL(2, table.getState(id));
+
+    table.clearStates();
+    TEST_ASSERT_EQUAL(JsonSubscriptionTable::NO_STATE, table.getState(id));
+    TEST_ASSERT_TRUE(table.update(id, 2));
+    TEST_ASSERT_FALSE(table.update(JsonSubscriptionTable::INVALID_ID, 2));
+}
+
+static void test_subscription_table_limits(void)
+{
+    JsonSubscriptionTable table(2, 8);
+    TEST_ASSERT_EQUAL(0, table.intern(ItemType::SENSOR, "IS1"));
+    TEST_ASSERT_EQUAL(JsonSubscriptionTable::INVALID_ID, table.intern(ItemType::SENSOR, "IS123456"));  // Pool
+    TEST_ASSERT_EQUAL(1, table.intern(ItemType::SENSOR, "IS2"));
+    TEST_ASSERT_EQUAL(JsonSubscriptionTable::INVALID_ID, table.intern(ItemType::SENSOR, "IS3"));  // Items
+    TEST_ASSERT_EQUAL(JsonSubscriptionTable::INVALID_ID, table.intern(ItemType::SENSOR, ""));
+
+    ItemType type;
+    TEST_ASSERT_TRUE(JsonSubscriptionTable::parseType("turnout", type));
+    TEST_ASSERT_TRUE(ItemType::TURNOUT == type);
+    TEST_ASSERT_FALSE(JsonSubscriptionTable::parseType("memory", type));
+    TEST_ASSERT_EQUAL_STRING("block", JsonSubscriptionTable::getTypeName(ItemType::BLOCK));
+}
+
+static void test_jmri_dispatches_subscribed_items(void)
+{
+    JmriJsonClient client;
+    client.initialize();
+
+    uint16_t sensor;
+    TEST_ASSERT_EQUAL(ESP_OK, client.subscribe(ItemType::SENSOR, "IS100", &sensor));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, client.subscribe(ItemType::POWER, "DCC++"));
+
+    std::string changes;
+    client.setItemStateCallback([&](ItemType type, uint16_t id, int state) {
+        changes += std::string(JsonSubscriptionTable::getTypeName(type)) + ":" +
+                   std::string(client.getSubscriptions().getSystemName(id)) + "=" + std::to_string(state) + ";";
+    });
+
+    StandInServer server;
+    client.testProcessMessage(server.sensor(0, 4));
+    client.testProcessMessage(server.sensor(0, 4));   // Repeat: no callback
+    client.testProcessMessage(server.turnout(0, 2));  // Not subscribed
+    client.testProcessMessage(server.sensor(0, 2));
+    client.testProcessMessage("{\"type\":\"power\",\"data\":{\"name\":\"DCC++\",\"state\":2}}");
+
+    TEST_ASSERT_EQUAL_STRING("sensor:IS100=4;sensor:IS100=2;power:DCC++=2;", changes.c_str());
+    TEST_ASSERT_EQUAL(2, client.getSubscriptions().getState(sensor));
+    TEST_ASSERT_EQUAL_STRING_LEN("FY_BK_01", client.getSubscriptions().getUserName(sensor).data(), 8);
+    TEST_ASSERT_EQUAL(1, client.getFrameStats().unmatched);
+    TEST_ASSERT_EQUAL((int)JmriJsonClient::PowerState::ON, (int)client.getPower());
+}
+
+static void test_jmri_subscription_burst_is_allocation_free(void)
+{
+    JmriJsonClient client;
+    client.initialize();
+    for (int i = 0; i < BLOCK_COUNT; i++) {
+        TEST_ASSERT_EQUAL(ESP_OK, client.subscribe(ItemType::SENSOR, "IS" + std::to_string(100 + i)));
+    }
+    for (int i = 0; i < TURNOUT_COUNT; i++) {
+        TEST_ASSERT_EQUAL(ESP_OK, client.subscribe(ItemType::TURNOUT, "IT" + std::to_string(200 + i)));
+    }
+
+    uint32_t callbacks = 0;
+    client.setItemStateCallback([&](ItemType, uint16_t, int) { callbacks++; });
+
+    // Warm up: first reports intern user names into the pool
+    StandInServer server;
+    for (int i = 0; i < BLOCK_COUNT; i++) {
+        client.testProcessMessage(server.sensor(i, 4));
+    }
+    for (int i = 0; i < TURNOUT_COUNT; i++) {
+        client.testProcessMessage(server.turnout(i, 2));
+    }
+    callbacks = 0;
+
+    // Trains moving through the yard: blocks toggle occupancy, turnouts
+    // throw, and every fourth report repeats the current state
+    int blockStates[BLOCK_COUNT];
+    int turnoutStates[TURNOUT_COUNT];
+    for (int& state : blockStates) {
+        state = 4;
+    }
+    for (int& state : turnoutStates) {
+        state = 2;
+    }
+
+    const int updates = 1000;
+    uint32_t expected = 0;
+    size_t heapBefore = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    int64_t start = esp_timer_get_time();
+    for (int i = 0; i < updates; i++) {
+        int item = i % (BLOCK_COUNT + TURNOUT_COUNT);
+        bool repeat = (i % 4) == 3;
+        if (item < BLOCK_COUNT) {
+            int& state = blockStates[item];
+            state = repeat ? state : 6 - state;  // ACTIVE (2) <-> INACTIVE (4)
+            client.testProcessMessage(server.sensor(item, state));
+        } else {
+            int& state = turnoutStates[item - BLOCK_COUNT];
+            state = repeat ? state : 6 - state;  // CLOSED (2) <-> THROWN (4)
+            client.testProcessMessage(server.turnout(item - BLOCK_COUNT, state));
+        }
+        if (!repeat) {
+            expected++;
+        }
+    }
+    int64_t elapsedUs = esp_timer_get_time() - start;
+    size_t heapAfter = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+
+    uint64_t perSecond = elapsedUs > 0 ? updates * 1000000ULL / elapsedUs : 0;
+    ESP_LOGI(TAG, "%d updates (%lu changes) in %lld us: %llu updates/s", updates, (unsigned long)callbacks,
+             (long long)elapsedUs, (unsigned long long)perSecond);
+    TEST_ASSERT_EQUAL(heapBefore, heapAfter);
+    TEST_ASSERT_EQUAL(expected, callbacks);
+    TEST_ASSERT_TRUE(perSecond > 500);
+    TEST_ASSERT_EQUAL(0, client.getFrameStats().unmatched);
+}
+
+extern "C" void register_json_subscription_table_tests(void)
+{
+    RUN_TEST(test_subscription_table_interns_names);
+    RUN_TEST(test_subscription_table_reports_changes_only);
+    RUN_TEST(test_subscription_table_limits);
+    RUN_TEST(test_jmri_dispatches_subscribed_items);
+    RUN_TEST(test_jmri_subscription_burst_is_allocation_free);
+}
@@ -0,0 +1,244 @@
+#include "unity.h"
+#include "JsonTokenizer.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include <algorithm>
+#include <string>
+
+static const char* TAG = "JsonTokenizerTests";
+
+namespace {
+    // Records tokens as "depth:type:key=text;" for comparison
+    class RecordingHandler : public JsonTokenizer::Handler {
+    public:
+        std::string log;
+
+        void onToken(const JsonTokenizer::Token& token) override
+        {
+            static const char* names[] = { "{", "}", "[", "]", "s", "n", "b", "null" };
+            log += std::to_string(token.depth) + ":" + names[static_cast<int>(token.type)] + ":" +
+                   std::string(token.key) + "=" + std::string(token.text) + (token.truncated ? "~" : "") + ";";
+        }
+    };
+
+    // Counts tokens and picks out element states without allocating
+    class CountingHandler : public JsonTokenizer::Handler {
+    public:
+        uint32_t tokens = 0;
+        uint32_t states = 0;
+
+        void onToken(const JsonTokenizer::Token& token) override
+        {
+            tokens++;
+            int state;
+            if (token.type == JsonTokenizer::TokenType::NUMBER && token.is("state") && token.getInt(state)) {
+                states++;
+            }
+        }
+    };
+
+    std::string powerList()
+    {
+        return "[{\"type\":\"power\",\"data\":{\"name\":\"DCC++\",\"state\":2,\"default\":true}},"
+               "{\"type\":\"power\",\"data\":{\"name\":\"LocoNet\",\"state\":4,\"default\":false}},"
+               "{\"type\":\"power\",\"data\":{\"name\":\"Internal\",\"state\":0,\"default\":false}}]";
+    }
+
+    std::string sensorList(int count)
+    {
+        std::string json = "[";
+        for (int i = 1; i <= count; i++) {
+            json += "{\"type\":\"sensor\",\"data\":{\"name\":\"IS" + std::to_string(i) +
+                    "\",\"userName\":\"Block " + std::to_string(i) + " occupancy\",\"comment\":null,"
+                    "\"properties\":[],\"inverted\":false,\"state\":" + (i % 3 ? "4" : "2") + "}}";
+            json += (i < count) ? "," : "]";
+        }
+        return json;
+    }
+
+    std::string turnoutList(int count)
+    {
+        std::string json = "[";
+        for (int i = 1; i <= count; i++) {
+            json += "{\"type\":\"turnout\",\"data\":{\"name\":\"IT" + std::to_string(i) +
+                    "\",\"userName\":\"Yard lead " + std::to_string(i) + "\",\"comment\":null,"
+                    "\"properties\":[],\"inverted\":false,\"state\":" + (i % 2 ? "2" : "4") +
+                    ",\"feedbackMode\":1,\"feedbackModes\":[1,2,16],\"sensor\":[null,null]}}";
+            json += (i < count) ? "," : "]";
+        }
+        return json;
+    }
+
+    std::string rosterList(int count)
+    {
+        std::string json = "[";
+        for (int i = 1; i <= count; i++) {
+            std::string number = std::to_string(4000 + i);
+            json += "{\"type\":\"rosterEntry\",\"data\":{\"name\":\"BNSF " + number + "\",\"address\":\"" + number +
+                    "\",\"isLongAddress\":true,\"road\":\"BNSF\",\"number\":\"" + number +
+                    "\",\"mfg\":\"Athearn\",\"decoderModel\":\"Tsunami2 EMD\",\"decoderFamily\":\"SoundTraxx\","
+                    "\"model\":\"SD40-2\",\"comment\":\"Weathered \\u00e9dition\",\"maxSpeedPct\":100,"
+                    "\"image\":null,\"icon\":\"/roster/BNSF%20" + number + "/icon\",\"shuntingFunction\":\"F6\","
+                    "\"owner\":\"Club\",\"dateModified\":\"2024-03-01T12:00:00.000+00:00\",\"functionKeys\":[";
+            for (int f = 0; f <= 8; f++) {
+                json += "{\"name\":\"F" + std::to_string(f) + "\",\"label\":\"Function " + std::to_string(f) +
+                        "\",\"lockable\":" + (f == 2 ? "false" : "true") + ",\"icon\":null,\"selectedIcon\":null}";
+                json += (f < 8) ? "," : "]";
+            }
+            json += ",\"attributes\":[],\"rosterGroups\":[\"Diesel\",\"Mainline\"]},\"id\":" + std::to_string(i) + "}";
+            json += (i < count) ? "," : "]";
+        }
+        return json;
+    }
+}
+
+static void test_json_tokens_keys_and_depths(void)
+{
+    JsonTokenizer tokenizer;
+    RecordingHandler handler;
+
+    JsonTokenizer::Status status = tokenizer.feed(
+        "{\"type\":\"power\",\"data\":{\"name\":\"main\",\"state\":2,\"on\":true,\"x\":null},\"list\":[1,-2.5e3]}", handler);
+
+    TEST_ASSERT_EQUAL((int)JsonTokenizer::Status::COMPLETE, (int)status);
+    TEST_ASSERT_EQUAL_STRING(
+        "0:{:=;1:s:type=power;1:{:data=;2:s:name=main;2:n:state=2;2:b:on=true;2:null:x=null;1:}:=;"
+        "1:[:list=;2:n:=1;2:n:=-2.5e3;1:]:=;0:}:=;",
+        handler.log.c_str());
+}
+
+static void test_json_chunked_input_matches_whole(void)
+{
+    std::string json = rosterList(3);
+
+    JsonTokenizer whole;
+    RecordingHandler wholeLog;
+    TEST_ASSERT_EQUAL((int)JsonTokenizer::Status::COMPLETE, (int)whole.feed(json, wholeLog));
+
+    // One byte at a time: every token straddles a chunk boundary somewhere
+    JsonTokenizer chunked;
+    RecordingHandler chunkedLog;
+    JsonTokenizer::Status status = JsonTokenizer::Status::IN_PROGRESS;
+    for (char c : json) {
+        status = chunked.feed(&c, 1, chunkedLog);
+    }
+    TEST_ASSERT_EQUAL((int)JsonTokenizer::Status::COMPLETE, (int)status);
+    TEST_ASSERT_TRUE(wholeLog.log == chunkedLog.log);
+    TEST_ASSERT_EQUAL(whole.getTokenCount(), chunked.getTokenCount());
+}
+
+static void test_json_escapes_and_truncation(void)
+{
+    JsonTokenizer tokenizer;
+    RecordingHandler handler;
+
+    tokenizer.feed("{\"a\":\"q\\\"\\\\\\/\\n\",\"b\":\"\\u00e9\\u20ac\"}", handler);
+    TEST_ASSERT_EQUAL_STRING("0:{:=;1:s:a=q\"\\/\n;1:s:b=\xC3\xA9\xE2\x82\xAC;0:}:=;", handler.log.c_str());
+
+    std::string longValue(JsonTokenizer::MAX_TEXT_LENGTH + 10, 'x');
+    tokenizer.reset();
+    handler.log.clear();
+    TEST_ASSERT_EQUAL((int)JsonTokenizer::Status::COMPLETE,
+                      (int)tokenizer.feed("[\"" + longValue + "\"]", handler));
+    std::string expected = "0:[:=;1:s:=" + std::string(JsonTokenizer::MAX_TEXT_LENGTH, 'x') + "~;0:]:=;";
+    TEST_ASSERT_TRUE(handler.log == expected);
+}
+
+static void test_json_rejects_malformed_input(void)
+{
+    const char* bad[] = { "{\"a\" 1}", "{\"a\":tru}", "[1,2}", "{\"a\":1,}", "{\"a\":\"\\x\"}", "{} x" };
+    for (const char* json : bad) {
+        JsonTokenizer tokenizer;
+        RecordingHandler handler;
+        TEST_ASSERT_EQUAL_MESSAGE((int)JsonTokenizer::Status::ERROR, (int)tokenizer.feed(json, handler), json);
+    }
+
+    std::string deep(JsonTokenizer::MAX_DEPTH + 1, '[');
+    JsonTokenizer tokenizer;
+    RecordingHandler handler;
+    TEST_ASSERT_EQUAL((int)JsonTokenizer::Status::ERROR, (int)tokenizer.feed(deep, handler));
+}
+
+static void test_json_top_level_scalar_and_strict_int(void)
+{
+    // A bare scalar has no closing delimiter; only the end of input completes it
+    const char* scalars[] = { "42", "-2.5e3", "true", "null" };
+    const char* logs[] = { "0:n:=42;", "0:n:=-2.5e3;", "0:b:=true;", "0:null:=null;" };
+    for (size_t i = 0; i < sizeof(scalars) / sizeof(scalars[0]); i++) {
+        JsonTokenizer tokenizer;
+        RecordingHandler handler;
+        TEST_ASSERT_EQUAL((int)JsonTokenizer::Status::IN_PROGRESS, (int)tokenizer.feed(scalars[i], handler));
+        TEST_ASSERT_EQUAL_MESSAGE((int)JsonTokenizer::Status::COMPLETE, (int)tokenizer.finish(handler), scalars[i]);
+        TEST_ASSERT_EQUAL_STRING(logs[i], handler.log.c_str());
+    }
+
+    JsonTokenizer tokenizer;
+    RecordingHandler handler;
+    tokenizer.feed("tru", handler);
+    TEST_ASSERT_EQUAL((int)JsonTokenizer::Status::ERROR, (int)tokenizer.finish(handler));
+    tokenizer.reset();
+    tokenizer.feed("{\"a\":1", handler);
+    TEST_ASSERT_EQUAL((int)JsonTokenizer::Status::IN_PROGRESS, (int)tokenizer.finish(handler));
+
+    // getInt() needs the whole text to be an integer
+    JsonTokenizer::Token token{ JsonTokenizer::TokenType::NUMBER, {}, "12", 0, false };
+    int value = 0;
+    TEST_ASSERT_TRUE(token.getInt(value));
+    TEST_ASSERT_EQUAL(12, value);
+    const char* notInts[] = { "12abc", "1.5", "1-2", "", "99999999999" };
+    for (const char* text : notInts) {
+        token.text = text;
+        TEST_ASSERT_FALSE(token.getInt(value));
+    }
+}
+
+static void test_json_list_payload_benchmark(void)
+{
+    struct Payload {
+        const char* name;
+        std::string json;
+        uint32_t elements;
+    };
+    Payload payloads[] = {
+        { "power", powerList(), 3 },
+        { "sensor", sensorList(300), 300 },
+        { "turnout", turnoutList(300), 300 },
+        { "roster", rosterList(100), 0 },
+    };
+
+    const size_t chunkSize = 1024;  // Typical WebSocket fragment
+    for (Payload& payload : payloads) {
+        JsonTokenizer tokenizer;
+        CountingHandler handler;
+
+        size_t heapBefore = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+        int64_t start = esp_timer_get_time();
+        JsonTokenizer::Status status = JsonTokenizer::Status::IN_PROGRESS;
+        for (size_t offset = 0; offset < payload.json.size(); offset += chunkSize) {
+            size_t length = std::min(chunkSize, payload.json.size() - offset);
+            status = tokenizer.feed(payload.json.data() + offset, length, handler);
+        }
+        int64_t elapsedUs = esp_timer_get_time() - start;
+        size_t heapAfter = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+
+        TEST_ASSERT_EQUAL((int)JsonTokenizer::Status::COMPLETE, (int)status);
+        TEST_ASSERT_EQUAL(payload.elements, handler.states);
+        TEST_ASSERT_EQUAL(heapBefore, heapAfter);
+
+        uint64_t kbPerSecond = elapsedUs > 0 ? (payload.json.size() * 1000000ULL / 1024) / elapsedUs : 0;
+        ESP_LOGI(TAG, "%-7s list: %6u bytes, %5lu tokens in %6lld us (%llu KB/s)",
+                 payload.name, (unsigned)payload.json.size(), (unsigned long)handler.tokens,
+                 (long long)elapsedUs, (unsigned long long)kbPerSecond);
+    }
+}
+
+extern "C" void register_json_tokenizer_tests(void)
+{
+    RUN_TEST(test_json_tokens_keys_and_depths);
+    RUN_TEST(test_json_chunked_input_matches_whole);
+    RUN_TEST(test_json_escapes_and_truncation);
+    RUN_TEST(test_json_rejects_malformed_input);
+    RUN_TEST(test_json_top_level_scalar_and_strict_int);
+    RUN_TEST(test_json_list_payload_benchmark);
+}
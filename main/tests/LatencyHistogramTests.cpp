@@ -0,0 +1,46 @@
+#include "unity.h"
+#include "LatencyHistogram.h"
+
+static void test_histogram_buckets_and_summary(void)
+{
+    LatencyHistogram histogram;
+    TEST_ASSERT_EQUAL(0, histogram.getCount());
+    TEST_ASSERT_EQUAL(0, histogram.getPercentileUs(50));
+
+    histogram.record(50);       // < 100 us
+    histogram.record(99);       // < 100 us
+    histogram.record(100);      // < 250 us
+    histogram.record(4000);     // < 5 ms
+    histogram.record(300000);   // overflow
+
+    TEST_ASSERT_EQUAL(5, histogram.getCount());
+    TEST_ASSERT_EQUAL(2, histogram.getBucketCount(0));
+    TEST_ASSERT_EQUAL(1, histogram.getBucketCount(1));
+    TEST_ASSERT_EQUAL(1, histogram.getBucketCount(5));
+    TEST_ASSERT_EQUAL(1, histogram.getBucketCount(LatencyHistogram::NUM_BUCKETS - 1));
+    TEST_ASSERT_EQUAL(300000, histogram.getMaxUs());
+    TEST_ASSERT_EQUAL((50 + 99 + 100 + 4000 + 300000) / 5, histogram.getMeanUs());
+}
+
+static void test_histogram_percentiles(void)
+{
+    LatencyHistogram histogram;
+    for (int i = 0; i < 99; i++) {
+        histogram.record(200);
+    }
+    histogram.record(20000);
+
+    TEST_ASSERT_EQUAL(250, histogram.getPercentileUs(50));
+    TEST_ASSERT_EQUAL(250, histogram.getPercentileUs(99));
+    TEST_ASSERT_EQUAL(25000, histogram.getPercentileUs(100));
+
+    histogram.reset();
+    TEST_ASSERT_EQUAL(0, histogram.getCount());
+    TEST_ASSERT_EQUAL(0, histogram.getMaxUs());
+}
+
+extern "C" void register_latency_histogram_tests(void)
+{
+    RUN_TEST(test_histogram_buckets_and_summary);
+    RUN_TEST(test_histogram_percentiles);
+}
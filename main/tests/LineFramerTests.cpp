@@ -0,0 +1,186 @@
+#include "unity.h"
+#include "LineFramer.h"
+#include "WiThrottleClient.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include <cstring>
+#include <string>
+
+static const char* TAG = "LineFramerTests";
+
+// Copy data into the framer as recv() would, in chunks of at most chunkSize
+static void feed(LineFramer& framer, const char* data, size_t length, size_t chunkSize)
+{
+    while (length > 0) {
+        char* dst = framer.writePtr();
+        size_t n = length < chunkSize ? length : chunkSize;
+        if (n > framer.writeSpace()) {
+            n = framer.writeSpace();
+        }
+        memcpy(dst, data, n);
+        framer.commit(n);
+        data += n;
+        length -= n;
+    }
+}
+
+static void test_line_framer_split_across_chunks(void)
+{
+    LineFramer framer(64);
+    TEST_ASSERT_TRUE(framer.isValid());
+
+    std::string_view line;
+    const char* part1 = "M0AS3<;>V";
+    feed(framer, part1, strlen(part1), 64);
+    TEST_ASSERT_FALSE(framer.nextLine(line));
+
+    const char* part2 = "50\nPPA1\n";
+    feed(framer, part2, strlen(part2), 64);
+    TEST_ASSERT_TRUE(framer.nextLine(line));
+    TEST_ASSERT_EQUAL(strlen("M0AS3<;>V50"), line.size());
+    TEST_ASSERT_EQUAL_STRING_LEN("M0AS3<;>V50", line.data(), line.size());
+    TEST_ASSERT_TRUE(framer.nextLine(line));
+    TEST_ASSERT_EQUAL_STRING_LEN("PPA1", line.data(), line.size());
+    TEST_ASSERT_FALSE(framer.nextLine(line));
+    TEST_ASSERT_EQUAL(0, framer.getBufferedBytes());
+}
+
+static void test_line_framer_strips_crlf(void)
+{
+    LineFramer framer(32);
+    const char* data = "VN2.0\r\n\r\n";
+    feed(framer, data, strlen(data), 32);
+
+    std::string_view line;
+    TEST_ASSERT_TRUE(framer.nextLine(line));
+    TEST_ASSERT_EQUAL(5, line.size());
+    TEST_ASSERT_EQUAL_STRING_LEN("VN2.0", line.data(), line.size());
+    TEST_ASSERT_TRUE(framer.nextLine(line));
+    TEST_ASSERT_EQUAL(0, line.size());
+}
+
+static void test_line_framer_compacts_partial_line(void)
+{
+    LineFramer framer(16);
+    std::string_view line;
+
+    // Fill to the end with one full line and the start of another
+    memcpy(framer.writePtr(), "PPA1\nM0AS3<;>V10", 16);
+    framer.commit(16);
+    TEST_ASSERT_TRUE(framer.nextLine(line));
+    TEST_ASSERT_FALSE(framer.nextLine(line));
+    TEST_ASSERT_EQUAL(0, framer.writeSpace());
+
+    // Next write must move the partial line to the front
+    char* dst = framer.writePtr();
+    TEST_ASSERT_EQUAL(5, framer.writeSpace());
+    memcpy(dst, "0\n", 2);
+    framer.commit(2);
+    TEST_ASSERT_TRUE(framer.nextLine(line));
+    TEST_ASSERT_EQUAL(strlen("M0AS3<;>V100"), line.size());
+    TEST_ASSERT_EQUAL_STRING_LEN("M0AS3<;>V100", line.data(), line.size());
+}
+
+static void test_line_framer_overflow_recovers(void)
+{
+    LineFramer framer(16);
+    std::string_view line;
+
+    // 40 byte line without a newline overflows a 16 byte buffer
+    std::string longLine(40, 'x');
+    std::string data = longLine + "\nPPA0\n";
+    size_t offset = 0;
+    int lines = 0;
+    while (offset < data.size()) {
+        char* dst = framer.writePtr();
+        size_t n = data.size() - offset;
+        if (n > framer.writeSpace()) {
+            n = framer.writeSpace();
+        }
+        memcpy(dst, data.data() + offset, n);
+        framer.commit(n);
+        offset += n;
+        while (framer.nextLine(line)) {
+            lines++;
+            TEST_ASSERT_EQUAL_STRING_LEN("PPA0", line.data(), line.size());
+        }
+    }
+
+    TEST_ASSERT_EQUAL(1, lines);
+    TEST_ASSERT_EQUAL(1, framer.getOverflowCount());
+}
+
+static void test_line_framer_recorded_session_throughput(void)
+{
+    // Representative server traffic: roster, power, throttle updates
+    std::string session = "VN2.0\nPW12080\nPPA1\n*10\n";
+    session += "RL50";
+    for (int i = 0; i < 50; i++) {
+        session += "]\\[Locomotive " + std::to_string(i) + "}|{" + std::to_string(100 + i) + "}|{L";
+    }
+    session += "\n";
+    for (int i = 0; i < 200; i++) {
+        int id = i % 4;
+        session += "M" + std::to_string(id) + "AL" + std::to_string(100 + id) + "<;>V" + std::to_string(i % 127) + "\n";
+        session += "M" + std::to_string(id) + "AL" + std::to_string(100 + id) + "<;>F1" + std::to_string(i % 10) + "\n";
+    }
+
+    WiThrottleClient client;
+    client.initialize();
+    LineFramer framer(CONFIG_WITHROTTLE_RX_BUFFER_SIZE);
+    TEST_ASSERT_TRUE(framer.isValid());
+
+    // Silence per-message RX logging so the measurement is of parsing, not UART
+    esp_log_level_set("WiThrottleClient", ESP_LOG_WARN);
+
+    const int passes = 20;
+    const size_t chunkSize = 512;
+    uint32_t messages = 0;
+    size_t heapBefore = heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+    int64_t start = esp_timer_get_time();
+
+    for (int pass = 0; pass < passes; pass++) {
+        size_t offset = 0;
+        while (offset < session.size()) {
+            char* dst = framer.writePtr();
+            size_t n = session.size() - offset;
+            if (n > chunkSize) {
+                n = chunkSize;
+            }
+            if (n > framer.writeSpace()) {
+                n = framer.writeSpace();
+            }
+            memcpy(dst, session.data() + offset, n);
+            framer.commit(n);
+            offset += n;
+
+            std::string_view line;
+            while (framer.nextLine(line)) {
+                client.testProcessMessage(line);
+                messages++;
+            }
+        }
+    }
+
+    int64_t elapsedUs = esp_timer_get_time() - start;
+    size_t heapAfter = heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+    esp_log_level_set("WiThrottleClient", ESP_LOG_INFO);
+
+    TEST_ASSERT_EQUAL(passes * 405, messages);
+    TEST_ASSERT_EQUAL(0, framer.getOverflowCount());
+
+    ESP_LOGI(TAG, "Recorded session: %lu msgs, %lu bytes in %lld us (%lu msgs/s), heap delta %d",
+             (unsigned long)messages, (unsigned long)(session.size() * passes), (long long)elapsedUs,
+             (unsigned long)(elapsedUs > 0 ? (uint64_t)messages * 1000000ULL / elapsedUs : 0),
+             (int)heapBefore - (int)heapAfter);
+}
+
+extern "C" void register_line_framer_tests(void)
+{
+    RUN_TEST(test_line_framer_split_across_chunks);
+    RUN_TEST(test_line_framer_strips_crlf);
+    RUN_TEST(test_line_framer_compacts_partial_line);
+    RUN_TEST(test_line_framer_overflow_recovers);
+    RUN_TEST(test_line_framer_recorded_session_throughput);
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "WiThrottleClient.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "lwip/sockets.h"
+#include <cstring>
+#include <string>
+
+/**
+ * @brief Loopback TCP server standing in for JMRI in WiThrottle client tests
+ */
+struct LoopbackServer {
+    int listener = -1;
+    int connection = -1;
+    uint16_t port = 0;
+
+    bool listen()
+    {
+        listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (listener < 0) {
+            return false;
+        }
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = 0;
+        if (bind(listener, (struct sockaddr*)&addr, sizeof(addr)) != 0 || ::listen(listener, 1) != 0) {
+            return false;
+        }
+        socklen_t addrLen = sizeof(addr);
+        getsockname(listener, (struct sockaddr*)&addr, &addrLen);
+        port = ntohs(addr.sin_port);
+        return true;
+    }
+
+    bool accept()
+    {
+        connection = ::accept(listener, nullptr, nullptr);
+        struct timeval timeout = { 2, 0 };
+        setsockopt(connection, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        return connection >= 0;
+    }
+
+    bool send(const std::string& data)
+    {
+        return ::send(connection, data.data(), data.size(), 0) == static_cast<int>(data.size());
+    }
+
+    // Read until @p suffix has been received (or timeout)
+    std::string readUntil(const std::string& suffix)
+    {
+        std::string received;
+        char buffer[256];
+        while (received.size() < suffix.size() ||
+               received.compare(received.size() - suffix.size(), suffix.size(), suffix) != 0) {
+            int len = recv(connection, buffer, sizeof(buffer), 0);
+            if (len <= 0) {
+                break;
+            }
+            received.append(buffer, len);
+        }
+        return received;
+    }
+
+    // Drop the client's connection as a failing link would; the listener stays up
+    void dropConnection()
+    {
+        if (connection >= 0) ::close(connection);
+        connection = -1;
+    }
+
+    void close()
+    {
+        if (connection >= 0) ::close(connection);
+        if (listener >= 0) ::close(listener);
+        connection = listener = -1;
+    }
+};
+
+// Accept the client, greet it as JMRI does and wait for its connect to complete
+inline bool acceptClient(LoopbackServer& server, WiThrottleClient& client)
+{
+    if (!server.accept() || !server.send("VN2.0\n")) {
+        return false;
+    }
+    for (int waitedMs = 0; waitedMs < 1000 && !client.isConnected(); waitedMs += 5) {
+        vTaskDelay(pdMS_TO_TICKS(5));
+    }
+    return client.isConnected();
+}
+
+inline void shutdownClient(LoopbackServer& server, WiThrottleClient& client)
+{
+    // Closing the server side ends the receive task before the client goes away
+    server.close();
+    vTaskDelay(pdMS_TO_TICKS(50));
+    client.disconnect();
+}
@@ -0,0 +1,350 @@
+#include "unity.h"
+#include "MdnsBrowser.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include <atomic>
+#include <cstring>
+
+static const char* TAG = "MdnsBrowserTests";
+
+namespace {
+    // Builds DNS packets the way JMRI's responder lays them out, with name compression
+    struct PacketWriter {
+        uint8_t data[512];
+        size_t length = 0;
+
+        void u8(uint8_t value) { data[length++] = value; }
+        void u16(uint16_t value) { u8(static_cast<uint8_t>(value >> 8)); u8(static_cast<uint8_t>(value)); }
+        void u32(uint32_t value) { u16(static_cast<uint16_t>(value >> 16)); u16(static_cast<uint16_t>(value)); }
+
+        void header(uint16_t id, uint16_t flags, uint16_t answers, uint16_t additional)
+        {
+            length = 0;
+            u16(id);
+            u16(flags);
+            u16(0);
+            u16(answers);
+            u16(0);
+            u16(additional);
+        }
+
+        // Labels of @p dotted, ended by a pointer to @p suffixOffset (or the root label if 0)
+        size_t name(const char* dotted, size_t suffixOffset = 0)
+        {
+            size_t start = length;
+            while (*dotted) {
+                const char* dot = strchr(dotted, '.');
+                size_t labelLength = dot ? static_cast<size_t>(dot - dotted) : strlen(dotted);
+                u8(static_cast<uint8_t>(labelLength));
+                memcpy(data + length, dotted, labelLength);
+                length += labelLength;
+                dotted += labelLength + (dot ? 1 : 0);
+            }
+            if (suffixOffset) {
+                pointer(suffixOffset);
+            } else {
+                u8(0);
+            }
+            return start;
+        }
+
+        void pointer(size_t offset) { u16(static_cast<uint16_t>(0xC000 | offset)); }
+
+        // Type, class, TTL; returns where to patch the data length
+        size_t recordHeader(uint16_t type, uint16_t recordClass)
+        {
+            u16(type);
+            u16(recordClass);
+            u32(120);
+            u16(0);
+            return length - 2;
+        }
+
+        void finishRecord(size_t lengthOffset)
+        {
+            uint16_t dataLength = static_cast<uint16_t>(length - lengthOffset - 2);
+            data[lengthOffset] = static_cast<uint8_t>(dataLength >> 8);
+            data[lengthOffset + 1] = static_cast<uint8_t>(dataLength);
+        }
+    };
+
+    // PTR answer plus SRV, TXT and (optionally) A additional records
+    size_t buildJmriResponse(PacketWriter& packet, uint16_t id, const char* instanceLabel, const char* hostLabel,
+                             uint16_t port, const char* address)
+    {
+        packet.header(id, 0x8400, 1, address ? 3 : 2);
+
+        size_t service = packet.name("_withrottle._tcp.local");
+        size_t local = service + 1 + 11 + 1 + 4;  // "local" inside the service name
+        size_t lengthOffset = packet.recordHeader(12, 1);
+        size_t instance = packet.name(instanceLabel, service);
+        packet.finishRecord(lengthOffset);
+
+        packet.pointer(instance);
+        lengthOffset = packet.recordHeader(33, 0x8001);
+        packet.u16(0);
+        packet.u16(0);
+        packet.u16(port);
+        size_t host = packet.name(hostLabel, local);
+        packet.finishRecord(lengthOffset);
+
+        packet.pointer(instance);
+        lengthOffset = packet.recordHeader(16, 0x8001);
+        packet.name("jmri=5.4");
+        packet.finishRecord(lengthOffset);
+
+        if (address) {
+            packet.pointer(host);
+            lengthOffset = packet.recordHeader(1, 0x8001);
+            struct in_addr in;
+            inet_aton(address, &in);
+            memcpy(packet.data + packet.length, &in.s_addr, 4);
+            packet.length += 4;
+            packet.finishRecord(lengthOffset);
+        }
+        return packet.length;
+    }
+
+    // UDP socket on loopback standing in for one mDNS responder
+    struct ResponderStandIn {
+        int sock = -1;
+        uint16_t port = 0;
+        struct sockaddr_in client;
+        uint16_t queryId = 0;
+
+        bool open()
+        {
+            sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+            struct sockaddr_in addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            if (sock < 0 || bind(sock, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+                return false;
+            }
+            socklen_t addrLength = sizeof(addr);
+            getsockname(sock, (struct sockaddr*)&addr, &addrLength);
+            port = ntohs(addr.sin_port);
+            struct timeval timeout = { 2, 0 };
+            setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+            return true;
+        }
+
+        // Wait for a query; remembers who asked
+        bool receiveQuery(uint8_t* buffer, size_t size, int& outLength)
+        {
+            socklen_t clientLength = sizeof(client);
+            outLength = recvfrom(sock, buffer, size, 0, (struct sockaddr*)&client, &clientLength);
+            if (outLength < 12) {
+                return false;
+            }
+            queryId = static_cast<uint16_t>((buffer[0] << 8) | buffer[1]);
+            return true;
+        }
+
+        bool reply(const PacketWriter& packet)
+        {
+            return sendto(sock, packet.data, packet.length, 0, (struct sockaddr*)&client, sizeof(client)) ==
+                   static_cast<int>(packet.length);
+        }
+
+        void close()
+        {
+            if (sock >= 0) ::close(sock);
+            sock = -1;
+        }
+    };
+
+    struct BrowseOutcome {
+        std::atomic<int> calls{0};
+        MdnsBrowser::Result result;
+    };
+
+    MdnsBrowser::ResultCallback recordInto(BrowseOutcome& outcome)
+    {
+        return [&outcome](const MdnsBrowser::Result& result) {
+            outcome.result = result;
+            outcome.calls++;
+        };
+    }
+
+    bool waitUntilIdle(MdnsBrowser& browser, int timeoutMs)
+    {
+        for (int waitedMs = 0; waitedMs < timeoutMs && browser.isBrowsing(); waitedMs += 5) {
+            vTaskDelay(pdMS_TO_TICKS(5));
+        }
+        return !browser.isBrowsing();
+    }
+
+    uint32_t addressOf(const char* text)
+    {
+        struct in_addr in;
+        inet_aton(text, &in);
+        return in.s_addr;
+    }
+}
+
+static void test_mdns_query_encoding(void)
+{
+    uint8_t buffer[64];
+    size_t length = MdnsBrowser::encodeQuery(buffer, sizeof(buffer), MdnsBrowser::WITHROTTLE_SERVICE, 0x1234);
+
+    static const uint8_t expected[] = {
+        0x12, 0x34, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        11, '_', 'w', 'i', 't', 'h', 'r', 'o', 't', 't', 'l', 'e',
+        4, '_', 't', 'c', 'p',
+        5, 'l', 'o', 'c', 'a', 'l',
+        0,
+        0x00, 0x0C,  // PTR
+        0x80, 0x01,  // IN, unicast response requested
+    };
+    TEST_ASSERT_EQUAL(sizeof(expected), length);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, buffer, sizeof(expected));
+
+    TEST_ASSERT_EQUAL(0, MdnsBrowser::encodeQuery(buffer, 20, MdnsBrowser::WITHROTTLE_SERVICE, 1));
+    TEST_ASSERT_EQUAL(0, MdnsBrowser::encodeQuery(buffer, sizeof(buffer), "_withrottle..local", 1));
+}
+
+static void test_mdns_parses_jmri_response(void)
+{
+    PacketWriter packet;
+    size_t length = buildJmriResponse(packet, 0, "JMRI on layout-pc", "layout-pc", 12090, "192.168.1.50");
+
+    MdnsBrowser::Result result;
+    TEST_ASSERT_TRUE(MdnsBrowser::parseResponse(packet.data, length, MdnsBrowser::WITHROTTLE_SERVICE, result));
+    TEST_ASSERT_EQUAL(12090, result.port);
+    TEST_ASSERT_EQUAL_UINT32(addressOf("192.168.1.50"), result.address.s_addr);
+    TEST_ASSERT_EQUAL_STRING("layout-pc.local", result.host);
+    TEST_ASSERT_EQUAL_STRING("JMRI on layout-pc._withrottle._tcp.local", result.instance);
+
+    // DNS names compare without case
+    TEST_ASSERT_TRUE(MdnsBrowser::parseResponse(packet.data, length, "_WiThrottle._TCP.local", result));
+
+    // Without an A record the caller supplies the address
+    length = buildJmriResponse(packet, 0, "JMRI", "layout-pc", 12091, nullptr);
+    TEST_ASSERT_TRUE(MdnsBrowser::parseResponse(packet.data, length, MdnsBrowser::WITHROTTLE_SERVICE, result));
+    TEST_ASSERT_EQUAL(12091, result.port);
+    TEST_ASSERT_EQUAL_UINT32(0, result.address.s_addr);
+}
+
+static void test_mdns_rejects_foreign_and_malformed(void)
+{
+    PacketWriter packet;
+    size_t length = buildJmriResponse(packet, 0, "JMRI on layout-pc", "layout-pc", 12090, "192.168.1.50");
+    MdnsBrowser::Result result;
+
+    TEST_ASSERT_FALSE(MdnsBrowser::parseResponse(packet.data, length, "_http._tcp.local", result));
+
+    // Every truncation is rejected or parsed without reading past the cut; the A record comes last
+    for (size_t cut = 0; cut < length; cut++) {
+        if (MdnsBrowser::parseResponse(packet.data, cut, MdnsBrowser::WITHROTTLE_SERVICE, result)) {
+            TEST_ASSERT_EQUAL(12090, result.port);
+            TEST_ASSERT_EQUAL_UINT32(0, result.address.s_addr);
+        }
+    }
+
+    // Queries are not answers
+    packet.data[2] = 0x00;
+    TEST_ASSERT_FALSE(MdnsBrowser::parseResponse(packet.data, length, MdnsBrowser::WITHROTTLE_SERVICE, result));
+
+    // A name that points at itself
+    packet.header(0, 0x8400, 1, 0);
+    packet.pointer(12);
+    packet.recordHeader(12, 1);
+    TEST_ASSERT_FALSE(MdnsBrowser::parseResponse(packet.data, packet.length, MdnsBrowser::WITHROTTLE_SERVICE, result));
+}
+
+static void test_mdns_browse_takes_first_responder(void)
+{
+    ResponderStandIn standIn;
+    TEST_ASSERT_TRUE(standIn.open());
+    struct in_addr loopback;
+    inet_aton("127.0.0.1", &loopback);
+
+    MdnsBrowser browser;
+    browser.testSetResponder(loopback, standIn.port);
+    BrowseOutcome outcome;
+
+    int64_t start = esp_timer_get_time();
+    TEST_ASSERT_EQUAL(ESP_OK, browser.start(recordInto(outcome), 2000));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, browser.start(recordInto(outcome), 2000));
+
+    uint8_t query[128];
+    int queryLength = 0;
+    TEST_ASSERT_TRUE(standIn.receiveQuery(query, sizeof(query), queryLength));
+    TEST_ASSERT_TRUE(queryLength > 12 && query[12] == 11 && memcmp(query + 13, "_withrottle", 11) == 0);
+
+    // A stale unicast answer to some other query is ignored; then two servers answer
+    PacketWriter packet;
+    buildJmriResponse(packet, static_cast<uint16_t>(standIn.queryId ^ 0x5554), "Old", "old-pc", 1, "10.0.0.1");
+    TEST_ASSERT_TRUE(standIn.reply(packet));
+    buildJmriResponse(packet, standIn.queryId, "JMRI on layout-pc", "layout-pc", 12090, "192.168.1.50");
+    TEST_ASSERT_TRUE(standIn.reply(packet));
+    buildJmriResponse(packet, 0, "JMRI on club-pc", "club-pc", 12090, "192.168.1.99");
+    TEST_ASSERT_TRUE(standIn.reply(packet));
+
+    TEST_ASSERT_TRUE(waitUntilIdle(browser, 1000));
+    ESP_LOGI(TAG, "First responder after %lld us", (long long)(esp_timer_get_time() - start));
+    TEST_ASSERT_EQUAL(1, outcome.calls.load());
+    TEST_ASSERT_EQUAL_UINT32(addressOf("192.168.1.50"), outcome.result.address.s_addr);
+    TEST_ASSERT_EQUAL(12090, outcome.result.port);
+
+    MdnsBrowser::Stats stats = browser.getStats();
+    TEST_ASSERT_EQUAL(1, stats.browses);
+    TEST_ASSERT_EQUAL(1, stats.found);
+    TEST_ASSERT_EQUAL(0, stats.timeouts);
+    TEST_ASSERT_TRUE(stats.lastFoundUs > 0 && stats.lastFoundUs < 1000000);
+
+    // Without an A record, the responder's own address is used
+    TEST_ASSERT_EQUAL(ESP_OK, browser.start(recordInto(outcome), 2000));
+    TEST_ASSERT_TRUE(standIn.receiveQuery(query, sizeof(query), queryLength));
+    buildJmriResponse(packet, standIn.queryId, "JMRI", "layout-pc", 12090, nullptr);
+    TEST_ASSERT_TRUE(standIn.reply(packet));
+    TEST_ASSERT_TRUE(waitUntilIdle(browser, 1000));
+    TEST_ASSERT_EQUAL(2, outcome.calls.load());
+    TEST_ASSERT_EQUAL_UINT32(loopback.s_addr, outcome.result.address.s_addr);
+
+    standIn.close();
+}
+
+static void test_mdns_browse_times_out_and_stops(void)
+{
+    ResponderStandIn standIn;
+    TEST_ASSERT_TRUE(standIn.open());
+    struct in_addr loopback;
+    inet_aton("127.0.0.1", &loopback);
+
+    MdnsBrowser browser;
+    browser.testSetResponder(loopback, standIn.port);
+    BrowseOutcome outcome;
+
+    // Nobody answers: the query is repeated, then the browse gives up
+    TEST_ASSERT_EQUAL(ESP_OK, browser.start(recordInto(outcome), 1200));
+    TEST_ASSERT_TRUE(waitUntilIdle(browser, 2000));
+    MdnsBrowser::Stats stats = browser.getStats();
+    TEST_ASSERT_EQUAL(0, outcome.calls.load());
+    TEST_ASSERT_EQUAL(1, stats.timeouts);
+    TEST_ASSERT_EQUAL(2, stats.queries);
+
+    // stop() cancels a long browse promptly
+    TEST_ASSERT_EQUAL(ESP_OK, browser.start(recordInto(outcome), 10000));
+    vTaskDelay(pdMS_TO_TICKS(20));
+    int64_t start = esp_timer_get_time();
+    browser.stop();
+    int64_t stopUs = esp_timer_get_time() - start;
+    TEST_ASSERT_FALSE(browser.isBrowsing());
+    TEST_ASSERT_TRUE(stopUs < 300000);
+    TEST_ASSERT_EQUAL(0, outcome.calls.load());
+    TEST_ASSERT_EQUAL(1, browser.getStats().timeouts);
+
+    standIn.close();
+}
+
+extern "C" void register_mdns_browser_tests(void)
+{
+    RUN_TEST(test_mdns_query_encoding);
+    RUN_TEST(test_mdns_parses_jmri_response);
+    RUN_TEST(test_mdns_rejects_foreign_and_malformed);
+    RUN_TEST(test_mdns_browse_takes_first_responder);
+    RUN_TEST(test_mdns_browse_times_out_and_stops);
+}
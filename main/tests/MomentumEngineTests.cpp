@@ -0,0 +1,294 @@
+#include "unity.h"
+#include "MomentumEngine.h"
+#include "ThrottleController.h"
+#include "WiThrottleClient.h"
+#include "Locomotive.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+#include <vector>
+
+static const char* TAG = "MomentumEngineTests";
+
+namespace {
+    constexpr uint32_t TICK_MS = 20;
+    constexpr uint32_t COMMAND_INTERVAL_MS = 100;  // Five ticks
+    constexpr int64_t TICK_US = TICK_MS * 1000;
+
+    // Runs ticks first to last one at a time, the way a punctual timer would
+    std::vector<MomentumEngine::Command> runTicks(MomentumEngine& engine, int first, int last)
+    {
+        std::vector<MomentumEngine::Command> sent;
+        for (int tick = first; tick <= last; tick++) {
+            MomentumEngine::Command commands[4];
+            int count = engine.advance(tick * TICK_US, commands, 4);
+            sent.insert(sent.end(), commands, commands + count);
+        }
+        return sent;
+    }
+
+    void setupThrottleWithLoco(ThrottleController& controller, int throttleId, int knobId, const char* name, int address)
+    {
+        Throttle* throttle = controller.getThrottle(throttleId);
+        Knob* knob = controller.getKnob(knobId);
+        TEST_ASSERT_TRUE(throttle->assignKnob(knobId));
+        knob->assignToThrottle(throttleId);
+        auto loco = std::make_unique<Locomotive>(name, address, Locomotive::AddressType::SHORT);
+        TEST_ASSERT_TRUE(throttle->assignLocomotive(std::move(loco)));
+        knob->startControlling();
+    }
+
+    void setupThrottleAllocatedNoKnob(ThrottleController& controller, int throttleId, int knobId, const char* name, int address)
+    {
+        setupThrottleWithLoco(controller, throttleId, knobId, name, address);
+        controller.getThrottle(throttleId)->unassignKnob();
+        controller.getKnob(knobId)->release();
+    }
+
+    int snapshotSpeed(const ThrottleController& controller, int throttleId)
+    {
+        ThrottleController::ThrottleSnapshot snapshot;
+        TEST_ASSERT_TRUE(controller.getThrottleSnapshot(throttleId, snapshot));
+        return snapshot.direction ? snapshot.currentSpeed : -snapshot.currentSpeed;
+    }
+}
+
+static void test_momentum_ramp_is_fixed_rate_and_deduplicated(void)
+{
+    MomentumEngine engine(1, TICK_MS, COMMAND_INTERVAL_MS, MomentumEngine::Rates{ 50, 50, 0 });
+    TEST_ASSERT_TRUE(engine.hasMomentum(0));
+    engine.reset(0, 0, true);
+
+    // 50 steps/s on a 20 ms tick is one step per tick; one command per five ticks
+    engine.setTarget(0, 20, 0);
+    TEST_ASSERT_TRUE(engine.isRamping(0));
+    TEST_ASSERT_TRUE(engine.isRunning());
+    auto sent = runTicks(engine, 1, 20);
+
+    const int expected[] = { 1, 6, 11, 16, 20 };
+    TEST_ASSERT_EQUAL(5, sent.size());
+    for (size_t i = 0; i < sent.size(); i++) {
+        TEST_ASSERT_EQUAL(0, sent[i].throttleId);
+        TEST_ASSERT_EQUAL(expected[i], sent[i].speed);
+        TEST_ASSERT_TRUE(sent[i].forward);
+        TEST_ASSERT_FALSE(sent[i].directionChanged);
+    }
+    TEST_ASSERT_FALSE(engine.isRamping(0));
+    TEST_ASSERT_FALSE(engine.isRunning());
+    TEST_ASSERT_EQUAL(20, engine.getSpeed(0));
+
+    MomentumEngine::ThrottleStats stats = engine.getThrottleStats(0);
+    TEST_ASSERT_EQUAL(5, stats.commands);
+    TEST_ASSERT_EQUAL(15, stats.deferred);
+    TEST_ASSERT_EQUAL(20, stats.rampTicks);
+    TEST_ASSERT_EQUAL(12, stats.commandsPerSecond(TICK_MS));
+
+    // A fifth of a step per tick: whole steps that have not moved send nothing
+    MomentumEngine slow(1, TICK_MS, COMMAND_INTERVAL_MS, MomentumEngine::Rates{ 10, 10, 0 });
+    slow.setTarget(0, 10, 0);
+    sent = runTicks(slow, 1, 60);
+    TEST_ASSERT_FALSE(slow.isRamping(0));
+    TEST_ASSERT_EQUAL(10, sent.back().speed);
+    stats = slow.getThrottleStats(0);
+    TEST_ASSERT_EQUAL(sent.size(), stats.commands);
+    TEST_ASSERT_LESS_OR_EQUAL_INT(11, static_cast<int>(stats.commands));
+    TEST_ASSERT_GREATER_THAN_INT(0, static_cast<int>(stats.unchanged));
+    for (size_t i = 1; i < sent.size(); i++) {
+        TEST_ASSERT_EQUAL(sent[i - 1].speed + 1, sent[i].speed);
+    }
+}
+
+static void test_momentum_catch_up_matches_punctual_ticks(void)
+{
+    MomentumEngine punctual(1, TICK_MS, COMMAND_INTERVAL_MS, MomentumEngine::Rates{ 37, 37, 0 });
+    MomentumEngine late(1, TICK_MS, COMMAND_INTERVAL_MS, MomentumEngine::Rates{ 37, 37, 0 });
+    punctual.setTarget(0, 126, 0);
+    late.setTarget(0, 126, 0);
+
+    auto sent = runTicks(punctual, 1, 40);
+    TEST_ASSERT_TRUE(punctual.isRamping(0));
+
+    // One wake-up 40 ticks in, 3 ms past the last of them: same ramp, only the newest command
+    MomentumEngine::Command commands[4];
+    TEST_ASSERT_EQUAL(1, late.advance(40 * TICK_US + 3000, commands, 4));
+    TEST_ASSERT_EQUAL(punctual.getSpeed(0), late.getSpeed(0));
+    TEST_ASSERT_EQUAL(sent.back().speed, commands[0].speed);
+
+    MomentumEngine::Stats stats = late.getStats();
+    TEST_ASSERT_EQUAL(40, stats.ticks);
+    TEST_ASSERT_EQUAL(39, stats.caughtUp);
+    TEST_ASSERT_EQUAL(0, stats.skipped);
+    // Late by 39 ticks and 3 ms, counted from the oldest tick due
+    TEST_ASSERT_EQUAL(39 * TICK_US + 3000, stats.jitter.getMaxUs());
+
+    // Nothing more is due until the next tick
+    TEST_ASSERT_EQUAL(0, late.advance(40 * TICK_US + 19000, commands, 4));
+    TEST_ASSERT_EQUAL(40, late.getStats().ticks);
+}
+
+static void test_momentum_reversal_passes_through_zero(void)
+{
+    MomentumEngine engine(1, TICK_MS, COMMAND_INTERVAL_MS, MomentumEngine::Rates{ 50, 50, 0 });
+    engine.reset(0, 3, true);
+    engine.setTarget(0, -3, 0);
+    auto sent = runTicks(engine, 1, 10);
+
+    // Down to zero still forward (sent at once), then the direction and speed together
+    TEST_ASSERT_EQUAL(3, sent.size());
+    TEST_ASSERT_EQUAL(2, sent[0].speed);
+    TEST_ASSERT_TRUE(sent[0].forward);
+    TEST_ASSERT_EQUAL(0, sent[1].speed);
+    TEST_ASSERT_TRUE(sent[1].forward);
+    TEST_ASSERT_FALSE(sent[1].directionChanged);
+    TEST_ASSERT_EQUAL(3, sent[2].speed);
+    TEST_ASSERT_FALSE(sent[2].forward);
+    TEST_ASSERT_TRUE(sent[2].directionChanged);
+    TEST_ASSERT_EQUAL(-3, engine.getSpeed(0));
+}
+
+static void test_momentum_brake_and_server_reports(void)
+{
+    MomentumEngine engine(1, TICK_MS, COMMAND_INTERVAL_MS, MomentumEngine::Rates{ 50, 50, 100 });
+    engine.reset(0, 20, true);
+    engine.brake(0, 0);
+    TEST_ASSERT_TRUE(engine.isBraking(0));
+    TEST_ASSERT_EQUAL(0, engine.getTarget(0));
+
+    // Two steps per tick at the brake rate, not one at the deceleration rate
+    auto sent = runTicks(engine, 1, 10);
+    TEST_ASSERT_EQUAL(0, sent.back().speed);
+    TEST_ASSERT_FALSE(engine.isBraking(0));
+    TEST_ASSERT_FALSE(engine.isRamping(0));
+
+    // A brake with nothing to stop does not start the clock
+    engine.brake(0, 11 * TICK_US);
+    TEST_ASSERT_FALSE(engine.isBraking(0));
+    TEST_ASSERT_FALSE(engine.isRunning());
+
+    // The echo of our own command leaves the ramp alone; anything else ends it
+    engine.reset(0, 10, true);
+    engine.setTarget(0, 30, 20 * TICK_US);
+    sent = runTicks(engine, 21, 21);
+    TEST_ASSERT_EQUAL(1, sent.size());
+    TEST_ASSERT_EQUAL(11, sent[0].speed);
+    TEST_ASSERT_FALSE(engine.adopt(0, 11, true));
+    TEST_ASSERT_TRUE(engine.isRamping(0));
+    TEST_ASSERT_TRUE(engine.adopt(0, 5, true));
+    TEST_ASSERT_FALSE(engine.isRamping(0));
+    TEST_ASSERT_EQUAL(5, engine.getSpeed(0));
+    TEST_ASSERT_EQUAL(5, engine.getTarget(0));
+
+    // Without acceleration or deceleration there is no momentum
+    engine.setRates(0, MomentumEngine::Rates{ 0, 0, 100 });
+    TEST_ASSERT_FALSE(engine.hasMomentum(0));
+}
+
+static void test_momentum_controller_ramps_four_throttles(void)
+{
+    WiThrottleClient client;
+    ThrottleController controller(&client);
+
+    // Throttles 2 and 3 hold locos with no knob; the knobs then move over to them
+    setupThrottleAllocatedNoKnob(controller, 2, 0, "LocoC", 30);
+    setupThrottleAllocatedNoKnob(controller, 3, 1, "LocoD", 40);
+    setupThrottleWithLoco(controller, 0, 0, "LocoA", 10);
+    setupThrottleWithLoco(controller, 1, 1, "LocoB", 20);
+    for (int i = 0; i < ThrottleController::NUM_THROTTLES; i++) {
+        controller.setMomentum(i, MomentumEngine::Rates{ 60, 60, 60 });
+    }
+    controller.resetMomentumStats();
+
+    int clicks = 10;
+    int target = clicks * ThrottleController::getSpeedStepsPerClick();
+    if (target > 126) target = 126;
+
+    int64_t start = esp_timer_get_time();
+    controller.onKnobRotation(0, clicks);
+    controller.onKnobRotation(1, clicks);
+    controller.onKnobIndicatorTouched(2, 0);
+    controller.onKnobIndicatorTouched(3, 1);
+    controller.onKnobRotation(0, clicks);
+    controller.onKnobRotation(1, clicks);
+    TEST_ASSERT_TRUE(controller.waitUntilIdle());
+
+    // The knob only moved the target; the locos are still near rest
+    TEST_ASSERT_TRUE(snapshotSpeed(controller, 0) < target);
+
+    bool settled = false;
+    while (!settled && esp_timer_get_time() - start < 10 * 1000000LL) {
+        vTaskDelay(pdMS_TO_TICKS(20));
+        settled = true;
+        for (int i = 0; i < ThrottleController::NUM_THROTTLES; i++) {
+            settled = settled && snapshotSpeed(controller, i) == target;
+        }
+    }
+    TEST_ASSERT_TRUE(settled);
+    int64_t elapsedUs = esp_timer_get_time() - start;
+    TEST_ASSERT_TRUE(controller.waitUntilIdle());
+
+    MomentumEngine::Stats stats = controller.getMomentumStats();
+    ESP_LOGI(TAG, "4 throttles to speed %d in %lld ms: %lu ticks (%lu caught up), jitter p50 %lu us p99 %lu us max %lu us",
+             target, (long long)(elapsedUs / 1000), (unsigned long)stats.ticks, (unsigned long)stats.caughtUp,
+             (unsigned long)stats.jitter.getPercentileUs(50), (unsigned long)stats.jitter.getPercentileUs(99),
+             (unsigned long)stats.jitter.getMaxUs());
+    TEST_ASSERT_EQUAL(4, stats.maxRamping);
+    TEST_ASSERT_EQUAL(0, stats.skipped);
+    TEST_ASSERT_GREATER_THAN_INT(0, static_cast<int>(stats.jitter.getCount()));
+
+    // Bounded: one command per interval, plus the first step and the end of the ramp
+    uint32_t intervalTicks = (CONFIG_THROTTLE_SPEED_MIN_INTERVAL_MS + CONFIG_THROTTLE_MOMENTUM_TICK_MS - 1) /
+                             CONFIG_THROTTLE_MOMENTUM_TICK_MS;
+    for (int i = 0; i < ThrottleController::NUM_THROTTLES; i++) {
+        MomentumEngine::ThrottleStats throttle = controller.getMomentumStats(i);
+        ESP_LOGI(TAG, "Throttle %d: %lu commands over %lu ramp ticks (%lu/s), %lu deferred",
+                 i, (unsigned long)throttle.commands, (unsigned long)throttle.rampTicks,
+                 (unsigned long)throttle.commandsPerSecond(CONFIG_THROTTLE_MOMENTUM_TICK_MS),
+                 (unsigned long)throttle.deferred);
+        TEST_ASSERT_GREATER_THAN_INT(1, static_cast<int>(throttle.commands));
+        TEST_ASSERT_LESS_OR_EQUAL_INT(static_cast<int>(throttle.rampTicks / intervalTicks + 2),
+                                      static_cast<int>(throttle.commands));
+        TEST_ASSERT_TRUE(static_cast<int>(throttle.commands) < target);
+    }
+}
+
+static void test_momentum_knob_press_brakes_then_stops(void)
+{
+    WiThrottleClient client;
+    ThrottleController controller(&client);
+    setupThrottleWithLoco(controller, 0, 0, "LocoE", 50);
+    controller.setMomentum(0, MomentumEngine::Rates{ 500, 500, 20 });
+
+    controller.onKnobRotation(0, 5);
+    int target = 5 * ThrottleController::getSpeedStepsPerClick();
+    for (int waitedMs = 0; waitedMs < 2000 && snapshotSpeed(controller, 0) != target; waitedMs += 10) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    TEST_ASSERT_EQUAL(target, snapshotSpeed(controller, 0));
+
+    // First press brakes gently: still moving, but slower
+    controller.onKnobPress(0);
+    vTaskDelay(pdMS_TO_TICKS(300));
+    int braking = snapshotSpeed(controller, 0);
+    TEST_ASSERT_TRUE(braking < target);
+    TEST_ASSERT_GREATER_THAN_INT(0, braking);
+
+    // Second press stops at once and ends the ramp
+    controller.onKnobPress(0);
+    TEST_ASSERT_TRUE(controller.waitUntilIdle());
+    TEST_ASSERT_EQUAL(0, snapshotSpeed(controller, 0));
+    vTaskDelay(pdMS_TO_TICKS(100));
+    TEST_ASSERT_TRUE(controller.waitUntilIdle());
+    TEST_ASSERT_EQUAL(0, snapshotSpeed(controller, 0));
+}
+
+extern "C" void register_momentum_engine_tests(void)
+{
+    RUN_TEST(test_momentum_ramp_is_fixed_rate_and_deduplicated);
+    RUN_TEST(test_momentum_catch_up_matches_punctual_ticks);
+    RUN_TEST(test_momentum_reversal_passes_through_zero);
+    RUN_TEST(test_momentum_brake_and_server_reports);
+    RUN_TEST(test_momentum_controller_ramps_four_throttles);
+    RUN_TEST(test_momentum_knob_press_brakes_then_stops);
+}
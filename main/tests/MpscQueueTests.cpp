@@ -0,0 +1,131 @@
+#include "unity.h"
+#include "MpscQueue.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <atomic>
+
+static const char* TAG = "MpscQueueTests";
+
+namespace {
+    constexpr int PRODUCER_TASKS = 4;
+    constexpr uint32_t VALUES_PER_PRODUCER = 20000;
+
+    struct Item {
+        uint32_t producer;
+        uint32_t sequence;
+    };
+
+    struct StressContext {
+        MpscQueue<Item>* queue = nullptr;
+        std::atomic<int> finished{0};
+        std::atomic<uint32_t> fullRetries{0};
+    };
+
+    struct ProducerArgs {
+        StressContext* context;
+        uint32_t producer;
+    };
+
+    void producerTask(void* arg)
+    {
+        ProducerArgs* args = static_cast<ProducerArgs*>(arg);
+        for (uint32_t i = 0; i < VALUES_PER_PRODUCER; i++) {
+            Item item = { args->producer, i };
+            while (!args->context->queue->tryPush(item)) {
+                args->context->fullRetries++;
+                vTaskDelay(1);
+            }
+        }
+        args->context->finished++;
+        vTaskDelete(nullptr);
+    }
+}
+
+static void test_mpsc_queue_order_and_capacity(void)
+{
+    MpscQueue<Item> queue(5);  // Rounded up to 8
+    TEST_ASSERT_EQUAL(8, queue.capacity());
+    TEST_ASSERT_TRUE(queue.empty());
+
+    Item item;
+    TEST_ASSERT_FALSE(queue.tryPop(item));
+
+    for (uint32_t i = 0; i < 8; i++) {
+        uint32_t depth = 99;
+        TEST_ASSERT_TRUE(queue.tryPush(Item{ 0, i }, &depth));
+        TEST_ASSERT_EQUAL(i, depth);
+    }
+    TEST_ASSERT_FALSE(queue.tryPush(Item{ 0, 8 }));
+    TEST_ASSERT_EQUAL(8, queue.size());
+    TEST_ASSERT_EQUAL(8, queue.pushCount());
+
+    // Freed cells are reused on the next lap, in order
+    for (uint32_t i = 0; i < 3; i++) {
+        TEST_ASSERT_TRUE(queue.tryPop(item));
+        TEST_ASSERT_EQUAL(i, item.sequence);
+    }
+    for (uint32_t i = 8; i < 11; i++) {
+        TEST_ASSERT_TRUE(queue.tryPush(Item{ 0, i }));
+    }
+    TEST_ASSERT_FALSE(queue.tryPush(Item{ 0, 11 }));
+    for (uint32_t i = 3; i < 11; i++) {
+        TEST_ASSERT_TRUE(queue.tryPop(item));
+        TEST_ASSERT_EQUAL(i, item.sequence);
+    }
+    TEST_ASSERT_FALSE(queue.tryPop(item));
+    TEST_ASSERT_TRUE(queue.empty());
+}
+
+static void test_mpsc_queue_concurrent_producers(void)
+{
+    MpscQueue<Item> queue(64);
+    StressContext context;
+    context.queue = &queue;
+    ProducerArgs args[PRODUCER_TASKS];
+
+    int64_t start = esp_timer_get_time();
+    for (int i = 0; i < PRODUCER_TASKS; i++) {
+        args[i] = ProducerArgs{ &context, static_cast<uint32_t>(i) };
+        TEST_ASSERT_EQUAL(pdPASS, xTaskCreate(producerTask, "mpsc_producer", 3072, &args[i], 5, nullptr));
+    }
+
+    // Every value arrives exactly once, and each producer's values in the order pushed
+    uint32_t nextSequence[PRODUCER_TASKS] = {0};
+    uint32_t received = 0;
+    uint32_t outOfOrder = 0;
+    Item item;
+    while (received < PRODUCER_TASKS * VALUES_PER_PRODUCER) {
+        if (!queue.tryPop(item)) {
+            TEST_ASSERT_TRUE(esp_timer_get_time() - start < 30 * 1000000LL);
+            taskYIELD();
+            continue;
+        }
+        TEST_ASSERT_TRUE(item.producer < PRODUCER_TASKS);
+        if (item.sequence != nextSequence[item.producer]) {
+            outOfOrder++;
+        }
+        nextSequence[item.producer] = item.sequence + 1;
+        received++;
+    }
+    while (context.finished < PRODUCER_TASKS) {
+        vTaskDelay(1);
+    }
+    int64_t elapsedUs = esp_timer_get_time() - start;
+
+    ESP_LOGI(TAG, "%lu values from %d producers in %lld us (%lu full-queue retries)",
+             (unsigned long)received, PRODUCER_TASKS, (long long)elapsedUs,
+             (unsigned long)context.fullRetries.load());
+    TEST_ASSERT_EQUAL(0, outOfOrder);
+    for (int i = 0; i < PRODUCER_TASKS; i++) {
+        TEST_ASSERT_EQUAL(VALUES_PER_PRODUCER, nextSequence[i]);
+    }
+    TEST_ASSERT_FALSE(queue.tryPop(item));
+}
+
+extern "C" void register_mpsc_queue_tests(void)
+{
+    RUN_TEST(test_mpsc_queue_order_and_capacity);
+    RUN_TEST(test_mpsc_queue_concurrent_producers);
+}
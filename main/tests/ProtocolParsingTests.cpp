@@ -1,6 +1,12 @@
 #include "unity.h"
 #include "WiThrottleClient.h"
 #include "JmriJsonClient.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include <cstring>
+#include <string>
+
+static const char* TAG = "ProtocolParsingTests";
 
 static void test_withrottle_roster_parsing(void)
 {
@@ -8,12 +14,13 @@ static void test_withrottle_roster_parsing(void)
     client.initialize();
 
     bool rosterCalled = false;
-    client.setRosterCallback([&](const std::vector<WiThrottleClient::Locomotive>& roster) {
+    client.setRosterCallback([&](const RosterHandle& roster) {
         rosterCalled = true;
-        TEST_ASSERT_EQUAL(2, roster.size());
-        TEST_ASSERT_EQUAL_STRING("LocoA", roster[0].name.c_str());
-        TEST_ASSERT_EQUAL(3, roster[0].address);
-        TEST_ASSERT_EQUAL('S', roster[0].addressType);
+        TEST_ASSERT_NOT_NULL(roster.get());
+        TEST_ASSERT_EQUAL(2, roster->size());
+        TEST_ASSERT_TRUE((*roster)[0].name == "LocoA");
+        TEST_ASSERT_EQUAL(3, (*roster)[0].address);
+        TEST_ASSERT_EQUAL('S', (*roster)[0].addressType);
     });
 
     // RL2]\[LocoA}|{3}|{S]\[LocoB}|{40}|{L
@@ -44,6 +51,99 @@ static void test_withrottle_throttle_update_parsing(void)
     TEST_ASSERT_TRUE(updateCalled);
 }
 
+static void test_withrottle_dispatch_counts_by_type(void)
+{
+    WiThrottleClient client;
+    client.initialize();
+
+    // No callbacks subscribed: every type is still counted
+    const char* messages[] = {
+        "VN2.0", "RL0]", "RCC0", "PPA1", "PW12080", "PTT]\\[Turnouts}|{Turnout",
+        "PTL]\\[LT12}|{Rico}|{2", "PTA4LT12", "PRT]\\[Routes}|{Route", "PRL]\\[IR1}|{Main}|{2",
+        "PRA2IR1", "PFT1700000000<;>4.0", "HTJMRI", "HtJMRI v5", "HmWelcome", "HMShort circuit",
+        "*10", "M0AS3<;>V50", "M0+S3<;>", "M0-S3<;>", "M1SL4014<;>L4014", "M0LS3<;>]\\[Lights",
+        "Xunknown"
+    };
+    for (const char* message : messages) {
+        client.testProcessMessage(message);
+    }
+    client.testProcessMessage("M2AL4014<;>V10");
+
+    for (int i = 0; i < static_cast<int>(WiThrottleClient::MessageType::COUNT); i++) {
+        auto type = static_cast<WiThrottleClient::MessageType>(i);
+        uint32_t expected = (type == WiThrottleClient::MessageType::THROTTLE_ACTION) ? 2 : 1;
+        TEST_ASSERT_EQUAL_MESSAGE(expected, client.getMessageStats(type).messages,
+                                  WiThrottleClient::getMessageTypeName(type));
+    }
+    TEST_ASSERT_EQUAL(strlen("M0AS3<;>V50") + strlen("M2AL4014<;>V10"),
+                      client.getMessageStats(WiThrottleClient::MessageType::THROTTLE_ACTION).bytes);
+
+    client.resetMessageStats();
+    TEST_ASSERT_EQUAL(0, client.getMessageStats(WiThrottleClient::MessageType::POWER).messages);
+}
+
+static void test_withrottle_layout_messages(void)
+{
+    WiThrottleClient client;
+    client.initialize();
+
+    std::string turnouts;
+    client.setTurnoutCallback([&](std::string_view systemName, char state) {
+        turnouts += std::string(systemName) + "=" + state + ";";
+    });
+    std::string routes;
+    client.setRouteCallback([&](std::string_view systemName, char state) {
+        routes += std::string(systemName) + "=" + state + ";";
+    });
+    uint32_t clockSeconds = 0;
+    float clockRate = 0.0f;
+    client.setFastClockCallback([&](uint32_t seconds, float rate) {
+        clockSeconds = seconds;
+        clockRate = rate;
+    });
+    std::string alert;
+    client.setAlertCallback([&](bool isAlert, std::string_view text) {
+        if (isAlert) {
+            alert = std::string(text);
+        }
+    });
+
+    client.testProcessMessage("PTL]\\[LT12}|{Rico Station N}|{1]\\[LT324}|{Rico Station S}|{2");
+    client.testProcessMessage("PTA4LT12");
+    TEST_ASSERT_EQUAL_STRING("LT12=1;LT324=2;LT12=4;", turnouts.c_str());
+
+    client.testProcessMessage("PRL]\\[IR:AUTO:0001}|{Rico Main}|{4");
+    client.testProcessMessage("PRA2IR:AUTO:0001");
+    TEST_ASSERT_EQUAL_STRING("IR:AUTO:0001=4;IR:AUTO:0001=2;", routes.c_str());
+
+    client.testProcessMessage("PFT1700000000<;>4.0");
+    TEST_ASSERT_EQUAL(1700000000u, clockSeconds);
+    TEST_ASSERT_TRUE(clockRate > 3.99f && clockRate < 4.01f);
+
+    client.testProcessMessage("HmJust so you know");
+    client.testProcessMessage("HMShort circuit on main");
+    TEST_ASSERT_EQUAL_STRING("Short circuit on main", alert.c_str());
+}
+
+static void test_withrottle_throttle_events(void)
+{
+    WiThrottleClient client;
+    client.initialize();
+
+    std::string events;
+    client.setThrottleEventCallback([&](char throttleId, WiThrottleClient::ThrottleEvent event,
+                                        int address, char addressType) {
+        const char* name = event == WiThrottleClient::ThrottleEvent::ADDED ? "add"
+                         : event == WiThrottleClient::ThrottleEvent::REMOVED ? "remove" : "steal";
+        events += std::string(1, throttleId) + name + addressType + std::to_string(address) + ";";
+    });
+
+    client.testProcessMessage("M0+S3<;>");
+    client.testProcessMessage("M1SL4014<;>L4014");
+    client.testProcessMessage("M0-S3<;>");
+    TEST_ASSERT_EQUAL_STRING("0addS3;1stealL4014;0removeS3;", events.c_str());
+}
+
 static void test_jmri_power_parsing(void)
 {
     JmriJsonClient client;
@@ -62,9 +162,187 @@ static void test_jmri_power_parsing(void)
     TEST_ASSERT_EQUAL((int)JmriJsonClient::PowerState::ON, (int)client.getPower());
 }
 
+static void test_jmri_power_list_parsing(void)
+{
+    JmriJsonClient client;
+    client.initialize();
+    client.setConfiguredPowerName("LocoNet");
+
+    int calls = 0;
+    client.setPowerStateCallback([&](const std::string& name, JmriJsonClient::PowerState state) {
+        calls++;
+        TEST_ASSERT_EQUAL_STRING("LocoNet", name.c_str());
+        TEST_ASSERT_EQUAL((int)JmriJsonClient::PowerState::OFF, (int)state);
+    });
+
+    // List response; nested "name"/"state" fields must not be mistaken for the element's own
+    client.testProcessMessage(
+        "[{\"type\":\"power\",\"data\":{\"meta\":{\"name\":\"LocoNet\",\"state\":2},"
+        "\"name\":\"DCC++\",\"state\":2}},"
+        "{\"data\":{\"name\":\"LocoNet\",\"state\":4},\"type\":\"power\"}]");
+
+    TEST_ASSERT_EQUAL(1, calls);
+    TEST_ASSERT_EQUAL((int)JmriJsonClient::PowerState::OFF, (int)client.getPower());
+}
+
+// A power list padded with sensors, large enough to span many WebSocket events
+static std::string largePowerList()
+{
+    std::string json = "[";
+    for (int i = 1; i <= 100; i++) {
+        json += "{\"type\":\"sensor\",\"data\":{\"name\":\"IS" + std::to_string(i) +
+                "\",\"userName\":\"Block " + std::to_string(i) + " occupancy\",\"state\":4}},";
+    }
+    json += "{\"type\":\"power\",\"data\":{\"name\":\"main\",\"state\":2}}]";
+    return json;
+}
+
+static void test_jmri_fragmented_frames(void)
+{
+    JmriJsonClient client;
+    client.initialize();
+    client.setConfiguredPowerName("main");
+
+    int calls = 0;
+    client.setPowerStateCallback([&](const std::string&, JmriJsonClient::PowerState) { calls++; });
+
+    // One text frame delivered in buffer-sized DATA events
+    const std::string json = largePowerList();
+    const size_t chunk = 1024;
+    TEST_ASSERT_TRUE(json.size() > 4 * chunk);
+    for (size_t offset = 0; offset < json.size(); offset += chunk) {
+        std::string_view part = std::string_view(json).substr(offset, chunk);
+        client.testProcessFragment(0x01, part, offset, json.size(), true);
+    }
+    TEST_ASSERT_EQUAL(1, calls);
+
+    // The same message as a text frame plus two continuation frames
+    client.testProcessMessage("{\"type\":\"power\",\"data\":{\"name\":\"main\",\"state\":4}}");
+    size_t first = json.size() / 3;
+    size_t second = json.size() / 2;
+    std::string_view view(json);
+    client.testProcessFragment(0x01, view.substr(0, first), 0, first, false);
+    client.testProcessFragment(0x09, "ping", 0, 4, true);  // Control frames may interleave
+    client.testProcessFragment(0x00, view.substr(first, second - first), 0, second - first, false);
+    client.testProcessFragment(0x00, view.substr(second, chunk), 0, json.size() - second, true);
+    client.testProcessFragment(0x00, view.substr(second + chunk), chunk, json.size() - second, true);
+    TEST_ASSERT_EQUAL(3, calls);
+    TEST_ASSERT_EQUAL((int)JmriJsonClient::PowerState::ON, (int)client.getPower());
+
+    JmriJsonClient::FrameStats stats = client.getFrameStats();
+    TEST_ASSERT_EQUAL(3, stats.messages);
+    TEST_ASSERT_EQUAL((json.size() + chunk - 1) / chunk, stats.maxFragments);
+    TEST_ASSERT_EQUAL(json.size(), stats.largestBytes);
+    TEST_ASSERT_EQUAL(0, stats.discarded);
+    client.logFrameStats();
+}
+
+static void test_jmri_fragment_gap_discards_message(void)
+{
+    JmriJsonClient client;
+    client.initialize();
+    client.setConfiguredPowerName("main");
+
+    int calls = 0;
+    client.setPowerStateCallback([&](const std::string&, JmriJsonClient::PowerState) { calls++; });
+
+    // Middle event lost: the power element at the end must not be applied
+    const std::string json = largePowerList();
+    std::string_view view(json);
+    client.testProcessFragment(0x01, view.substr(0, 1024), 0, json.size(), true);
+    client.testProcessFragment(0x01, view.substr(2048), 2048, json.size(), true);
+    TEST_ASSERT_EQUAL(0, calls);
+    TEST_ASSERT_EQUAL(1, client.getFrameStats().discarded);
+
+    // The next message is parsed normally
+    client.testProcessMessage("{\"type\":\"power\",\"data\":{\"name\":\"main\",\"state\":2}}");
+    TEST_ASSERT_EQUAL(1, calls);
+    TEST_ASSERT_EQUAL(2, client.getFrameStats().messages);
+}
+
+static void test_jmri_oversized_message_is_skipped(void)
+{
+    JmriJsonClient client;
+    client.initialize();
+    client.setConfiguredPowerName("main");
+
+    int calls = 0;
+    client.setPowerStateCallback([&](const std::string&, JmriJsonClient::PowerState) { calls++; });
+
+    // Whitespace padding past the cap, without building the message in memory
+    const std::string element = "[{\"type\":\"power\",\"data\":{\"name\":\"main\",\"state\":2}}";
+    const std::string padding(2048, ' ');
+    const size_t total = element.size() + (CONFIG_JMRI_JSON_MAX_MESSAGE_SIZE / padding.size() + 1) * padding.size() + 1;
+    size_t offset = 0;
+    client.testProcessFragment(0x01, element, offset, total, true);
+    offset += element.size();
+    while (offset + 1 < total) {
+        client.testProcessFragment(0x01, padding, offset, total, true);
+        offset += padding.size();
+    }
+    client.testProcessFragment(0x01, "]", offset, total, true);
+
+    // Elements before the cap are still delivered; the rest is drained unparsed
+    TEST_ASSERT_EQUAL(1, calls);
+    JmriJsonClient::FrameStats stats = client.getFrameStats();
+    TEST_ASSERT_EQUAL(1, stats.messages);
+    TEST_ASSERT_EQUAL(1, stats.oversized);
+    TEST_ASSERT_EQUAL(0, stats.discarded);
+    TEST_ASSERT_EQUAL(total, stats.largestBytes);
+
+    client.resetFrameStats();
+    TEST_ASSERT_EQUAL(0, client.getFrameStats().messages);
+}
+
+static void test_jmri_hello_does_not_block_event_task(void)
+{
+    JmriJsonClient client;
+    client.initialize();
+    client.setConfiguredPowerName("main");
+
+    // Runs on the WebSocket event task: the subscribe is queued, not sent inline
+    int64_t start = esp_timer_get_time();
+    client.testProcessMessage("{\"type\":\"hello\",\"data\":{\"JMRI\":\"5.8\",\"json\":\"5.0\"}}");
+    int64_t elapsedUs = esp_timer_get_time() - start;
+
+    ESP_LOGI(TAG, "hello handled in %lld us", (long long)elapsedUs);
+    TEST_ASSERT_TRUE(elapsedUs < 10000);
+    TEST_ASSERT_EQUAL(1, client.getTxStats().queued);
+}
+
+static void test_jmri_send_never_blocks_caller(void)
+{
+    JmriJsonClient client;
+    client.initialize();
+
+    // No writer is draining, as when it is stuck in a send to a slow host:
+    // callers must see a full queue immediately rather than wait for it
+    const char* hello = "{\"type\":\"hello\",\"data\":{}}";
+    const int extra = 4;
+    for (int i = 0; i < CONFIG_JMRI_JSON_TX_QUEUE_LENGTH + extra; i++) {
+        client.testProcessMessage(hello);
+    }
+
+    JmriJsonClient::TxStats stats = client.getTxStats();
+    ESP_LOGI(TAG, "Worst caller wait with a stalled writer: %lu us", (unsigned long)stats.maxEnqueueUs);
+    TEST_ASSERT_EQUAL(CONFIG_JMRI_JSON_TX_QUEUE_LENGTH, stats.queued);
+    TEST_ASSERT_EQUAL(extra, stats.dropped);
+    TEST_ASSERT_TRUE(stats.maxEnqueueUs < 1000);
+    client.logTxStats();
+}
+
 extern "C" void register_protocol_tests(void)
 {
     RUN_TEST(test_withrottle_roster_parsing);
     RUN_TEST(test_withrottle_throttle_update_parsing);
+    RUN_TEST(test_withrottle_dispatch_counts_by_type);
+    RUN_TEST(test_withrottle_layout_messages);
+    RUN_TEST(test_withrottle_throttle_events);
     RUN_TEST(test_jmri_power_parsing);
+    RUN_TEST(test_jmri_power_list_parsing);
+    RUN_TEST(test_jmri_fragmented_frames);
+    RUN_TEST(test_jmri_fragment_gap_discards_message);
+    RUN_TEST(test_jmri_oversized_message_is_skipped);
+    RUN_TEST(test_jmri_hello_does_not_block_event_task);
+    RUN_TEST(test_jmri_send_never_blocks_caller);
 }
@@ -0,0 +1,193 @@
+#include "unity.h"
+#include "RosterSnapshot.h"
+#include "WiThrottleClient.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include <string>
+
+static const char* TAG = "RosterSnapshotTests";
+
+static std::string buildRosterMessage(int count)
+{
+    std::string message = "RL" + std::to_string(count) + "]";
+    for (int i = 0; i < count; i++) {
+        int address = 3 + i;
+        message += "\\[Loco " + std::to_string(i) + " Class 66}|{" + std::to_string(address) +
+                   "}|{" + (address > 127 ? "L" : "S") + "]";
+    }
+    message.pop_back();  // No ] after the last entry
+    return message;
+}
+
+static void test_roster_snapshot_parses_entries(void)
+{
+    RosterHandle roster = RosterSnapshot::parse("RL3]\\[56086}|{3}|{S]\\[Shunter}|{4}|{S]\\[Class 66 {Freight}}|{6601}|{L");
+    TEST_ASSERT_NOT_NULL(roster.get());
+    TEST_ASSERT_EQUAL(3, roster->size());
+
+    TEST_ASSERT_TRUE((*roster)[0].name == "56086");
+    TEST_ASSERT_EQUAL(3, (*roster)[0].address);
+    TEST_ASSERT_EQUAL('S', (*roster)[0].addressType);
+
+    TEST_ASSERT_TRUE((*roster)[1].name == "Shunter");
+    TEST_ASSERT_EQUAL(4, (*roster)[1].address);
+
+    // Braces inside a name are not a field delimiter
+    TEST_ASSERT_TRUE((*roster)[2].name == "Class 66 {Freight}");
+    TEST_ASSERT_EQUAL(6601, (*roster)[2].address);
+    TEST_ASSERT_EQUAL('L', (*roster)[2].addressType);
+}
+
+static void test_roster_snapshot_handles_bad_input(void)
+{
+    TEST_ASSERT_NULL(RosterSnapshot::parse("RX2]").get());
+    TEST_ASSERT_NULL(RosterSnapshot::parse("RL").get());
+    TEST_ASSERT_NULL(RosterSnapshot::parse("RL2").get());
+
+    RosterHandle empty = RosterSnapshot::parse("RL0]");
+    TEST_ASSERT_NOT_NULL(empty.get());
+    TEST_ASSERT_TRUE(empty->empty());
+
+    // Announced more than sent: keep what was complete
+    RosterHandle truncated = RosterSnapshot::parse("RL3]\\[LocoA}|{3}|{S]\\[LocoB}|{4");
+    TEST_ASSERT_NOT_NULL(truncated.get());
+    TEST_ASSERT_EQUAL(1, truncated->size());
+    TEST_ASSERT_TRUE((*truncated)[0].name == "LocoA");
+}
+
+static void test_roster_swap_keeps_readers_valid(void)
+{
+    WiThrottleClient client;
+    client.initialize();
+    TEST_ASSERT_NULL(client.getRosterSnapshot().get());
+
+    client.testProcessMessage("RL1]\\[Old}|{3}|{S");
+    RosterHandle held = client.getRosterSnapshot();
+    TEST_ASSERT_NOT_NULL(held.get());
+
+    client.testProcessMessage("RL2]\\[New}|{4}|{S]\\[Other}|{5}|{S");
+    RosterHandle current = client.getRosterSnapshot();
+
+    // The reader's snapshot is unchanged by the update
+    TEST_ASSERT_TRUE(held.get() != current.get());
+    TEST_ASSERT_EQUAL(1, held->size());
+    TEST_ASSERT_TRUE((*held)[0].name == "Old");
+    TEST_ASSERT_EQUAL(2, client.getRosterSize());
+
+    WiThrottleClient::Locomotive loco;
+    TEST_ASSERT_TRUE(client.getRosterEntry(1, loco));
+    TEST_ASSERT_EQUAL_STRING("Other", loco.name.c_str());
+    TEST_ASSERT_FALSE(client.getRosterEntry(2, loco));
+}
+
+static void test_roster_snapshot_scaling(void)
+{
+    const int sizes[] = { 50, 500, 5000 };
+
+    for (int count : sizes) {
+        std::string message = buildRosterMessage(count);
+
+        size_t heapBefore = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+        int64_t start = esp_timer_get_time();
+        RosterHandle roster = RosterSnapshot::parse(message);
+        int64_t elapsedUs = esp_timer_get_time() - start;
+        size_t heapHeld = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+
+        TEST_ASSERT_NOT_NULL(roster.get());
+        TEST_ASSERT_EQUAL(count, static_cast<int>(roster->size()));
+        TEST_ASSERT_EQUAL(count - 1 + 3, (*roster)[count - 1].address);
+
+        // Everything the snapshot holds is in the arena (plus the handle itself)
+        ESP_LOGI(TAG, "RL %d entries: %u byte message parsed in %lld us, arena %u bytes, heap used %d",
+                 count, (unsigned)message.size(), (long long)elapsedUs,
+                 (unsigned)roster->getArenaBytes(), (int)heapBefore - (int)heapHeld);
+
+        roster.reset();
+        TEST_ASSERT_EQUAL(heapBefore, heap_caps_get_free_size(MALLOC_CAP_8BIT));
+    }
+}
+
+static void test_roster_builder_packs_function_labels(void)
+{
+    RosterSnapshot::Builder builder;
+    builder.setFunctionLabel(0, "Lights");
+    builder.setFunctionLabel(2, "Horn");
+    builder.addEntry("GWR 4073", 4073, 'L');
+    builder.addEntry("Shunter", 3, 'S');  // Labels do not carry over
+    builder.setFunctionLabel(1, "Bell\nRing");
+    builder.discardLabels();
+    builder.setFunctionLabel(1, "Whistle");
+    builder.addEntry("Tank", 47, 'S');
+    RosterHandle roster = builder.finish();
+    TEST_ASSERT_NOT_NULL(roster.get());
+    TEST_ASSERT_TRUE(builder.empty());
+
+    TEST_ASSERT_EQUAL(3, roster->size());
+    RosterSnapshot::Entry first = (*roster)[0];
+    TEST_ASSERT_TRUE(first.name == "GWR 4073");
+    TEST_ASSERT_TRUE(first.functionLabels == "Lights\n\nHorn");
+    TEST_ASSERT_TRUE(first.functionLabel(0) == "Lights");
+    TEST_ASSERT_TRUE(first.functionLabel(1).empty());
+    TEST_ASSERT_TRUE(first.functionLabel(2) == "Horn");
+    TEST_ASSERT_TRUE(first.functionLabel(3).empty());
+    TEST_ASSERT_TRUE((*roster)[1].functionLabels.empty());
+    TEST_ASSERT_TRUE((*roster)[2].functionLabel(1) == "Whistle");
+
+    std::vector<std::string> labels;
+    first.getFunctionLabels(labels);
+    TEST_ASSERT_EQUAL(RosterSnapshot::MAX_FUNCTION_LABELS, labels.size());
+    TEST_ASSERT_EQUAL_STRING("Lights", labels[0].c_str());
+    TEST_ASSERT_EQUAL_STRING("Horn", labels[2].c_str());
+    TEST_ASSERT_TRUE(labels[28].empty());
+
+    // Roster lines carry no labels
+    RosterHandle parsed = RosterSnapshot::parse("RL1]\\[LocoA}|{3}|{S");
+    TEST_ASSERT_TRUE((*parsed)[0].functionLabels.empty());
+}
+
+static void test_roster_incremental_updates(void)
+{
+    RosterSnapshot::Builder builder;
+    builder.addEntry("LocoA", 3, 'S');
+    builder.setFunctionLabel(0, "Lights");
+    builder.addEntry("LocoB", 4, 'S');
+    RosterHandle base = builder.finish();
+
+    // Update in place keeps the order and leaves the base untouched
+    builder.setFunctionLabel(0, "Headlight");
+    builder.addEntry("LocoB", 1004, 'L');
+    RosterHandle change = builder.finish();
+    RosterHandle updated = RosterSnapshot::withEntry(base, (*change)[0]);
+    TEST_ASSERT_EQUAL(2, updated->size());
+    TEST_ASSERT_TRUE((*updated)[0].name == "LocoA");
+    TEST_ASSERT_EQUAL(1004, (*updated)[1].address);
+    TEST_ASSERT_EQUAL('L', (*updated)[1].addressType);
+    TEST_ASSERT_TRUE((*updated)[1].functionLabel(0) == "Headlight");
+    TEST_ASSERT_EQUAL(4, (*base)[1].address);
+    TEST_ASSERT_TRUE((*base)[1].functionLabel(0) == "Lights");
+
+    // New names are appended, including to an empty roster
+    RosterSnapshot::Entry added{ "LocoC", 5, 'S', "" };
+    RosterHandle grown = RosterSnapshot::withEntry(updated, added);
+    TEST_ASSERT_EQUAL(3, grown->size());
+    TEST_ASSERT_EQUAL(2, grown->find("LocoC"));
+    TEST_ASSERT_EQUAL(1, RosterSnapshot::withEntry(nullptr, added)->size());
+
+    // Removal
+    RosterHandle shrunk = RosterSnapshot::withoutEntry(grown, "LocoA");
+    TEST_ASSERT_EQUAL(2, shrunk->size());
+    TEST_ASSERT_EQUAL(-1, shrunk->find("LocoA"));
+    TEST_ASSERT_TRUE((*shrunk)[0].functionLabel(0) == "Headlight");
+    TEST_ASSERT_TRUE(RosterSnapshot::withoutEntry(shrunk, "Missing") == shrunk);
+}
+
+extern "C" void register_roster_snapshot_tests(void)
+{
+    RUN_TEST(test_roster_snapshot_parses_entries);
+    RUN_TEST(test_roster_snapshot_handles_bad_input);
+    RUN_TEST(test_roster_swap_keeps_readers_valid);
+    RUN_TEST(test_roster_snapshot_scaling);
+    RUN_TEST(test_roster_builder_packs_function_labels);
+    RUN_TEST(test_roster_incremental_updates);
+}
@@ -0,0 +1,282 @@
+#include "unity.h"
+#include "Scheduler.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+static const char* TAG = "SchedulerTests";
+
+namespace {
+    // Records job runs; jobs call in from the scheduler task
+    struct RunLog {
+        std::mutex mutex;
+        std::vector<char> runs;
+
+        void record(char job)
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            runs.push_back(job);
+        }
+
+        std::vector<char> copy()
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            return runs;
+        }
+    };
+
+    // Stand-in for the dedicated tasks the scheduler replaced: sleeps until told to exit
+    void sleepingTask(void* arg)
+    {
+        auto* exit = static_cast<std::atomic<bool>*>(arg);
+        while (!*exit) {
+            vTaskDelay(pdMS_TO_TICKS(5));
+        }
+        vTaskDelete(NULL);
+    }
+
+    struct CancelRequest {
+        Scheduler* scheduler;
+        Scheduler::JobId id;
+        std::atomic<bool> finishedBefore{false};  // Callback done when cancel() returned
+        std::atomic<bool> returned{false};
+        const std::atomic<bool>* finished;
+    };
+
+    // Cancels a job from a second task, so two callers wait on the same run
+    void cancelTask(void* arg)
+    {
+        auto* request = static_cast<CancelRequest*>(arg);
+        request->scheduler->cancel(request->id);
+        request->finishedBefore = request->finished->load();
+        request->returned = true;
+        vTaskDelete(NULL);
+    }
+}
+
+static void test_scheduler_once_periodic_and_cancel(void)
+{
+    Scheduler scheduler("sched_test");
+    std::atomic<int> onceRuns{0};
+    std::atomic<int> periodicRuns{0};
+
+    Scheduler::JobId once = scheduler.scheduleOnce(20, Scheduler::Priority::NORMAL, [&]() { onceRuns++; });
+    Scheduler::JobId periodic = scheduler.schedulePeriodic(20, Scheduler::Priority::NORMAL, [&]() { periodicRuns++; });
+    Scheduler::JobId cancelled = scheduler.scheduleOnce(30, Scheduler::Priority::NORMAL, [&]() { onceRuns += 100; });
+    TEST_ASSERT_TRUE(once != Scheduler::INVALID_JOB);
+    TEST_ASSERT_TRUE(periodic != Scheduler::INVALID_JOB);
+    TEST_ASSERT_TRUE(scheduler.cancel(cancelled));
+    TEST_ASSERT_FALSE(scheduler.isScheduled(cancelled));
+    TEST_ASSERT_EQUAL(2, scheduler.getStats().activeJobs);
+
+    vTaskDelay(pdMS_TO_TICKS(110));
+    TEST_ASSERT_EQUAL(1, onceRuns.load());
+    TEST_ASSERT_FALSE(scheduler.isScheduled(once));
+    TEST_ASSERT_FALSE(scheduler.cancel(once));  // Finished ids are stale
+    TEST_ASSERT_TRUE(periodicRuns.load() >= 4);
+    TEST_ASSERT_TRUE(scheduler.isScheduled(periodic));
+
+    TEST_ASSERT_TRUE(scheduler.cancel(periodic));
+    int runsAtCancel = periodicRuns.load();
+    vTaskDelay(pdMS_TO_TICKS(50));
+    TEST_ASSERT_EQUAL(runsAtCancel, periodicRuns.load());
+    TEST_ASSERT_EQUAL(0, scheduler.getStats().activeJobs);
+
+    // A freed slot is reused under a new id; the old one stays stale
+    Scheduler::JobId reused = scheduler.scheduleOnce(1000, Scheduler::Priority::LOW, [&]() {});
+    TEST_ASSERT_TRUE(reused != periodic);
+    TEST_ASSERT_FALSE(scheduler.cancel(periodic));
+    TEST_ASSERT_TRUE(scheduler.cancel(reused));
+    TEST_ASSERT_EQUAL(Scheduler::INVALID_JOB, scheduler.scheduleOnce(10, Scheduler::Priority::NORMAL, nullptr));
+}
+
+static void test_scheduler_runs_due_jobs_by_priority(void)
+{
+    Scheduler scheduler("sched_test");
+    RunLog log;
+
+    // Scheduled in reverse order; all due in the same pass
+    scheduler.scheduleOnce(30, Scheduler::Priority::LOW, [&]() { log.record('L'); });
+    scheduler.scheduleOnce(30, Scheduler::Priority::NORMAL, [&]() { log.record('N'); });
+    scheduler.scheduleOnce(30, Scheduler::Priority::HIGH, [&]() { log.record('H'); });
+
+    vTaskDelay(pdMS_TO_TICKS(80));
+    std::vector<char> runs = log.copy();
+    TEST_ASSERT_EQUAL(3, runs.size());
+    TEST_ASSERT_EQUAL('H', runs[0]);
+    TEST_ASSERT_EQUAL('N', runs[1]);
+    TEST_ASSERT_EQUAL('L', runs[2]);
+}
+
+static void test_scheduler_low_priority_shares_wakeups(void)
+{
+    Scheduler scheduler("sched_test");
+    std::atomic<int> normalRuns{0};
+    std::atomic<int64_t> lowRanAtUs{0};
+
+    Scheduler::JobId periodic = scheduler.schedulePeriodic(50, Scheduler::Priority::NORMAL, [&]() { normalRuns++; });
+    vTaskDelay(pdMS_TO_TICKS(20));
+    Scheduler::Stats before = scheduler.getStats();
+
+    // Due at ~80 ms; waits for the NORMAL job's wake-up at ~100 ms instead of its own
+    int64_t lowDueUs = esp_timer_get_time() + 60000;
+    scheduler.scheduleOnce(60, Scheduler::Priority::LOW, [&]() { lowRanAtUs = esp_timer_get_time(); });
+
+    vTaskDelay(pdMS_TO_TICKS(110));
+    scheduler.cancel(periodic);
+    Scheduler::Stats after = scheduler.getStats();
+
+    TEST_ASSERT_EQUAL(2, normalRuns.load());
+    TEST_ASSERT_TRUE(lowRanAtUs.load() >= lowDueUs);
+    TEST_ASSERT_EQUAL(2, after.wakeups - before.wakeups);
+    TEST_ASSERT_EQUAL(3, after.runs - before.runs);
+
+    LatencyHistogram lateness;
+    scheduler.getLateness(Scheduler::Priority::LOW, lateness);
+    TEST_ASSERT_EQUAL(1, lateness.getCount());
+    TEST_ASSERT_TRUE(lateness.getMaxUs() >= 10000);
+    scheduler.getLateness(Scheduler::Priority::NORMAL, lateness);
+    TEST_ASSERT_EQUAL(2, lateness.getCount());
+    TEST_ASSERT_TRUE(lateness.getMaxUs() < 10000);
+    scheduler.logStats();
+}
+
+static void test_scheduler_cancel_while_running(void)
+{
+    Scheduler scheduler("sched_test");
+    std::atomic<bool> started{false};
+    std::atomic<bool> finished{false};
+    std::atomic<int> selfRuns{0};
+    std::atomic<Scheduler::JobId> selfId{Scheduler::INVALID_JOB};
+
+    // Cancelling from another task waits for the running callback
+    Scheduler::JobId slow = scheduler.scheduleOnce(10, Scheduler::Priority::NORMAL, [&]() {
+        started = true;
+        vTaskDelay(pdMS_TO_TICKS(40));
+        finished = true;
+    });
+    while (!started) {
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+    TEST_ASSERT_TRUE(scheduler.cancel(slow));
+    TEST_ASSERT_TRUE(finished.load());
+
+    // Two tasks cancelling the same running job both wait for it
+    started = false;
+    finished = false;
+    slow = scheduler.scheduleOnce(10, Scheduler::Priority::NORMAL, [&]() {
+        started = true;
+        vTaskDelay(pdMS_TO_TICKS(40));
+        finished = true;
+    });
+    while (!started) {
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+    CancelRequest request;
+    request.scheduler = &scheduler;
+    request.id = slow;
+    request.finished = &finished;
+    TEST_ASSERT_EQUAL(pdPASS, xTaskCreate(cancelTask, "sched_cancel", 3072, &request, 5, nullptr));
+    TEST_ASSERT_TRUE(scheduler.cancel(slow));
+    TEST_ASSERT_TRUE(finished.load());
+    for (int waitedMs = 0; waitedMs < 100 && !request.returned; waitedMs++) {
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+    TEST_ASSERT_TRUE(request.returned.load());
+    TEST_ASSERT_TRUE(request.finishedBefore.load());
+
+    // A periodic job may cancel itself from its own callback
+    std::atomic<bool> selfCancelled{false};
+    selfId = scheduler.schedulePeriodic(10, Scheduler::Priority::NORMAL, [&]() {
+        if (++selfRuns == 3) {
+            selfCancelled = scheduler.cancel(selfId);
+        }
+    });
+    vTaskDelay(pdMS_TO_TICKS(100));
+    TEST_ASSERT_TRUE(selfCancelled.load());
+    TEST_ASSERT_EQUAL(3, selfRuns.load());
+    TEST_ASSERT_EQUAL(0, scheduler.getStats().activeJobs);
+}
+
+static void test_scheduler_skips_overrun_periods_and_limits_pool(void)
+{
+    Scheduler scheduler("sched_test");
+    std::atomic<int> runs{0};
+
+    // Each run takes longer than two periods; missed runs are dropped, not queued
+    Scheduler::JobId overrun = scheduler.schedulePeriodic(10, Scheduler::Priority::NORMAL, [&]() {
+        runs++;
+        vTaskDelay(pdMS_TO_TICKS(25));
+    });
+    vTaskDelay(pdMS_TO_TICKS(120));
+    scheduler.cancel(overrun);
+    TEST_ASSERT_TRUE(runs.load() <= 5);
+    TEST_ASSERT_TRUE(scheduler.getStats().skipped >= static_cast<uint32_t>(runs.load()));
+
+    std::vector<Scheduler::JobId> jobs;
+    for (int i = 0; i < Scheduler::MAX_JOBS; i++) {
+        jobs.push_back(scheduler.scheduleOnce(10000, Scheduler::Priority::LOW, [&]() {}));
+        TEST_ASSERT_TRUE(jobs.back() != Scheduler::INVALID_JOB);
+    }
+    TEST_ASSERT_EQUAL(Scheduler::INVALID_JOB, scheduler.scheduleOnce(10, Scheduler::Priority::HIGH, [&]() {}));
+    for (Scheduler::JobId job : jobs) {
+        TEST_ASSERT_TRUE(scheduler.cancel(job));
+    }
+}
+
+static void test_scheduler_cost_against_tasks(void)
+{
+    // Before: heartbeat (2 KB), reconnect (3 KB) and auto-connect (4 KB) tasks
+    UBaseType_t tasksBefore = uxTaskGetNumberOfTasks();
+    size_t heapBefore = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+    std::atomic<bool> exitTasks{false};
+    TEST_ASSERT_EQUAL(pdPASS, xTaskCreate(sleepingTask, "old_heartbeat", 2048, &exitTasks, 5, nullptr));
+    TEST_ASSERT_EQUAL(pdPASS, xTaskCreate(sleepingTask, "old_reconnect", 3072, &exitTasks, 4, nullptr));
+    TEST_ASSERT_EQUAL(pdPASS, xTaskCreate(sleepingTask, "old_autoconn", 4096, &exitTasks, 5, nullptr));
+    vTaskDelay(pdMS_TO_TICKS(10));
+    UBaseType_t tasksWithThreads = uxTaskGetNumberOfTasks();
+    size_t heapWithThreads = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+    exitTasks = true;
+    vTaskDelay(pdMS_TO_TICKS(50));
+
+    // After: the same three jobs plus polling on one scheduler task
+    UBaseType_t tasksBeforeScheduler = uxTaskGetNumberOfTasks();
+    size_t heapBeforeScheduler = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+    UBaseType_t tasksWithScheduler;
+    size_t heapWithScheduler;
+    {
+        Scheduler scheduler("sched_test");
+        scheduler.schedulePeriodic(30000, Scheduler::Priority::LOW, []() {}, "jmri_heartbeat");
+        scheduler.schedulePeriodic(5000, Scheduler::Priority::NORMAL, []() {}, "jmri_reconnect");
+        scheduler.schedulePeriodic(500, Scheduler::Priority::NORMAL, []() {}, "jmri_autoconn");
+        scheduler.schedulePeriodic(10000, Scheduler::Priority::LOW, []() {}, "throttle_poll");
+        vTaskDelay(pdMS_TO_TICKS(10));
+        tasksWithScheduler = uxTaskGetNumberOfTasks();
+        heapWithScheduler = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+    }
+
+    size_t threadHeap = heapBefore - heapWithThreads;
+    size_t schedulerHeap = heapBeforeScheduler - heapWithScheduler;
+    ESP_LOGI(TAG, "Dedicated tasks: +%u tasks, %u bytes internal heap",
+             (unsigned)(tasksWithThreads - tasksBefore), (unsigned)threadHeap);
+    ESP_LOGI(TAG, "Scheduler:       +%u tasks, %u bytes internal heap",
+             (unsigned)(tasksWithScheduler - tasksBeforeScheduler), (unsigned)schedulerHeap);
+    TEST_ASSERT_EQUAL(3, tasksWithThreads - tasksBefore);
+    TEST_ASSERT_EQUAL(1, tasksWithScheduler - tasksBeforeScheduler);
+    TEST_ASSERT_TRUE(schedulerHeap <= threadHeap);
+}
+
+extern "C" void register_scheduler_tests(void)
+{
+    RUN_TEST(test_scheduler_once_periodic_and_cancel);
+    RUN_TEST(test_scheduler_runs_due_jobs_by_priority);
+    RUN_TEST(test_scheduler_low_priority_shares_wakeups);
+    RUN_TEST(test_scheduler_cancel_while_running);
+    RUN_TEST(test_scheduler_skips_overrun_periods_and_limits_pool);
+    RUN_TEST(test_scheduler_cost_against_tasks);
+}
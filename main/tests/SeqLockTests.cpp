@@ -0,0 +1,162 @@
+#include "unity.h"
+#include "SeqLock.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+
+static const char* TAG = "SeqLockTests";
+
+namespace {
+    constexpr int READER_TASKS = 3;
+    constexpr uint32_t WRITES = 200000;
+
+    // Every field is derived from one counter, so a mix of two writes is detectable
+    struct Payload {
+        uint32_t counter;
+        uint32_t words[14];
+        char name[20];
+        int32_t negated;
+    };
+
+    void fillPayload(Payload& payload, uint32_t counter)
+    {
+        std::memset(&payload, 0, sizeof(payload));
+        payload.counter = counter;
+        for (int i = 0; i < 14; i++) {
+            payload.words[i] = counter * (i + 1);
+        }
+        snprintf(payload.name, sizeof(payload.name), "loco-%lu", (unsigned long)counter);
+        payload.negated = -static_cast<int32_t>(counter);
+    }
+
+    bool payloadConsistent(const Payload& payload)
+    {
+        Payload expected;
+        fillPayload(expected, payload.counter);
+        return std::memcmp(&expected, &payload, sizeof(payload)) == 0;
+    }
+
+    struct StressContext {
+        SeqLock<Payload>* published = nullptr;
+        std::atomic<bool> writing{true};
+        std::atomic<int> finished{0};
+        std::atomic<uint32_t> reads{0};
+        std::atomic<uint32_t> retries{0};
+        std::atomic<uint32_t> torn{0};
+        std::atomic<uint32_t> backwards{0};
+    };
+
+    void writerTask(void* arg)
+    {
+        StressContext* context = static_cast<StressContext*>(arg);
+        Payload payload;
+        for (uint32_t i = 1; i <= WRITES; i++) {
+            fillPayload(payload, i);
+            context->published->write(payload);
+            if ((i % 1000) == 0) {
+                taskYIELD();
+            }
+        }
+        context->writing = false;
+        context->finished++;
+        vTaskDelete(nullptr);
+    }
+
+    void readerTask(void* arg)
+    {
+        StressContext* context = static_cast<StressContext*>(arg);
+        uint32_t lastCounter = 0;
+        uint32_t lastVersion = 0;
+        Payload payload;
+        while (context->writing) {
+            uint32_t version = 0;
+            if (!context->published->tryRead(payload, &version)) {
+                context->retries++;
+                continue;
+            }
+            if (version == 0) {
+                continue;  // Nothing written yet
+            }
+            context->reads++;
+            if (!payloadConsistent(payload)) {
+                context->torn++;
+            }
+            // The counter and the version both only move forward, in step
+            if (payload.counter < lastCounter || version < lastVersion || payload.counter != version) {
+                context->backwards++;
+            }
+            lastCounter = payload.counter;
+            lastVersion = version;
+        }
+        context->finished++;
+        vTaskDelete(nullptr);
+    }
+}
+
+static void test_seqlock_read_write(void)
+{
+    SeqLock<Payload> published;
+    TEST_ASSERT_EQUAL(0, published.version());
+
+    Payload payload;
+    uint32_t version = 99;
+    TEST_ASSERT_TRUE(published.tryRead(payload, &version));
+    TEST_ASSERT_EQUAL(0, version);
+    TEST_ASSERT_EQUAL(0, payload.counter);
+
+    Payload written;
+    fillPayload(written, 7);
+    published.write(written);
+    TEST_ASSERT_EQUAL(1, published.version());
+    TEST_ASSERT_TRUE(published.tryRead(payload, &version));
+    TEST_ASSERT_EQUAL(1, version);
+    TEST_ASSERT_TRUE(payloadConsistent(payload));
+    TEST_ASSERT_EQUAL(7, payload.counter);
+    TEST_ASSERT_EQUAL_STRING("loco-7", payload.name);
+
+    // Unchanged until the next write
+    TEST_ASSERT_EQUAL(1, published.version());
+    fillPayload(written, 8);
+    published.write(written);
+    TEST_ASSERT_EQUAL(2, published.version());
+}
+
+static void test_seqlock_tear_free_under_concurrent_writes(void)
+{
+    SeqLock<Payload> published;
+    StressContext context;
+    context.published = &published;
+
+    int64_t start = esp_timer_get_time();
+    for (int i = 0; i < READER_TASKS; i++) {
+        TEST_ASSERT_EQUAL(pdPASS, xTaskCreate(readerTask, "seqlock_reader", 3072, &context, 5, nullptr));
+    }
+    TEST_ASSERT_EQUAL(pdPASS, xTaskCreate(writerTask, "seqlock_writer", 3072, &context, 5, nullptr));
+
+    while (context.finished < READER_TASKS + 1) {
+        TEST_ASSERT_TRUE(esp_timer_get_time() - start < 30 * 1000000LL);
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+
+    ESP_LOGI(TAG, "%lu writes, %lu reads, %lu retries while a write was in progress",
+             (unsigned long)WRITES, (unsigned long)context.reads.load(),
+             (unsigned long)context.retries.load());
+    TEST_ASSERT_TRUE(context.reads.load() > 0);
+    TEST_ASSERT_EQUAL(0, context.torn.load());
+    TEST_ASSERT_EQUAL(0, context.backwards.load());
+    TEST_ASSERT_EQUAL(WRITES, published.version());
+
+    Payload payload;
+    TEST_ASSERT_TRUE(published.tryRead(payload));
+    TEST_ASSERT_EQUAL(WRITES, payload.counter);
+}
+
+extern "C" void register_seqlock_tests(void)
+{
+    RUN_TEST(test_seqlock_read_write);
+    RUN_TEST(test_seqlock_tear_free_under_concurrent_writes);
+}
@@ -0,0 +1,210 @@
+#include "unity.h"
+#include "ThrottleController.h"
+#include "WiThrottleClient.h"
+#include "JmriJsonClient.h"
+#include "JmriJsonThrottle.h"
+#include "LoopbackServer.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+static const char* TAG = "SessionResumeTests";
+
+namespace {
+    bool waitForResume(ThrottleController& controller, uint32_t sessions, int timeoutMs)
+    {
+        for (int waitedMs = 0; waitedMs < timeoutMs && controller.getResumeStats().sessionsResumed < sessions;
+             waitedMs += 5) {
+            vTaskDelay(pdMS_TO_TICKS(5));
+        }
+        return controller.getResumeStats().sessionsResumed >= sessions;
+    }
+
+    bool waitForRoster(ThrottleController& controller, size_t size, int timeoutMs)
+    {
+        for (int waitedMs = 0; waitedMs < timeoutMs && controller.getRosterSize() < size; waitedMs += 5) {
+            vTaskDelay(pdMS_TO_TICKS(5));
+        }
+        return controller.getRosterSize() >= size;
+    }
+
+    // Take queued JSON messages until one contains @p text
+    bool takeQueuedContaining(JmriJsonClient& client, const char* text)
+    {
+        std::string queued;
+        while (client.testTakeQueuedMessage(queued)) {
+            if (queued.find(text) != std::string::npos) {
+                return true;
+            }
+        }
+        return false;
+    }
+}
+
+static void test_resume_withrottle_after_link_drop(void)
+{
+    LoopbackServer server;
+    TEST_ASSERT_TRUE(server.listen());
+
+    WiThrottleClient client;
+    client.initialize();
+    ThrottleController controller(&client);
+
+    TEST_ASSERT_EQUAL(ESP_OK, client.connect("127.0.0.1", server.port));
+    TEST_ASSERT_TRUE(acceptClient(server, client));
+    TEST_ASSERT_TRUE(server.send("RL1]\\[Big Boy}|{4014}|{L\n"));
+    TEST_ASSERT_TRUE(waitForRoster(controller, 1, 1000));
+
+    controller.onKnobIndicatorTouched(0, 0);
+    controller.onKnobPress(0);
+    TEST_ASSERT_TRUE(controller.waitUntilIdle());
+    std::string received = server.readUntil("M0+L4014<;>L4014\n");
+    TEST_ASSERT_TRUE(received.find("M0+L4014<;>L4014\n") != std::string::npos);
+    controller.onKnobRotation(0, 5);
+    TEST_ASSERT_TRUE(controller.waitUntilIdle());
+
+    ThrottleController::ThrottleSnapshot snapshot;
+    TEST_ASSERT_TRUE(controller.getThrottleSnapshot(0, snapshot));
+    int speedBeforeDrop = snapshot.currentSpeed;
+    TEST_ASSERT_TRUE(speedBeforeDrop > 0);
+
+    // The stand-in drops the link; JMRI releases the loco with it
+    int64_t droppedUs = esp_timer_get_time();
+    server.dropConnection();
+    for (int waitedMs = 0; waitedMs < 1000 && client.isConnected(); waitedMs += 5) {
+        vTaskDelay(pdMS_TO_TICKS(5));
+    }
+    TEST_ASSERT_FALSE(client.isConnected());
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, client.setSpeed('0', 10));
+
+    // The operator's throttle stays allocated while the link is down
+    TEST_ASSERT_TRUE(controller.getThrottleSnapshot(0, snapshot));
+    TEST_ASSERT_TRUE(snapshot.state == Throttle::State::ALLOCATED_WITH_KNOB);
+
+    // Reconnect as the reconnect job does; the loco is re-acquired and queried unprompted
+    TEST_ASSERT_EQUAL(ESP_OK, client.connect("127.0.0.1", server.port));
+    TEST_ASSERT_TRUE(acceptClient(server, client));
+    received = server.readUntil("M0AL4014<;>qR\n");
+    TEST_ASSERT_TRUE(received.find("M0+L4014<;>L4014\n") != std::string::npos);
+    TEST_ASSERT_TRUE(received.find("M0AL4014<;>qV\n") != std::string::npos);
+
+    // JMRI stopped the loco when the link dropped; the headlight is still on
+    TEST_ASSERT_TRUE(server.send("M0+L4014<;>\nM0AL4014<;>F10\nM0AL4014<;>V0\nM0AL4014<;>R1\n"));
+    TEST_ASSERT_TRUE(waitForResume(controller, 1, 1000));
+    int64_t recoveredUs = esp_timer_get_time() - droppedUs;
+
+    ThrottleController::ResumeStats stats = controller.getResumeStats();
+    ESP_LOGI(TAG, "WiThrottle: controllable %lu ms after link loss (%lld us including test overhead)",
+             (unsigned long)stats.lastRecoveryMs, (long long)recoveredUs);
+    TEST_ASSERT_EQUAL(1, stats.locosReacquired);
+    TEST_ASSERT_EQUAL(1, stats.corrections);
+    TEST_ASSERT_TRUE(stats.lastRecoveryMs <= recoveredUs / 1000);
+    TEST_ASSERT_EQUAL(stats.lastRecoveryMs, stats.maxRecoveryMs);
+
+    // The server's state won, and functions were adopted from it
+    TEST_ASSERT_TRUE(controller.getThrottleSnapshot(0, snapshot));
+    TEST_ASSERT_EQUAL(0, snapshot.currentSpeed);
+    TEST_ASSERT_TRUE(snapshot.direction);
+    bool headlight = false;
+    TEST_ASSERT_TRUE(controller.getFunctionState(0, 0, headlight));
+    TEST_ASSERT_TRUE(headlight);
+
+    // Control carries on without re-selecting the loco
+    controller.onKnobPress(0);
+    TEST_ASSERT_TRUE(controller.waitUntilIdle());
+    received = server.readUntil("M0AL4014<;>V0\n");
+    TEST_ASSERT_TRUE(received.find("M0AL4014<;>V0\n") != std::string::npos);
+    TEST_ASSERT_EQUAL(ESP_OK, client.setSpeed('0', 10));
+
+    shutdownClient(server, client);
+}
+
+static void test_resume_json_after_session_drop(void)
+{
+    JmriJsonClient client;
+    client.initialize();
+    JmriJsonThrottle throttle(client);
+    TEST_ASSERT_EQUAL(ESP_OK, throttle.initialize());
+    ThrottleController controller(&throttle);
+
+    client.testSetConnected(true);
+    client.testProcessMessage(
+        "[{\"type\":\"rosterEntry\",\"data\":{\"name\":\"GWR 4073\",\"address\":\"4073\",\"isLongAddress\":true}}]");
+    TEST_ASSERT_EQUAL(1, controller.getRosterSize());
+
+    controller.onKnobIndicatorTouched(0, 0);
+    controller.onKnobPress(0);
+    controller.onKnobRotation(0, 5);
+    TEST_ASSERT_TRUE(controller.waitUntilIdle());
+    TEST_ASSERT_TRUE(takeQueuedContaining(client, "\"address\":4073"));
+
+    // The session drops and comes back; the loco is re-acquired
+    client.testSetConnected(false);
+    client.testSetConnected(true);
+    TEST_ASSERT_TRUE(controller.waitUntilIdle());
+    TEST_ASSERT_TRUE(takeQueuedContaining(client, "{\"type\":\"throttle\",\"data\":{\"name\":\"T0\",\"address\":4073,\"isLongAddress\":true}}"));
+    TEST_ASSERT_FALSE(takeQueuedContaining(client, "\"status\""));  // The acquire answer carries the state
+
+    // Another operator reversed the loco at half speed while we were away
+    client.testProcessMessage(
+        "{\"type\":\"throttle\",\"data\":{\"name\":\"T0\",\"address\":4073,\"speed\":0.5,\"forward\":false,\"F0\":true}}");
+    TEST_ASSERT_TRUE(waitForResume(controller, 1, 100));
+
+    ThrottleController::ResumeStats stats = controller.getResumeStats();
+    TEST_ASSERT_EQUAL(1, stats.locosReacquired);
+    TEST_ASSERT_EQUAL(2, stats.corrections);
+
+    ThrottleController::ThrottleSnapshot snapshot;
+    TEST_ASSERT_TRUE(controller.getThrottleSnapshot(0, snapshot));
+    TEST_ASSERT_EQUAL(63, snapshot.currentSpeed);
+    TEST_ASSERT_FALSE(snapshot.direction);
+    TEST_ASSERT_EQUAL(ESP_OK, throttle.setSpeed('0', 10));
+
+    client.testSetConnected(false);
+}
+
+static void test_resume_skips_released_throttles(void)
+{
+    JmriJsonClient client;
+    client.initialize();
+    JmriJsonThrottle throttle(client);
+    TEST_ASSERT_EQUAL(ESP_OK, throttle.initialize());
+    ThrottleController controller(&throttle);
+
+    client.testSetConnected(true);
+    client.testProcessMessage(
+        "[{\"type\":\"rosterEntry\",\"data\":{\"name\":\"GWR 4073\",\"address\":\"4073\",\"isLongAddress\":true}}]");
+    controller.onKnobIndicatorTouched(0, 0);
+    controller.onKnobPress(0);
+    TEST_ASSERT_TRUE(controller.waitUntilIdle());
+    TEST_ASSERT_TRUE(takeQueuedContaining(client, "\"address\":4073"));
+
+    // Released while the server has not yet answered the re-acquire
+    client.testSetConnected(false);
+    client.testSetConnected(true);
+    TEST_ASSERT_TRUE(controller.waitUntilIdle());
+    TEST_ASSERT_TRUE(takeQueuedContaining(client, "\"address\":4073"));
+    controller.onThrottleRelease(0);
+    TEST_ASSERT_TRUE(controller.waitUntilIdle());
+
+    client.testProcessMessage("{\"type\":\"throttle\",\"data\":{\"name\":\"T0\",\"speed\":0.0,\"forward\":true}}");
+    TEST_ASSERT_TRUE(controller.waitUntilIdle());
+    ThrottleController::ResumeStats stats = controller.getResumeStats();
+    TEST_ASSERT_EQUAL(0, stats.sessionsResumed);
+    TEST_ASSERT_EQUAL(0, stats.corrections);
+
+    // The next drop finds nothing to re-acquire
+    client.testSetConnected(false);
+    client.testSetConnected(true);
+    TEST_ASSERT_TRUE(controller.waitUntilIdle());
+    TEST_ASSERT_FALSE(takeQueuedContaining(client, "\"address\":4073"));
+    TEST_ASSERT_EQUAL(1, controller.getResumeStats().locosReacquired);
+
+    client.testSetConnected(false);
+}
+
+extern "C" void register_session_resume_tests(void)
+{
+    RUN_TEST(test_resume_withrottle_after_link_drop);
+    RUN_TEST(test_resume_json_after_session_drop);
+    RUN_TEST(test_resume_skips_released_throttles);
+}
@@ -0,0 +1,235 @@
+#include "unity.h"
+#include "Settings.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include <atomic>
+#include <string>
+
+static const char* TAG = "SettingsTests";
+
+namespace {
+    // Every key goes to this namespace, so the device's own settings are left alone
+    const char* const TEST_NAMESPACE = "settings_test";
+    const char* const KEY_NAMES[] = { "ssid", "password", "server_ip", "wt_port", "json_port",
+                                      "throttle_proto", "power_mgr", "speed_steps" };
+
+    void clearTestNamespace()
+    {
+        nvs_handle_t handle;
+        if (nvs_open(TEST_NAMESPACE, NVS_READWRITE, &handle) == ESP_OK) {
+            for (const char* key : KEY_NAMES) {
+                nvs_erase_key(handle, key);
+            }
+            nvs_commit(handle);
+            nvs_close(handle);
+        }
+    }
+
+    std::string storedString(const char* key)
+    {
+        nvs_handle_t handle;
+        char text[80] = {0};
+        size_t length = sizeof(text);
+        if (nvs_open(TEST_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+            return "<none>";
+        }
+        esp_err_t err = nvs_get_str(handle, key, text, &length);
+        nvs_close(handle);
+        return err == ESP_OK ? std::string(text) : std::string("<none>");
+    }
+
+    bool waitUntilSaved(Settings& settings, int timeoutMs)
+    {
+        for (int waitedMs = 0; waitedMs < timeoutMs && settings.hasUnsavedChanges(); waitedMs += 10) {
+            vTaskDelay(pdMS_TO_TICKS(10));
+        }
+        return !settings.hasUnsavedChanges();
+    }
+}
+
+static void test_settings_load_typed_values(void)
+{
+    clearTestNamespace();
+    nvs_handle_t handle;
+    TEST_ASSERT_EQUAL(ESP_OK, nvs_open(TEST_NAMESPACE, NVS_READWRITE, &handle));
+    nvs_set_str(handle, "server_ip", "192.168.1.20");
+    nvs_set_str(handle, "wt_port", "12345");
+    nvs_set_str(handle, "json_port", "0");  // Out of range: reads as the default
+    nvs_set_u8(handle, "throttle_proto", 1);
+    nvs_set_i32(handle, "speed_steps", 7);
+    nvs_commit(handle);
+    nvs_close(handle);
+
+    Settings settings(100, TEST_NAMESPACE);
+    TEST_ASSERT_EQUAL(4, settings.getInt(Settings::Key::SPEED_STEPS));
+    TEST_ASSERT_EQUAL_STRING("DCC++", settings.getString(Settings::Key::POWER_MANAGER).c_str());
+
+    TEST_ASSERT_EQUAL(ESP_OK, settings.load());
+    TEST_ASSERT_EQUAL_STRING("192.168.1.20", settings.getString(Settings::Key::SERVER_IP).c_str());
+    TEST_ASSERT_EQUAL(12345, settings.getInt(Settings::Key::WITHROTTLE_PORT));
+    TEST_ASSERT_EQUAL(12080, settings.getInt(Settings::Key::JSON_PORT));
+    TEST_ASSERT_FALSE(settings.isStored(Settings::Key::JSON_PORT));
+    TEST_ASSERT_EQUAL(1, settings.getInt(Settings::Key::THROTTLE_PROTOCOL));
+    TEST_ASSERT_EQUAL(7, settings.getInt(Settings::Key::SPEED_STEPS));
+    TEST_ASSERT_FALSE(settings.isStored(Settings::Key::WIFI_SSID));
+    TEST_ASSERT_FALSE(settings.hasUnsavedChanges());
+
+    // The encoder path reads RAM instead of opening NVS on every detent
+    const int reads = 10000;
+    volatile int32_t sink = 0;
+    int64_t start = esp_timer_get_time();
+    for (int i = 0; i < reads; i++) {
+        sink = sink + settings.getInt(Settings::Key::SPEED_STEPS);
+    }
+    int64_t registryUs = esp_timer_get_time() - start;
+    start = esp_timer_get_time();
+    for (int i = 0; i < reads; i++) {
+        int32_t value = 0;
+        nvs_open(TEST_NAMESPACE, NVS_READONLY, &handle);
+        nvs_get_i32(handle, "speed_steps", &value);
+        nvs_close(handle);
+        sink = sink + value;
+    }
+    int64_t nvsUs = esp_timer_get_time() - start;
+    ESP_LOGI(TAG, "%d speed-step reads: registry %lld us, nvs_open/get/close %lld us",
+             reads, (long long)registryUs, (long long)nvsUs);
+    TEST_ASSERT_TRUE(registryUs < nvsUs);
+
+    clearTestNamespace();
+}
+
+static void test_settings_write_behind_batches_changes(void)
+{
+    clearTestNamespace();
+    Settings settings(100, TEST_NAMESPACE);
+    TEST_ASSERT_EQUAL(ESP_OK, settings.load());
+
+    // A burst of changes is visible at once but written later, together
+    TEST_ASSERT_EQUAL(ESP_OK, settings.setString(Settings::Key::SERVER_IP, "10.0.0.9"));
+    TEST_ASSERT_EQUAL(ESP_OK, settings.setInt(Settings::Key::WITHROTTLE_PORT, 12091));
+    TEST_ASSERT_EQUAL(ESP_OK, settings.setInt(Settings::Key::SPEED_STEPS, 6));
+    TEST_ASSERT_EQUAL(ESP_OK, settings.setInt(Settings::Key::SPEED_STEPS, 8));
+    TEST_ASSERT_EQUAL(8, settings.getInt(Settings::Key::SPEED_STEPS));
+    TEST_ASSERT_TRUE(settings.hasUnsavedChanges());
+    TEST_ASSERT_EQUAL_STRING("<none>", storedString("server_ip").c_str());
+
+    // Low-priority job: may ride along with another wake-up up to the slack later
+    TEST_ASSERT_TRUE(waitUntilSaved(settings, CONFIG_SCHEDULER_LOW_PRIORITY_SLACK_MS + 1000));
+    Settings::Stats stats = settings.getStats();
+    TEST_ASSERT_EQUAL(4, stats.changes);
+    TEST_ASSERT_EQUAL(1, stats.flushes);
+    TEST_ASSERT_EQUAL(1, stats.commits);
+    TEST_ASSERT_EQUAL(3, stats.keysWritten);
+    TEST_ASSERT_EQUAL_STRING("10.0.0.9", storedString("server_ip").c_str());
+    TEST_ASSERT_EQUAL_STRING("12091", storedString("wt_port").c_str());  // Same format as before
+
+    nvs_handle_t handle;
+    int32_t speedSteps = 0;
+    TEST_ASSERT_EQUAL(ESP_OK, nvs_open(TEST_NAMESPACE, NVS_READONLY, &handle));
+    TEST_ASSERT_EQUAL(ESP_OK, nvs_get_i32(handle, "speed_steps", &speedSteps));
+    nvs_close(handle);
+    TEST_ASSERT_EQUAL(8, speedSteps);
+
+    // Saving what is already saved (e.g. WiFi credentials on every connect) writes nothing
+    TEST_ASSERT_EQUAL(ESP_OK, settings.setString(Settings::Key::SERVER_IP, "10.0.0.9"));
+    TEST_ASSERT_EQUAL(ESP_OK, settings.setInt(Settings::Key::SPEED_STEPS, 8));
+    TEST_ASSERT_FALSE(settings.hasUnsavedChanges());
+    TEST_ASSERT_EQUAL(2, settings.getStats().unchanged);
+    TEST_ASSERT_EQUAL(1, settings.getStats().commits);
+
+    clearTestNamespace();
+}
+
+static void test_settings_validation_and_subscriptions(void)
+{
+    clearTestNamespace();
+    Settings settings(100, TEST_NAMESPACE);
+    TEST_ASSERT_EQUAL(ESP_OK, settings.load());
+
+    std::atomic<int> notified{0};
+    Settings::SubscriptionId id = settings.subscribe(Settings::Key::SPEED_STEPS, [&](Settings::Key key) {
+        TEST_ASSERT_TRUE(key == Settings::Key::SPEED_STEPS);
+        // The new value is readable from the callback
+        TEST_ASSERT_EQUAL(9, settings.getInt(Settings::Key::SPEED_STEPS));
+        notified++;
+    });
+    TEST_ASSERT_TRUE(id != Settings::INVALID_SUBSCRIPTION);
+
+    TEST_ASSERT_EQUAL(ESP_OK, settings.setInt(Settings::Key::SPEED_STEPS, 9));
+    TEST_ASSERT_EQUAL(ESP_OK, settings.setInt(Settings::Key::SPEED_STEPS, 9));
+    TEST_ASSERT_EQUAL(ESP_OK, settings.setInt(Settings::Key::WITHROTTLE_PORT, 12000));
+    TEST_ASSERT_EQUAL(1, notified.load());
+
+    // Out-of-range and wrongly typed values are refused and change nothing
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, settings.setInt(Settings::Key::SPEED_STEPS, 21));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, settings.setInt(Settings::Key::JSON_PORT, 70000));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, settings.setInt(Settings::Key::SERVER_IP, 1));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, settings.setString(Settings::Key::SPEED_STEPS, "5"));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG,
+                      settings.setString(Settings::Key::SERVER_IP, std::string(Settings::MAX_STRING_LENGTH + 1, 'x')));
+    TEST_ASSERT_EQUAL(9, settings.getInt(Settings::Key::SPEED_STEPS));
+    TEST_ASSERT_EQUAL(1, notified.load());
+
+    settings.unsubscribe(id);
+    TEST_ASSERT_EQUAL(ESP_OK, settings.setInt(Settings::Key::SPEED_STEPS, 10));
+    TEST_ASSERT_EQUAL(1, notified.load());
+
+    // Slots are limited and reused
+    Settings::SubscriptionId ids[Settings::MAX_SUBSCRIPTIONS];
+    for (int i = 0; i < Settings::MAX_SUBSCRIPTIONS; i++) {
+        ids[i] = settings.subscribe(Settings::Key::SERVER_IP, [](Settings::Key) {});
+        TEST_ASSERT_TRUE(ids[i] != Settings::INVALID_SUBSCRIPTION);
+    }
+    TEST_ASSERT_EQUAL(Settings::INVALID_SUBSCRIPTION, settings.subscribe(Settings::Key::SERVER_IP, [](Settings::Key) {}));
+    settings.unsubscribe(ids[3]);
+    TEST_ASSERT_TRUE(settings.subscribe(Settings::Key::SERVER_IP, [](Settings::Key) {}) != Settings::INVALID_SUBSCRIPTION);
+
+    TEST_ASSERT_EQUAL(ESP_OK, settings.flush());
+    clearTestNamespace();
+}
+
+static void test_settings_flush_erase_and_destruction(void)
+{
+    clearTestNamespace();
+    {
+        Settings settings(60000, TEST_NAMESPACE);
+        TEST_ASSERT_EQUAL(ESP_OK, settings.load());
+
+        // flush() writes at once instead of waiting for the job
+        settings.setString(Settings::Key::WIFI_SSID, "Layout");
+        settings.setString(Settings::Key::WIFI_PASSWORD, "secret");
+        TEST_ASSERT_EQUAL(ESP_OK, settings.flush());
+        TEST_ASSERT_FALSE(settings.hasUnsavedChanges());
+        TEST_ASSERT_EQUAL_STRING("Layout", storedString("ssid").c_str());
+
+        // Erasing returns the default and removes the key
+        settings.erase(Settings::Key::WIFI_PASSWORD);
+        TEST_ASSERT_FALSE(settings.isStored(Settings::Key::WIFI_PASSWORD));
+        TEST_ASSERT_EQUAL_STRING("", settings.getString(Settings::Key::WIFI_PASSWORD).c_str());
+        TEST_ASSERT_EQUAL(ESP_OK, settings.flush());
+        TEST_ASSERT_EQUAL_STRING("<none>", storedString("password").c_str());
+        TEST_ASSERT_EQUAL(2, settings.getStats().commits);
+
+        // Left unsaved when the registry goes away
+        settings.setString(Settings::Key::POWER_MANAGER, "Booster");
+    }
+    TEST_ASSERT_EQUAL_STRING("Booster", storedString("power_mgr").c_str());
+
+    // A fresh registry sees what the last one saved
+    Settings reloaded(60000, TEST_NAMESPACE);
+    TEST_ASSERT_EQUAL(ESP_OK, reloaded.load());
+    TEST_ASSERT_EQUAL_STRING("Layout", reloaded.getString(Settings::Key::WIFI_SSID).c_str());
+    TEST_ASSERT_FALSE(reloaded.isStored(Settings::Key::WIFI_PASSWORD));
+    TEST_ASSERT_EQUAL_STRING("Booster", reloaded.getString(Settings::Key::POWER_MANAGER).c_str());
+
+    clearTestNamespace();
+}
+
+extern "C" void register_settings_tests(void)
+{
+    RUN_TEST(test_settings_load_typed_values);
+    RUN_TEST(test_settings_write_behind_batches_changes);
+    RUN_TEST(test_settings_validation_and_subscriptions);
+    RUN_TEST(test_settings_flush_erase_and_destruction);
+}
@@ -0,0 +1,158 @@
+#include "unity.h"
+#include "SpeedCoalescer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace {
+    // Records sent speeds; the flush timer calls in from another task
+    struct SentLog {
+        std::mutex mutex;
+        std::vector<std::pair<int, int>> sent;
+
+        void record(int throttleId, int speed)
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            sent.emplace_back(throttleId, speed);
+        }
+
+        std::vector<std::pair<int, int>> copy()
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            return sent;
+        }
+    };
+}
+
+static void test_coalescer_burst_sends_first_and_latest(void)
+{
+    SentLog log;
+    SpeedCoalescer coalescer(4, 50, [&](int id, int speed) { log.record(id, speed); });
+
+    for (int speed = 4; speed <= 40; speed += 4) {
+        coalescer.submit(0, speed);
+    }
+
+    // Leading edge goes out immediately, the rest wait for the interval
+    auto sent = log.copy();
+    TEST_ASSERT_EQUAL(1, sent.size());
+    TEST_ASSERT_EQUAL(4, sent[0].second);
+
+    vTaskDelay(pdMS_TO_TICKS(120));
+    sent = log.copy();
+    TEST_ASSERT_EQUAL(2, sent.size());
+    TEST_ASSERT_EQUAL(0, sent[1].first);
+    TEST_ASSERT_EQUAL(40, sent[1].second);
+    TEST_ASSERT_EQUAL(2, coalescer.getSentCount());
+    TEST_ASSERT_EQUAL(8, coalescer.getSuppressedCount());
+}
+
+static void test_coalescer_throttles_are_independent(void)
+{
+    SentLog log;
+    SpeedCoalescer coalescer(4, 50, [&](int id, int speed) { log.record(id, speed); });
+
+    coalescer.submit(0, 10);
+    coalescer.submit(1, 20);
+    coalescer.submit(0, 11);
+    coalescer.submit(1, 21);
+
+    auto sent = log.copy();
+    TEST_ASSERT_EQUAL(2, sent.size());
+
+    vTaskDelay(pdMS_TO_TICKS(120));
+    sent = log.copy();
+    TEST_ASSERT_EQUAL(4, sent.size());
+    int last0 = -1;
+    int last1 = -1;
+    for (const auto& entry : sent) {
+        if (entry.first == 0) last0 = entry.second;
+        if (entry.first == 1) last1 = entry.second;
+    }
+    TEST_ASSERT_EQUAL(11, last0);
+    TEST_ASSERT_EQUAL(21, last1);
+}
+
+static void test_coalescer_earlier_deadline_rearms_timer(void)
+{
+    SentLog log;
+    SpeedCoalescer coalescer(4, 200, [&](int id, int speed) { log.record(id, speed); });
+
+    // Throttle 1 sent first, so it falls due before throttle 0
+    coalescer.submit(1, 10);
+    vTaskDelay(pdMS_TO_TICKS(100));
+    coalescer.submit(0, 5);
+    coalescer.submit(0, 6);   // Due 200 ms from now; arms the timer
+    coalescer.submit(1, 11);  // Due 100 ms from now; must not wait for throttle 0
+
+    vTaskDelay(pdMS_TO_TICKS(150));
+    auto sent = log.copy();
+    TEST_ASSERT_EQUAL(3, sent.size());
+    TEST_ASSERT_EQUAL(1, sent[2].first);
+    TEST_ASSERT_EQUAL(11, sent[2].second);
+
+    vTaskDelay(pdMS_TO_TICKS(100));
+    sent = log.copy();
+    TEST_ASSERT_EQUAL(4, sent.size());
+    TEST_ASSERT_EQUAL(0, sent[3].first);
+    TEST_ASSERT_EQUAL(6, sent[3].second);
+}
+
+static void test_coalescer_flush_preserves_order(void)
+{
+    SentLog log;
+    SpeedCoalescer coalescer(4, 1000, [&](int id, int speed) { log.record(id, speed); });
+
+    coalescer.submit(2, 8);
+    coalescer.submit(2, 0);
+
+    // A direction change would be sent right after this flush
+    coalescer.flush(2);
+    auto sent = log.copy();
+    TEST_ASSERT_EQUAL(2, sent.size());
+    TEST_ASSERT_EQUAL(0, sent[1].second);
+
+    // Nothing left for the timer to send later
+    coalescer.flush(2);
+    TEST_ASSERT_EQUAL(2, log.copy().size());
+}
+
+static void test_coalescer_stop_discards_pending(void)
+{
+    SentLog log;
+    SpeedCoalescer coalescer(4, 50, [&](int id, int speed) { log.record(id, speed); });
+
+    coalescer.submit(3, 30);
+    coalescer.submit(3, 60);
+    coalescer.sendNow(3, 0);
+
+    vTaskDelay(pdMS_TO_TICKS(120));
+    auto sent = log.copy();
+    TEST_ASSERT_EQUAL(2, sent.size());
+    TEST_ASSERT_EQUAL(30, sent[0].second);
+    TEST_ASSERT_EQUAL(0, sent[1].second);
+}
+
+static void test_coalescer_zero_interval_passes_through(void)
+{
+    SentLog log;
+    SpeedCoalescer coalescer(4, 0, [&](int id, int speed) { log.record(id, speed); });
+
+    for (int i = 0; i < 5; i++) {
+        coalescer.submit(0, i);
+    }
+    TEST_ASSERT_EQUAL(5, log.copy().size());
+    TEST_ASSERT_EQUAL(0, coalescer.getSuppressedCount());
+}
+
+extern "C" void register_speed_coalescer_tests(void)
+{
+    RUN_TEST(test_coalescer_burst_sends_first_and_latest);
+    RUN_TEST(test_coalescer_throttles_are_independent);
+    RUN_TEST(test_coalescer_earlier_deadline_rearms_timer);
+    RUN_TEST(test_coalescer_flush_preserves_order);
+    RUN_TEST(test_coalescer_stop_discards_pending);
+    RUN_TEST(test_coalescer_zero_interval_passes_through);
+}
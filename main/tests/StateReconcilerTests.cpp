@@ -0,0 +1,237 @@
+#include "unity.h"
+#include "StateReconciler.h"
+#include "ThrottleController.h"
+#include "WiThrottleClient.h"
+#include "LoopbackServer.h"
+#include "esp_timer.h"
+#include <string>
+
+namespace {
+    constexpr int64_t MS = 1000;
+
+    StateReconciler::Config testConfig()
+    {
+        StateReconciler::Config config;
+        config.ackTimeoutMs = 500;
+        config.retryMaxMs = 4000;
+        config.verifyIntervalMs = 10000;
+        config.verifyMaxMs = 40000;
+        return config;
+    }
+
+    // Acquired at 0, with both fields reported at 100 ms
+    void trackConfirmed(StateReconciler& reconciler, int throttleId)
+    {
+        reconciler.track(throttleId, 0);
+        reconciler.recordReport(throttleId, StateReconciler::SPEED, 0, 100 * MS);
+        reconciler.recordReport(throttleId, StateReconciler::DIRECTION, 1, 100 * MS);
+    }
+
+    bool waitForConfirmed(ThrottleController& controller, int throttleId, int timeoutMs)
+    {
+        for (int waitedMs = 0; waitedMs < timeoutMs && !controller.isThrottleStateConfirmed(throttleId);
+             waitedMs += 5) {
+            vTaskDelay(pdMS_TO_TICKS(5));
+        }
+        return controller.isThrottleStateConfirmed(throttleId);
+    }
+}
+
+static void test_reconciler_echo_confirms_without_queries(void)
+{
+    StateReconciler reconciler(4, testConfig());
+    TEST_ASSERT_EQUAL(StateReconciler::NEVER, reconciler.nextDueUs());
+
+    reconciler.track(0, 0);
+    TEST_ASSERT_FALSE(reconciler.isConfirmed(0));
+    TEST_ASSERT_EQUAL(500 * MS, reconciler.nextDueUs());
+
+    // The acquire is answered with the loco's state before anything is queried
+    reconciler.recordReport(0, StateReconciler::SPEED, 0, 100 * MS);
+    TEST_ASSERT_FALSE(reconciler.isConfirmed(0));
+    reconciler.recordReport(0, StateReconciler::DIRECTION, 1, 100 * MS);
+    TEST_ASSERT_TRUE(reconciler.isConfirmed(0));
+
+    // A pushing transport needs no idle checks
+    TEST_ASSERT_EQUAL(StateReconciler::NEVER, reconciler.nextDueUs());
+
+    reconciler.recordCommand(0, StateReconciler::SPEED, 20, 1000 * MS);
+    reconciler.recordCommand(0, StateReconciler::SPEED, 40, 1100 * MS);
+    TEST_ASSERT_FALSE(reconciler.isConfirmed(0));
+    TEST_ASSERT_EQUAL(1500 * MS, reconciler.nextDueUs());
+
+    TEST_ASSERT_TRUE(StateReconciler::Report::STALE ==
+                     reconciler.recordReport(0, StateReconciler::SPEED, 20, 1030 * MS));
+    TEST_ASSERT_TRUE(StateReconciler::Report::CONFIRMED ==
+                     reconciler.recordReport(0, StateReconciler::SPEED, 40, 1140 * MS));
+    TEST_ASSERT_TRUE(reconciler.isConfirmed(0));
+    TEST_ASSERT_EQUAL(0, reconciler.takeDueQueries(0, 60000 * MS));
+
+    StateReconciler::Stats stats = reconciler.getStats(0);
+    TEST_ASSERT_EQUAL(2, stats.commands);
+    TEST_ASSERT_EQUAL(1, stats.echoConfirmed);
+    TEST_ASSERT_EQUAL(0, stats.queryConfirmed);
+    TEST_ASSERT_EQUAL(0, stats.retryQueries + stats.verifyQueries);
+    TEST_ASSERT_EQUAL(2, stats.roundTrip.getCount());
+    TEST_ASSERT_EQUAL(40 * MS, stats.roundTrip.getMaxUs());
+}
+
+static void test_reconciler_queries_unanswered_with_backoff(void)
+{
+    StateReconciler reconciler(4, testConfig());
+    trackConfirmed(reconciler, 1);
+
+    reconciler.recordCommand(1, StateReconciler::DIRECTION, 0, 1000 * MS);
+    TEST_ASSERT_EQUAL(0, reconciler.takeDueQueries(1, 1499 * MS));
+
+    // Only the unanswered field is asked for, at 500, 1000, 2000, 4000, 4000 ms gaps
+    int64_t expected[] = { 1500, 2000, 3000, 5000, 9000, 13000 };
+    for (int64_t dueMs : expected) {
+        TEST_ASSERT_EQUAL(dueMs * MS, reconciler.nextDueUs());
+        TEST_ASSERT_EQUAL(0, reconciler.takeDueQueries(1, dueMs * MS - 1));
+        TEST_ASSERT_EQUAL(StateReconciler::DIRECTION, reconciler.takeDueQueries(1, dueMs * MS));
+    }
+
+    // The answer confirms it; the round trip is measured from the last query
+    TEST_ASSERT_TRUE(StateReconciler::Report::CONFIRMED ==
+                     reconciler.recordReport(1, StateReconciler::DIRECTION, 0, 13020 * MS));
+    TEST_ASSERT_TRUE(reconciler.isConfirmed(1));
+    TEST_ASSERT_EQUAL(StateReconciler::NEVER, reconciler.nextDueUs());
+
+    StateReconciler::Stats stats = reconciler.getStats(1);
+    TEST_ASSERT_EQUAL(1, stats.queryConfirmed);
+    TEST_ASSERT_EQUAL(6, stats.retryQueries);
+    TEST_ASSERT_EQUAL(20 * MS, stats.roundTrip.getMaxUs());
+
+    // A new command starts the back-off again
+    reconciler.recordCommand(1, StateReconciler::SPEED, 30, 20000 * MS);
+    TEST_ASSERT_EQUAL(20500 * MS, reconciler.nextDueUs());
+    TEST_ASSERT_EQUAL(StateReconciler::SPEED, reconciler.takeDueQueries(1, 20500 * MS));
+    TEST_ASSERT_EQUAL(21000 * MS, reconciler.nextDueUs());
+}
+
+static void test_reconciler_divergence_takes_server_value(void)
+{
+    StateReconciler reconciler(4, testConfig());
+    trackConfirmed(reconciler, 2);
+
+    reconciler.recordCommand(2, StateReconciler::SPEED, 50, 1000 * MS);
+    TEST_ASSERT_TRUE(StateReconciler::Report::DIVERGED ==
+                     reconciler.recordReport(2, StateReconciler::SPEED, 12, 1050 * MS));
+    TEST_ASSERT_EQUAL(1, reconciler.getStats(2).diverged);
+
+    // Asked once more to be sure, then confirmed by whatever the server says
+    TEST_ASSERT_FALSE(reconciler.isConfirmed(2));
+    TEST_ASSERT_EQUAL(1550 * MS, reconciler.nextDueUs());
+    TEST_ASSERT_EQUAL(StateReconciler::SPEED, reconciler.takeDueQueries(2, 1550 * MS));
+    TEST_ASSERT_TRUE(StateReconciler::Report::REPORTED ==
+                     reconciler.recordReport(2, StateReconciler::SPEED, 12, 1600 * MS));
+    TEST_ASSERT_TRUE(reconciler.isConfirmed(2));
+}
+
+static void test_reconciler_idle_verification_backs_off(void)
+{
+    StateReconciler reconciler(4, testConfig());
+    reconciler.setIdleVerification(true);
+    trackConfirmed(reconciler, 0);
+
+    // Confirmed at 100 ms: checked after 10, 20, 40, 40 s of quiet
+    int64_t expected[] = { 10100, 30100, 70100, 110100 };
+    for (int64_t dueMs : expected) {
+        TEST_ASSERT_EQUAL(dueMs * MS, reconciler.nextDueUs());
+        TEST_ASSERT_EQUAL(StateReconciler::ALL_FIELDS, reconciler.takeDueQueries(0, dueMs * MS));
+        reconciler.recordReport(0, StateReconciler::SPEED, 0, dueMs * MS + 20 * MS);
+        reconciler.recordReport(0, StateReconciler::DIRECTION, 1, dueMs * MS + 20 * MS);
+        TEST_ASSERT_TRUE(reconciler.isConfirmed(0));
+    }
+    TEST_ASSERT_EQUAL(8, reconciler.getStats(0).verifyQueries);
+
+    // Activity resets the idle interval
+    reconciler.recordCommand(0, StateReconciler::SPEED, 10, 120000 * MS);
+    reconciler.recordReport(0, StateReconciler::SPEED, 10, 120030 * MS);
+    TEST_ASSERT_EQUAL(130030 * MS, reconciler.nextDueUs());
+
+    // Untracked throttles are never queried
+    reconciler.untrack(0);
+    TEST_ASSERT_EQUAL(StateReconciler::NEVER, reconciler.nextDueUs());
+    TEST_ASSERT_EQUAL(0, reconciler.takeDueQueries(0, 200000 * MS));
+    reconciler.recordCommand(0, StateReconciler::SPEED, 20, 200000 * MS);
+    TEST_ASSERT_EQUAL(1, reconciler.getStats(0).commands);
+
+    reconciler.resetStats();
+    TEST_ASSERT_EQUAL(0, reconciler.getStats(0).commands);
+    TEST_ASSERT_EQUAL(0, reconciler.getStats(0).roundTrip.getCount());
+}
+
+static void test_reconciler_withrottle_queries_only_unanswered(void)
+{
+    LoopbackServer server;
+    TEST_ASSERT_TRUE(server.listen());
+
+    WiThrottleClient client;
+    client.initialize();
+    ThrottleController controller(&client);
+
+    TEST_ASSERT_EQUAL(ESP_OK, client.connect("127.0.0.1", server.port));
+    TEST_ASSERT_TRUE(acceptClient(server, client));
+    TEST_ASSERT_TRUE(server.send("RL1]\\[Big Boy}|{4014}|{L\n"));
+    for (int waitedMs = 0; waitedMs < 1000 && controller.getRosterSize() < 1; waitedMs += 5) {
+        vTaskDelay(pdMS_TO_TICKS(5));
+    }
+
+    // The acquire is answered with the loco's state: confirmed without a query
+    controller.onKnobIndicatorTouched(0, 0);
+    controller.onKnobPress(0);
+    TEST_ASSERT_TRUE(controller.waitUntilIdle());
+    std::string received = server.readUntil("M0+L4014<;>L4014\n");
+    TEST_ASSERT_TRUE(received.find("M0+L4014<;>L4014\n") != std::string::npos);
+    TEST_ASSERT_FALSE(controller.isThrottleStateConfirmed(0));
+    TEST_ASSERT_TRUE(server.send("M0+L4014<;>\nM0AL4014<;>V0\nM0AL4014<;>R1\n"));
+    TEST_ASSERT_TRUE(waitForConfirmed(controller, 0, 1000));
+
+    // An unanswered speed is asked for after the ack timeout, and only the speed
+    int64_t sentUs = esp_timer_get_time();
+    controller.onKnobRotation(0, 5);
+    TEST_ASSERT_TRUE(controller.waitUntilIdle());
+    ThrottleController::ThrottleSnapshot snapshot;
+    TEST_ASSERT_TRUE(controller.getThrottleSnapshot(0, snapshot));
+    std::string speed = "M0AL4014<;>V" + std::to_string(snapshot.currentSpeed) + "\n";
+
+    received = server.readUntil("M0AL4014<;>qV\n");
+    int64_t queriedAfterMs = (esp_timer_get_time() - sentUs) / 1000;
+    TEST_ASSERT_TRUE(received.find(speed) != std::string::npos);
+    TEST_ASSERT_TRUE(received.find("M0AL4014<;>qV\n") != std::string::npos);
+    TEST_ASSERT_TRUE(received.find("qR") == std::string::npos);
+    TEST_ASSERT_TRUE(queriedAfterMs >= CONFIG_THROTTLE_ACK_TIMEOUT_MS - 10);
+
+    TEST_ASSERT_TRUE(server.send(speed));
+    TEST_ASSERT_TRUE(waitForConfirmed(controller, 0, 1000));
+
+    // An echoed command needs no query at all
+    controller.onKnobRotation(0, 5);
+    TEST_ASSERT_TRUE(controller.waitUntilIdle());
+    TEST_ASSERT_TRUE(controller.getThrottleSnapshot(0, snapshot));
+    speed = "M0AL4014<;>V" + std::to_string(snapshot.currentSpeed) + "\n";
+    received = server.readUntil(speed);
+    TEST_ASSERT_TRUE(server.send(speed));
+    TEST_ASSERT_TRUE(waitForConfirmed(controller, 0, 1000));
+
+    StateReconciler::Stats stats = controller.getReconcileStats(0);
+    TEST_ASSERT_EQUAL(2, stats.commands);
+    TEST_ASSERT_EQUAL(1, stats.echoConfirmed);
+    TEST_ASSERT_EQUAL(1, stats.queryConfirmed);
+    TEST_ASSERT_EQUAL(1, stats.retryQueries);
+    TEST_ASSERT_EQUAL(0, stats.diverged);
+    TEST_ASSERT_EQUAL(2, stats.roundTrip.getCount());
+
+    shutdownClient(server, client);
+}
+
+extern "C" void register_state_reconciler_tests(void)
+{
+    RUN_TEST(test_reconciler_echo_confirms_without_queries);
+    RUN_TEST(test_reconciler_queries_unanswered_with_backoff);
+    RUN_TEST(test_reconciler_divergence_takes_server_value);
+    RUN_TEST(test_reconciler_idle_verification_backs_off);
+    RUN_TEST(test_reconciler_withrottle_queries_only_unanswered);
+}
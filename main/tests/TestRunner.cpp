@@ -5,6 +5,27 @@ extern "C" void register_controller_tests(void);
 extern "C" void register_roster_tests(void);
 extern "C" void register_locomotive_tests(void);
 extern "C" void register_protocol_tests(void);
+extern "C" void register_line_framer_tests(void);
+extern "C" void register_command_encoder_tests(void);
+extern "C" void register_speed_coalescer_tests(void);
+extern "C" void register_state_reconciler_tests(void);
+extern "C" void register_momentum_engine_tests(void);
+extern "C" void register_throttle_scaling_tests(void);
+extern "C" void register_latency_histogram_tests(void);
+extern "C" void register_heartbeat_monitor_tests(void);
+extern "C" void register_roster_snapshot_tests(void);
+extern "C" void register_throttle_slot_tests(void);
+extern "C" void register_json_tokenizer_tests(void);
+extern "C" void register_json_subscription_table_tests(void);
+extern "C" void register_throttle_transport_tests(void);
+extern "C" void register_scheduler_tests(void);
+extern "C" void register_mpsc_queue_tests(void);
+extern "C" void register_seqlock_tests(void);
+extern "C" void register_ui_event_bus_tests(void);
+extern "C" void register_connection_tests(void);
+extern "C" void register_session_resume_tests(void);
+extern "C" void register_mdns_browser_tests(void);
+extern "C" void register_settings_tests(void);
 
 extern "C" void run_throttle_tests(void)
 {
@@ -14,5 +35,26 @@ extern "C" void run_throttle_tests(void)
     register_roster_tests();
     register_locomotive_tests();
     register_protocol_tests();
+    register_line_framer_tests();
+    register_command_encoder_tests();
+    register_speed_coalescer_tests();
+    register_state_reconciler_tests();
+    register_momentum_engine_tests();
+    register_throttle_scaling_tests();
+    register_latency_histogram_tests();
+    register_heartbeat_monitor_tests();
+    register_roster_snapshot_tests();
+    register_throttle_slot_tests();
+    register_json_tokenizer_tests();
+    register_json_subscription_table_tests();
+    register_throttle_transport_tests();
+    register_scheduler_tests();
+    register_mpsc_queue_tests();
+    register_seqlock_tests();
+    register_ui_event_bus_tests();
+    register_connection_tests();
+    register_session_resume_tests();
+    register_mdns_browser_tests();
+    register_settings_tests();
     UNITY_END();
 }
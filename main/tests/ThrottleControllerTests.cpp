@@ -1,21 +1,91 @@
 #include "unity.h"
 #include "ThrottleController.h"
 #include "WiThrottleClient.h"
+#include "JmriJsonClient.h"
+#include "JmriJsonThrottle.h"
 #include "Locomotive.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/task.h"
+#include <atomic>
+#include <cstring>
+
+static const char* TAG = "ThrottleControllerTests";
 
 namespace {
     struct UiCallbackState {
         int calls = 0;
+        uint32_t throttles = 0;  // Bit per throttle ID named by a callback
+        uint8_t changes = 0;     // UIChange flags seen
+    };
+
+    constexpr int LOAD_ROTATIONS = 1001;  // Odd: each knob ends one click up
+    constexpr int LOAD_FUNCTIONS = 500;
+
+    struct LoadContext {
+        ThrottleController* controller = nullptr;
+        std::atomic<int> finished{0};
+        std::atomic<int> uiCalls{0};
     };
 
-    void uiUpdateCallback(void* userData)
+    struct KnobArgs {
+        LoadContext* context;
+        int knobId;
+    };
+
+    void countingUiCallback(void* userData, int throttleId, uint8_t changes)
+    {
+        (void)throttleId;
+        (void)changes;
+        static_cast<LoadContext*>(userData)->uiCalls++;
+    }
+
+    // Alternate one click up and one down, as fast as the task can post
+    void rotationTask(void* arg)
+    {
+        KnobArgs* args = static_cast<KnobArgs*>(arg);
+        for (int i = 0; i < LOAD_ROTATIONS; i++) {
+            args->context->controller->onKnobRotation(args->knobId, (i % 2 == 0) ? 1 : -1);
+        }
+        args->context->finished++;
+        vTaskDelete(nullptr);
+    }
+
+    void functionTask(void* arg)
+    {
+        LoadContext* context = static_cast<LoadContext*>(arg);
+        for (int i = 0; i < LOAD_FUNCTIONS; i++) {
+            context->controller->setFunction(2, i % 29, (i % 2) == 0);
+        }
+        context->finished++;
+        vTaskDelete(nullptr);
+    }
+
+    void uiUpdateCallback(void* userData, int throttleId, uint8_t changes)
     {
         auto* state = static_cast<UiCallbackState*>(userData);
         if (state) {
             state->calls++;
+            state->throttles |= (throttleId >= 0) ? (1u << throttleId) : UINT32_MAX;
+            state->changes |= changes;
         }
     }
 
+    // Remembers the task each UI callback ran on
+    struct UiTaskState {
+        std::atomic<int> calls{0};
+        std::atomic<TaskHandle_t> task{nullptr};
+    };
+
+    void uiTaskCallback(void* userData, int throttleId, uint8_t changes)
+    {
+        (void)throttleId;
+        (void)changes;
+        auto* state = static_cast<UiTaskState*>(userData);
+        state->task = xTaskGetCurrentTaskHandle();
+        state->calls++;
+    }
+
     void setupThrottleWithLoco(ThrottleController& controller, int throttleId, int knobId, const char* name, int address)
     {
         Throttle* throttle = controller.getThrottle(throttleId);
@@ -55,6 +125,7 @@ static void test_controller_assign_knob_to_unallocated(void)
     controller.setUIUpdateCallback(uiUpdateCallback, &uiState);
 
     controller.onKnobIndicatorTouched(0, 0);
+    TEST_ASSERT_TRUE(controller.waitUntilIdle());
 
     Throttle* throttle = controller.getThrottle(0);
     Knob* knob = controller.getKnob(0);
@@ -65,6 +136,8 @@ static void test_controller_assign_knob_to_unallocated(void)
     TEST_ASSERT_EQUAL(Knob::State::SELECTING, knob->getState());
     TEST_ASSERT_EQUAL(0, knob->getAssignedThrottleId());
     TEST_ASSERT_GREATER_THAN(0, uiState.calls);
+    TEST_ASSERT_EQUAL_UINT32(0x1, uiState.throttles);
+    TEST_ASSERT_TRUE(uiState.changes & ThrottleController::UI_ROSTER_SELECTION);
 }
 
 static void test_controller_move_knob_between_throttles(void)
@@ -74,8 +147,14 @@ static void test_controller_move_knob_between_throttles(void)
 
     setupThrottleWithLoco(controller, 0, 0, "LocoA", 10);
     setupThrottleAllocatedNoKnob(controller, 1, 1, "LocoB", 20);
+    UiCallbackState uiState;
+    controller.setUIUpdateCallback(uiUpdateCallback, &uiState);
 
     controller.onKnobIndicatorTouched(1, 0);
+    TEST_ASSERT_TRUE(controller.waitUntilIdle());
+
+    // Both meters change: the one the knob left and the one it moved to
+    TEST_ASSERT_EQUAL_UINT32(0x3, uiState.throttles);
 
     Throttle* throttle0 = controller.getThrottle(0);
     Throttle* throttle1 = controller.getThrottle(1);
@@ -96,6 +175,7 @@ static void test_controller_move_knob_to_unallocated_for_selection(void)
     setupThrottleWithLoco(controller, 0, 0, "LocoA", 10);
 
     controller.onKnobIndicatorTouched(1, 0);
+    TEST_ASSERT_TRUE(controller.waitUntilIdle());
 
     Throttle* throttle0 = controller.getThrottle(0);
     Throttle* throttle1 = controller.getThrottle(1);
@@ -121,6 +201,7 @@ static void test_controller_release_resets_knob(void)
     setupThrottleWithLoco(controller, 0, 0, "LocoC", 30);
 
     controller.onThrottleRelease(0);
+    TEST_ASSERT_TRUE(controller.waitUntilIdle());
 
     Throttle* throttle = controller.getThrottle(0);
     Knob* knob = controller.getKnob(0);
@@ -130,6 +211,8 @@ static void test_controller_release_resets_knob(void)
     TEST_ASSERT_EQUAL(Throttle::State::UNALLOCATED, throttle->getState());
     TEST_ASSERT_EQUAL(Knob::State::IDLE, knob->getState());
     TEST_ASSERT_GREATER_THAN(0, uiState.calls);
+    TEST_ASSERT_EQUAL_UINT32(0x1, uiState.throttles);
+    TEST_ASSERT_EQUAL_UINT8(ThrottleController::UI_ALL, uiState.changes);
 }
 
 static void test_controller_rotation_updates_speed(void)
@@ -144,12 +227,47 @@ static void test_controller_rotation_updates_speed(void)
 
     throttle->setSpeed(0);
     controller.onKnobRotation(0, 1);
+    TEST_ASSERT_TRUE(controller.waitUntilIdle());
 
     int speed = throttle->getCurrentSpeed();
     TEST_ASSERT_GREATER_THAN_INT(0, speed);
     TEST_ASSERT_LESS_OR_EQUAL_INT(126, speed);
 }
 
+static void test_controller_snapshot_generation_tracks_changes(void)
+{
+    WiThrottleClient client;
+    ThrottleController controller(&client);
+
+    setupThrottleWithLoco(controller, 0, 0, "A loco name longer than the snapshot holds", 40);
+    controller.onKnobRotation(0, 1);
+    TEST_ASSERT_TRUE(controller.waitUntilIdle());
+
+    ThrottleController::ThrottleSnapshot snapshot;
+    TEST_ASSERT_TRUE(controller.getThrottleSnapshot(0, snapshot));
+    TEST_ASSERT_EQUAL(controller.getThrottleGeneration(0), snapshot.generation);
+    TEST_ASSERT_TRUE(snapshot.hasLocomotive);
+    TEST_ASSERT_EQUAL(40, snapshot.locoAddress);
+    TEST_ASSERT_EQUAL(ThrottleController::LOCO_NAME_LENGTH - 1, strlen(snapshot.locoName));
+    TEST_ASSERT_EQUAL_STRING_LEN("A loco name longer", snapshot.locoName, 18);
+    uint32_t speedGeneration = snapshot.generation;
+    uint32_t otherGeneration = controller.getThrottleGeneration(1);
+
+    // A change to throttle 0 leaves throttle 1's generation alone
+    controller.onKnobRotation(0, 1);
+    TEST_ASSERT_TRUE(controller.waitUntilIdle());
+    TEST_ASSERT_TRUE(controller.getThrottleGeneration(0) != speedGeneration);
+    TEST_ASSERT_EQUAL(otherGeneration, controller.getThrottleGeneration(1));
+
+    // Events that change nothing shown (a function command) keep the generation
+    uint32_t generation = controller.getThrottleGeneration(0);
+    controller.setFunction(0, 0, true);
+    TEST_ASSERT_TRUE(controller.waitUntilIdle());
+    TEST_ASSERT_EQUAL(generation, controller.getThrottleGeneration(0));
+
+    TEST_ASSERT_FALSE(controller.getThrottleSnapshot(ThrottleController::NUM_THROTTLES, snapshot));
+}
+
 static void test_controller_rotation_cross_zero_switches_to_reverse(void)
 {
     WiThrottleClient client;
@@ -164,6 +282,7 @@ static void test_controller_rotation_cross_zero_switches_to_reverse(void)
     throttle->setDirection(true);
 
     controller.onKnobRotation(0, -2); // 4 + (-2*4) = -4
+    TEST_ASSERT_TRUE(controller.waitUntilIdle());
 
     TEST_ASSERT_EQUAL_INT(4, throttle->getCurrentSpeed());
     TEST_ASSERT_FALSE(throttle->getDirection());
@@ -183,11 +302,127 @@ static void test_controller_rotation_cross_zero_switches_to_forward(void)
     throttle->setDirection(false);
 
     controller.onKnobRotation(0, 3); // -8 + (3*4) = 4
+    TEST_ASSERT_TRUE(controller.waitUntilIdle());
 
     TEST_ASSERT_EQUAL_INT(4, throttle->getCurrentSpeed());
     TEST_ASSERT_TRUE(throttle->getDirection());
 }
 
+static void test_controller_acquire_uses_prefetched_labels(void)
+{
+    WiThrottleClient client;
+    JmriJsonClient jsonClient;
+    jsonClient.initialize();
+    JmriJsonThrottle jsonThrottle(jsonClient);
+    TEST_ASSERT_EQUAL(ESP_OK, jsonThrottle.initialize());
+
+    ThrottleController controller(&client);
+    controller.setRosterSource(&jsonThrottle);
+
+    jsonClient.testProcessMessage(
+        "[{\"type\":\"rosterEntry\",\"data\":{\"name\":\"GWR 4073\",\"address\":\"4073\",\"isLongAddress\":true,"
+        "\"functionKeys\":[{\"name\":\"F0\",\"label\":\"Lights\"},{\"name\":\"F1\",\"label\":\"Whistle\"}]}}]");
+    TEST_ASSERT_EQUAL(1, controller.getRosterSize());
+
+    controller.onKnobIndicatorTouched(0, 0);
+    TEST_ASSERT_TRUE(controller.waitUntilIdle());
+    controller.onKnobPress(0);
+    TEST_ASSERT_TRUE(controller.waitUntilIdle());
+
+    // Functions are labelled as soon as the loco is acquired, with no server round trip
+    std::vector<Function> functions;
+    TEST_ASSERT_TRUE(controller.getFunctionsSnapshot(0, functions));
+    TEST_ASSERT_TRUE(functions.size() >= 2);
+    TEST_ASSERT_EQUAL_STRING("Lights", functions[0].label.c_str());
+    TEST_ASSERT_EQUAL_STRING("Whistle", functions[1].label.c_str());
+    Throttle* throttle = controller.getThrottle(0);
+    TEST_ASSERT_NOT_NULL(throttle->getLocomotive());
+    TEST_ASSERT_EQUAL(4073, throttle->getLocomotive()->getAddress());
+}
+
+static void test_controller_roster_source_refreshes_on_controller_task(void)
+{
+    WiThrottleClient client;
+    JmriJsonClient jsonClient;
+    jsonClient.initialize();
+    JmriJsonThrottle jsonThrottle(jsonClient);
+    TEST_ASSERT_EQUAL(ESP_OK, jsonThrottle.initialize());
+
+    ThrottleController controller(&client);
+    TEST_ASSERT_TRUE(controller.waitUntilIdle());
+    UiTaskState uiState;
+    controller.setUIUpdateCallback(uiTaskCallback, &uiState);
+
+    // The source is used at once, but only the controller task publishes snapshots
+    jsonClient.testProcessMessage(
+        "[{\"type\":\"rosterEntry\",\"data\":{\"name\":\"GWR 4073\",\"address\":\"4073\",\"isLongAddress\":true}}]");
+    controller.setRosterSource(&jsonThrottle);
+    TEST_ASSERT_EQUAL(1, controller.getRosterSize());
+    TEST_ASSERT_TRUE(controller.waitUntilIdle());
+    TEST_ASSERT_EQUAL(1, uiState.calls.load());
+    TEST_ASSERT_TRUE(uiState.task.load() != xTaskGetCurrentTaskHandle());
+
+    controller.setUIUpdateCallback(nullptr, nullptr);
+}
+
+static void test_controller_handles_every_event_under_load(void)
+{
+    WiThrottleClient client;
+    ThrottleController controller(&client);
+    LoadContext context;
+    context.controller = &controller;
+
+    setupThrottleWithLoco(controller, 0, 0, "LocoG", 70);
+    setupThrottleWithLoco(controller, 1, 1, "LocoH", 80);
+    controller.setUIUpdateCallback(countingUiCallback, &context);
+    controller.resetEventStats();
+    ThrottleController::EventStats before = controller.getEventStats();
+
+    // Two encoders and the function panel post at once, without pause
+    esp_log_level_set("ThrottleController", ESP_LOG_WARN);
+    int64_t start = esp_timer_get_time();
+    KnobArgs knobArgs[2] = { { &context, 0 }, { &context, 1 } };
+    TEST_ASSERT_EQUAL(pdPASS, xTaskCreate(rotationTask, "load_knob0", 3072, &knobArgs[0], 5, nullptr));
+    TEST_ASSERT_EQUAL(pdPASS, xTaskCreate(rotationTask, "load_knob1", 3072, &knobArgs[1], 5, nullptr));
+    TEST_ASSERT_EQUAL(pdPASS, xTaskCreate(functionTask, "load_func", 3072, &context, 5, nullptr));
+    for (int waitedMs = 0; waitedMs < 30000 && context.finished < 3; waitedMs += 10) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    TEST_ASSERT_EQUAL(3, context.finished.load());
+    TEST_ASSERT_TRUE(controller.waitUntilIdle(5000));
+    int64_t elapsedUs = esp_timer_get_time() - start;
+    esp_log_level_set("ThrottleController", ESP_LOG_INFO);
+
+    ThrottleController::EventStats stats = controller.getEventStats();
+    const uint32_t total = 2 * LOAD_ROTATIONS + LOAD_FUNCTIONS;
+    ESP_LOGI(TAG, "%lu events in %lld us: max depth %lu, %lu full-queue waits, latency mean %lu us, p99 <= %lu us, max %lu us",
+             (unsigned long)total, (long long)elapsedUs, (unsigned long)stats.maxDepth,
+             (unsigned long)stats.queueFullWaits, (unsigned long)stats.latency.getMeanUs(),
+             (unsigned long)stats.latency.getPercentileUs(99), (unsigned long)stats.latency.getMaxUs());
+    for (int i = 0; i < ThrottleController::DEPTH_BUCKETS; i++) {
+        ESP_LOGI(TAG, "  depth bucket %d: %lu", i, (unsigned long)stats.depthBuckets[i]);
+    }
+
+    // Nothing was dropped: every rotation moved its throttle and refreshed the UI
+    TEST_ASSERT_EQUAL(total, stats.posted - before.posted);
+    TEST_ASSERT_EQUAL(total, stats.handled - before.handled);
+    TEST_ASSERT_EQUAL(total, stats.latency.getCount());
+    uint32_t bucketed = 0;
+    for (int i = 0; i < ThrottleController::DEPTH_BUCKETS; i++) {
+        bucketed += stats.depthBuckets[i];
+    }
+    TEST_ASSERT_EQUAL(total, bucketed);
+    TEST_ASSERT_EQUAL(2 * LOAD_ROTATIONS, context.uiCalls.load());
+
+    int stepsPerClick = ThrottleController::getSpeedStepsPerClick();
+    for (int i = 0; i < 2; i++) {
+        ThrottleController::ThrottleSnapshot snapshot;
+        TEST_ASSERT_TRUE(controller.getThrottleSnapshot(i, snapshot));
+        TEST_ASSERT_EQUAL(stepsPerClick, snapshot.currentSpeed);
+        TEST_ASSERT_TRUE(snapshot.direction);
+    }
+}
+
 extern "C" void register_controller_tests(void)
 {
     RUN_TEST(test_controller_assign_knob_to_unallocated);
@@ -195,6 +430,10 @@ extern "C" void register_controller_tests(void)
     RUN_TEST(test_controller_move_knob_to_unallocated_for_selection);
     RUN_TEST(test_controller_release_resets_knob);
     RUN_TEST(test_controller_rotation_updates_speed);
+    RUN_TEST(test_controller_snapshot_generation_tracks_changes);
     RUN_TEST(test_controller_rotation_cross_zero_switches_to_reverse);
     RUN_TEST(test_controller_rotation_cross_zero_switches_to_forward);
+    RUN_TEST(test_controller_acquire_uses_prefetched_labels);
+    RUN_TEST(test_controller_roster_source_refreshes_on_controller_task);
+    RUN_TEST(test_controller_handles_every_event_under_load);
 }
@@ -0,0 +1,162 @@
+#include "unity.h"
+#include "ThrottleController.h"
+#include "ThrottleTransport.h"
+#include "WiThrottleClient.h"
+#include "WiThrottleCommandEncoder.h"
+#include "JmriJsonThrottle.h"
+#include "Locomotive.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/task.h"
+#include <cstring>
+#include <memory>
+
+static const char* TAG = "ThrottleScalingTests";
+
+namespace {
+    constexpr int BENCH_ROTATIONS = 400;  // Even: the knob ends where it started
+
+    void putLocoOnThrottle(ThrottleController& controller, int throttleId, int knobId, int address)
+    {
+        Throttle* throttle = controller.getThrottle(throttleId);
+        Knob* knob = controller.getKnob(knobId);
+        TEST_ASSERT_NOT_NULL(throttle);
+        TEST_ASSERT_NOT_NULL(knob);
+
+        TEST_ASSERT_TRUE(throttle->assignKnob(knobId));
+        knob->assignToThrottle(throttleId);
+        auto loco = std::make_unique<Locomotive>("Yard", address, Locomotive::AddressType::SHORT);
+        TEST_ASSERT_TRUE(throttle->assignLocomotive(std::move(loco)));
+        knob->startControlling();
+    }
+}
+
+static void test_throttle_ids_encode_past_ten(void)
+{
+    for (int i = 0; i < ThrottleTransport::MAX_THROTTLE_IDS; i++) {
+        char id = ThrottleTransport::throttleIdChar(i);
+        TEST_ASSERT_TRUE(id != '\0');
+        TEST_ASSERT_EQUAL(i, ThrottleTransport::throttleIndex(id));
+    }
+    TEST_ASSERT_EQUAL('9', ThrottleTransport::throttleIdChar(9));
+    TEST_ASSERT_EQUAL('a', ThrottleTransport::throttleIdChar(10));
+    TEST_ASSERT_EQUAL('z', ThrottleTransport::throttleIdChar(35));
+    TEST_ASSERT_EQUAL('\0', ThrottleTransport::throttleIdChar(36));
+    TEST_ASSERT_EQUAL('\0', ThrottleTransport::throttleIdChar(-1));
+
+    // The protocols' own throttles and anything else are not slots
+    const char others[] = { 'T', 'S', 'A', ':', '/', '{', '\0' };
+    for (char id : others) {
+        TEST_ASSERT_EQUAL(-1, ThrottleTransport::throttleIndex(id));
+    }
+
+    // Both wire formats carry the letter ids
+    WiThrottleCommandEncoder::Command command;
+    TEST_ASSERT_TRUE(WiThrottleCommandEncoder::encodeSpeed(command, 'c', 'S', 3, 40));
+    TEST_ASSERT_EQUAL_STRING_LEN("McA", command.data, 3);
+
+    JmriJsonThrottle::Message message;
+    TEST_ASSERT_TRUE(JmriJsonThrottle::encodeSpeed(message, 'c', 63));
+    TEST_ASSERT_NOT_NULL(strstr(message.data, "\"name\":\"Tc\""));
+    TEST_ASSERT_FALSE(JmriJsonThrottle::encodeSpeed(message, 'X', 10));
+}
+
+static void test_controller_drives_slots_past_ten(void)
+{
+    WiThrottleClient client;
+    client.initialize();
+
+    ThrottleController clamped(&client, 100);
+    TEST_ASSERT_EQUAL(ThrottleController::MAX_THROTTLES, clamped.getNumThrottles());
+    ThrottleController single(&client, 0);
+    TEST_ASSERT_EQUAL(1, single.getNumThrottles());
+    ThrottleController defaults(&client);
+    TEST_ASSERT_EQUAL(ThrottleController::NUM_THROTTLES, defaults.getNumThrottles());
+
+    ThrottleController controller(&client, 16);
+    TEST_ASSERT_EQUAL(16, controller.getNumThrottles());
+    putLocoOnThrottle(controller, 12, 0, 40);
+
+    controller.onKnobRotation(0, 1);
+    TEST_ASSERT_TRUE(controller.waitUntilIdle());
+    ThrottleController::ThrottleSnapshot snapshot;
+    TEST_ASSERT_TRUE(controller.getThrottleSnapshot(12, snapshot));
+    TEST_ASSERT_EQUAL(ThrottleController::getSpeedStepsPerClick(), snapshot.currentSpeed);
+
+    // Throttle 12 is 'c' on the wire; a report for it reaches slot 12 and no other
+    uint32_t otherGeneration = controller.getThrottleGeneration(2);
+    client.testProcessMessage("McAS40<;>V20");
+    TEST_ASSERT_TRUE(controller.waitUntilIdle());
+    TEST_ASSERT_TRUE(controller.getThrottleSnapshot(12, snapshot));
+    TEST_ASSERT_EQUAL(20, snapshot.currentSpeed);
+    TEST_ASSERT_EQUAL(otherGeneration, controller.getThrottleGeneration(2));
+
+    // Past the last slot
+    TEST_ASSERT_FALSE(controller.getThrottleSnapshot(16, snapshot));
+    TEST_ASSERT_NULL(controller.getThrottle(16));
+}
+
+static void test_throttle_slot_scaling_benchmark(void)
+{
+    const int slotCounts[] = { 4, 8, 16 };
+    WiThrottleClient client;
+    client.initialize();
+
+    size_t firstHeapUsed = 0;  // The task, queue and timers cost the same at any size
+
+    esp_log_level_set("ThrottleController", ESP_LOG_WARN);
+    for (int slots : slotCounts) {
+        size_t heapBefore = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+        {
+            ThrottleController controller(&client, slots);
+            size_t heapUsed = heapBefore - heap_caps_get_free_size(MALLOC_CAP_8BIT);
+            if (slots == slotCounts[0]) {
+                firstHeapUsed = heapUsed;
+            }
+            size_t perSlot = slots > slotCounts[0]
+                ? (heapUsed - firstHeapUsed) / (slots - slotCounts[0]) : 0;
+
+            // Every slot holds a loco; the knob drives the last one
+            for (int i = 0; i < slots - 1; i++) {
+                putLocoOnThrottle(controller, i, 1, 100 + i);
+                controller.getKnob(1)->release();
+                controller.getThrottle(i)->unassignKnob();
+            }
+            putLocoOnThrottle(controller, slots - 1, 0, 100 + slots - 1);
+            TEST_ASSERT_TRUE(controller.waitUntilIdle());
+            controller.resetEventStats();
+
+            int64_t start = esp_timer_get_time();
+            for (int i = 0; i < BENCH_ROTATIONS; i++) {
+                controller.onKnobRotation(0, (i % 2 == 0) ? 1 : -1);
+            }
+            TEST_ASSERT_TRUE(controller.waitUntilIdle(5000));
+            int64_t elapsedUs = esp_timer_get_time() - start;
+
+            ThrottleController::EventStats stats = controller.getEventStats();
+            TEST_ASSERT_EQUAL(BENCH_ROTATIONS, stats.latency.getCount());
+            ThrottleController::ThrottleSnapshot snapshot;
+            TEST_ASSERT_TRUE(controller.getThrottleSnapshot(slots - 1, snapshot));
+            TEST_ASSERT_EQUAL(0, snapshot.currentSpeed);
+
+            ESP_LOGI(TAG, "%2d slots: %u bytes controller + %u bytes heap (%u per slot past %d), "
+                          "knob update %lld us each (latency mean %lu us, p99 <= %lu us)",
+                     slots, (unsigned)sizeof(ThrottleController), (unsigned)heapUsed,
+                     (unsigned)perSlot, slotCounts[0], (long long)(elapsedUs / BENCH_ROTATIONS),
+                     (unsigned long)stats.latency.getMeanUs(),
+                     (unsigned long)stats.latency.getPercentileUs(99));
+        }
+        // Everything a slot holds goes with the controller (the idle task frees its stack)
+        vTaskDelay(pdMS_TO_TICKS(20));
+        TEST_ASSERT_EQUAL(heapBefore, heap_caps_get_free_size(MALLOC_CAP_8BIT));
+    }
+    esp_log_level_set("ThrottleController", ESP_LOG_INFO);
+}
+
+extern "C" void register_throttle_scaling_tests(void)
+{
+    RUN_TEST(test_throttle_ids_encode_past_ten);
+    RUN_TEST(test_controller_drives_slots_past_ten);
+    RUN_TEST(test_throttle_slot_scaling_benchmark);
+}
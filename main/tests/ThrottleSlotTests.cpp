@@ -0,0 +1,235 @@
+#include "unity.h"
+#include "WiThrottleClient.h"
+#include "LoopbackServer.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include <atomic>
+#include <cstdlib>
+#include <functional>
+#include <string>
+
+static const char* TAG = "ThrottleSlotTests";
+
+namespace {
+    constexpr int OWNER_TASKS = 4;        // One exclusive slot each ('0'-'3')
+    constexpr int ITERATIONS = 200;
+    constexpr char SHARED_SLOT = '4';     // Acquired/released by one task, driven by another
+
+    struct StressContext {
+        WiThrottleClient* client;
+        std::atomic<int> finished{0};
+        std::atomic<bool> flipping{true};
+        std::atomic<uint32_t> commandsSent{0};
+        std::atomic<uint32_t> queueFull{0};
+        std::atomic<uint32_t> unexpectedErrors{0};
+        std::atomic<uint32_t> sharedRejected{0};
+    };
+
+    struct OwnerArgs {
+        StressContext* context;
+        int slot;
+    };
+
+    // Addresses alternate short/long so a torn read would show up as a mismatched type
+    int addressFor(int slot, int iteration)
+    {
+        return (iteration % 2) ? 1000 + slot : 3 + slot;
+    }
+
+    // Retry while the TX queue is full; that is back-pressure, not lock contention
+    esp_err_t sendWithRetry(StressContext* context, const std::function<esp_err_t()>& send)
+    {
+        esp_err_t err;
+        while ((err = send()) == ESP_ERR_NO_MEM) {
+            context->queueFull++;
+            vTaskDelay(1);
+        }
+        if (err == ESP_OK) {
+            context->commandsSent++;
+        }
+        return err;
+    }
+
+    void ownerTask(void* arg)
+    {
+        OwnerArgs* args = static_cast<OwnerArgs*>(arg);
+        StressContext* context = args->context;
+        WiThrottleClient* client = context->client;
+        char throttleId = '0' + args->slot;
+
+        for (int i = 0; i < ITERATIONS; i++) {
+            int address = addressFor(args->slot, i);
+            if (sendWithRetry(context, [&] { return client->acquireLocomotive(throttleId, address, address > 127); }) != ESP_OK) {
+                context->unexpectedErrors++;
+            }
+            for (int speed = 0; speed < 5; speed++) {
+                // Our own slot: must never be refused
+                if (sendWithRetry(context, [&] { return client->setSpeed(throttleId, speed * 10); }) != ESP_OK) {
+                    context->unexpectedErrors++;
+                }
+            }
+            if (sendWithRetry(context, [&] { return client->releaseLocomotive(throttleId); }) != ESP_OK) {
+                context->unexpectedErrors++;
+            }
+        }
+        context->finished++;
+        vTaskDelete(nullptr);
+    }
+
+    void flipperTask(void* arg)
+    {
+        StressContext* context = static_cast<StressContext*>(arg);
+        for (int i = 0; i < ITERATIONS; i++) {
+            int address = addressFor(SHARED_SLOT - '0', i);
+            sendWithRetry(context, [&] { return context->client->acquireLocomotive(SHARED_SLOT, address, address > 127); });
+            vTaskDelay(1);
+            sendWithRetry(context, [&] { return context->client->releaseLocomotive(SHARED_SLOT); });
+        }
+        context->flipping = false;
+        context->finished++;
+        vTaskDelete(nullptr);
+    }
+
+    void sharedSpeedTask(void* arg)
+    {
+        StressContext* context = static_cast<StressContext*>(arg);
+        while (context->flipping) {
+            esp_err_t err = sendWithRetry(context, [&] { return context->client->setSpeed(SHARED_SLOT, 1); });
+            if (err == ESP_ERR_INVALID_STATE) {
+                context->sharedRejected++;  // Slot released at that moment: expected
+            } else if (err != ESP_OK) {
+                context->unexpectedErrors++;
+            }
+        }
+        context->finished++;
+        vTaskDelete(nullptr);
+    }
+
+    // Contend for the state mutex the way the receive task does
+    void rosterTask(void* arg)
+    {
+        StressContext* context = static_cast<StressContext*>(arg);
+        while (context->flipping) {
+            context->client->testProcessMessage("RL2]\\[LocoA}|{3}|{S]\\[LocoB}|{4014}|{L");
+            RosterHandle roster = context->client->getRosterSnapshot();
+            (void)roster;
+            vTaskDelay(1);
+        }
+        context->finished++;
+        vTaskDelete(nullptr);
+    }
+
+    // Check every action command pairs the address with the right type
+    int countTornCommands(const std::string& stream, int& actions)
+    {
+        int torn = 0;
+        size_t pos = 0;
+        while ((pos = stream.find('M', pos)) != std::string::npos) {
+            size_t end = stream.find('\n', pos);
+            if (end == std::string::npos) {
+                break;
+            }
+            std::string line = stream.substr(pos, end - pos);
+            pos = end + 1;
+            if (line.size() < 5 || line[2] != 'A') {
+                continue;
+            }
+            actions++;
+            char type = line[3];
+            int address = atoi(line.c_str() + 4);
+            int slot = line[1] - '0';
+            bool known = address == addressFor(slot, 0) || address == addressFor(slot, 1);
+            if (!known || type != (address > 127 ? 'L' : 'S')) {
+                torn++;
+            }
+        }
+        return torn;
+    }
+}
+
+static void test_throttle_slots_under_concurrent_acquire_release_speed(void)
+{
+    LoopbackServer server;
+    TEST_ASSERT_TRUE(server.listen());
+
+    WiThrottleClient client;
+    client.initialize();
+    TEST_ASSERT_EQUAL(ESP_OK, client.connect("127.0.0.1", server.port));
+    TEST_ASSERT_TRUE(acceptClient(server, client));
+
+    StressContext context;
+    context.client = &client;
+    OwnerArgs ownerArgs[OWNER_TASKS];
+
+    int64_t start = esp_timer_get_time();
+    for (int i = 0; i < OWNER_TASKS; i++) {
+        ownerArgs[i] = OwnerArgs{ &context, i };
+        xTaskCreate(ownerTask, "slot_owner", 4096, &ownerArgs[i], 5, nullptr);
+    }
+    xTaskCreate(flipperTask, "slot_flip", 4096, &context, 5, nullptr);
+    xTaskCreate(sharedSpeedTask, "slot_speed", 4096, &context, 5, nullptr);
+    xTaskCreate(rosterTask, "slot_roster", 4096, &context, 4, nullptr);
+    const int totalTasks = OWNER_TASKS + 3;
+
+    // Drain the server side while the tasks run
+    struct timeval timeout = { 0, 20000 };
+    setsockopt(server.connection, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    std::string stream;
+    char buffer[1024];
+    int idleReads = 0;
+    while (context.finished < totalTasks || idleReads < 5) {
+        int len = recv(server.connection, buffer, sizeof(buffer), 0);
+        if (len > 0) {
+            stream.append(buffer, len);
+            idleReads = 0;
+        } else if (context.finished == totalTasks) {
+            idleReads++;
+        }
+        TEST_ASSERT_TRUE(esp_timer_get_time() - start < 30 * 1000000LL);
+    }
+    int64_t elapsedMs = (esp_timer_get_time() - start) / 1000;
+
+    int actions = 0;
+    int torn = countTornCommands(stream, actions);
+    ESP_LOGI(TAG, "%lu commands in %lld ms (%d action commands, %lu queue-full retries, %lu shared-slot rejects)",
+             (unsigned long)context.commandsSent.load(), (long long)elapsedMs, actions,
+             (unsigned long)context.queueFull.load(), (unsigned long)context.sharedRejected.load());
+
+    TEST_ASSERT_EQUAL(0, context.unexpectedErrors.load());
+    TEST_ASSERT_EQUAL(0, torn);
+    TEST_ASSERT_TRUE(actions >= OWNER_TASKS * ITERATIONS * 5);
+    TEST_ASSERT_EQUAL(0, client.getTxDroppedCount() - context.queueFull.load());
+
+    shutdownClient(server, client);
+}
+
+static void test_throttle_slot_rejects_unknown_id(void)
+{
+    LoopbackServer server;
+    TEST_ASSERT_TRUE(server.listen());
+
+    WiThrottleClient client;
+    client.initialize();
+    TEST_ASSERT_EQUAL(ESP_OK, client.connect("127.0.0.1", server.port));
+    TEST_ASSERT_TRUE(acceptClient(server, client));
+
+    // Lower case letters are throttle slots past '9'; other upper case ones are not
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, client.acquireLocomotive('X', 3, false));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, client.setSpeed('X', 10));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, client.setSpeed('5', 10));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, client.setSpeed('x', 10));
+
+    // The UI's test controls use throttle 'T'
+    TEST_ASSERT_EQUAL(ESP_OK, client.acquireLocomotive('T', 4014, true));
+    TEST_ASSERT_EQUAL(ESP_OK, client.setSpeed('T', 10));
+    std::string received = server.readUntil("MTAL4014<;>V10\n");
+    TEST_ASSERT_TRUE(received.find("MTAL4014<;>V10\n") != std::string::npos);
+
+    shutdownClient(server, client);
+}
+
+extern "C" void register_throttle_slot_tests(void)
+{
+    RUN_TEST(test_throttle_slots_under_concurrent_acquire_release_speed);
+    RUN_TEST(test_throttle_slot_rejects_unknown_id);
+}
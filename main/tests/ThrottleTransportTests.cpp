@@ -0,0 +1,321 @@
+#include "unity.h"
+#include "JmriJsonThrottle.h"
+#include "JmriJsonClient.h"
+#include "WiThrottleClient.h"
+#include "LoopbackServer.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include <cstring>
+#include <string>
+#include <vector>
+
+static const char* TAG = "ThrottleTransportTests";
+
+static const char* ROSTER_REQUEST = "{\"type\":\"roster\",\"method\":\"list\"}";
+
+static void assertMessage(const char* expected, const JmriJsonThrottle::Message& message)
+{
+    TEST_ASSERT_EQUAL(strlen(expected), message.length);
+    TEST_ASSERT_EQUAL_STRING_LEN(expected, message.data, strlen(expected));
+}
+
+// Brings the session up and discards the roster request it triggers
+static void connectJsonClient(JmriJsonClient& client)
+{
+    client.testSetConnected(true);
+    std::string queued;
+    TEST_ASSERT_TRUE(client.testTakeQueuedMessage(queued));
+    TEST_ASSERT_EQUAL_STRING(ROSTER_REQUEST, queued.c_str());
+}
+
+static void test_json_throttle_encoders(void)
+{
+    JmriJsonThrottle::Message message;
+
+    TEST_ASSERT_TRUE(JmriJsonThrottle::encodeAcquire(message, '0', 3, false));
+    assertMessage("{\"type\":\"throttle\",\"data\":{\"name\":\"T0\",\"address\":3,\"isLongAddress\":false}}", message);
+
+    TEST_ASSERT_TRUE(JmriJsonThrottle::encodeRelease(message, '1'));
+    assertMessage("{\"type\":\"throttle\",\"data\":{\"name\":\"T1\",\"release\":null}}", message);
+
+    TEST_ASSERT_TRUE(JmriJsonThrottle::encodeSpeed(message, '2', 63));
+    assertMessage("{\"type\":\"throttle\",\"data\":{\"name\":\"T2\",\"speed\":0.500}}", message);
+
+    TEST_ASSERT_TRUE(JmriJsonThrottle::encodeSpeed(message, '2', 126));
+    assertMessage("{\"type\":\"throttle\",\"data\":{\"name\":\"T2\",\"speed\":1.000}}", message);
+
+    TEST_ASSERT_TRUE(JmriJsonThrottle::encodeDirection(message, '3', false));
+    assertMessage("{\"type\":\"throttle\",\"data\":{\"name\":\"T3\",\"forward\":false}}", message);
+
+    TEST_ASSERT_TRUE(JmriJsonThrottle::encodeFunction(message, 'T', 12, true));
+    assertMessage("{\"type\":\"throttle\",\"data\":{\"name\":\"TT\",\"F12\":true}}", message);
+
+    TEST_ASSERT_TRUE(JmriJsonThrottle::encodeStatus(message, '0'));
+    assertMessage("{\"type\":\"throttle\",\"data\":{\"name\":\"T0\",\"status\":true}}", message);
+
+    TEST_ASSERT_FALSE(JmriJsonThrottle::encodeSpeed(message, 'X', 10));
+    TEST_ASSERT_EQUAL(0, message.length);
+    TEST_ASSERT_FALSE(JmriJsonThrottle::encodeFunction(message, '0', 29, true));
+    TEST_ASSERT_EQUAL(0, message.length);
+}
+
+static void test_json_throttle_parses_pushed_state(void)
+{
+    JmriJsonClient client;
+    client.initialize();
+    JmriJsonThrottle throttle(client);
+    TEST_ASSERT_EQUAL(ESP_OK, throttle.initialize());
+
+    std::vector<ThrottleTransport::ThrottleUpdate> updates;
+    throttle.setThrottleStateCallback([&updates](const ThrottleTransport::ThrottleUpdate& update) {
+        updates.push_back(update);
+    });
+
+    client.testProcessMessage(
+        "{\"type\":\"throttle\",\"data\":{\"name\":\"T1\",\"address\":41,\"speed\":0.5,"
+        "\"forward\":false,\"F0\":true,\"F2\":false,"
+        "\"rosterEntry\":{\"name\":\"GWR 4073\",\"F1\":true}}}");
+
+    TEST_ASSERT_EQUAL(3, updates.size());
+    TEST_ASSERT_EQUAL('1', updates[0].throttleId);
+    TEST_ASSERT_EQUAL(41, updates[0].address);
+    TEST_ASSERT_EQUAL(63, updates[0].speed);
+    TEST_ASSERT_EQUAL(0, updates[0].direction);
+    TEST_ASSERT_EQUAL(-1, updates[0].function);
+    TEST_ASSERT_EQUAL(0, updates[1].function);
+    TEST_ASSERT_TRUE(updates[1].functionState);
+    TEST_ASSERT_EQUAL(-1, updates[1].speed);
+    TEST_ASSERT_EQUAL(2, updates[2].function);
+    TEST_ASSERT_FALSE(updates[2].functionState);
+
+    // Emergency stop is reported as -1 and maps to step 0
+    updates.clear();
+    client.testProcessMessage("{\"type\":\"throttle\",\"data\":{\"name\":\"T1\",\"speed\":-1.0}}");
+    TEST_ASSERT_EQUAL(1, updates.size());
+    TEST_ASSERT_EQUAL(0, updates[0].speed);
+    TEST_ASSERT_EQUAL(-1, updates[0].direction);
+
+    // Throttles opened by other clients on the same server are ignored
+    updates.clear();
+    client.testProcessMessage("{\"type\":\"throttle\",\"data\":{\"name\":\"cab7\",\"speed\":1.0}}");
+    TEST_ASSERT_EQUAL(0, updates.size());
+}
+
+static void test_json_throttle_builds_roster_from_list(void)
+{
+    JmriJsonClient client;
+    client.initialize();
+    JmriJsonThrottle throttle(client);
+    TEST_ASSERT_EQUAL(ESP_OK, throttle.initialize());
+    TEST_ASSERT_TRUE(throttle.getRosterSnapshot() == nullptr);
+
+    client.testProcessMessage(
+        "[{\"type\":\"rosterEntry\",\"data\":{\"name\":\"GWR 4073\",\"address\":\"4073\",\"isLongAddress\":true,"
+        "\"functionKeys\":[{\"name\":\"F0\",\"label\":\"Lights\"}]}},"
+        "{\"type\":\"rosterEntry\",\"data\":{\"name\":\"Shunter\",\"address\":\"3\",\"isLongAddress\":false}}]");
+
+    TEST_ASSERT_EQUAL(2, throttle.getRosterSize());
+    ThrottleTransport::Locomotive loco;
+    TEST_ASSERT_TRUE(throttle.getRosterEntry(0, loco));
+    TEST_ASSERT_EQUAL_STRING("GWR 4073", loco.name.c_str());
+    TEST_ASSERT_EQUAL(4073, loco.address);
+    TEST_ASSERT_EQUAL('L', loco.addressType);
+    TEST_ASSERT_TRUE(throttle.getRosterEntry(1, loco));
+    TEST_ASSERT_EQUAL_STRING("Shunter", loco.name.c_str());
+    TEST_ASSERT_EQUAL(3, loco.address);
+    TEST_ASSERT_EQUAL('S', loco.addressType);
+
+    // Function labels come with the list, before any loco is acquired
+    RosterHandle roster = throttle.getRosterSnapshot();
+    TEST_ASSERT_TRUE((*roster)[0].functionLabel(0) == "Lights");
+    TEST_ASSERT_TRUE((*roster)[1].functionLabels.empty());
+
+    // A list cut short keeps the roster already published
+    client.testProcessMessage(
+        "[{\"type\":\"rosterEntry\",\"data\":{\"name\":\"Lone\",\"address\":\"9\",\"isLongAddress\":false}},"
+        "{\"type\":\"rosterEntry\",\"data\":{\"name\":\"Cut");
+    TEST_ASSERT_EQUAL(2, throttle.getRosterSize());
+}
+
+static void test_json_throttle_applies_roster_updates(void)
+{
+    JmriJsonClient client;
+    client.initialize();
+    JmriJsonThrottle throttle(client);
+    TEST_ASSERT_EQUAL(ESP_OK, throttle.initialize());
+    connectJsonClient(client);
+
+    std::vector<char> labelledThrottles;
+    std::vector<std::string> lastLabels;
+    throttle.setFunctionLabelsCallback([&](char throttleId, const std::vector<std::string>& labels) {
+        labelledThrottles.push_back(throttleId);
+        lastLabels = labels;
+    });
+
+    client.testProcessMessage(
+        "[{\"type\":\"rosterEntry\",\"data\":{\"name\":\"GWR 4073\",\"address\":\"4073\",\"isLongAddress\":true}},"
+        "{\"type\":\"rosterEntry\",\"data\":{\"name\":\"Shunter\",\"address\":\"3\",\"isLongAddress\":false}}]");
+    RosterHandle original = throttle.getRosterSnapshot();
+    TEST_ASSERT_EQUAL(2, original->size());
+    TEST_ASSERT_EQUAL(0, labelledThrottles.size());
+
+    // An edited entry replaces the old one in place; its labels reach the throttle holding it
+    TEST_ASSERT_EQUAL(ESP_OK, throttle.acquireLocomotive('1', 3, false));
+    client.testProcessMessage(
+        "{\"type\":\"rosterEntry\",\"data\":{\"name\":\"Shunter\",\"address\":\"3\",\"isLongAddress\":false,"
+        "\"functionKeys\":[{\"name\":\"F0\",\"label\":\"Lights\"},{\"name\":\"F2\",\"label\":\"Horn\"}]}}");
+    TEST_ASSERT_EQUAL(2, throttle.getRosterSize());
+    TEST_ASSERT_TRUE((*throttle.getRosterSnapshot())[1].functionLabel(2) == "Horn");
+    TEST_ASSERT_TRUE((*original)[1].functionLabels.empty());
+    TEST_ASSERT_EQUAL(1, labelledThrottles.size());
+    TEST_ASSERT_EQUAL('1', labelledThrottles[0]);
+    TEST_ASSERT_EQUAL_STRING("Lights", lastLabels[0].c_str());
+    TEST_ASSERT_EQUAL_STRING("Horn", lastLabels[2].c_str());
+
+    // A new entry is appended
+    client.testProcessMessage(
+        "{\"type\":\"rosterEntry\",\"data\":{\"name\":\"Tank\",\"address\":\"47\",\"isLongAddress\":false}}");
+    TEST_ASSERT_EQUAL(3, throttle.getRosterSize());
+    ThrottleTransport::Locomotive loco;
+    TEST_ASSERT_TRUE(throttle.getRosterEntry(2, loco));
+    TEST_ASSERT_EQUAL_STRING("Tank", loco.name.c_str());
+
+    // A deleted entry is removed, an unknown one changes nothing
+    client.testProcessMessage(
+        "{\"type\":\"rosterEntry\",\"method\":\"delete\",\"data\":{\"name\":\"GWR 4073\"}}");
+    TEST_ASSERT_EQUAL(2, throttle.getRosterSize());
+    TEST_ASSERT_EQUAL(-1, throttle.getRosterSnapshot()->find("GWR 4073"));
+    client.testProcessMessage(
+        "{\"type\":\"rosterEntry\",\"method\":\"delete\",\"data\":{\"name\":\"Missing\"}}");
+    TEST_ASSERT_EQUAL(2, throttle.getRosterSize());
+
+    client.testSetConnected(false);
+}
+
+static void test_json_throttle_commands_reach_queue(void)
+{
+    JmriJsonClient client;
+    client.initialize();
+    JmriJsonThrottle throttle(client);
+    TEST_ASSERT_EQUAL(ESP_OK, throttle.initialize());
+
+    // Nothing goes out before the session is up or before a loco is acquired
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, throttle.acquireLocomotive('0', 3, false));
+    connectJsonClient(client);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, throttle.setSpeed('0', 10));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, throttle.acquireLocomotive('X', 3, false));
+
+    TEST_ASSERT_EQUAL(ESP_OK, throttle.acquireLocomotive('0', 3, false));
+    TEST_ASSERT_EQUAL(ESP_OK, throttle.setSpeed('0', 126));
+    TEST_ASSERT_EQUAL(ESP_OK, throttle.setFunction('0', 1, true));
+    TEST_ASSERT_EQUAL(ESP_OK, throttle.querySpeed('0'));
+
+    std::string queued;
+    TEST_ASSERT_TRUE(client.testTakeQueuedMessage(queued));
+    TEST_ASSERT_EQUAL_STRING("{\"type\":\"throttle\",\"data\":{\"name\":\"T0\",\"address\":3,\"isLongAddress\":false}}", queued.c_str());
+    TEST_ASSERT_TRUE(client.testTakeQueuedMessage(queued));
+    TEST_ASSERT_EQUAL_STRING("{\"type\":\"throttle\",\"data\":{\"name\":\"T0\",\"speed\":1.000}}", queued.c_str());
+    TEST_ASSERT_TRUE(client.testTakeQueuedMessage(queued));
+    TEST_ASSERT_EQUAL_STRING("{\"type\":\"throttle\",\"data\":{\"name\":\"T0\",\"F1\":true}}", queued.c_str());
+    TEST_ASSERT_TRUE(client.testTakeQueuedMessage(queued));
+    TEST_ASSERT_EQUAL_STRING("{\"type\":\"throttle\",\"data\":{\"name\":\"T0\",\"status\":true}}", queued.c_str());
+
+    // JMRI drops a closed session's throttles, so ours are forgotten too
+    client.testSetConnected(false);
+    client.testSetConnected(true);
+    TEST_ASSERT_TRUE(client.testTakeQueuedMessage(queued));
+    TEST_ASSERT_EQUAL_STRING(ROSTER_REQUEST, queued.c_str());
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, throttle.setSpeed('0', 10));
+
+    // A server-side release frees the slot as well
+    TEST_ASSERT_EQUAL(ESP_OK, throttle.acquireLocomotive('2', 41, false));
+    client.testProcessMessage("{\"type\":\"throttle\",\"data\":{\"name\":\"T2\",\"release\":null}}");
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, throttle.setDirection('2', true));
+
+    client.testSetConnected(false);
+}
+
+static void test_json_throttle_cost_against_withrottle(void)
+{
+    const int bursts = 4;
+    const int perBurst = 8;  // Fits the JSON TX queue between drains
+
+    // WiThrottle: second socket, receive task and TX queue
+    size_t heapBefore = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    LoopbackServer server;
+    TEST_ASSERT_TRUE(server.listen());
+    WiThrottleClient wiThrottle;
+    wiThrottle.initialize();
+    TEST_ASSERT_EQUAL(ESP_OK, wiThrottle.connect("127.0.0.1", server.port));
+    TEST_ASSERT_TRUE(acceptClient(server, wiThrottle));
+    TEST_ASSERT_EQUAL(ESP_OK, wiThrottle.acquireLocomotive('0', 3, false));
+    vTaskDelay(pdMS_TO_TICKS(20));
+    size_t wiThrottleHeap = heapBefore - heap_caps_get_free_size(MALLOC_CAP_8BIT);
+
+    int64_t wiThrottleWorstUs = 0;
+    int64_t wiThrottleTotalUs = 0;
+    for (int b = 0; b < bursts; b++) {
+        for (int i = 0; i < perBurst; i++) {
+            int64_t start = esp_timer_get_time();
+            TEST_ASSERT_EQUAL(ESP_OK, wiThrottle.setSpeed('0', b * perBurst + i));
+            int64_t elapsedUs = esp_timer_get_time() - start;
+            wiThrottleTotalUs += elapsedUs;
+            if (elapsedUs > wiThrottleWorstUs) {
+                wiThrottleWorstUs = elapsedUs;
+            }
+        }
+        vTaskDelay(pdMS_TO_TICKS(20));
+    }
+    shutdownClient(server, wiThrottle);
+
+    // JMRI JSON: rides on the client that already exists for power and sensors
+    JmriJsonClient client;
+    client.initialize();
+    heapBefore = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    {
+        JmriJsonThrottle throttle(client);
+        TEST_ASSERT_EQUAL(ESP_OK, throttle.initialize());
+        connectJsonClient(client);
+        TEST_ASSERT_EQUAL(ESP_OK, throttle.acquireLocomotive('0', 3, false));
+        size_t jsonHeap = heapBefore - heap_caps_get_free_size(MALLOC_CAP_8BIT);
+
+        int64_t jsonWorstUs = 0;
+        int64_t jsonTotalUs = 0;
+        std::string queued;
+        for (int b = 0; b < bursts; b++) {
+            while (client.testTakeQueuedMessage(queued)) {
+            }
+            for (int i = 0; i < perBurst; i++) {
+                int64_t start = esp_timer_get_time();
+                TEST_ASSERT_EQUAL(ESP_OK, throttle.setSpeed('0', b * perBurst + i));
+                int64_t elapsedUs = esp_timer_get_time() - start;
+                jsonTotalUs += elapsedUs;
+                if (elapsedUs > jsonWorstUs) {
+                    jsonWorstUs = elapsedUs;
+                }
+            }
+        }
+        TEST_ASSERT_EQUAL(0, client.getTxStats().dropped);
+
+        ESP_LOGI(TAG, "WiThrottle: %u bytes heap, setSpeed avg %lld us, worst %lld us",
+                 (unsigned)wiThrottleHeap, (long long)(wiThrottleTotalUs / (bursts * perBurst)),
+                 (long long)wiThrottleWorstUs);
+        ESP_LOGI(TAG, "JMRI JSON:  %u bytes heap, setSpeed avg %lld us, worst %lld us",
+                 (unsigned)jsonHeap, (long long)(jsonTotalUs / (bursts * perBurst)),
+                 (long long)jsonWorstUs);
+        TEST_ASSERT_TRUE(jsonHeap <= wiThrottleHeap);
+        TEST_ASSERT_TRUE(jsonTotalUs / (bursts * perBurst) < 50);
+    }
+    client.testSetConnected(false);
+}
+
+extern "C" void register_throttle_transport_tests(void)
+{
+    RUN_TEST(test_json_throttle_encoders);
+    RUN_TEST(test_json_throttle_parses_pushed_state);
+    RUN_TEST(test_json_throttle_builds_roster_from_list);
+    RUN_TEST(test_json_throttle_applies_roster_updates);
+    RUN_TEST(test_json_throttle_commands_reach_queue);
+    RUN_TEST(test_json_throttle_cost_against_withrottle);
+}
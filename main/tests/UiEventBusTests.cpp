@@ -0,0 +1,136 @@
+#include "unity.h"
+#include "UiEventBus.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <atomic>
+
+namespace {
+    constexpr int PRODUCER_TASKS = 3;
+    constexpr int EVENTS_PER_PRODUCER = 5000;
+
+    struct ProducerContext {
+        UiEventBus* bus = nullptr;
+        std::atomic<int> finished{0};
+    };
+
+    struct ProducerArgs {
+        ProducerContext* context;
+        int throttleId;
+    };
+
+    void producerTask(void* arg)
+    {
+        ProducerArgs* args = static_cast<ProducerArgs*>(arg);
+        for (int i = 0; i < EVENTS_PER_PRODUCER; i++) {
+            args->context->bus->post(UiEventBus::THROTTLE_METER, args->throttleId);
+        }
+        args->context->finished++;
+        vTaskDelete(nullptr);
+    }
+}
+
+static void test_ui_event_bus_coalesces_per_widget(void)
+{
+    UiEventBus bus;
+    UiEventBus::DirtySet dirty;
+    TEST_ASSERT_FALSE(bus.collect(dirty));
+    TEST_ASSERT_FALSE(dirty.any());
+
+    // A burst of speed changes on one throttle is one meter redraw
+    for (int i = 0; i < 10; i++) {
+        TEST_ASSERT_TRUE(bus.post(UiEventBus::THROTTLE_METER, 2));
+    }
+    TEST_ASSERT_TRUE(bus.post(UiEventBus::FUNCTION_PANEL, 1));
+    TEST_ASSERT_TRUE(bus.post(UiEventBus::TRACK_POWER));
+    TEST_ASSERT_TRUE(bus.post(UiEventBus::TRACK_POWER));
+
+    TEST_ASSERT_TRUE(bus.collect(dirty));
+    TEST_ASSERT_EQUAL_UINT32(0x4, dirty.throttleMeters);
+    TEST_ASSERT_EQUAL_UINT32(0x2, dirty.functionPanels);
+    TEST_ASSERT_FALSE(dirty.rosterCarousel);
+    TEST_ASSERT_TRUE(dirty.trackPower);
+    TEST_ASSERT_FALSE(dirty.connectionStatus);
+
+    UiEventBus::Stats stats = bus.getStats();
+    TEST_ASSERT_EQUAL(13, stats.posted);
+    TEST_ASSERT_EQUAL(11, stats.throttleEvents);
+    TEST_ASSERT_EQUAL(2, stats.statusEvents);
+    TEST_ASSERT_EQUAL(1, stats.frames);
+    TEST_ASSERT_EQUAL(10, stats.coalesced);
+
+    // Nothing carries over to the next frame
+    TEST_ASSERT_FALSE(bus.collect(dirty));
+    TEST_ASSERT_EQUAL(1, bus.getStats().frames);
+
+    // ALL_THROTTLES marks every meter
+    bus.post(UiEventBus::THROTTLE_METER | UiEventBus::ROSTER_CAROUSEL, UiEventBus::ALL_THROTTLES);
+    TEST_ASSERT_TRUE(bus.collect(dirty));
+    TEST_ASSERT_EQUAL_UINT32(UINT32_MAX, dirty.throttleMeters);
+    TEST_ASSERT_EQUAL_UINT32(0, dirty.functionPanels);
+    TEST_ASSERT_TRUE(dirty.rosterCarousel);
+}
+
+static void test_ui_event_bus_overflow_redraws_everything(void)
+{
+    UiEventBus bus(4);
+    for (int i = 0; i < 4; i++) {
+        TEST_ASSERT_TRUE(bus.post(UiEventBus::THROTTLE_METER, 0));
+    }
+    // Producers never wait; the dropped event becomes a full refresh
+    TEST_ASSERT_FALSE(bus.post(UiEventBus::CONNECTION_STATUS));
+    TEST_ASSERT_EQUAL(1, bus.getStats().overflows);
+
+    UiEventBus::DirtySet dirty;
+    TEST_ASSERT_TRUE(bus.collect(dirty));
+    TEST_ASSERT_EQUAL_UINT32(UINT32_MAX, dirty.throttleMeters);
+    TEST_ASSERT_EQUAL_UINT32(UINT32_MAX, dirty.functionPanels);
+    TEST_ASSERT_TRUE(dirty.rosterCarousel);
+    TEST_ASSERT_TRUE(dirty.trackPower);
+    TEST_ASSERT_TRUE(dirty.connectionStatus);
+
+    TEST_ASSERT_FALSE(bus.collect(dirty));
+    bus.resetStats();
+    TEST_ASSERT_EQUAL(0, bus.getStats().posted);
+    TEST_ASSERT_EQUAL(0, bus.getStats().overflows);
+}
+
+static void test_ui_event_bus_concurrent_producers(void)
+{
+    UiEventBus bus(16);
+    ProducerContext context;
+    context.bus = &bus;
+    ProducerArgs args[PRODUCER_TASKS];
+
+    for (int i = 0; i < PRODUCER_TASKS; i++) {
+        args[i] = ProducerArgs{ &context, i };
+        TEST_ASSERT_EQUAL(pdPASS, xTaskCreate(producerTask, "ui_producer", 3072, &args[i], 5, nullptr));
+    }
+
+    // Every producer's throttle is seen dirty, however the posts interleave with frames
+    uint32_t seen = 0;
+    UiEventBus::DirtySet dirty;
+    while (context.finished < PRODUCER_TASKS) {
+        if (bus.collect(dirty)) {
+            seen |= dirty.throttleMeters;
+        }
+        vTaskDelay(1);
+    }
+    if (bus.collect(dirty)) {
+        seen |= dirty.throttleMeters;
+    }
+
+    TEST_ASSERT_EQUAL_UINT32(0x7, seen & 0x7);
+    TEST_ASSERT_FALSE(bus.collect(dirty));
+
+    // Each post was either queued or turned into a full refresh
+    UiEventBus::Stats stats = bus.getStats();
+    TEST_ASSERT_EQUAL(PRODUCER_TASKS * EVENTS_PER_PRODUCER, stats.posted + stats.overflows);
+    TEST_ASSERT_TRUE(stats.frames <= stats.posted + stats.overflows);
+}
+
+extern "C" void register_ui_event_bus_tests(void)
+{
+    RUN_TEST(test_ui_event_bus_coalesces_per_widget);
+    RUN_TEST(test_ui_event_bus_overflow_redraws_everything);
+    RUN_TEST(test_ui_event_bus_concurrent_producers);
+}
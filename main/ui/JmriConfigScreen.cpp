@@ -1,12 +1,12 @@
 #include "JmriConfigScreen.h"
 #include "wrappers/main_screen_wrapper.h"
 #include "esp_log.h"
+#include "../controller/AppController.h"
 #include "../controller/WiFiController.h"
 #include "../hardware/RotaryEncoderHal.h"
 #include "esp_app_desc.h"
 #include "esp_chip_info.h"
-#include "nvs_flash.h"
-#include "nvs.h"
+#include "Settings.h"
 #include "lvgl_port.h"
 #include <cstring>
 
@@ -17,13 +17,6 @@ extern "C" {
 
 static const char* TAG = "JmriConfigScreen";
 
-// NVS keys for JMRI settings
-static const char* NVS_NAMESPACE = "jmri";
-static const char* NVS_KEY_SERVER_IP = "server_ip";
-static const char* NVS_KEY_WITHROTTLE_PORT = "wt_port";
-static const char* NVS_KEY_POWER_MANAGER = "power_mgr";
-static const char* NVS_KEY_SPEED_STEPS = "speed_steps";
-
 JmriConfigScreen::JmriConfigScreen(JmriJsonClient& jsonClient,
                                    WiThrottleClient& wiThrottleClient,
                                    WiFiController* wifiController,
@@ -31,6 +24,8 @@ JmriConfigScreen::JmriConfigScreen(JmriJsonClient& jsonClient,
     : m_screen(nullptr)
     , m_serverIpInput(nullptr)
     , m_wiThrottlePortInput(nullptr)
+    , m_jsonPortInput(nullptr)
+    , m_throttleProtocolDropdown(nullptr)
     , m_powerManagerInput(nullptr)
         , m_speedStepsInput(nullptr)
     , m_statusWifiValue(nullptr)
@@ -172,7 +167,7 @@ void JmriConfigScreen::createConfigSection(lv_obj_t* parent)
     lv_obj_set_size(configContainer, LV_PCT(100), LV_SIZE_CONTENT);
     lv_obj_set_flex_flow(configContainer, LV_FLEX_FLOW_ROW);
     lv_obj_set_flex_align(configContainer, LV_FLEX_ALIGN_SPACE_BETWEEN, LV_FLEX_ALIGN_START, LV_FLEX_ALIGN_START);
-    lv_obj_set_style_pad_bottom(configContainer, 50, 0);
+    lv_obj_set_style_pad_bottom(configContainer, 20, 0);
     lv_obj_set_style_pad_column(configContainer, 20, 0);
     
     // Left column (Server settings)
@@ -211,6 +206,22 @@ void JmriConfigScreen::createConfigSection(lv_obj_t* parent)
     lv_textarea_set_max_length(m_wiThrottlePortInput, 5);
     lv_obj_add_event_cb(m_wiThrottlePortInput, onTextAreaFocused, LV_EVENT_FOCUSED, this);
     lv_obj_add_event_cb(m_wiThrottlePortInput, onTextAreaDefocused, LV_EVENT_DEFOCUSED, this);
+
+    // JSON Port label
+    lv_obj_t* jsonPortLabel = lv_label_create(leftColumn);
+    lv_label_set_text(jsonPortLabel, "JSON Port:");
+    lv_obj_set_width(jsonPortLabel, LV_PCT(100));
+
+    // JSON Port input (used directly when throttles run over JSON)
+    m_jsonPortInput = lv_textarea_create(leftColumn);
+    lv_textarea_set_one_line(m_jsonPortInput, true);
+    lv_textarea_set_placeholder_text(m_jsonPortInput, "12080");
+    lv_textarea_set_text(m_jsonPortInput, "12080");
+    lv_obj_set_width(m_jsonPortInput, LV_PCT(100));
+    lv_textarea_set_accepted_chars(m_jsonPortInput, "0123456789");
+    lv_textarea_set_max_length(m_jsonPortInput, 5);
+    lv_obj_add_event_cb(m_jsonPortInput, onTextAreaFocused, LV_EVENT_FOCUSED, this);
+    lv_obj_add_event_cb(m_jsonPortInput, onTextAreaDefocused, LV_EVENT_DEFOCUSED, this);
     
     // Right column (Power settings)
     lv_obj_t* rightColumn = lv_obj_create(configContainer);
@@ -250,6 +261,16 @@ void JmriConfigScreen::createConfigSection(lv_obj_t* parent)
     lv_obj_add_event_cb(m_speedStepsInput, onTextAreaFocused, LV_EVENT_FOCUSED, this);
     lv_obj_add_event_cb(m_speedStepsInput, onTextAreaDefocused, LV_EVENT_DEFOCUSED, this);
 
+    // Throttle Protocol label
+    lv_obj_t* protocolLabel = lv_label_create(rightColumn);
+    lv_label_set_text(protocolLabel, "Throttle Protocol:");
+    lv_obj_set_width(protocolLabel, LV_PCT(100));
+
+    // Throttle Protocol selector (option index = ThrottleProtocol value)
+    m_throttleProtocolDropdown = lv_dropdown_create(rightColumn);
+    lv_dropdown_set_options(m_throttleProtocolDropdown, "WiThrottle\nJMRI JSON");
+    lv_obj_set_width(m_throttleProtocolDropdown, LV_PCT(100));
+
     // Notes removed to make space for status summary row
 }
 
@@ -326,6 +347,8 @@ void JmriConfigScreen::showKeyboard(lv_obj_t* textarea)
             lv_label_set_text(m_keyboardLabel, "Editing: Server IP Address");
         } else if (textarea == m_wiThrottlePortInput) {
             lv_label_set_text(m_keyboardLabel, "Editing: WiThrottle Port");
+        } else if (textarea == m_jsonPortInput) {
+            lv_label_set_text(m_keyboardLabel, "Editing: JSON Port");
         } else if (textarea == m_powerManagerInput) {
             lv_label_set_text(m_keyboardLabel, "Editing: Power Manager Name");
         }
@@ -419,7 +442,9 @@ void JmriConfigScreen::connectToJmri()
 {
     std::string serverIp = getServerIpText();
     std::string wtPortStr = getWiThrottlePortText();
+    std::string jsonPortStr = getJsonPortText();
     std::string powerMgr = getPowerManagerText();
+    ThrottleProtocol protocol = getSelectedThrottleProtocol();
     
     if (serverIp.empty()) {
         ESP_LOGW(TAG, "Server IP is empty");
@@ -428,6 +453,7 @@ void JmriConfigScreen::connectToJmri()
     
     // Parse WiThrottle port
     uint16_t wtPort = wtPortStr.empty() ? 12090 : std::atoi(wtPortStr.c_str());
+    uint16_t jsonPort = jsonPortStr.empty() ? 12080 : std::atoi(jsonPortStr.c_str());
     
     // Set power manager name (use default if empty)
     if (powerMgr.empty()) {
@@ -440,14 +466,28 @@ void JmriConfigScreen::connectToJmri()
     
     // Save settings
     saveSettings();
-    
-    // Connect WiThrottle first - it will auto-discover JSON port
-    esp_err_t err = m_wiThrottleClient.connect(serverIp, wtPort);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to connect WiThrottle client");
+
+    // Route throttles through the chosen transport before any loco is acquired
+    AppController::instance().setThrottleProtocol(protocol);
+
+    if (protocol == ThrottleProtocol::JMRI_JSON) {
+        // Throttles ride on the JSON socket; no WiThrottle connection needed
+        m_wiThrottleClient.setWebPortCallback(nullptr);
+        m_wiThrottleClient.disconnect();
+
+        ESP_LOGI(TAG, "Connecting JSON client to port %d (JSON throttles)", jsonPort);
+        m_jsonClient.disconnect();  // connect() refuses while an earlier attempt is in flight
+        esp_err_t err = m_jsonClient.connect(serverIp, jsonPort);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to connect JSON client");
+        }
+
+        updateStatus();
+        return;
     }
     
-    // Set callback to connect JSON when port is discovered
+    // Set callback to connect JSON when port is discovered. Set before
+    // connecting: the connection opens in the background and PW may come at once
     m_wiThrottleClient.setWebPortCallback([this, serverIp](uint16_t jsonPort) {
         ESP_LOGI(TAG, "Auto-connecting JSON client to port %d", jsonPort);
         esp_err_t err = m_jsonClient.connect(serverIp, jsonPort);
@@ -456,6 +496,12 @@ void JmriConfigScreen::connectToJmri()
         }
     });
     
+    // Connect WiThrottle first - it will auto-discover JSON port
+    esp_err_t err = m_wiThrottleClient.connect(serverIp, wtPort);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to connect WiThrottle client");
+    }
+    
     // Update status
     updateStatus();
 }
@@ -472,75 +518,77 @@ void JmriConfigScreen::disconnectFromJmri()
 
 void JmriConfigScreen::saveSettings()
 {
-    nvs_handle_t handle;
-    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to open NVS: %s", esp_err_to_name(err));
-        return;
-    }
+    Settings& settings = Settings::instance();
     
     std::string serverIp = getServerIpText();
-    std::string wtPort = getWiThrottlePortText();
     std::string powerMgr = getPowerManagerText();
+    int wtPort = atoi(getWiThrottlePortText().c_str());
+    int jsonPort = atoi(getJsonPortText().c_str());
     const char* speedStepsText = lv_textarea_get_text(m_speedStepsInput);
     int speedSteps = speedStepsText ? atoi(speedStepsText) : 4;
     if (speedSteps < 1) speedSteps = 1;
     if (speedSteps > 20) speedSteps = 20;
     
-    nvs_set_str(handle, NVS_KEY_SERVER_IP, serverIp.c_str());
-    nvs_set_str(handle, NVS_KEY_WITHROTTLE_PORT, wtPort.c_str());
-    nvs_set_str(handle, NVS_KEY_POWER_MANAGER, powerMgr.c_str());
-    nvs_set_i32(handle, NVS_KEY_SPEED_STEPS, speedSteps);
+    // Held in RAM at once; unchanged values are not rewritten
+    settings.setString(Settings::Key::SERVER_IP, serverIp);
+    if (settings.setInt(Settings::Key::WITHROTTLE_PORT, wtPort) != ESP_OK) {
+        ESP_LOGW(TAG, "Invalid WiThrottle port, not saved");
+    }
+    if (settings.setInt(Settings::Key::JSON_PORT, jsonPort) != ESP_OK) {
+        ESP_LOGW(TAG, "Invalid JSON port, not saved");
+    }
+    settings.setInt(Settings::Key::THROTTLE_PROTOCOL, static_cast<int32_t>(getSelectedThrottleProtocol()));
+    settings.setString(Settings::Key::POWER_MANAGER, powerMgr);
+    settings.setInt(Settings::Key::SPEED_STEPS, speedSteps);
     
-    nvs_commit(handle);
-    nvs_close(handle);
+    // An explicit save goes to flash now, not after the write-behind delay
+    esp_err_t err = settings.flush();
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to write JMRI settings to flash: %s", esp_err_to_name(err));
+    }
     
     ESP_LOGI(TAG, "JMRI settings saved (Power Manager: %s, Speed Steps: %d)", powerMgr.c_str(), speedSteps);
 }
 
 void JmriConfigScreen::loadSettings()
 {
-    nvs_handle_t handle;
-    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle);
-    if (err != ESP_OK) {
-        ESP_LOGD(TAG, "No saved JMRI settings");
-        return;
-    }
-    
-    char buffer[64];
-    size_t length;
+    const Settings& settings = Settings::instance();
+    char buffer[16];
     
     // Load server IP
-    length = sizeof(buffer);
-    if (nvs_get_str(handle, NVS_KEY_SERVER_IP, buffer, &length) == ESP_OK) {
-        lv_textarea_set_text(m_serverIpInput, buffer);
+    if (settings.isStored(Settings::Key::SERVER_IP)) {
+        lv_textarea_set_text(m_serverIpInput, settings.getString(Settings::Key::SERVER_IP).c_str());
     }
     
-    // Load WiThrottle port
-    length = sizeof(buffer);
-    if (nvs_get_str(handle, NVS_KEY_WITHROTTLE_PORT, buffer, &length) == ESP_OK) {
-        lv_textarea_set_text(m_wiThrottlePortInput, buffer);
+    // Load WiThrottle and JSON ports
+    snprintf(buffer, sizeof(buffer), "%d", (int)settings.getInt(Settings::Key::WITHROTTLE_PORT));
+    lv_textarea_set_text(m_wiThrottlePortInput, buffer);
+    snprintf(buffer, sizeof(buffer), "%d", (int)settings.getInt(Settings::Key::JSON_PORT));
+    lv_textarea_set_text(m_jsonPortInput, buffer);
+
+    // Load throttle protocol
+    int32_t protocol = settings.getInt(Settings::Key::THROTTLE_PROTOCOL);
+    if (protocol == static_cast<int32_t>(ThrottleProtocol::JMRI_JSON)) {
+        lv_dropdown_set_selected(m_throttleProtocolDropdown, protocol);
     }
     
     // Load Power Manager name
-    length = sizeof(buffer);
-    if (nvs_get_str(handle, NVS_KEY_POWER_MANAGER, buffer, &length) == ESP_OK) {
-        lv_textarea_set_text(m_powerManagerInput, buffer);
+    if (settings.isStored(Settings::Key::POWER_MANAGER)) {
+        std::string powerMgr = settings.getString(Settings::Key::POWER_MANAGER);
+        lv_textarea_set_text(m_powerManagerInput, powerMgr.c_str());
         // Update the JMRI client with the configured power manager name
-        m_jsonClient.setConfiguredPowerName(buffer);
-        ESP_LOGI(TAG, "Power Manager configured: %s", buffer);
+        m_jsonClient.setConfiguredPowerName(powerMgr);
+        ESP_LOGI(TAG, "Power Manager configured: %s", powerMgr.c_str());
     }
     
     // Load Speed Steps
-    int32_t speedSteps = 4; // default
-    if (nvs_get_i32(handle, NVS_KEY_SPEED_STEPS, &speedSteps) == ESP_OK) {
-        char speedStepsStr[8];
-        snprintf(speedStepsStr, sizeof(speedStepsStr), "%d", (int)speedSteps);
-        lv_textarea_set_text(m_speedStepsInput, speedStepsStr);
-        ESP_LOGI(TAG, "Speed Steps configured: %d", (int)speedSteps);
+    if (settings.isStored(Settings::Key::SPEED_STEPS)) {
+        int speedSteps = (int)settings.getInt(Settings::Key::SPEED_STEPS);
+        snprintf(buffer, sizeof(buffer), "%d", speedSteps);
+        lv_textarea_set_text(m_speedStepsInput, buffer);
+        ESP_LOGI(TAG, "Speed Steps configured: %d", speedSteps);
     }
     
-    nvs_close(handle);
     ESP_LOGI(TAG, "JMRI settings loaded");
 }
 
@@ -556,6 +604,21 @@ std::string JmriConfigScreen::getWiThrottlePortText() const
     return text ? std::string(text) : std::string();
 }
 
+std::string JmriConfigScreen::getJsonPortText() const
+{
+    const char* text = lv_textarea_get_text(m_jsonPortInput);
+    return text ? std::string(text) : std::string();
+}
+
+ThrottleProtocol JmriConfigScreen::getSelectedThrottleProtocol() const
+{
+    if (m_throttleProtocolDropdown &&
+        lv_dropdown_get_selected(m_throttleProtocolDropdown) == static_cast<uint16_t>(ThrottleProtocol::JMRI_JSON)) {
+        return ThrottleProtocol::JMRI_JSON;
+    }
+    return ThrottleProtocol::WITHROTTLE;
+}
+
 std::string JmriConfigScreen::getPowerManagerText() const
 {
     const char* text = lv_textarea_get_text(m_powerManagerInput);
@@ -12,6 +12,7 @@
  * - Configure JMRI server IP address
  * - Configure JSON API port (default 12080)
  * - Configure WiThrottle port (default 12090)
+ * - Choose the throttle protocol (WiThrottle or JMRI JSON)
  * - View connection status
  * - Connect/Disconnect from server
  * 
@@ -62,6 +63,8 @@ private:
     
     std::string getServerIpText() const;
     std::string getWiThrottlePortText() const;
+    std::string getJsonPortText() const;
+    ThrottleProtocol getSelectedThrottleProtocol() const;
     std::string getPowerManagerText() const;
     
     // Event handlers
@@ -75,6 +78,8 @@ private:
     lv_obj_t* m_screen;
     lv_obj_t* m_serverIpInput;
     lv_obj_t* m_wiThrottlePortInput;
+    lv_obj_t* m_jsonPortInput;
+    lv_obj_t* m_throttleProtocolDropdown;
     lv_obj_t* m_powerManagerInput;
     lv_obj_t* m_speedStepsInput;
     lv_obj_t* m_statusWifiValue;
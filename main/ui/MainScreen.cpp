@@ -3,19 +3,18 @@
 #include "wrappers/jmri_config_wrapper.h"
 #include "esp_log.h"
 #include "lvgl_port.h"
+#include <algorithm>
 #include <vector>
 
-extern "C" {
-    bool lvgl_port_lock(int timeout_ms);
-    void lvgl_port_unlock(void);
-}
-
 static const char* TAG = "MainScreen";
 
 // Screen dimensions
 static const int SCREEN_WIDTH = 800;
 static const int SCREEN_HEIGHT = 480;
 
+// How often the redraw counters are logged (only when something changed)
+static const uint32_t REFRESH_STATS_INTERVAL_MS = 10000;
+
 MainScreen::MainScreen()
     : m_screen(nullptr)
     , m_leftPanel(nullptr)
@@ -24,32 +23,48 @@ MainScreen::MainScreen()
     , m_powerStatusBar(nullptr)
     , m_rosterCarousel(nullptr)
     , m_functionPanel(nullptr)
+    , m_page(0)
+    , m_numPages(1)
+    , m_numThrottles(0)
+    , m_pageLabel(nullptr)
 #if ENABLE_VIRTUAL_ENCODER
     , m_virtualEncoderPanel(nullptr)
 #endif
     , m_throttleController(nullptr)
-    , m_wiThrottleClient(nullptr)
+    , m_throttleTransport(nullptr)
     , m_jmriClient(nullptr)
+    , m_uiEvents()
+    , m_frameTimer(nullptr)
+    , m_redraws(0)
+    , m_statsWindowStartMs(0)
 {
     // Throttles are now managed by ThrottleController
+    m_shownGenerations.fill(UINT32_MAX);  // Nothing shown yet
 }
 
 MainScreen::~MainScreen()
 {
+    if (m_frameTimer) {
+        lv_timer_del(m_frameTimer);
+        m_frameTimer = nullptr;
+    }
+
     // Don't delete LVGL objects here - LVGL manages screen lifecycle
     // When lv_scr_load() is called with a new screen, LVGL will clean up the old one
     // Our ThrottleMeter objects will be destroyed naturally with their parent containers
 }
 
-lv_obj_t* MainScreen::create(WiThrottleClient* wiThrottleClient, JmriJsonClient* jmriClient, ThrottleController* throttleController)
+lv_obj_t* MainScreen::create(ThrottleTransport* throttleTransport, JmriJsonClient* jmriClient, ThrottleController* throttleController)
 {
-    m_wiThrottleClient = wiThrottleClient;
+    m_throttleTransport = throttleTransport;
     m_jmriClient = jmriClient;
     m_throttleController = throttleController;  // Store reference (not owned)
     
     // Register UI update callback with the controller
     if (m_throttleController) {
         m_throttleController->setUIUpdateCallback(onUIUpdateNeeded, this);
+        m_numThrottles = m_throttleController->getNumThrottles();
+        m_numPages = (m_numThrottles + METERS_PER_PAGE - 1) / METERS_PER_PAGE;
     }
     
     // Create a new screen or clean the current one
@@ -67,9 +82,16 @@ lv_obj_t* MainScreen::create(WiThrottleClient* wiThrottleClient, JmriJsonClient*
     
     // Create settings button
     createSettingsButton();
+
+    // Page through the throttles when they do not fit on the meters
+    createPageButtons();
     
     // Initial UI update
     updateAllThrottles();
+
+    // Everything after this is redrawn from the event bus, once per frame
+    m_statsWindowStartMs = lv_tick_get();
+    m_frameTimer = lv_timer_create(onFrameTimer, LV_DISP_DEF_REFR_PERIOD, this);
     
     ESP_LOGI(TAG, "Main screen created");
     
@@ -112,7 +134,7 @@ void MainScreen::createRightPanel()
     
     // Add track power controls at the top
     m_powerStatusBar = std::make_unique<PowerStatusBar>();
-    m_powerStatusBar->create(m_rightPanel, m_jmriClient);
+    m_powerStatusBar->create(m_rightPanel, m_jmriClient, &m_uiEvents);
     
     // Roster selection carousel
     m_rosterCarousel = std::make_unique<RosterCarousel>();
@@ -155,7 +177,7 @@ void MainScreen::createThrottleMeters()
     static lv_coord_t gridRow[] = {LV_GRID_FR(1), LV_GRID_FR(1), LV_GRID_TEMPLATE_LAST};
     lv_obj_set_grid_dsc_array(meterGrid, gridCol, gridRow);
     
-    // Create 4 containers and place ThrottleMeters inside
+    // Create 4 containers and place ThrottleMeters inside; they show one page of throttles
     int meterIdx = 0;
     for (int r = 0; r < 2; ++r) {
         for (int c = 0; c < 2; ++c) {
@@ -171,8 +193,13 @@ void MainScreen::createThrottleMeters()
             m_throttleMeters[meterIdx]->setFunctionsCallback(onFunctionsButtonClicked, this);
             m_throttleMeters[meterIdx]->setReleaseCallback(onReleaseButtonClicked, this);
             
-            // Store throttle ID in the meter container's user data
+            // Store the meter index in the container's user data
             lv_obj_set_user_data(m_throttleMeters[meterIdx]->getContainer(), (void*)(intptr_t)meterIdx);
+
+            // With fewer throttles than meters the spare cells stay empty
+            if (throttleForMeter(meterIdx) < 0) {
+                lv_obj_add_flag(m_throttleMeters[meterIdx]->getContainer(), LV_OBJ_FLAG_HIDDEN);
+            }
             
             meterIdx++;
         }
@@ -205,6 +232,95 @@ void MainScreen::createSettingsButton()
 
 }
 
+void MainScreen::createPageButtons()
+{
+    if (m_numPages <= 1) {
+        return;
+    }
+
+    // Previous / page number / next, left of the JMRI button
+    static const char* const SYMBOLS[] = { LV_SYMBOL_LEFT, LV_SYMBOL_RIGHT };
+    static const int OFFSETS[] = { -280, -170 };
+    for (int i = 0; i < 2; i++) {
+        lv_obj_t* button = lv_btn_create(m_screen);
+        lv_obj_set_size(button, 50, 40);
+        lv_obj_align(button, LV_ALIGN_BOTTOM_RIGHT, OFFSETS[i], -10);
+        lv_obj_set_user_data(button, (void*)(intptr_t)(i == 0 ? -1 : 1));
+        lv_obj_add_event_cb(button, onPageButtonClicked, LV_EVENT_CLICKED, this);
+
+        lv_obj_t* label = lv_label_create(button);
+        lv_label_set_text(label, SYMBOLS[i]);
+        lv_obj_center(label);
+    }
+
+    m_pageLabel = lv_label_create(m_screen);
+    lv_obj_set_width(m_pageLabel, 60);
+    lv_obj_set_style_text_align(m_pageLabel, LV_TEXT_ALIGN_CENTER, 0);
+    lv_obj_align(m_pageLabel, LV_ALIGN_BOTTOM_RIGHT, -225, -20);
+    lv_label_set_text_fmt(m_pageLabel, "%d/%d", m_page + 1, m_numPages);
+}
+
+void MainScreen::onPageButtonClicked(lv_event_t* e)
+{
+    MainScreen* screen = static_cast<MainScreen*>(lv_event_get_user_data(e));
+    int step = (int)(intptr_t)lv_obj_get_user_data(lv_event_get_target(e));
+
+    // Wraps around in both directions
+    screen->showPage((screen->m_page + step + screen->m_numPages) % screen->m_numPages);
+}
+
+void MainScreen::showPage(int page)
+{
+    if (page < 0 || page >= m_numPages || page == m_page) {
+        return;
+    }
+    m_page = page;
+    ESP_LOGI(TAG, "Showing throttles %d-%d",
+             page * METERS_PER_PAGE,
+             std::min((page + 1) * METERS_PER_PAGE, m_numThrottles) - 1);
+
+    // The meters now show other throttles: redraw each one from its snapshot
+    m_shownGenerations.fill(UINT32_MAX);
+    for (int i = 0; i < METERS_PER_PAGE; i++) {
+        if (!m_throttleMeters[i]) continue;
+        lv_obj_t* container = m_throttleMeters[i]->getContainer();
+        if (throttleForMeter(i) < 0) {
+            lv_obj_add_flag(container, LV_OBJ_FLAG_HIDDEN);
+        } else {
+            lv_obj_clear_flag(container, LV_OBJ_FLAG_HIDDEN);
+        }
+    }
+    if (m_pageLabel) {
+        lv_label_set_text_fmt(m_pageLabel, "%d/%d", m_page + 1, m_numPages);
+    }
+    updateAllThrottles();
+}
+
+int MainScreen::throttleForMeter(int meter) const
+{
+    int throttleId = m_page * METERS_PER_PAGE + meter;
+    return meter >= 0 && meter < METERS_PER_PAGE && throttleId < m_numThrottles ? throttleId : -1;
+}
+
+int MainScreen::meterForThrottle(int throttleId) const
+{
+    int meter = throttleId - m_page * METERS_PER_PAGE;
+    return meter >= 0 && meter < METERS_PER_PAGE ? meter : -1;
+}
+
+int MainScreen::findThrottleForObject(lv_obj_t* obj) const
+{
+    // Walk up the parent chain to the throttle meter container
+    for (lv_obj_t* current = obj; current; current = lv_obj_get_parent(current)) {
+        for (int i = 0; i < METERS_PER_PAGE; i++) {
+            if (m_throttleMeters[i] && current == m_throttleMeters[i]->getContainer()) {
+                return throttleForMeter(i);
+            }
+        }
+    }
+    return -1;
+}
+
 void MainScreen::onJmriButtonClicked(lv_event_t* e)
 {
     ESP_LOGI(TAG, "JMRI button clicked");
@@ -217,23 +333,31 @@ void MainScreen::onSettingsButtonClicked(lv_event_t* e)
     show_wifi_config_screen();
 }
 
-void MainScreen::updateThrottle(int throttleId)
+bool MainScreen::updateThrottle(int throttleId)
 {
-    if (throttleId < 0 || throttleId >= 4) {
+    if (throttleId < 0 || throttleId >= m_numThrottles) {
         ESP_LOGW(TAG, "Invalid throttle ID: %d", throttleId);
-        return;
+        return false;
     }
-    
-    if (!m_throttleController || !m_throttleMeters[throttleId]) {
-        return;
+
+    // Throttles on other pages are drawn when their page is shown
+    int meterIndex = meterForThrottle(throttleId);
+    if (meterIndex < 0 || !m_throttleController || !m_throttleMeters[meterIndex]) {
+        return false;
+    }
+
+    // Unchanged since the last redraw: nothing to copy or draw
+    if (m_throttleController->getThrottleGeneration(throttleId) == m_shownGenerations[meterIndex]) {
+        return false;
     }
 
     ThrottleController::ThrottleSnapshot snapshot;
     if (!m_throttleController->getThrottleSnapshot(throttleId, snapshot)) {
-        return;
+        return false;
     }
+    m_shownGenerations[meterIndex] = snapshot.generation;
 
-    ThrottleMeter* meter = m_throttleMeters[throttleId].get();
+    ThrottleMeter* meter = m_throttleMeters[meterIndex].get();
 
     // Update speed display
     meter->setValue(snapshot.currentSpeed);
@@ -243,7 +367,7 @@ void MainScreen::updateThrottle(int throttleId)
 
     // Update loco info
     if (snapshot.hasLocomotive) {
-        meter->setLocomotive(snapshot.locoName.c_str(), snapshot.locoAddress);
+        meter->setLocomotive(snapshot.locoName, snapshot.locoAddress);
     } else {
         meter->clearLocomotive();
     }
@@ -267,18 +391,27 @@ void MainScreen::updateThrottle(int throttleId)
         meter->setKnobAvailable(0, true);
         meter->setKnobAvailable(1, true);
     }
+    return true;
 }
 
 void MainScreen::updateAllThrottles()
 {
-    for (int i = 0; i < 4; ++i) {
-        updateThrottle(i);
+    for (int i = 0; i < METERS_PER_PAGE; ++i) {
+        int throttleId = throttleForMeter(i);
+        if (throttleId >= 0) {
+            updateThrottle(throttleId);
+        }
     }
 
     if (m_rosterCarousel) {
         m_rosterCarousel->update(m_throttleController);
     }
 
+    updateFunctionPanel();
+}
+
+void MainScreen::updateFunctionPanel()
+{
     if (m_functionPanel && m_functionPanel->isVisible() && m_throttleController) {
         std::vector<Function> functions;
         if (m_throttleController->getFunctionsSnapshot(m_functionPanel->getThrottleId(), functions)) {
@@ -286,6 +419,72 @@ void MainScreen::updateAllThrottles()
         }
     }
 }
+
+void MainScreen::applyUiEvents()
+{
+    UiEventBus::DirtySet dirty;
+    if (m_uiEvents.collect(dirty)) {
+        // Only the page on screen is redrawn; the others catch up when shown
+        for (int i = 0; i < METERS_PER_PAGE; ++i) {
+            int throttleId = throttleForMeter(i);
+            if (throttleId >= 0 && (dirty.throttleMeters & (1u << throttleId)) && updateThrottle(throttleId)) {
+                m_redraws++;
+            }
+        }
+
+        if (dirty.rosterCarousel && m_rosterCarousel) {
+            m_rosterCarousel->update(m_throttleController);
+            m_redraws++;
+        }
+
+        // The panel shows one throttle; changes to the others are not visible
+        if (m_functionPanel && m_functionPanel->isVisible() &&
+            (dirty.functionPanels & (1u << m_functionPanel->getThrottleId()))) {
+            updateFunctionPanel();
+            m_redraws++;
+        }
+
+        if (m_powerStatusBar) {
+            if (dirty.trackPower) {
+                m_powerStatusBar->refreshTrackPower();
+                m_redraws++;
+            }
+            if (dirty.connectionStatus) {
+                m_powerStatusBar->refreshConnectionStatus();
+                m_redraws++;
+            }
+        }
+    }
+
+    if (lv_tick_elaps(m_statsWindowStartMs) >= REFRESH_STATS_INTERVAL_MS) {
+        logRefreshStats();
+    }
+}
+
+void MainScreen::logRefreshStats()
+{
+    UiEventBus::Stats stats = m_uiEvents.getStats();
+    uint32_t elapsedMs = lv_tick_elaps(m_statsWindowStartMs);
+
+    if (stats.posted > 0 || stats.overflows > 0) {
+        // Only what was measured: events posted, frames that applied them and widgets redrawn
+        float seconds = elapsedMs / 1000.0f;
+
+        ESP_LOGI(TAG, "UI refresh: %.1f events/s (%.1f throttle, %.1f status) -> %.1f frames/s, %.1f redraws/s "
+                      "(%lu coalesced, %lu overflows)",
+                 (stats.posted + stats.overflows) / seconds,
+                 stats.throttleEvents / seconds,
+                 stats.statusEvents / seconds,
+                 stats.frames / seconds,
+                 m_redraws / seconds,
+                 (unsigned long)stats.coalesced,
+                 (unsigned long)stats.overflows);
+    }
+
+    m_uiEvents.resetStats();
+    m_redraws = 0;
+    m_statsWindowStartMs = lv_tick_get();
+}
 Throttle* MainScreen::getThrottle(int throttleId)
 {
     if (!m_throttleController) return nullptr;
@@ -297,14 +496,14 @@ void MainScreen::onAcquireButtonClicked(lv_event_t* e)
 {
     MainScreen* screen = static_cast<MainScreen*>(lv_event_get_user_data(e));
     
-    if (!screen->m_wiThrottleClient || !screen->m_wiThrottleClient->isConnected()) {
-        ESP_LOGW(TAG, "WiThrottle not connected");
+    if (!screen->m_throttleTransport || !screen->m_throttleTransport->isConnected()) {
+        ESP_LOGW(TAG, "Throttle transport not connected");
         return;
     }
     
     // Get first loco from roster
-    WiThrottleClient::Locomotive loco;
-    if (!screen->m_wiThrottleClient->getRosterEntry(0, loco)) {
+    ThrottleTransport::Locomotive loco;
+    if (!screen->m_throttleTransport->getRosterEntry(0, loco)) {
         ESP_LOGW(TAG, "No locomotives in roster");
         return;
     }
@@ -313,7 +512,7 @@ void MainScreen::onAcquireButtonClicked(lv_event_t* e)
     ESP_LOGI(TAG, "Acquiring loco: %s (addr=%d, type=%c)", 
              loco.name.c_str(), loco.address, loco.addressType);
     
-    screen->m_wiThrottleClient->acquireLocomotive('T', loco.address, isLong);
+    screen->m_throttleTransport->acquireLocomotive('T', loco.address, isLong);
 }
 
 void MainScreen::onSpeedButtonClicked(lv_event_t* e)
@@ -321,49 +520,49 @@ void MainScreen::onSpeedButtonClicked(lv_event_t* e)
     MainScreen* screen = static_cast<MainScreen*>(lv_event_get_user_data(e));
     lv_obj_t* btn = lv_event_get_target(e);
     
-    if (!screen->m_wiThrottleClient || !screen->m_wiThrottleClient->isConnected()) {
-        ESP_LOGW(TAG, "WiThrottle not connected");
+    if (!screen->m_throttleTransport || !screen->m_throttleTransport->isConnected()) {
+        ESP_LOGW(TAG, "Throttle transport not connected");
         return;
     }
     
     int speed = (int)(intptr_t)lv_obj_get_user_data(btn);
     ESP_LOGI(TAG, "Setting speed to %d", speed);
     
-    screen->m_wiThrottleClient->setSpeed('T', speed);
+    screen->m_throttleTransport->setSpeed('T', speed);
 }
 
 void MainScreen::onForwardButtonClicked(lv_event_t* e)
 {
     MainScreen* screen = static_cast<MainScreen*>(lv_event_get_user_data(e));
     
-    if (!screen->m_wiThrottleClient || !screen->m_wiThrottleClient->isConnected()) {
-        ESP_LOGW(TAG, "WiThrottle not connected");
+    if (!screen->m_throttleTransport || !screen->m_throttleTransport->isConnected()) {
+        ESP_LOGW(TAG, "Throttle transport not connected");
         return;
     }
     
     ESP_LOGI(TAG, "Setting direction: FORWARD");
-    screen->m_wiThrottleClient->setDirection('T', true);
+    screen->m_throttleTransport->setDirection('T', true);
 }
 
 void MainScreen::onReverseButtonClicked(lv_event_t* e)
 {
     MainScreen* screen = static_cast<MainScreen*>(lv_event_get_user_data(e));
     
-    if (!screen->m_wiThrottleClient || !screen->m_wiThrottleClient->isConnected()) {
-        ESP_LOGW(TAG, "WiThrottle not connected");
+    if (!screen->m_throttleTransport || !screen->m_throttleTransport->isConnected()) {
+        ESP_LOGW(TAG, "Throttle transport not connected");
         return;
     }
     
     ESP_LOGI(TAG, "Setting direction: REVERSE");
-    screen->m_wiThrottleClient->setDirection('T', false);
+    screen->m_throttleTransport->setDirection('T', false);
 }
 
 void MainScreen::onF0ButtonClicked(lv_event_t* e)
 {
     MainScreen* screen = static_cast<MainScreen*>(lv_event_get_user_data(e));
     
-    if (!screen->m_wiThrottleClient || !screen->m_wiThrottleClient->isConnected()) {
-        ESP_LOGW(TAG, "WiThrottle not connected");
+    if (!screen->m_throttleTransport || !screen->m_throttleTransport->isConnected()) {
+        ESP_LOGW(TAG, "Throttle transport not connected");
         return;
     }
     
@@ -372,20 +571,20 @@ void MainScreen::onF0ButtonClicked(lv_event_t* e)
     f0State = !f0State;
     
     ESP_LOGI(TAG, "Setting F0: %s", f0State ? "ON" : "OFF");
-    screen->m_wiThrottleClient->setFunction('T', 0, f0State);
+    screen->m_throttleTransport->setFunction('T', 0, f0State);
 }
 
 void MainScreen::onOldReleaseButtonClicked(lv_event_t* e)
 {
     MainScreen* screen = static_cast<MainScreen*>(lv_event_get_user_data(e));
     
-    if (!screen->m_wiThrottleClient || !screen->m_wiThrottleClient->isConnected()) {
-        ESP_LOGW(TAG, "WiThrottle not connected");
+    if (!screen->m_throttleTransport || !screen->m_throttleTransport->isConnected()) {
+        ESP_LOGW(TAG, "Throttle transport not connected");
         return;
     }
     
     ESP_LOGI(TAG, "Releasing throttle T");
-    screen->m_wiThrottleClient->releaseLocomotive('T');
+    screen->m_throttleTransport->releaseLocomotive('T');
 }
 
 void MainScreen::onKnobIndicatorTouched(lv_event_t* e)
@@ -397,19 +596,7 @@ void MainScreen::onKnobIndicatorTouched(lv_event_t* e)
     lv_obj_t* indicator = lv_event_get_target(e);
     int knobId = (int)(intptr_t)lv_obj_get_user_data(indicator);
     
-    // Find the throttle meter container by walking up parent chain
-    lv_obj_t* current = indicator;
-    int throttleId = -1;
-    while (current) {
-        for (int i = 0; i < 4; i++) {
-            if (screen->m_throttleMeters[i] && current == screen->m_throttleMeters[i]->getContainer()) {
-                throttleId = i;
-                break;
-            }
-        }
-        if (throttleId >= 0) break;
-        current = lv_obj_get_parent(current);
-    }
+    int throttleId = screen->findThrottleForObject(indicator);
     
     if (throttleId >= 0) {
         ESP_LOGI(TAG, "Knob %d indicator touched on throttle %d", knobId, throttleId);
@@ -422,20 +609,7 @@ void MainScreen::onFunctionsButtonClicked(lv_event_t* e)
     MainScreen* screen = static_cast<MainScreen*>(lv_event_get_user_data(e));
     if (!screen->m_throttleController) return;
     
-    // Find the throttle meter container by walking up parent chain
-    lv_obj_t* button = lv_event_get_target(e);
-    lv_obj_t* current = button;
-    int throttleId = -1;
-    while (current) {
-        for (int i = 0; i < 4; i++) {
-            if (screen->m_throttleMeters[i] && current == screen->m_throttleMeters[i]->getContainer()) {
-                throttleId = i;
-                break;
-            }
-        }
-        if (throttleId >= 0) break;
-        current = lv_obj_get_parent(current);
-    }
+    int throttleId = screen->findThrottleForObject(lv_event_get_target(e));
     
     if (throttleId >= 0) {
         ESP_LOGI(TAG, "Functions button clicked on throttle %d", throttleId);
@@ -445,8 +619,7 @@ void MainScreen::onFunctionsButtonClicked(lv_event_t* e)
         }
 
         ThrottleController::ThrottleSnapshot snapshot;
-        screen->m_throttleController->getThrottleSnapshot(throttleId, snapshot);
-        if (!snapshot.hasLocomotive) {
+        if (!screen->m_throttleController->getThrottleSnapshot(throttleId, snapshot) || !snapshot.hasLocomotive) {
             return;
         }
 
@@ -474,12 +647,12 @@ void MainScreen::onFunctionPanelCloseClicked(lv_event_t* e)
 void MainScreen::onFunctionButtonClicked(lv_event_t* e)
 {
     MainScreen* screen = static_cast<MainScreen*>(lv_event_get_user_data(e));
-    if (!screen || !screen->m_functionPanel || !screen->m_throttleController || !screen->m_wiThrottleClient) {
+    if (!screen || !screen->m_functionPanel || !screen->m_throttleController || !screen->m_throttleTransport) {
         return;
     }
 
-    if (!screen->m_wiThrottleClient->isConnected()) {
-        ESP_LOGW(TAG, "WiThrottle not connected");
+    if (!screen->m_throttleTransport->isConnected()) {
+        ESP_LOGW(TAG, "Throttle transport not connected");
         return;
     }
 
@@ -493,9 +666,9 @@ void MainScreen::onFunctionButtonClicked(lv_event_t* e)
         return;
     }
 
-    screen->m_wiThrottleClient->setFunction('0' + throttleId, functionNumber, newState);
+    screen->m_throttleController->setFunction(throttleId, functionNumber, newState);
 
-    // Wait for WiThrottle updates to drive UI state
+    // Wait for transport updates to drive UI state
 }
 
 void MainScreen::onReleaseButtonClicked(lv_event_t* e)
@@ -503,20 +676,7 @@ void MainScreen::onReleaseButtonClicked(lv_event_t* e)
     MainScreen* screen = static_cast<MainScreen*>(lv_event_get_user_data(e));
     if (!screen->m_throttleController) return;
     
-    // Find the throttle meter container by walking up parent chain
-    lv_obj_t* button = lv_event_get_target(e);
-    lv_obj_t* current = button;
-    int throttleId = -1;
-    while (current) {
-        for (int i = 0; i < 4; i++) {
-            if (screen->m_throttleMeters[i] && current == screen->m_throttleMeters[i]->getContainer()) {
-                throttleId = i;
-                break;
-            }
-        }
-        if (throttleId >= 0) break;
-        current = lv_obj_get_parent(current);
-    }
+    int throttleId = screen->findThrottleForObject(lv_event_get_target(e));
     
     if (throttleId >= 0) {
         ESP_LOGI(TAG, "Release button clicked on throttle %d", throttleId);
@@ -524,23 +684,24 @@ void MainScreen::onReleaseButtonClicked(lv_event_t* e)
     }
 }
 
-void MainScreen::onUIUpdateNeeded(void* userData)
+void MainScreen::onUIUpdateNeeded(void* userData, int throttleId, uint8_t changes)
 {
     MainScreen* screen = static_cast<MainScreen*>(userData);
+    if (!screen) return;
+
+    // Runs on the controller task: record what changed, the LVGL task redraws it
+    uint8_t widgets = 0;
+    if (changes & ThrottleController::UI_THROTTLE) widgets |= UiEventBus::THROTTLE_METER;
+    if (changes & ThrottleController::UI_FUNCTIONS) widgets |= UiEventBus::FUNCTION_PANEL;
+    if (changes & ThrottleController::UI_ROSTER_SELECTION) widgets |= UiEventBus::ROSTER_CAROUSEL;
+    screen->m_uiEvents.post(widgets, throttleId);
+}
+
+void MainScreen::onFrameTimer(lv_timer_t* timer)
+{
+    MainScreen* screen = static_cast<MainScreen*>(timer->user_data);
     if (screen) {
-        // CRITICAL: Lock LVGL mutex before accessing LVGL objects
-        // This callback may be called from WiThrottle network task
-        if (lvgl_port_lock(200)) {
-            screen->updateAllThrottles();
-            lvgl_port_unlock();
-        } else {
-            static int64_t lastWarnMs = 0;
-            int64_t nowMs = esp_log_timestamp();
-            if (nowMs - lastWarnMs > 1000) {
-                ESP_LOGW(TAG, "Failed to acquire LVGL lock for UI update");
-                lastWarnMs = nowMs;
-            }
-        }
+        screen->applyUiEvents();
     }
 }
 
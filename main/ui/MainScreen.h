@@ -12,9 +12,10 @@
 #include "components/RosterCarousel.h"
 #include "components/PowerStatusBar.h"
 #include "components/FunctionPanel.h"
+#include "UiEventBus.h"
 #include "../model/Throttle.h"
 #include "../controller/ThrottleController.h"
-#include "../communication/WiThrottleClient.h"
+#include "../communication/ThrottleTransport.h"
 #include "../communication/JmriJsonClient.h"
 #include <array>
 #include <memory>
@@ -23,14 +24,23 @@
  * @brief Main application screen with throttle controls
  * 
  * The main screen displays:
- * - 4 throttle meters in a 2x2 grid (left half)
+ * - 4 throttle meters in a 2x2 grid (left half), paged when there are
+ *   more throttle slots (CONFIG_THROTTLE_SLOT_COUNT) than meters
  * - Track power controls (right side) - uses JMRI JSON API
  * - Settings button to access WiFi configuration
+ *
+ * Other tasks never touch these widgets. The throttle controller and the
+ * JMRI client post what changed to a UiEventBus; a timer on the LVGL task
+ * collects the events once per frame and redraws only the dirty widgets.
  * 
  * This replaces the legacy test_throttle_screen.c with a proper C++ implementation.
  */
 class MainScreen {
 public:
+    static constexpr int METERS_PER_PAGE = 4;
+    static_assert(ThrottleController::MAX_THROTTLES <= UiEventBus::MAX_THROTTLES,
+                  "Every throttle needs a dirty bit");
+
     MainScreen();
     ~MainScreen();
     
@@ -40,37 +50,60 @@ public:
     
     /**
      * @brief Create and show the main screen
-     * @param wiThrottleClient WiThrottle client for DCC control
+     * @param throttleTransport Throttle transport for DCC control (WiThrottle or JMRI JSON)
      * @param jmriClient JMRI JSON client for power control
      * @param throttleController Throttle controller (owned by application layer)
      * @return The LVGL screen object
      */
-    lv_obj_t* create(WiThrottleClient* wiThrottleClient, JmriJsonClient* jmriClient, ThrottleController* throttleController);
+    lv_obj_t* create(ThrottleTransport* throttleTransport, JmriJsonClient* jmriClient, ThrottleController* throttleController);
     
     /**
      * @brief Update throttle displays with current state
-     * @param throttleId Throttle ID (0-3)
+     * @param throttleId Throttle ID (0 to the controller's slot count - 1)
+     * @return true if the meter was redrawn (false if its snapshot is unchanged
+     *         or the throttle is on another page)
      */
-    void updateThrottle(int throttleId);
+    bool updateThrottle(int throttleId);
     
     /**
-     * @brief Update all throttle displays
+     * @brief Update all throttle displays on the current page
      */
     void updateAllThrottles();
+
+    /**
+     * @brief Show the meters for another page of throttles (LVGL task only)
+     * @param page Page index (0 to getNumPages() - 1); the meters show
+     *        throttles page * METERS_PER_PAGE onwards
+     */
+    void showPage(int page);
+
+    int getPage() const { return m_page; }
+    int getNumPages() const { return m_numPages; }
+
+    /**
+     * @brief Redraw the widgets marked dirty since the last frame (LVGL task only)
+     */
+    void applyUiEvents();
     
     /**
      * @brief Get the throttle model by ID
-     * @param throttleId Throttle ID (0-3)
+     * @param throttleId Throttle ID (0 to the controller's slot count - 1)
      * @return Pointer to throttle or nullptr if invalid ID
      */
     Throttle* getThrottle(int throttleId);
 
 private:
     void createRosterPanel(lv_obj_t* parent);
+    void updateFunctionPanel();
+    void logRefreshStats();
+    int throttleForMeter(int meter) const;
+    int meterForThrottle(int throttleId) const;
+    int findThrottleForObject(lv_obj_t* obj) const;
     
     // Event handlers
     static void onSettingsButtonClicked(lv_event_t* e);
     static void onJmriButtonClicked(lv_event_t* e);
+    static void onPageButtonClicked(lv_event_t* e);
     
     // Test control event handlers
     static void onAcquireButtonClicked(lv_event_t* e);
@@ -90,8 +123,13 @@ private:
     std::unique_ptr<RosterCarousel> m_rosterCarousel;
     std::unique_ptr<FunctionPanel> m_functionPanel;
     
-    // Throttle meters (C++ widgets)
-    std::array<std::unique_ptr<ThrottleMeter>, 4> m_throttleMeters;
+    // Throttle meters (C++ widgets); meter i shows throttle m_page * METERS_PER_PAGE + i
+    std::array<std::unique_ptr<ThrottleMeter>, METERS_PER_PAGE> m_throttleMeters;
+    std::array<uint32_t, METERS_PER_PAGE> m_shownGenerations;  // Snapshot generation each meter shows
+    int m_page;
+    int m_numPages;         // Enough pages of METERS_PER_PAGE for every throttle slot
+    int m_numThrottles;     // The controller's slot count
+    lv_obj_t* m_pageLabel;  // "2/4"; only created when there is more than one page
     
     // Virtual encoder panel for testing
 #if ENABLE_VIRTUAL_ENCODER
@@ -102,14 +140,21 @@ private:
     ThrottleController* m_throttleController;
     
     // Client references (not owned)
-    WiThrottleClient* m_wiThrottleClient;
+    ThrottleTransport* m_throttleTransport;
     JmriJsonClient* m_jmriClient;
+
+    // Dirty-widget events from other tasks, drained once per frame
+    UiEventBus m_uiEvents;
+    lv_timer_t* m_frameTimer;
+    uint32_t m_redraws;              // Widgets redrawn in the current stats window
+    uint32_t m_statsWindowStartMs;
     
     // Throttle UI event handlers
     static void onKnobIndicatorTouched(lv_event_t* e);
     static void onFunctionsButtonClicked(lv_event_t* e);
     static void onReleaseButtonClicked(lv_event_t* e);
-    static void onUIUpdateNeeded(void* userData);
+    static void onUIUpdateNeeded(void* userData, int throttleId, uint8_t changes);
+    static void onFrameTimer(lv_timer_t* timer);
     static void onFunctionButtonClicked(lv_event_t* e);
     static void onFunctionPanelCloseClicked(lv_event_t* e);
     
@@ -123,5 +168,6 @@ private:
     void createLeftPanel();
     void createRightPanel();
     void createSettingsButton();
+    void createPageButtons();
     void createThrottleMeters();
 };
@@ -0,0 +1,124 @@
+#include "UiEventBus.h"
+
+UiEventBus::UiEventBus(size_t capacity)
+    : m_queue(capacity)
+    , m_overflowed(false)
+    , m_posted(0)
+    , m_throttleEvents(0)
+    , m_statusEvents(0)
+    , m_overflows(0)
+    , m_frames(0)
+    , m_coalesced(0)
+{
+}
+
+uint32_t UiEventBus::throttleMask(int throttleId)
+{
+    if (throttleId < 0 || throttleId >= MAX_THROTTLES) {
+        return UINT32_MAX;
+    }
+    return 1u << throttleId;
+}
+
+bool UiEventBus::post(uint8_t widgets, int throttleId)
+{
+    if (widgets == 0) {
+        return true;
+    }
+
+    Event event;
+    event.widgets = widgets;
+    event.throttleId = static_cast<int8_t>(throttleId >= 0 && throttleId < MAX_THROTTLES ? throttleId : ALL_THROTTLES);
+
+    if (!m_queue.tryPush(event)) {
+        // Never wait on the LVGL task; redraw everything next frame instead
+        m_overflowed.store(true, std::memory_order_release);
+        m_overflows.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    m_posted.fetch_add(1, std::memory_order_relaxed);
+    if (widgets & THROTTLE_WIDGETS) {
+        m_throttleEvents.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        m_statusEvents.fetch_add(1, std::memory_order_relaxed);
+    }
+    return true;
+}
+
+bool UiEventBus::collect(DirtySet& outDirty)
+{
+    DirtySet dirty;
+    uint32_t coalesced = 0;
+
+    Event event;
+    while (m_queue.tryPop(event)) {
+        uint32_t mask = throttleMask(event.throttleId);
+        bool marked = false;
+
+        if ((event.widgets & THROTTLE_METER) && (dirty.throttleMeters & mask) != mask) {
+            dirty.throttleMeters |= mask;
+            marked = true;
+        }
+        if ((event.widgets & FUNCTION_PANEL) && (dirty.functionPanels & mask) != mask) {
+            dirty.functionPanels |= mask;
+            marked = true;
+        }
+        if ((event.widgets & ROSTER_CAROUSEL) && !dirty.rosterCarousel) {
+            dirty.rosterCarousel = true;
+            marked = true;
+        }
+        if ((event.widgets & TRACK_POWER) && !dirty.trackPower) {
+            dirty.trackPower = true;
+            marked = true;
+        }
+        if ((event.widgets & CONNECTION_STATUS) && !dirty.connectionStatus) {
+            dirty.connectionStatus = true;
+            marked = true;
+        }
+
+        if (!marked) {
+            coalesced++;
+        }
+    }
+
+    // Checked after draining: an event dropped after this point is seen next frame
+    if (m_overflowed.exchange(false, std::memory_order_acquire)) {
+        dirty.throttleMeters = UINT32_MAX;
+        dirty.functionPanels = UINT32_MAX;
+        dirty.rosterCarousel = true;
+        dirty.trackPower = true;
+        dirty.connectionStatus = true;
+    }
+
+    outDirty = dirty;
+    if (!dirty.any()) {
+        return false;
+    }
+
+    m_frames.fetch_add(1, std::memory_order_relaxed);
+    m_coalesced.fetch_add(coalesced, std::memory_order_relaxed);
+    return true;
+}
+
+UiEventBus::Stats UiEventBus::getStats() const
+{
+    Stats stats;
+    stats.posted = m_posted.load(std::memory_order_relaxed);
+    stats.throttleEvents = m_throttleEvents.load(std::memory_order_relaxed);
+    stats.statusEvents = m_statusEvents.load(std::memory_order_relaxed);
+    stats.overflows = m_overflows.load(std::memory_order_relaxed);
+    stats.frames = m_frames.load(std::memory_order_relaxed);
+    stats.coalesced = m_coalesced.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void UiEventBus::resetStats()
+{
+    m_posted.store(0, std::memory_order_relaxed);
+    m_throttleEvents.store(0, std::memory_order_relaxed);
+    m_statusEvents.store(0, std::memory_order_relaxed);
+    m_overflows.store(0, std::memory_order_relaxed);
+    m_frames.store(0, std::memory_order_relaxed);
+    m_coalesced.store(0, std::memory_order_relaxed);
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include "MpscQueue.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Lock-free queue of "widget is dirty" events for the LVGL task
+ *
+ * Producers on any task (the throttle controller, the JMRI websocket task)
+ * post which widgets a change affects and return at once; they never take
+ * the LVGL lock. Once per frame the LVGL task collects everything posted
+ * since the last frame into one DirtySet, so a burst of changes to the same
+ * widget costs a single redraw, and then refreshes only the widgets named.
+ *
+ * Events carry no values: the LVGL task reads current state from the model
+ * when it redraws, so merging events never loses anything. If the queue
+ * fills, the event is dropped and the next collect() marks every widget
+ * dirty instead.
+ */
+class UiEventBus {
+public:
+    /**
+     * @brief Widgets an event marks dirty (bit flags)
+     */
+    enum Widget : uint8_t {
+        THROTTLE_METER = 0x01,     ///< Meter of one throttle (or all)
+        FUNCTION_PANEL = 0x02,     ///< Function panel, if showing that throttle
+        ROSTER_CAROUSEL = 0x04,
+        TRACK_POWER = 0x08,
+        CONNECTION_STATUS = 0x10,
+        THROTTLE_WIDGETS = THROTTLE_METER | FUNCTION_PANEL | ROSTER_CAROUSEL,
+        STATUS_WIDGETS = TRACK_POWER | CONNECTION_STATUS
+    };
+
+    static constexpr int ALL_THROTTLES = -1;
+    static constexpr int MAX_THROTTLES = 32;  // One bit each in DirtySet
+    static constexpr size_t DEFAULT_CAPACITY = 64;
+
+    /**
+     * @brief Widgets to redraw this frame
+     */
+    struct DirtySet {
+        uint32_t throttleMeters = 0;   // Bit per throttle ID
+        uint32_t functionPanels = 0;   // Bit per throttle ID
+        bool rosterCarousel = false;
+        bool trackPower = false;
+        bool connectionStatus = false;
+
+        bool any() const
+        {
+            return throttleMeters || functionPanels || rosterCarousel || trackPower || connectionStatus;
+        }
+    };
+
+    /**
+     * @brief Counters since construction (or resetStats())
+     */
+    struct Stats {
+        uint32_t posted = 0;          // Events accepted
+        uint32_t throttleEvents = 0;  // ... of which marked throttle widgets
+        uint32_t statusEvents = 0;    // ... of which marked only status widgets
+        uint32_t overflows = 0;       // Events dropped on a full queue (turned into a full refresh)
+        uint32_t frames = 0;          // collect() calls that found work
+        uint32_t coalesced = 0;       // Events that marked nothing not already dirty that frame
+    };
+
+    explicit UiEventBus(size_t capacity = DEFAULT_CAPACITY);
+
+    UiEventBus(const UiEventBus&) = delete;
+    UiEventBus& operator=(const UiEventBus&) = delete;
+
+    /**
+     * @brief Mark widgets dirty (any task; never blocks)
+     * @param widgets Widget flags
+     * @param throttleId Throttle the meter/function panel flags refer to, or ALL_THROTTLES
+     * @return false if the queue was full and the next frame will redraw everything
+     */
+    bool post(uint8_t widgets, int throttleId = ALL_THROTTLES);
+
+    /**
+     * @brief Take everything posted since the last call, merged (LVGL task only)
+     * @param outDirty Receives the widgets to redraw
+     * @return true if anything is dirty
+     */
+    bool collect(DirtySet& outDirty);
+
+    Stats getStats() const;
+    void resetStats();
+
+private:
+    struct Event {
+        uint8_t widgets;
+        int8_t throttleId;
+    };
+
+    static uint32_t throttleMask(int throttleId);
+
+    MpscQueue<Event> m_queue;
+    std::atomic<bool> m_overflowed;
+
+    std::atomic<uint32_t> m_posted;
+    std::atomic<uint32_t> m_throttleEvents;
+    std::atomic<uint32_t> m_statusEvents;
+    std::atomic<uint32_t> m_overflows;
+    std::atomic<uint32_t> m_frames;
+    std::atomic<uint32_t> m_coalesced;
+};
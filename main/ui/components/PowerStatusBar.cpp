@@ -1,11 +1,5 @@
 #include "PowerStatusBar.h"
 #include "esp_log.h"
-#include "lvgl_port.h"
-
-extern "C" {
-    bool lvgl_port_lock(int timeout_ms);
-    void lvgl_port_unlock(void);
-}
 
 static const char* TAG = "PowerStatusBar";
 
@@ -14,12 +8,14 @@ PowerStatusBar::PowerStatusBar()
     , m_trackPowerButton(nullptr)
     , m_connectionStatusLabel(nullptr)
     , m_jmriClient(nullptr)
+    , m_uiEvents(nullptr)
 {
 }
 
-lv_obj_t* PowerStatusBar::create(lv_obj_t* parent, JmriJsonClient* jmriClient)
+lv_obj_t* PowerStatusBar::create(lv_obj_t* parent, JmriJsonClient* jmriClient, UiEventBus* uiEvents)
 {
     m_jmriClient = jmriClient;
+    m_uiEvents = uiEvents;
 
     m_container = lv_obj_create(parent);
     lv_obj_set_size(m_container, LV_PCT(90), 50);
@@ -42,21 +38,22 @@ lv_obj_t* PowerStatusBar::create(lv_obj_t* parent, JmriJsonClient* jmriClient)
     lv_obj_center(m_connectionStatusLabel);
 
     if (m_jmriClient) {
-        updateTrackPowerButton(m_jmriClient->getPower());
-        updateConnectionStatus(m_jmriClient->getState());
+        refreshTrackPower();
+        refreshConnectionStatus();
 
+        // Websocket task: mark dirty only; the state is read back when the frame redraws
         m_jmriClient->setPowerStateCallback([this](const std::string& powerName, JmriJsonClient::PowerState state) {
             (void)powerName;
-            if (lvgl_port_lock(-1)) {
-                updateTrackPowerButton(state);
-                lvgl_port_unlock();
+            (void)state;
+            if (m_uiEvents) {
+                m_uiEvents->post(UiEventBus::TRACK_POWER);
             }
         });
 
         m_jmriClient->setConnectionStateCallback([this](JmriJsonClient::ConnectionState state) {
-            if (lvgl_port_lock(-1)) {
-                updateConnectionStatus(state);
-                lvgl_port_unlock();
+            (void)state;
+            if (m_uiEvents) {
+                m_uiEvents->post(UiEventBus::CONNECTION_STATUS);
             }
         });
     }
@@ -80,6 +77,20 @@ void PowerStatusBar::onTrackPowerClicked(lv_event_t* e)
     bar->m_jmriClient->setPower(newState);
 }
 
+void PowerStatusBar::refreshTrackPower()
+{
+    if (m_jmriClient) {
+        updateTrackPowerButton(m_jmriClient->getPower());
+    }
+}
+
+void PowerStatusBar::refreshConnectionStatus()
+{
+    if (m_jmriClient) {
+        updateConnectionStatus(m_jmriClient->getState());
+    }
+}
+
 void PowerStatusBar::updateTrackPowerButton(JmriJsonClient::PowerState state)
 {
     if (!m_trackPowerButton) return;
@@ -2,9 +2,13 @@
 
 #include "lvgl.h"
 #include "communication/JmriJsonClient.h"
+#include "UiEventBus.h"
 
 /**
  * @brief Track power button + connection status bar
+ *
+ * JMRI client callbacks run on the websocket task, so they only post to the
+ * screen's UiEventBus; the LVGL task calls the refresh methods.
  */
 class PowerStatusBar {
 public:
@@ -19,9 +23,20 @@ public:
      * @brief Create the status bar
      * @param parent Parent LVGL object
      * @param jmriClient JMRI JSON client (not owned)
+     * @param uiEvents Bus the client callbacks post to (not owned)
      * @return Container object
      */
-    lv_obj_t* create(lv_obj_t* parent, JmriJsonClient* jmriClient);
+    lv_obj_t* create(lv_obj_t* parent, JmriJsonClient* jmriClient, UiEventBus* uiEvents);
+
+    /**
+     * @brief Redraw the track power button from the client's current state (LVGL task)
+     */
+    void refreshTrackPower();
+
+    /**
+     * @brief Redraw the connection label from the client's current state (LVGL task)
+     */
+    void refreshConnectionStatus();
 
 private:
     static void onTrackPowerClicked(lv_event_t* e);
@@ -34,4 +49,5 @@ private:
     lv_obj_t* m_connectionStatusLabel;
 
     JmriJsonClient* m_jmriClient;
+    UiEventBus* m_uiEvents;
 };
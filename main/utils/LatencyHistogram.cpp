@@ -0,0 +1,98 @@
+#include "LatencyHistogram.h"
+#include "esp_log.h"
+#include <cstring>
+
+namespace {
+    // Upper bound (exclusive) of each bucket except the last
+    constexpr uint32_t BUCKET_LIMITS_US[LatencyHistogram::NUM_BUCKETS - 1] = {
+        100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000
+    };
+}
+
+LatencyHistogram::LatencyHistogram()
+{
+    reset();
+}
+
+void LatencyHistogram::record(uint32_t durationUs)
+{
+    int bucket = 0;
+    while (bucket < NUM_BUCKETS - 1 && durationUs >= BUCKET_LIMITS_US[bucket]) {
+        bucket++;
+    }
+    m_buckets[bucket]++;
+    m_count++;
+    m_totalUs += durationUs;
+    if (durationUs > m_maxUs) {
+        m_maxUs = durationUs;
+    }
+}
+
+void LatencyHistogram::reset()
+{
+    memset(m_buckets, 0, sizeof(m_buckets));
+    m_count = 0;
+    m_totalUs = 0;
+    m_maxUs = 0;
+}
+
+uint32_t LatencyHistogram::getMeanUs() const
+{
+    return m_count > 0 ? static_cast<uint32_t>(m_totalUs / m_count) : 0;
+}
+
+uint32_t LatencyHistogram::getPercentileUs(int percent) const
+{
+    if (m_count == 0) {
+        return 0;
+    }
+    if (percent < 1) percent = 1;
+    if (percent > 100) percent = 100;
+
+    // Smallest bucket whose cumulative count reaches the target rank
+    uint64_t target = (static_cast<uint64_t>(m_count) * percent + 99) / 100;
+    uint64_t cumulative = 0;
+    for (int i = 0; i < NUM_BUCKETS; i++) {
+        cumulative += m_buckets[i];
+        if (cumulative >= target) {
+            return i < NUM_BUCKETS - 1 ? BUCKET_LIMITS_US[i] : m_maxUs;
+        }
+    }
+    return m_maxUs;
+}
+
+uint32_t LatencyHistogram::getBucketCount(int bucket) const
+{
+    if (bucket < 0 || bucket >= NUM_BUCKETS) {
+        return 0;
+    }
+    return m_buckets[bucket];
+}
+
+uint32_t LatencyHistogram::getBucketLimitUs(int bucket)
+{
+    if (bucket < 0 || bucket >= NUM_BUCKETS - 1) {
+        return UINT32_MAX;
+    }
+    return BUCKET_LIMITS_US[bucket];
+}
+
+void LatencyHistogram::log(const char* tag, const char* label) const
+{
+    ESP_LOGI(tag, "%s: n=%lu mean=%lu us p50<%lu us p99<%lu us max=%lu us",
+             label, (unsigned long)m_count, (unsigned long)getMeanUs(),
+             (unsigned long)getPercentileUs(50), (unsigned long)getPercentileUs(99),
+             (unsigned long)m_maxUs);
+
+    for (int i = 0; i < NUM_BUCKETS; i++) {
+        if (m_buckets[i] == 0) {
+            continue;
+        }
+        if (i < NUM_BUCKETS - 1) {
+            ESP_LOGI(tag, "  <%6lu us: %lu", (unsigned long)BUCKET_LIMITS_US[i], (unsigned long)m_buckets[i]);
+        } else {
+            ESP_LOGI(tag, "  >=%5lu us: %lu", (unsigned long)BUCKET_LIMITS_US[NUM_BUCKETS - 2],
+                     (unsigned long)m_buckets[i]);
+        }
+    }
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+ * @brief Fixed-bucket latency histogram for on-device instrumentation
+ *
+ * Records durations in microseconds into 12 buckets spanning 100 us to
+ * 250 ms (plus overflow) and keeps count, mean and maximum. No allocation;
+ * recording is a handful of compares and adds.
+ *
+ * Not thread-safe: record and read from a single task, or guard externally.
+ */
+class LatencyHistogram {
+public:
+    static constexpr int NUM_BUCKETS = 12;
+
+    LatencyHistogram();
+
+    /**
+     * @brief Add one sample
+     */
+    void record(uint32_t durationUs);
+
+    /**
+     * @brief Clear all samples
+     */
+    void reset();
+
+    uint32_t getCount() const { return m_count; }
+    uint32_t getMaxUs() const { return m_maxUs; }
+    uint32_t getMeanUs() const;
+
+    /**
+     * @brief Upper bound of the bucket containing the given percentile
+     * @param percent 1-100
+     * @return Bucket limit in us (getMaxUs() for the overflow bucket), 0 if empty
+     */
+    uint32_t getPercentileUs(int percent) const;
+
+    /**
+     * @brief Samples in a bucket (0 = fastest)
+     */
+    uint32_t getBucketCount(int bucket) const;
+
+    /**
+     * @brief Upper limit of a bucket in us (UINT32_MAX for the overflow bucket)
+     */
+    static uint32_t getBucketLimitUs(int bucket);
+
+    /**
+     * @brief Log summary and non-empty buckets at INFO level
+     */
+    void log(const char* tag, const char* label) const;
+
+private:
+    uint32_t m_buckets[NUM_BUCKETS];
+    uint32_t m_count;
+    uint64_t m_totalUs;
+    uint32_t m_maxUs;
+};
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+
+/**
+ * @brief Bounded lock-free multi-producer, single-consumer queue
+ *
+ * A ring of cells, each carrying a sequence number that says whether it is
+ * free for the producer claiming that position or holds a value for the
+ * consumer (D. Vyukov's bounded queue). Producers claim a position with one
+ * compare-and-swap and never block or take a lock; the single consumer
+ * needs no atomic read-modify-write at all.
+ *
+ * tryPush() fails only when the ring is full; what to do then (wait, count,
+ * fall back) is the caller's decision. A producer pre-empted between
+ * claiming a cell and publishing it holds up the consumer at that cell
+ * until it runs again, never other producers.
+ *
+ * @tparam T Trivially copyable element type
+ */
+template <typename T>
+class MpscQueue {
+    static_assert(std::is_trivially_copyable<T>::value, "MpscQueue elements are copied between tasks");
+
+public:
+    /**
+     * @param capacity Number of elements; rounded up to a power of two (at least 2)
+     */
+    explicit MpscQueue(size_t capacity)
+        : m_capacity(roundUpToPowerOfTwo(capacity))
+        , m_mask(static_cast<uint32_t>(m_capacity - 1))
+        , m_cells(new Cell[m_capacity])
+        , m_tail(0)
+        , m_head(0)
+    {
+        for (size_t i = 0; i < m_capacity; i++) {
+            m_cells[i].sequence.store(static_cast<uint32_t>(i), std::memory_order_relaxed);
+        }
+    }
+
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    /**
+     * @brief Append a value (any task or number of tasks)
+     * @param outDepth If not null, receives the number of elements queued ahead of this one
+     * @return false if the queue is full
+     */
+    bool tryPush(const T& value, uint32_t* outDepth = nullptr)
+    {
+        uint32_t position = m_tail.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = m_cells[position & m_mask];
+            uint32_t sequence = cell.sequence.load(std::memory_order_acquire);
+            int32_t difference = static_cast<int32_t>(sequence - position);
+            if (difference == 0) {
+                // Cell is free for this position; claim it
+                if (m_tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    cell.value = value;
+                    cell.sequence.store(position + 1, std::memory_order_release);
+                    if (outDepth) {
+                        *outDepth = position - m_head.load(std::memory_order_relaxed);
+                    }
+                    return true;
+                }
+                // Another producer won; position now holds the new tail
+            } else if (difference < 0) {
+                // The consumer has not freed this cell from the previous lap
+                return false;
+            } else {
+                position = m_tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /**
+     * @brief Take the oldest value (consumer task only)
+     * @return false if the queue is empty (or its oldest value is not yet published)
+     */
+    bool tryPop(T& outValue)
+    {
+        uint32_t position = m_head.load(std::memory_order_relaxed);
+        Cell& cell = m_cells[position & m_mask];
+        uint32_t sequence = cell.sequence.load(std::memory_order_acquire);
+        if (static_cast<int32_t>(sequence - (position + 1)) < 0) {
+            return false;
+        }
+        outValue = cell.value;
+        // Free the cell for the producer one lap ahead
+        cell.sequence.store(position + static_cast<uint32_t>(m_capacity), std::memory_order_release);
+        m_head.store(position + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    /**
+     * @brief Number of queued elements (approximate while producers are active)
+     */
+    size_t size() const
+    {
+        uint32_t tail = m_tail.load(std::memory_order_relaxed);
+        uint32_t head = m_head.load(std::memory_order_relaxed);
+        return static_cast<size_t>(tail - head);
+    }
+
+    bool empty() const { return size() == 0; }
+
+    /**
+     * @brief Values pushed, or being pushed, since construction (wraps)
+     * Everything pushed before a call is among the first pushCount() values popped.
+     */
+    uint32_t pushCount() const { return m_tail.load(std::memory_order_acquire); }
+
+    size_t capacity() const { return m_capacity; }
+
+private:
+    struct Cell {
+        std::atomic<uint32_t> sequence;
+        T value;
+    };
+
+    static size_t roundUpToPowerOfTwo(size_t value)
+    {
+        size_t result = 2;
+        while (result < value) {
+            result <<= 1;
+        }
+        return result;
+    }
+
+    const size_t m_capacity;
+    const uint32_t m_mask;
+    std::unique_ptr<Cell[]> m_cells;
+    std::atomic<uint32_t> m_tail;  // Next position to claim (producers)
+    std::atomic<uint32_t> m_head;  // Next position to take (consumer); atomic only for size()
+};
@@ -0,0 +1,436 @@
+#include "Scheduler.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include <climits>
+
+static const char* TAG = "Scheduler";
+
+namespace {
+    constexpr int WHEEL_MASK = Scheduler::WHEEL_SLOTS - 1;
+    static_assert((Scheduler::WHEEL_SLOTS & WHEEL_MASK) == 0, "Wheel size must be a power of two");
+
+    const char* const PRIORITY_NAMES[Scheduler::NUM_PRIORITIES] = { "High", "Normal", "Low" };
+}
+
+Scheduler& Scheduler::instance()
+{
+    static Scheduler instance;
+    return instance;
+}
+
+Scheduler::Scheduler(const char* name, uint32_t tickMs)
+    : m_tickUs(static_cast<int64_t>(tickMs > 0 ? tickMs : 1) * 1000)
+    , m_currentTick(0)
+    , m_plannedWakeUs(INT64_MAX)
+    , m_stats{}
+    , m_mutex(nullptr)
+    , m_task(nullptr)
+    , m_taskExited(nullptr)
+    , m_running(false)
+{
+    for (int i = 0; i < WHEEL_SLOTS; i++) {
+        m_wheel[i] = -1;
+    }
+    m_currentTick = esp_timer_get_time() / m_tickUs;
+
+    m_mutex = xSemaphoreCreateMutex();
+    m_taskExited = xSemaphoreCreateBinary();
+    bool created = m_mutex && m_taskExited;
+    for (int i = 0; i < MAX_JOBS && created; i++) {
+        m_jobs[i].done = xSemaphoreCreateCounting(UINT8_MAX, 0);
+        created = m_jobs[i].done != nullptr;
+    }
+    if (!created) {
+        // No task: scheduling is refused, so nothing waits on the missing semaphores
+        ESP_LOGE(TAG, "Failed to create scheduler semaphores");
+        return;
+    }
+
+    m_running = true;
+    if (xTaskCreate(taskEntry, name, CONFIG_SCHEDULER_TASK_STACK_SIZE, this, 5, &m_task) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create scheduler task");
+        m_running = false;
+        m_task = nullptr;
+    }
+}
+
+Scheduler::~Scheduler()
+{
+    if (m_task) {
+        // The task checks the flag on every wake-up and deletes itself
+        m_running = false;
+        xTaskNotifyGive(m_task);
+        xSemaphoreTake(m_taskExited, portMAX_DELAY);
+        m_task = nullptr;
+    }
+    for (int i = 0; i < MAX_JOBS; i++) {
+        if (m_jobs[i].done) {
+            vSemaphoreDelete(m_jobs[i].done);
+            m_jobs[i].done = nullptr;
+        }
+    }
+    if (m_taskExited) {
+        vSemaphoreDelete(m_taskExited);
+        m_taskExited = nullptr;
+    }
+    if (m_mutex) {
+        vSemaphoreDelete(m_mutex);
+        m_mutex = nullptr;
+    }
+}
+
+Scheduler::JobId Scheduler::scheduleOnce(uint32_t delayMs, Priority priority, JobCallback callback, const char* name)
+{
+    return schedule(static_cast<int64_t>(delayMs) * 1000, 0, priority, std::move(callback), name);
+}
+
+Scheduler::JobId Scheduler::schedulePeriodic(uint32_t periodMs, Priority priority, JobCallback callback, const char* name)
+{
+    if (periodMs == 0) {
+        return INVALID_JOB;
+    }
+    int64_t periodUs = static_cast<int64_t>(periodMs) * 1000;
+    return schedule(periodUs, periodUs, priority, std::move(callback), name);
+}
+
+Scheduler::JobId Scheduler::schedule(int64_t delayUs, int64_t periodUs, Priority priority,
+                                     JobCallback callback, const char* name)
+{
+    if (!callback || !m_running) {
+        return INVALID_JOB;
+    }
+
+    lock();
+    int index = -1;
+    for (int i = 0; i < MAX_JOBS; i++) {
+        if (m_jobs[i].state == JobState::FREE) {
+            index = i;
+            break;
+        }
+    }
+    if (index < 0) {
+        unlock();
+        ESP_LOGE(TAG, "No free job for '%s' (%d in use)", name ? name : "?", MAX_JOBS);
+        return INVALID_JOB;
+    }
+
+    Job& job = m_jobs[index];
+    job.callback = std::move(callback);
+    job.name = name;
+    job.dueUs = esp_timer_get_time() + delayUs;
+    job.periodUs = periodUs;
+    job.priority = priority;
+    job.cancelled = false;
+    insertLocked(index);
+    m_stats.activeJobs++;
+    JobId id = (static_cast<JobId>(job.generation) << 8) | static_cast<JobId>(index + 1);
+
+    wakeIfSoonerLocked(job.dueUs + slackUs(priority));
+    unlock();
+    return id;
+}
+
+bool Scheduler::cancel(JobId id)
+{
+    if (id == INVALID_JOB || !m_mutex) {
+        return false;
+    }
+
+    lock();
+    int index = findLocked(id);
+    if (index < 0) {
+        unlock();
+        return false;
+    }
+
+    Job& job = m_jobs[index];
+    if (job.state == JobState::WAITING) {
+        unlinkLocked(index);
+        freeLocked(index);
+        unlock();
+        return true;
+    }
+
+    // Running: the task frees it when the callback returns
+    job.cancelled = true;
+    bool wait = xTaskGetCurrentTaskHandle() != m_task;
+    if (wait) {
+        job.waiters++;
+    }
+    unlock();
+
+    if (wait) {
+        xSemaphoreTake(job.done, portMAX_DELAY);
+    }
+    return true;
+}
+
+bool Scheduler::isScheduled(JobId id) const
+{
+    if (id == INVALID_JOB || !m_mutex) {
+        return false;
+    }
+    lock();
+    int index = findLocked(id);
+    bool scheduled = index >= 0 && !m_jobs[index].cancelled;
+    unlock();
+    return scheduled;
+}
+
+Scheduler::Stats Scheduler::getStats() const
+{
+    lock();
+    Stats stats = m_stats;
+    unlock();
+    return stats;
+}
+
+void Scheduler::getLateness(Priority priority, LatencyHistogram& out) const
+{
+    int index = static_cast<int>(priority);
+    if (index < 0 || index >= NUM_PRIORITIES) {
+        out.reset();
+        return;
+    }
+    lock();
+    out = m_lateness[index];
+    unlock();
+}
+
+void Scheduler::logStats() const
+{
+    Stats stats = getStats();
+    ESP_LOGI(TAG, "%lu jobs, %lu wake-ups, %lu runs, %lu skipped, longest run %lu us",
+             (unsigned long)stats.activeJobs, (unsigned long)stats.wakeups, (unsigned long)stats.runs,
+             (unsigned long)stats.skipped, (unsigned long)stats.maxRunUs);
+    ESP_LOGI(TAG, "%u tasks, %u bytes free internal heap",
+             (unsigned)uxTaskGetNumberOfTasks(),
+             (unsigned)heap_caps_get_free_size(MALLOC_CAP_INTERNAL));
+
+    LatencyHistogram lateness;
+    for (int i = 0; i < NUM_PRIORITIES; i++) {
+        getLateness(static_cast<Priority>(i), lateness);
+        if (lateness.getCount() > 0) {
+            lateness.log(TAG, PRIORITY_NAMES[i]);
+        }
+    }
+}
+
+void Scheduler::insertLocked(int index)
+{
+    // Never in a slot behind the next one to be processed, so the task cannot skip it
+    Job& job = m_jobs[index];
+    int64_t dueTick = job.dueUs / m_tickUs;
+    if (dueTick <= m_currentTick) {
+        dueTick = m_currentTick + 1;
+    }
+    job.dueTick = dueTick;
+    job.state = JobState::WAITING;
+
+    int slot = static_cast<int>(dueTick & WHEEL_MASK);
+    job.next = m_wheel[slot];
+    m_wheel[slot] = static_cast<int8_t>(index);
+}
+
+void Scheduler::unlinkLocked(int index)
+{
+    int slot = static_cast<int>(m_jobs[index].dueTick & WHEEL_MASK);
+    int8_t* link = &m_wheel[slot];
+    while (*link >= 0) {
+        if (*link == index) {
+            *link = m_jobs[index].next;
+            break;
+        }
+        link = &m_jobs[*link].next;
+    }
+    m_jobs[index].next = -1;
+}
+
+void Scheduler::freeLocked(int index)
+{
+    Job& job = m_jobs[index];
+    for (; job.waiters > 0; job.waiters--) {
+        xSemaphoreGive(job.done);
+    }
+    job.callback = nullptr;
+    job.state = JobState::FREE;
+    job.cancelled = false;
+    job.next = -1;
+    job.generation++;  // Ids handed out for this slot go stale
+    m_stats.activeJobs--;
+}
+
+int Scheduler::findLocked(JobId id) const
+{
+    int index = static_cast<int>(id & 0xFF) - 1;
+    if (index < 0 || index >= MAX_JOBS) {
+        return -1;
+    }
+    const Job& job = m_jobs[index];
+    if (job.state == JobState::FREE || job.generation != static_cast<uint16_t>(id >> 8)) {
+        return -1;
+    }
+    return index;
+}
+
+int64_t Scheduler::slackUs(Priority priority) const
+{
+    return priority == Priority::LOW ? static_cast<int64_t>(CONFIG_SCHEDULER_LOW_PRIORITY_SLACK_MS) * 1000 : 0;
+}
+
+int64_t Scheduler::nextWakeLocked() const
+{
+    int64_t wakeUs = INT64_MAX;
+    for (int i = 0; i < MAX_JOBS; i++) {
+        const Job& job = m_jobs[i];
+        if (job.state != JobState::WAITING) {
+            continue;
+        }
+        int64_t jobWakeUs = job.dueUs + slackUs(job.priority);
+        if (jobWakeUs < wakeUs) {
+            wakeUs = jobWakeUs;
+        }
+    }
+    return wakeUs;
+}
+
+void Scheduler::wakeIfSoonerLocked(int64_t wakeUs)
+{
+    // The task recomputes its sleep on every wake-up; only a sooner job needs one
+    if (m_task && wakeUs < m_plannedWakeUs) {
+        m_plannedWakeUs = wakeUs;
+        xTaskNotifyGive(m_task);
+    }
+}
+
+void Scheduler::runDueJobs()
+{
+    int due[MAX_JOBS];
+    int dueCount = 0;
+
+    lock();
+    int64_t nowUs = esp_timer_get_time();
+    int64_t nowTick = nowUs / m_tickUs;
+
+    // Visit each slot reached since the last pass (all of them at most once).
+    // The current tick's slot may still hold jobs due later in the tick, so
+    // it is visited again on the next pass.
+    int64_t ticks = nowTick - m_currentTick;
+    if (ticks > WHEEL_SLOTS) {
+        ticks = WHEEL_SLOTS;
+    }
+    for (int64_t t = 1; t <= ticks; t++) {
+        int slot = static_cast<int>((m_currentTick + t) & WHEEL_MASK);
+        int8_t index = m_wheel[slot];
+        while (index >= 0) {
+            int8_t next = m_jobs[index].next;
+            if (m_jobs[index].dueUs <= nowUs) {
+                unlinkLocked(index);
+                m_jobs[index].state = JobState::RUNNING;
+                due[dueCount++] = index;
+            }
+            index = next;
+        }
+    }
+    if (nowTick - 1 > m_currentTick) {
+        m_currentTick = nowTick - 1;
+    }
+    unlock();
+
+    // Priority class first, then due time
+    for (int i = 1; i < dueCount; i++) {
+        int index = due[i];
+        int j = i - 1;
+        while (j >= 0 && (m_jobs[due[j]].priority > m_jobs[index].priority ||
+                          (m_jobs[due[j]].priority == m_jobs[index].priority &&
+                           m_jobs[due[j]].dueUs > m_jobs[index].dueUs))) {
+            due[j + 1] = due[j];
+            j--;
+        }
+        due[j + 1] = index;
+    }
+
+    for (int i = 0; i < dueCount; i++) {
+        // A running job's callback is never touched by other tasks, so no lock is needed
+        Job& job = m_jobs[due[i]];
+        int64_t startUs = esp_timer_get_time();
+        if (!job.cancelled) {
+            job.callback();
+        }
+        int64_t endUs = esp_timer_get_time();
+
+        lock();
+        m_stats.runs++;
+        uint32_t runUs = static_cast<uint32_t>(endUs - startUs);
+        if (runUs > m_stats.maxRunUs) {
+            m_stats.maxRunUs = runUs;
+        }
+        int64_t latenessUs = startUs - job.dueUs;
+        m_lateness[static_cast<int>(job.priority)].record(latenessUs > 0 ? static_cast<uint32_t>(latenessUs) : 0);
+
+        if (job.cancelled || job.periodUs == 0) {
+            freeLocked(due[i]);
+        } else {
+            job.dueUs += job.periodUs;
+            if (job.dueUs <= endUs) {
+                int64_t missed = (endUs - job.dueUs) / job.periodUs + 1;
+                m_stats.skipped += static_cast<uint32_t>(missed);
+                job.dueUs += missed * job.periodUs;
+            }
+            insertLocked(due[i]);
+        }
+        unlock();
+    }
+}
+
+void Scheduler::lock() const
+{
+    if (m_mutex) {
+        xSemaphoreTake(m_mutex, portMAX_DELAY);
+    }
+}
+
+void Scheduler::unlock() const
+{
+    if (m_mutex) {
+        xSemaphoreGive(m_mutex);
+    }
+}
+
+void Scheduler::taskEntry(void* arg)
+{
+    auto* scheduler = static_cast<Scheduler*>(arg);
+
+    while (scheduler->m_running) {
+        scheduler->lock();
+        int64_t wakeUs = scheduler->nextWakeLocked();
+        scheduler->m_plannedWakeUs = wakeUs;
+        scheduler->unlock();
+
+        TickType_t waitTicks = portMAX_DELAY;
+        if (wakeUs != INT64_MAX) {
+            int64_t waitUs = wakeUs - esp_timer_get_time();
+            // Round up so the task does not wake a tick early and find nothing due
+            waitTicks = waitUs > 0 ? pdMS_TO_TICKS((waitUs + 999) / 1000) + 1 : 0;
+        }
+        if (waitTicks > 0) {
+            ulTaskNotifyTake(pdTRUE, waitTicks);
+        }
+        if (!scheduler->m_running) {
+            break;
+        }
+
+        // Jobs scheduled while this pass runs are picked up when the sleep is recomputed
+        scheduler->lock();
+        scheduler->m_stats.wakeups++;
+        scheduler->m_plannedWakeUs = INT64_MIN;
+        scheduler->unlock();
+
+        scheduler->runDueJobs();
+    }
+
+    // Signal last: the destructor frees everything as soon as it wakes
+    xSemaphoreGive(scheduler->m_taskExited);
+    vTaskDelete(NULL);
+}
@@ -0,0 +1,158 @@
+#pragma once
+
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "LatencyHistogram.h"
+#include <atomic>
+#include <cstdint>
+#include <functional>
+
+/**
+ * @brief Shared timer service for periodic and one-shot jobs
+ *
+ * One task runs every timed job in the application (JSON heartbeat and
+ * handshake timeout, JMRI auto-connect and reconnect, throttle state
+ * reconciliation, settings flush) instead of one sleeping task or esp_timer
+ * each. Jobs live in a fixed pool and are hashed
+ * into a timer wheel by their due tick, so scheduling, cancelling and
+ * firing never walk more than one wheel slot. The task sleeps until the
+ * earliest job is due and is only woken early when a sooner job arrives.
+ *
+ * Jobs carry a priority class. Jobs due in the same pass run HIGH first,
+ * then NORMAL, then LOW. LOW jobs may also run up to
+ * CONFIG_SCHEDULER_LOW_PRIORITY_SLACK_MS late, so they ride along with
+ * another job's wake-up rather than waking the CPU themselves.
+ *
+ * Callbacks run on the scheduler task and must not block for long: a slow
+ * job delays every job behind it. Lateness (actual start minus due time)
+ * is recorded per priority class for jitter statistics.
+ *
+ * Thread-safe: jobs may be scheduled and cancelled from any task, including
+ * from inside a running job.
+ */
+class Scheduler {
+public:
+    enum class Priority : uint8_t { HIGH = 0, NORMAL = 1, LOW = 2 };
+
+    using JobId = uint32_t;
+    using JobCallback = std::function<void()>;
+
+    static constexpr JobId INVALID_JOB = 0;
+    static constexpr int MAX_JOBS = 16;
+    static constexpr int WHEEL_SLOTS = 64;
+    static constexpr int NUM_PRIORITIES = 3;
+
+    struct Stats {
+        uint32_t wakeups;    // Times the task woke up (due job or early notification)
+        uint32_t runs;       // Job callbacks run
+        uint32_t skipped;    // Periodic runs dropped because a run finished after the next was due
+        uint32_t maxRunUs;   // Longest single callback
+        uint32_t activeJobs; // Jobs scheduled or running now
+    };
+
+    /**
+     * @brief Application-wide scheduler (task started on first use)
+     */
+    static Scheduler& instance();
+
+    /**
+     * @param name Task name
+     * @param tickMs Width of one wheel slot (jobs still run at their own due time)
+     */
+    explicit Scheduler(const char* name = "scheduler", uint32_t tickMs = CONFIG_SCHEDULER_TICK_MS);
+    ~Scheduler();
+
+    Scheduler(const Scheduler&) = delete;
+    Scheduler& operator=(const Scheduler&) = delete;
+
+    /**
+     * @brief Run a callback once after a delay
+     * @return Job id for cancel(), or INVALID_JOB if the pool is full
+     */
+    JobId scheduleOnce(uint32_t delayMs, Priority priority, JobCallback callback, const char* name = nullptr);
+
+    /**
+     * @brief Run a callback every @p periodMs, first after one period
+     *
+     * Due times advance by exactly one period, so the schedule does not drift.
+     * A run that finishes after the next one was due skips the missed runs.
+     * @return Job id for cancel(), or INVALID_JOB if the pool is full
+     */
+    JobId schedulePeriodic(uint32_t periodMs, Priority priority, JobCallback callback, const char* name = nullptr);
+
+    /**
+     * @brief Cancel a job
+     *
+     * If the job is running on the scheduler task and this is called from
+     * another task, waits for the run to finish, so the callback's captures
+     * may be destroyed once this returns. Stale ids are ignored.
+     * @return true if the job was still scheduled or running
+     */
+    bool cancel(JobId id);
+
+    /**
+     * @brief True while the job is scheduled or running
+     */
+    bool isScheduled(JobId id) const;
+
+    Stats getStats() const;
+
+    /**
+     * @brief Copy the lateness histogram of one priority class
+     */
+    void getLateness(Priority priority, LatencyHistogram& out) const;
+
+    /**
+     * @brief Log job statistics, task count and free internal heap at INFO level
+     */
+    void logStats() const;
+
+private:
+    enum class JobState : uint8_t { FREE, WAITING, RUNNING };
+
+    struct Job {
+        JobCallback callback;
+        const char* name = nullptr;
+        int64_t dueUs = 0;
+        int64_t periodUs = 0;  // 0 = one-shot
+        int64_t dueTick = 0;
+        uint16_t generation = 0;
+        int8_t next = -1;      // Next job in the same wheel slot
+        JobState state = JobState::FREE;
+        Priority priority = Priority::NORMAL;
+        bool cancelled = false;
+        uint8_t waiters = 0;  // Tasks in cancel() waiting for the running callback
+        SemaphoreHandle_t done = nullptr;  // Given once per waiter when the job is freed
+    };
+
+    JobId schedule(int64_t delayUs, int64_t periodUs, Priority priority,
+                   JobCallback callback, const char* name);
+    void insertLocked(int index);
+    void unlinkLocked(int index);
+    void freeLocked(int index);
+    int findLocked(JobId id) const;
+    int64_t nextWakeLocked() const;
+    int64_t slackUs(Priority priority) const;
+    void wakeIfSoonerLocked(int64_t wakeUs);
+    void runDueJobs();
+    void lock() const;
+    void unlock() const;
+
+    static void taskEntry(void* arg);
+
+    Job m_jobs[MAX_JOBS];
+    int8_t m_wheel[WHEEL_SLOTS];  // Head job of each slot, -1 if empty
+    int64_t m_tickUs;
+    int64_t m_currentTick;        // Slots up to this tick have been swept
+    int64_t m_plannedWakeUs;      // When the task will wake next (INT64_MAX idle, INT64_MIN running jobs)
+
+    Stats m_stats;
+    LatencyHistogram m_lateness[NUM_PRIORITIES];
+
+    mutable SemaphoreHandle_t m_mutex;
+    TaskHandle_t m_task;
+    SemaphoreHandle_t m_taskExited;  // Given by the task just before it deletes itself
+    std::atomic<bool> m_running;
+};
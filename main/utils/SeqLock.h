@@ -0,0 +1,99 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+/**
+ * @brief Single-writer value that readers copy without locks (sequence lock)
+ *
+ * The writer makes the sequence odd, stores the value and makes it even
+ * again; a reader copies the value between two loads of the sequence and
+ * keeps the copy only if both are the same even number. Readers never
+ * block the writer and never see half of one write and half of another.
+ *
+ * The value is stored as relaxed atomic words so concurrent copies are
+ * well-defined, not just unlikely to tear. version() counts completed
+ * writes, so a reader can tell "unchanged since I last looked" with one
+ * load.
+ *
+ * tryRead() fails while a write is in progress. A reader that retries must
+ * not spin at a higher priority than the writer on the same core; see
+ * ThrottleController::getThrottleSnapshot() for the back-off used.
+ *
+ * @tparam T Trivially copyable value type
+ */
+template <typename T>
+class SeqLock {
+    static_assert(std::is_trivially_copyable<T>::value, "SeqLock values are copied byte for byte");
+
+public:
+    SeqLock()
+        : m_sequence(0)
+    {
+        for (auto& word : m_words) {
+            word.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    SeqLock(const SeqLock&) = delete;
+    SeqLock& operator=(const SeqLock&) = delete;
+
+    /**
+     * @brief Publish a new value (one writer task only)
+     */
+    void write(const T& value)
+    {
+        uint32_t words[WORDS] = {};
+        std::memcpy(words, &value, sizeof(T));
+
+        uint32_t sequence = m_sequence.load(std::memory_order_relaxed);
+        m_sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (size_t i = 0; i < WORDS; i++) {
+            m_words[i].store(words[i], std::memory_order_relaxed);
+        }
+        m_sequence.store(sequence + 2, std::memory_order_release);
+    }
+
+    /**
+     * @brief Copy the current value (any task)
+     * @param outVersion If not null, receives the version of the copy
+     * @return false if a write was in progress; outValue is then unchanged
+     */
+    bool tryRead(T& outValue, uint32_t* outVersion = nullptr) const
+    {
+        uint32_t before = m_sequence.load(std::memory_order_acquire);
+        if (before & 1) {
+            return false;
+        }
+
+        uint32_t words[WORDS];
+        for (size_t i = 0; i < WORDS; i++) {
+            words[i] = m_words[i].load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (m_sequence.load(std::memory_order_relaxed) != before) {
+            return false;
+        }
+
+        std::memcpy(&outValue, words, sizeof(T));
+        if (outVersion) {
+            *outVersion = before >> 1;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Number of completed writes (wraps)
+     */
+    uint32_t version() const { return m_sequence.load(std::memory_order_acquire) >> 1; }
+
+private:
+    static constexpr size_t WORDS = (sizeof(T) + sizeof(uint32_t) - 1) / sizeof(uint32_t);
+
+    std::atomic<uint32_t> m_sequence;  // Odd while a write is in progress
+    std::atomic<uint32_t> m_words[WORDS];
+};
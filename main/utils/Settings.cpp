@@ -0,0 +1,497 @@
+#include "Settings.h"
+#include "esp_log.h"
+#include "nvs_flash.h"
+#include "nvs.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+static const char* TAG = "Settings";
+
+const Settings::KeyInfo Settings::KEYS[Settings::NUM_KEYS] = {
+    { "wifi", "ssid",           Type::STRING,         0, 0,     0,     "" },
+    { "wifi", "password",       Type::STRING,         0, 0,     0,     "" },
+    { "jmri", "server_ip",      Type::STRING,         0, 0,     0,     "" },
+    { "jmri", "wt_port",        Type::DECIMAL_STRING, 1, 65535, 12090, nullptr },
+    { "jmri", "json_port",      Type::DECIMAL_STRING, 1, 65535, 12080, nullptr },
+    { "jmri", "throttle_proto", Type::U8,             0, 1,     0,     nullptr },
+    { "jmri", "power_mgr",      Type::STRING,         0, 0,     0,     "DCC++" },
+    { "jmri", "speed_steps",    Type::I32,            1, 20,    4,     nullptr },
+};
+
+static_assert(Settings::NUM_KEYS <= 32, "Key sets are 32-bit masks");
+
+namespace {
+    uint32_t bitOf(int index)
+    {
+        return 1u << index;
+    }
+}
+
+Settings& Settings::instance()
+{
+    static Settings instance;
+    return instance;
+}
+
+Settings::Settings(uint32_t writeDelayMs, const char* namespaceOverride)
+    : m_writeDelayMs(writeDelayMs)
+    , m_namespaceOverride(namespaceOverride)
+    , m_loaded(false)
+    , m_stored(0)
+    , m_dirty(0)
+    , m_erased(0)
+    , m_nextSubscriptionId(1)
+    , m_stats{}
+    , m_flushJob(Scheduler::INVALID_JOB)
+    , m_mutex(nullptr)
+    , m_flushMutex(nullptr)
+{
+    for (int i = 0; i < NUM_KEYS; i++) {
+        m_ints[i] = KEYS[i].defaultInt;
+        m_strings[i] = KEYS[i].defaultString ? KEYS[i].defaultString : "";
+    }
+
+    m_mutex = xSemaphoreCreateMutex();
+    m_flushMutex = xSemaphoreCreateMutex();
+    if (!m_mutex || !m_flushMutex) {
+        ESP_LOGE(TAG, "Failed to create settings mutexes");
+    }
+}
+
+Settings::~Settings()
+{
+    if (hasUnsavedChanges()) {
+        flush();
+    }
+    Scheduler::instance().cancel(m_flushJob.exchange(Scheduler::INVALID_JOB));
+    if (m_mutex) {
+        vSemaphoreDelete(m_mutex);
+        m_mutex = nullptr;
+    }
+    if (m_flushMutex) {
+        vSemaphoreDelete(m_flushMutex);
+        m_flushMutex = nullptr;
+    }
+}
+
+esp_err_t Settings::load()
+{
+    if (m_loaded) {
+        return ESP_OK;
+    }
+
+    esp_err_t err = nvs_flash_init();
+    if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+        ESP_LOGW(TAG, "NVS partition erased (%s)", esp_err_to_name(err));
+        ESP_ERROR_CHECK(nvs_flash_erase());
+        err = nvs_flash_init();
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "NVS init failed: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    int found = 0;
+    for (int i = 0; i < NUM_KEYS; i++) {
+        const KeyInfo& info = KEYS[i];
+        nvs_handle_t handle;
+        if (nvs_open(namespaceOf(static_cast<Key>(i)), NVS_READONLY, &handle) != ESP_OK) {
+            continue;  // Namespace not created yet
+        }
+
+        char text[MAX_STRING_LENGTH + 1];
+        size_t length = sizeof(text);
+        bool present = false;
+        bool valid = true;
+        int32_t value = info.defaultInt;
+
+        switch (info.type) {
+        case Type::STRING:
+            present = nvs_get_str(handle, info.name, text, &length) == ESP_OK;
+            break;
+        case Type::DECIMAL_STRING:
+            present = nvs_get_str(handle, info.name, text, &length) == ESP_OK;
+            value = present ? static_cast<int32_t>(std::atoi(text)) : value;
+            break;
+        case Type::U8: {
+            uint8_t byte = 0;
+            present = nvs_get_u8(handle, info.name, &byte) == ESP_OK;
+            value = present ? byte : value;
+            break;
+        }
+        case Type::I32:
+            present = nvs_get_i32(handle, info.name, &value) == ESP_OK;
+            break;
+        }
+        nvs_close(handle);
+
+        if (!present) {
+            continue;
+        }
+        if (info.type != Type::STRING) {
+            valid = value >= info.minimum && value <= info.maximum;
+        }
+        if (!valid) {
+            ESP_LOGW(TAG, "Ignoring out-of-range %s/%s = %ld", info.nvsNamespace, info.name, (long)value);
+            continue;
+        }
+
+        lock();
+        if (info.type == Type::STRING) {
+            m_strings[i] = text;
+        } else {
+            m_ints[i] = value;
+        }
+        m_stored |= bitOf(i);
+        unlock();
+        found++;
+    }
+
+    m_loaded = true;
+    ESP_LOGI(TAG, "Loaded %d of %d settings", found, NUM_KEYS);
+    return ESP_OK;
+}
+
+int32_t Settings::getInt(Key key) const
+{
+    int index = static_cast<int>(key);
+    if (index >= NUM_KEYS) {
+        return 0;
+    }
+    return m_ints[index].load(std::memory_order_acquire);
+}
+
+std::string Settings::getString(Key key) const
+{
+    int index = static_cast<int>(key);
+    if (index >= NUM_KEYS) {
+        return std::string();
+    }
+    lock();
+    std::string value = m_strings[index];
+    unlock();
+    return value;
+}
+
+bool Settings::isStored(Key key) const
+{
+    int index = static_cast<int>(key);
+    lock();
+    bool stored = index < NUM_KEYS && (m_stored & bitOf(index));
+    unlock();
+    return stored;
+}
+
+esp_err_t Settings::setInt(Key key, int32_t value)
+{
+    int index = static_cast<int>(key);
+    if (!isInteger(key) || value < KEYS[index].minimum || value > KEYS[index].maximum) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    lock();
+    if ((m_stored & bitOf(index)) && m_ints[index].load(std::memory_order_relaxed) == value) {
+        m_stats.unchanged++;
+        unlock();
+        return ESP_OK;
+    }
+    m_ints[index].store(value, std::memory_order_release);
+    m_stored |= bitOf(index);
+    m_dirty |= bitOf(index);
+    m_erased &= ~bitOf(index);
+    m_stats.changes++;
+    scheduleFlushLocked();
+    unlock();
+
+    changed(key);
+    return ESP_OK;
+}
+
+esp_err_t Settings::setString(Key key, const std::string& value)
+{
+    int index = static_cast<int>(key);
+    if (index >= NUM_KEYS || isInteger(key) || value.size() > MAX_STRING_LENGTH) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    lock();
+    if ((m_stored & bitOf(index)) && m_strings[index] == value) {
+        m_stats.unchanged++;
+        unlock();
+        return ESP_OK;
+    }
+    m_strings[index] = value;
+    m_stored |= bitOf(index);
+    m_dirty |= bitOf(index);
+    m_erased &= ~bitOf(index);
+    m_stats.changes++;
+    scheduleFlushLocked();
+    unlock();
+
+    changed(key);
+    return ESP_OK;
+}
+
+void Settings::erase(Key key)
+{
+    int index = static_cast<int>(key);
+    if (index >= NUM_KEYS) {
+        return;
+    }
+
+    lock();
+    if (!(m_stored & bitOf(index))) {
+        unlock();
+        return;
+    }
+    m_ints[index].store(KEYS[index].defaultInt, std::memory_order_release);
+    m_strings[index] = KEYS[index].defaultString ? KEYS[index].defaultString : "";
+    m_stored &= ~bitOf(index);
+    m_dirty |= bitOf(index);
+    m_erased |= bitOf(index);
+    m_stats.changes++;
+    scheduleFlushLocked();
+    unlock();
+
+    changed(key);
+}
+
+esp_err_t Settings::flush()
+{
+    // A flush job that is already running finishes before this one starts
+    Scheduler::instance().cancel(m_flushJob.exchange(Scheduler::INVALID_JOB));
+
+    if (!m_flushMutex) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    xSemaphoreTake(m_flushMutex, portMAX_DELAY);
+
+    // Snapshot the dirty values so NVS is written without holding the lock
+    std::string strings[NUM_KEYS];
+    int32_t ints[NUM_KEYS] = {};
+    lock();
+    uint32_t dirty = m_dirty;
+    uint32_t erased = m_erased;
+    for (int i = 0; i < NUM_KEYS; i++) {
+        if (dirty & bitOf(i)) {
+            strings[i] = m_strings[i];
+            ints[i] = m_ints[i].load(std::memory_order_relaxed);
+        }
+    }
+    m_dirty = 0;
+    m_erased = 0;
+    if (dirty) {
+        m_stats.flushes++;
+    }
+    unlock();
+
+    // One open and commit per namespace
+    esp_err_t result = ESP_OK;
+    uint32_t remaining = dirty;
+    while (remaining) {
+        const char* nvsNamespace = namespaceOf(static_cast<Key>(__builtin_ctz(remaining)));
+        uint32_t group = 0;
+        for (int i = 0; i < NUM_KEYS; i++) {
+            if ((remaining & bitOf(i)) && strcmp(namespaceOf(static_cast<Key>(i)), nvsNamespace) == 0) {
+                group |= bitOf(i);
+            }
+        }
+        remaining &= ~group;
+
+        esp_err_t err = writeNamespace(nvsNamespace, group, strings, ints, erased & group);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to save %s settings: %s", nvsNamespace, esp_err_to_name(err));
+            result = err;
+
+            // Retry later unless a newer change is already waiting
+            lock();
+            uint32_t retry = group & ~m_dirty;
+            m_dirty |= retry;
+            m_erased |= erased & retry;
+            scheduleFlushLocked();
+            unlock();
+        }
+    }
+
+    xSemaphoreGive(m_flushMutex);
+    return result;
+}
+
+bool Settings::hasUnsavedChanges() const
+{
+    lock();
+    bool dirty = m_dirty != 0;
+    unlock();
+    return dirty;
+}
+
+Settings::SubscriptionId Settings::subscribe(Key key, ChangeCallback callback)
+{
+    if (static_cast<int>(key) >= NUM_KEYS || !callback) {
+        return INVALID_SUBSCRIPTION;
+    }
+
+    lock();
+    for (Subscription& subscription : m_subscriptions) {
+        if (subscription.id == INVALID_SUBSCRIPTION) {
+            subscription.id = m_nextSubscriptionId++;
+            if (m_nextSubscriptionId == INVALID_SUBSCRIPTION) {
+                m_nextSubscriptionId++;
+            }
+            subscription.key = key;
+            subscription.callback = std::move(callback);
+            SubscriptionId id = subscription.id;
+            unlock();
+            return id;
+        }
+    }
+    unlock();
+
+    ESP_LOGE(TAG, "No free settings subscription slot");
+    return INVALID_SUBSCRIPTION;
+}
+
+void Settings::unsubscribe(SubscriptionId id)
+{
+    if (id == INVALID_SUBSCRIPTION) {
+        return;
+    }
+
+    lock();
+    for (Subscription& subscription : m_subscriptions) {
+        if (subscription.id == id) {
+            subscription = Subscription();
+            break;
+        }
+    }
+    unlock();
+}
+
+Settings::Stats Settings::getStats() const
+{
+    lock();
+    Stats stats = m_stats;
+    unlock();
+    return stats;
+}
+
+bool Settings::isInteger(Key key)
+{
+    int index = static_cast<int>(key);
+    return index < NUM_KEYS && KEYS[index].type != Type::STRING;
+}
+
+const char* Settings::namespaceOf(Key key) const
+{
+    return m_namespaceOverride ? m_namespaceOverride : KEYS[static_cast<int>(key)].nvsNamespace;
+}
+
+void Settings::changed(Key key)
+{
+    // Callbacks run without the lock so they may read settings
+    ChangeCallback callbacks[MAX_SUBSCRIPTIONS];
+    int count = 0;
+    lock();
+    for (const Subscription& subscription : m_subscriptions) {
+        if (subscription.id != INVALID_SUBSCRIPTION && subscription.key == key) {
+            callbacks[count++] = subscription.callback;
+        }
+    }
+    unlock();
+
+    for (int i = 0; i < count; i++) {
+        callbacks[i](key);
+    }
+}
+
+void Settings::scheduleFlushLocked()
+{
+    // Later changes ride along with the pending write
+    if (m_flushJob.load() != Scheduler::INVALID_JOB) {
+        return;
+    }
+    m_flushJob = Scheduler::instance().scheduleOnce(
+        m_writeDelayMs, Scheduler::Priority::LOW,
+        [this]() {
+            // Taking the lock orders this after the id was stored above
+            lock();
+            m_flushJob = Scheduler::INVALID_JOB;
+            unlock();
+            flush();
+        },
+        "settings_flush");
+    if (m_flushJob.load() == Scheduler::INVALID_JOB) {
+        ESP_LOGW(TAG, "Could not schedule settings write; call flush()");
+    }
+}
+
+esp_err_t Settings::writeNamespace(const char* nvsNamespace, uint32_t keys, const std::string* strings,
+                                   const int32_t* ints, uint32_t erased)
+{
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(nvsNamespace, NVS_READWRITE, &handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    int written = 0;
+    for (int i = 0; i < NUM_KEYS && err == ESP_OK; i++) {
+        if (!(keys & bitOf(i))) {
+            continue;
+        }
+        const KeyInfo& info = KEYS[i];
+        if (erased & bitOf(i)) {
+            err = nvs_erase_key(handle, info.name);
+            if (err == ESP_ERR_NVS_NOT_FOUND) {
+                err = ESP_OK;
+            }
+        } else {
+            switch (info.type) {
+            case Type::STRING:
+                err = nvs_set_str(handle, info.name, strings[i].c_str());
+                break;
+            case Type::DECIMAL_STRING: {
+                char text[12];
+                snprintf(text, sizeof(text), "%ld", (long)ints[i]);
+                err = nvs_set_str(handle, info.name, text);
+                break;
+            }
+            case Type::U8:
+                err = nvs_set_u8(handle, info.name, static_cast<uint8_t>(ints[i]));
+                break;
+            case Type::I32:
+                err = nvs_set_i32(handle, info.name, ints[i]);
+                break;
+            }
+        }
+        written++;
+    }
+    if (err == ESP_OK) {
+        err = nvs_commit(handle);
+    }
+    nvs_close(handle);
+
+    if (err == ESP_OK) {
+        lock();
+        m_stats.keysWritten += written;
+        m_stats.commits++;
+        unlock();
+        ESP_LOGI(TAG, "Saved %d %s setting(s)", written, nvsNamespace);
+    }
+    return err;
+}
+
+void Settings::lock() const
+{
+    if (m_mutex) {
+        xSemaphoreTake(m_mutex, portMAX_DELAY);
+    }
+}
+
+void Settings::unlock() const
+{
+    if (m_mutex) {
+        xSemaphoreGive(m_mutex);
+    }
+}
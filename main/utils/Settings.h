@@ -0,0 +1,187 @@
+#pragma once
+
+#include "sdkconfig.h"
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "Scheduler.h"
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+/**
+ * @brief Typed, RAM-cached registry of every persistent setting
+ *
+ * All keys are read from NVS once by load() and served from RAM afterwards:
+ * integer settings are atomics, so hot paths such as the knob rotation
+ * handler read them without a lock or any flash access. Strings are copied
+ * out under a mutex.
+ *
+ * Writes are write-behind. A set that changes a value updates RAM at once,
+ * notifies subscribers and marks the key dirty; a one-shot "settings_flush"
+ * job on the shared Scheduler writes every dirty key CONFIG_SETTINGS_WRITE_DELAY_MS
+ * after the first change, with one nvs_commit() per namespace. Setting a
+ * key to the value it already has does not touch flash at all.
+ *
+ * The NVS layout (namespaces, key names and types) is the one the firmware
+ * has always used, so settings saved by earlier versions load unchanged.
+ *
+ * Thread-safe: any task may read, write or subscribe.
+ */
+class Settings {
+public:
+    enum class Key : uint8_t {
+        WIFI_SSID,          // "wifi" / "ssid", string
+        WIFI_PASSWORD,      // "wifi" / "password", string
+        SERVER_IP,          // "jmri" / "server_ip", string
+        WITHROTTLE_PORT,    // "jmri" / "wt_port", integer (stored as decimal string)
+        JSON_PORT,          // "jmri" / "json_port", integer (stored as decimal string)
+        THROTTLE_PROTOCOL,  // "jmri" / "throttle_proto", integer (u8)
+        POWER_MANAGER,      // "jmri" / "power_mgr", string
+        SPEED_STEPS,        // "jmri" / "speed_steps", integer (i32)
+        COUNT
+    };
+
+    using SubscriptionId = uint32_t;
+    using ChangeCallback = std::function<void(Key key)>;
+
+    static constexpr SubscriptionId INVALID_SUBSCRIPTION = 0;
+    static constexpr int NUM_KEYS = static_cast<int>(Key::COUNT);
+    static constexpr int MAX_SUBSCRIPTIONS = 8;
+    static constexpr size_t MAX_STRING_LENGTH = 64;
+
+    struct Stats {
+        uint32_t changes;      // Sets that changed a value
+        uint32_t unchanged;    // Sets that matched the value already held (no write)
+        uint32_t keysWritten;  // Keys written or erased in NVS
+        uint32_t commits;      // nvs_commit() calls
+        uint32_t flushes;      // Write-behind batches
+    };
+
+    /**
+     * @brief Application-wide registry (call load() once at boot)
+     */
+    static Settings& instance();
+
+    /**
+     * @param writeDelayMs Delay from the first unsaved change to the NVS write
+     * @param namespaceOverride Store every key in this namespace instead (tests)
+     */
+    explicit Settings(uint32_t writeDelayMs = CONFIG_SETTINGS_WRITE_DELAY_MS,
+                      const char* namespaceOverride = nullptr);
+
+    /**
+     * @brief Writes any unsaved changes
+     */
+    ~Settings();
+
+    Settings(const Settings&) = delete;
+    Settings& operator=(const Settings&) = delete;
+
+    /**
+     * @brief Initialise NVS flash and read every key into RAM
+     *
+     * Missing or out-of-range values read as their defaults. Later calls
+     * return ESP_OK without reading again.
+     */
+    esp_err_t load();
+
+    /**
+     * @brief Value of an integer key (lock-free; the default if never set)
+     */
+    int32_t getInt(Key key) const;
+
+    /**
+     * @brief Value of a string key (the default if never set)
+     */
+    std::string getString(Key key) const;
+
+    /**
+     * @brief True if the key holds a saved (or about to be saved) value
+     */
+    bool isStored(Key key) const;
+
+    /**
+     * @return ESP_ERR_INVALID_ARG for a string key or a value outside the key's range
+     */
+    esp_err_t setInt(Key key, int32_t value);
+
+    /**
+     * @return ESP_ERR_INVALID_ARG for an integer key or a value longer than MAX_STRING_LENGTH
+     */
+    esp_err_t setString(Key key, const std::string& value);
+
+    /**
+     * @brief Return a key to its default and remove it from NVS
+     */
+    void erase(Key key);
+
+    /**
+     * @brief Write unsaved changes now instead of waiting for the flush job
+     */
+    esp_err_t flush();
+
+    bool hasUnsavedChanges() const;
+
+    /**
+     * @brief Call @p callback after @p key changes
+     *
+     * The callback runs on the task that made the change, after the new
+     * value is readable, and must not block.
+     * @return Id for unsubscribe(), or INVALID_SUBSCRIPTION if all slots are used
+     */
+    SubscriptionId subscribe(Key key, ChangeCallback callback);
+
+    void unsubscribe(SubscriptionId id);
+
+    Stats getStats() const;
+
+private:
+    enum class Type : uint8_t { STRING, DECIMAL_STRING, U8, I32 };
+
+    struct KeyInfo {
+        const char* nvsNamespace;
+        const char* name;
+        Type type;
+        int32_t minimum;
+        int32_t maximum;
+        int32_t defaultInt;
+        const char* defaultString;
+    };
+
+    struct Subscription {
+        SubscriptionId id = INVALID_SUBSCRIPTION;
+        Key key = Key::COUNT;
+        ChangeCallback callback;
+    };
+
+    static const KeyInfo KEYS[NUM_KEYS];
+
+    static bool isInteger(Key key);
+    const char* namespaceOf(Key key) const;
+    void changed(Key key);
+    void scheduleFlushLocked();
+    esp_err_t writeNamespace(const char* nvsNamespace, uint32_t keys, const std::string* strings,
+                             const int32_t* ints, uint32_t erased);
+    void lock() const;
+    void unlock() const;
+
+    uint32_t m_writeDelayMs;
+    const char* m_namespaceOverride;
+    bool m_loaded;
+
+    std::atomic<int32_t> m_ints[NUM_KEYS];
+    std::string m_strings[NUM_KEYS];
+    uint32_t m_stored;   // Keys with a value in NVS (or pending)
+    uint32_t m_dirty;    // Keys changed since the last flush
+    uint32_t m_erased;   // Dirty keys to remove from NVS rather than write
+
+    Subscription m_subscriptions[MAX_SUBSCRIPTIONS];
+    SubscriptionId m_nextSubscriptionId;
+
+    Stats m_stats;
+    std::atomic<Scheduler::JobId> m_flushJob;
+    mutable SemaphoreHandle_t m_mutex;
+    SemaphoreHandle_t m_flushMutex;  // One flush at a time; not held while reading
+};